@@ -79,6 +79,8 @@ typedef struct pa_daemon_conf {
         flat_volumes,
         rescue_streams,
         lock_memory,
+        mempool_hugepages,
+        scache_preconvert,
         deferred_volume;
     pa_server_type_t local_server_type;
     int exit_idle_time,
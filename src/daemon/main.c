@@ -95,6 +95,7 @@
 #include <pulsecore/dbus-shared.h>
 #endif
 #include <pulsecore/cpu.h>
+#include <pulsecore/startup-trace.h>
 
 #include "cmdline.h"
 #include "cpulimit.h"
@@ -527,6 +528,7 @@ int main(int argc, char *argv[]) {
 #endif
     int autospawn_fd = -1;
     bool autospawn_locked = false;
+    pa_startup_trace_span span;
 #ifdef HAVE_DBUS
     pa_dbusobj_server_lookup *server_lookup = NULL; /* /org/pulseaudio/server_lookup */
     pa_dbus_connection *lookup_service_bus = NULL; /* Always the user bus. */
@@ -638,6 +640,9 @@ int main(int argc, char *argv[]) {
 
     pa_init_i18n();
 
+    pa_startup_trace_start();
+    span = pa_startup_trace_begin("daemon", "configuration", NULL);
+
     conf = pa_daemon_conf_new();
 
     if (pa_daemon_conf_load(conf, NULL) < 0)
@@ -651,6 +656,8 @@ int main(int argc, char *argv[]) {
         goto finish;
     }
 
+    pa_startup_trace_end(span);
+
     if (conf->log_target)
         pa_log_set_target(conf->log_target);
     else {
@@ -1187,6 +1194,8 @@ int main(int argc, char *argv[]) {
 
     pa_assert_se(mainloop = pa_mainloop_new());
 
+    span = pa_startup_trace_begin("daemon", "core", NULL);
+
     if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), !conf->disable_shm,
                           !conf->disable_shm && !conf->disable_memfd && pa_memfd_is_locally_supported(),
                           conf->shm_size))) {
@@ -1194,6 +1203,11 @@ int main(int argc, char *argv[]) {
         goto finish;
     }
 
+    pa_startup_trace_end(span);
+
+    if (conf->mempool_hugepages)
+        pa_mempool_advise_hugepages(c->mempool);
+
     c->default_sample_spec = conf->default_sample_spec;
     c->alternate_sample_rate = conf->alternate_sample_rate;
     c->default_channel_map = conf->default_channel_map;
@@ -1204,6 +1218,7 @@ int main(int argc, char *argv[]) {
     c->lfe_crossover_freq = conf->lfe_crossover_freq;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
+    c->scache_preconvert = conf->scache_preconvert;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = conf->realtime_scheduling;
@@ -1253,6 +1268,8 @@ int main(int argc, char *argv[]) {
     {
         const char *command_source = NULL;
 
+        span = pa_startup_trace_begin("daemon", "startup commands", NULL);
+
         if (conf->load_default_script_file) {
             FILE *f;
 
@@ -1268,6 +1285,8 @@ int main(int argc, char *argv[]) {
             command_source = _("command line arguments");
         }
 
+        pa_startup_trace_end(span);
+
         pa_log_error("%s", s = pa_strbuf_to_string_free(buf));
         pa_xfree(s);
 
@@ -1276,7 +1295,7 @@ int main(int argc, char *argv[]) {
             goto finish;
         }
 
-        if (!c->modules || pa_idxset_size(c->modules) == 0) {
+        if (!c->modules || (pa_idxset_size(c->modules) == 0 && pa_hashmap_isempty(c->modules_pending_load))) {
             pa_log(_("Daemon startup without any loaded modules, refusing to work."));
             goto finish;
         }
@@ -1316,6 +1335,7 @@ int main(int argc, char *argv[]) {
 #endif
 
     pa_log_info("Daemon startup complete.");
+    pa_startup_trace_ready();
 
 #ifdef HAVE_SYSTEMD_DAEMON
     sd_notify(0, "READY=1");
@@ -1408,6 +1428,8 @@ finish:
     if (valid_pid_file)
         pa_pid_file_remove();
 
+    pa_startup_trace_done();
+
     /* This has no real purpose except making things valgrind-clean */
     pa_unset_env_recorded();
 
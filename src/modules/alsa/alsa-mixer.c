@@ -44,6 +44,7 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/strbuf.h>
+#include <pulsecore/tagstruct.h>
 
 #include "alsa-mixer.h"
 #include "alsa-util.h"
@@ -4505,9 +4506,14 @@ static void profile_set_set_availability_groups(pa_alsa_profile_set *ps) {
     pa_dynarray_free(paths);
 }
 
+/* If the mapping's PCM isn't open (because the probe result came from the
+ * probe cache), the mixer is looked up by alsa_card_index instead */
+/* If known_paths is non-NULL, only the paths named in it are probed. It
+ * holds what was left after an earlier probe of the same mapping, see
+ * pa_alsa_profile_set_probe_cache_load(). */
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
                                 pa_alsa_direction_t direction, pa_hashmap *used_paths,
-                                pa_hashmap *mixers) {
+                                pa_hashmap *mixers, int alsa_card_index, pa_hashmap *known_paths) {
 
     pa_alsa_path *p;
     void *state;
@@ -4530,9 +4536,12 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    pa_assert(pcm_handle || alsa_card_index >= 0);
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    else
+        mixer_handle = pa_alsa_open_mixer(mixers, alsa_card_index, true);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -4540,6 +4549,11 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     }
 
     PA_HASHMAP_FOREACH(p, ps->paths, state) {
+        if (known_paths && !pa_hashmap_get(known_paths, p->name)) {
+            pa_hashmap_remove(ps->paths, p);
+            continue;
+        }
+
         if (p->autodetect_eld_device)
             p->eld_device = m->hw_device_index;
 
@@ -4919,6 +4933,27 @@ void pa_alsa_decibel_fix_dump(pa_alsa_decibel_fix *db_fix) {
     pa_xfree(db_values);
 }
 
+/* 64 bit FNV-1a over the file contents, 0 if it can't be read */
+static uint64_t hash_file(const char *fn) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    uint8_t buf[4096];
+    size_t n, i;
+    FILE *f;
+
+    if (!(f = pa_fopen_cloexec(fn, "r")))
+        return 0;
+
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        for (i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= UINT64_C(0x100000001b3);
+        }
+
+    fclose(f);
+
+    return h;
+}
+
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus) {
     pa_alsa_profile_set *ps;
     pa_alsa_profile *p;
@@ -4978,6 +5013,10 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
                               PA_ALSA_PROFILE_SETS_DIR);
 
     r = pa_config_parse(fn, NULL, items, NULL, false, ps);
+
+    if (r >= 0)
+        ps->config_hash = hash_file(fn);
+
     pa_xfree(fn);
 
     if (r < 0)
@@ -5138,6 +5177,17 @@ static void mapping_query_hw_device(pa_alsa_mapping *mapping, snd_pcm_t *pcm) {
     mapping->hw_device_index = snd_pcm_info_get_device(pcm_info);
 }
 
+static void profile_set_probe_finish(pa_alsa_profile_set *ps, pa_hashmap *used_paths) {
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unused(ps->input_paths, used_paths);
+    paths_drop_unused(ps->output_paths, used_paths);
+
+    profile_set_set_availability_groups(ps);
+
+    ps->probed = true;
+}
+
 void pa_alsa_profile_set_probe(
         pa_alsa_profile_set *ps,
         pa_hashmap *mixers,
@@ -5279,7 +5329,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_output && selected_fallback_output == NULL) {
                         selected_fallback_output = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, -1, NULL);
                 }
 
         if (p->input_mappings)
@@ -5289,25 +5339,335 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_input && selected_fallback_input == NULL) {
                         selected_fallback_input = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, -1, NULL);
                 }
     }
 
     /* Clean up */
     profile_finalize_probing(last, NULL);
 
-    pa_alsa_profile_set_drop_unsupported(ps);
+    profile_set_probe_finish(ps, used_paths);
 
-    paths_drop_unused(ps->input_paths, used_paths);
-    paths_drop_unused(ps->output_paths, used_paths);
     pa_hashmap_free(broken_inputs);
     pa_hashmap_free(broken_outputs);
     pa_hashmap_free(used_paths);
     pa_xfree(probe_order);
+}
 
-    profile_set_set_availability_groups(ps);
+#define PROBE_CACHE_VERSION 2
 
-    ps->probed = true;
+char *pa_alsa_profile_set_probe_cache_key_for_card(
+        pa_alsa_profile_set *ps,
+        const char *driver,
+        const char *name,
+        const char *components,
+        const char *mixername,
+        const pa_sample_spec *ss,
+        unsigned default_n_fragments,
+        unsigned default_fragment_size_msec) {
+
+    char sst[PA_SAMPLE_SPEC_SNPRINT_MAX];
+
+    pa_assert(ps);
+    pa_assert(ss);
+
+    if (ps->config_hash == 0)
+        return NULL;
+
+    return pa_sprintf_malloc("%s|%s|%s|%s|%016" PRIx64 "|%s|%u|%u",
+                             pa_strempty(driver),
+                             pa_strempty(name),
+                             pa_strempty(components),
+                             pa_strempty(mixername),
+                             ps->config_hash,
+                             pa_sample_spec_snprint(sst, sizeof(sst), ss),
+                             default_n_fragments,
+                             default_fragment_size_msec);
+}
+
+char *pa_alsa_profile_set_probe_cache_key(
+        pa_alsa_profile_set *ps,
+        int alsa_card_index,
+        const pa_sample_spec *ss,
+        unsigned default_n_fragments,
+        unsigned default_fragment_size_msec) {
+
+    char dev[16];
+    snd_ctl_card_info_t *info;
+    snd_ctl_t *ctl;
+    char *key = NULL;
+    int err;
+
+    pa_assert(ps);
+    pa_assert(ss);
+
+    if (ps->config_hash == 0 || alsa_card_index < 0)
+        return NULL;
+
+    snd_ctl_card_info_alloca(&info);
+
+    pa_snprintf(dev, sizeof(dev), "hw:%i", alsa_card_index);
+
+    if ((err = snd_ctl_open(&ctl, dev, 0)) < 0) {
+        pa_log_debug("Failed to open control device %s: %s", dev, pa_alsa_strerror(err));
+        return NULL;
+    }
+
+    /* The long name is left out on purpose, it contains the USB port the
+     * card is plugged into. The same model on another port probes the same
+     * way. */
+    if ((err = snd_ctl_card_info(ctl, info)) >= 0)
+        key = pa_alsa_profile_set_probe_cache_key_for_card(ps,
+                                                           snd_ctl_card_info_get_driver(info),
+                                                           snd_ctl_card_info_get_name(info),
+                                                           snd_ctl_card_info_get_components(info),
+                                                           snd_ctl_card_info_get_mixername(info),
+                                                           ss,
+                                                           default_n_fragments,
+                                                           default_fragment_size_msec);
+    else
+        pa_log_debug("Failed to get card info for %s: %s", dev, pa_alsa_strerror(err));
+
+    snd_ctl_close(ctl);
+
+    return key;
+}
+
+struct probe_cache_mapping {
+    pa_alsa_mapping *mapping;
+    pa_channel_map channel_map;
+    int64_t hw_device_index;
+    uint32_t supported;
+    /* Names of the mixer paths that survived probing, the strings point
+     * into the tagstruct */
+    pa_hashmap *output_paths;
+    pa_hashmap *input_paths;
+};
+
+static pa_hashmap *probe_cache_get_paths(pa_tagstruct *t) {
+    pa_hashmap *paths;
+    uint32_t n, i;
+
+    if (pa_tagstruct_getu32(t, &n) < 0)
+        return NULL;
+
+    paths = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    for (i = 0; i < n; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name) {
+            pa_hashmap_free(paths);
+            return NULL;
+        }
+
+        pa_hashmap_put(paths, (void *) name, (void *) name);
+    }
+
+    return paths;
+}
+
+/* NULL for a mapping that isn't in the entry, all its paths are probed */
+static pa_hashmap *probe_cache_known_paths(struct probe_cache_mapping *cached, uint32_t n, pa_alsa_mapping *m, pa_alsa_direction_t direction) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        if (cached[i].mapping == m)
+            return direction == PA_ALSA_DIRECTION_OUTPUT ? cached[i].output_paths : cached[i].input_paths;
+
+    return NULL;
+}
+
+static void probe_cache_put_paths(pa_tagstruct *t, pa_alsa_path_set *ps) {
+    pa_alsa_path *p;
+    void *state;
+
+    if (!ps) {
+        pa_tagstruct_putu32(t, 0);
+        return;
+    }
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->paths));
+    PA_HASHMAP_FOREACH(p, ps->paths, state)
+        pa_tagstruct_puts(t, p->name);
+}
+
+bool pa_alsa_profile_set_probe_cache_load(
+        pa_alsa_profile_set *ps,
+        pa_database *db,
+        const char *key,
+        pa_hashmap *mixers,
+        int alsa_card_index) {
+
+    pa_datum k, d;
+    pa_tagstruct *t;
+    pa_hashmap *cached_profiles = NULL, *used_paths = NULL;
+    struct probe_cache_mapping *cached_mappings = NULL;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    uint8_t version;
+    uint32_t n_profiles, n_mappings = 0, i, idx;
+    void *state;
+    bool ret = false;
+
+    pa_assert(ps);
+    pa_assert(db);
+    pa_assert(key);
+    pa_assert(mixers);
+
+    if (ps->probed)
+        return true;
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    if (!pa_database_get(db, &k, &d))
+        return false;
+
+    t = pa_tagstruct_new_fixed(d.data, d.size);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 ||
+        version != PROBE_CACHE_VERSION ||
+        pa_tagstruct_getu32(t, &n_profiles) < 0 ||
+        n_profiles > pa_hashmap_size(ps->profiles))
+        goto finish;
+
+    cached_profiles = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    for (i = 0; i < n_profiles; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            !(p = pa_hashmap_get(ps->profiles, name)))
+            goto finish;
+
+        pa_hashmap_put(cached_profiles, p, p);
+    }
+
+    if (pa_tagstruct_getu32(t, &n_mappings) < 0 ||
+        n_mappings > pa_hashmap_size(ps->mappings))
+        goto finish;
+
+    cached_mappings = pa_xnew0(struct probe_cache_mapping, n_mappings);
+
+    for (i = 0; i < n_mappings; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            !(cached_mappings[i].mapping = pa_hashmap_get(ps->mappings, name)) ||
+            pa_tagstruct_get_channel_map(t, &cached_mappings[i].channel_map) < 0 ||
+            !pa_channel_map_valid(&cached_mappings[i].channel_map) ||
+            pa_tagstruct_gets64(t, &cached_mappings[i].hw_device_index) < 0 ||
+            pa_tagstruct_getu32(t, &cached_mappings[i].supported) < 0 ||
+            !(cached_mappings[i].output_paths = probe_cache_get_paths(t)) ||
+            !(cached_mappings[i].input_paths = probe_cache_get_paths(t)))
+            goto finish;
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto finish;
+
+    /* The entry is consistent with this profile set, apply it the way a
+     * real probe would have left things */
+    PA_HASHMAP_FOREACH(m, ps->mappings, state)
+        m->supported = 0;
+
+    for (i = 0; i < n_mappings; i++) {
+        m = cached_mappings[i].mapping;
+        m->channel_map = cached_mappings[i].channel_map;
+        m->hw_device_index = (int) cached_mappings[i].hw_device_index;
+        m->supported = cached_mappings[i].supported;
+    }
+
+    used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    /* Only the mixer paths that were usable last time are probed again.
+     * Their elements are still needed at runtime, but the paths that
+     * didn't match the mixer aren't looked at anymore. */
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        p->supported = !!pa_hashmap_get(cached_profiles, p);
+
+        if (!p->supported)
+            continue;
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, alsa_card_index,
+                                    probe_cache_known_paths(cached_mappings, n_mappings, m, PA_ALSA_DIRECTION_OUTPUT));
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, alsa_card_index,
+                                    probe_cache_known_paths(cached_mappings, n_mappings, m, PA_ALSA_DIRECTION_INPUT));
+    }
+
+    profile_set_probe_finish(ps, used_paths);
+    ret = true;
+
+    pa_log_debug("Loaded probe results for %u profiles and %u mappings from the probe cache.", n_profiles, n_mappings);
+
+finish:
+    if (!ret)
+        pa_log_debug("No usable probe cache entry for %s.", key);
+
+    if (used_paths)
+        pa_hashmap_free(used_paths);
+    if (cached_profiles)
+        pa_hashmap_free(cached_profiles);
+    for (i = 0; i < n_mappings && cached_mappings; i++) {
+        if (cached_mappings[i].output_paths)
+            pa_hashmap_free(cached_mappings[i].output_paths);
+        if (cached_mappings[i].input_paths)
+            pa_hashmap_free(cached_mappings[i].input_paths);
+    }
+    pa_xfree(cached_mappings);
+    pa_tagstruct_free(t);
+    pa_datum_free(&d);
+
+    return ret;
+}
+
+void pa_alsa_profile_set_probe_cache_save(pa_alsa_profile_set *ps, pa_database *db, const char *key) {
+    pa_tagstruct *t;
+    pa_datum k, d;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+
+    pa_assert(ps);
+    pa_assert(ps->probed);
+    pa_assert(db);
+    pa_assert(key);
+
+    /* Unsupported profiles and mappings have been dropped at this point */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->profiles));
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        pa_tagstruct_puts(t, p->name);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->mappings));
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        pa_tagstruct_put_channel_map(t, &m->channel_map);
+        pa_tagstruct_puts64(t, m->hw_device_index);
+        pa_tagstruct_putu32(t, m->supported);
+        probe_cache_put_paths(t, m->output_path_set);
+        probe_cache_put_paths(t, m->input_path_set);
+    }
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    d.data = (void *) pa_tagstruct_data(t, &d.size);
+
+    if (pa_database_set(db, &k, &d, true) < 0)
+        pa_log_warn("Failed to store probe results for %s.", key);
+    else
+        pa_database_sync(db);
+
+    pa_tagstruct_free(t);
 }
 
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
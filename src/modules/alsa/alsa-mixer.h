@@ -28,6 +28,7 @@
 #include <pulse/channelmap.h>
 #include <pulse/volume.h>
 
+#include <pulsecore/database.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/rtpoll.h>
 
@@ -370,6 +371,9 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* Hash of the profile set file, 0 if the set wasn't read from a file */
+    uint64_t config_hash;
+
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
@@ -386,6 +390,21 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
 
+/* Probing opens every PCM of every mapping and matches every mixer path
+ * against the mixer, which is slow on some cards. The outcome can be
+ * stored in a database under a key made of the card identity and the
+ * profile set contents and be reused later on. Loading skips the PCM
+ * checks and only probes the mixer paths that were usable last time,
+ * their elements are needed at runtime. Sinks and sources loaded directly
+ * with a device string don't probe anything, so they have nothing to
+ * cache. The key is NULL if the profile set can't be cached. */
+char *pa_alsa_profile_set_probe_cache_key(pa_alsa_profile_set *ps, int alsa_card_index, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+/* Same from the identity strings of the card's control interface */
+char *pa_alsa_profile_set_probe_cache_key_for_card(pa_alsa_profile_set *ps, const char *driver, const char *name, const char *components, const char *mixername,
+                                                   const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+bool pa_alsa_profile_set_probe_cache_load(pa_alsa_profile_set *ps, pa_database *db, const char *key, pa_hashmap *mixers, int alsa_card_index);
+void pa_alsa_profile_set_probe_cache_save(pa_alsa_profile_set *ps, pa_database *db, const char *key);
+
 pa_alsa_fdlist *pa_alsa_fdlist_new(void);
 void pa_alsa_fdlist_free(pa_alsa_fdlist *fdl);
 int pa_alsa_fdlist_set_handle(pa_alsa_fdlist *fdl, snd_mixer_t *mixer_handle, snd_hctl_t *hctl_handle, pa_mainloop_api* m);
@@ -24,6 +24,7 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <alsa/asoundlib.h>
 
@@ -145,8 +146,16 @@ struct userdata {
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    /* What we learned about the device, restored on resume and stored
+     * under tsched_state_key on unload */
+    pa_alsa_tsched_state tsched_learned;
+    char *tsched_state_key;
+
     pa_memchunk memchunk;
 
+    /* Block unix_write() renders into, reused across cycles */
+    pa_memblock *write_buffer;
+
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
 
@@ -447,6 +456,43 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
                 (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
 }
 
+/* Called from IO Context on suspend */
+static void remember_watermark(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    u->tsched_learned.watermark = u->tsched_watermark_usec;
+    u->tsched_learned.min_latency = u->sink->thread_info.min_latency;
+}
+
+/* Called from IO Context on unsuspend or from main thread when creating sink,
+ * after reset_watermark() */
+static void restore_watermark(struct userdata *u, bool in_thread) {
+    pa_usec_t min_latency, max_latency;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    if (u->tsched_learned.watermark <= 0)
+        return;
+
+    u->tsched_watermark = pa_usec_to_bytes(u->tsched_learned.watermark, &u->sink->sample_spec);
+    fix_tsched_watermark(u);
+
+    max_latency = u->sink->thread_info.max_latency;
+    min_latency = PA_MIN(u->tsched_learned.min_latency, max_latency);
+
+    if (min_latency > u->sink->thread_info.min_latency) {
+        if (in_thread)
+            pa_sink_set_latency_range_within_thread(u->sink, min_latency, max_latency);
+        else
+            pa_sink_set_latency_range(u->sink, min_latency, max_latency);
+    }
+
+    pa_log_info("Restored learned time scheduling watermark of %0.2fms",
+                (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+}
+
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
     pa_usec_t usec, wm;
 
@@ -553,9 +599,12 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
+            u->sink->thread_info.render_stats.underruns++;
+
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+        }
     }
 
 #ifdef DEBUG_TIMING
@@ -787,6 +836,38 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
     return work_done ? 1 : 0;
 }
 
+/* Render up to n_bytes into u->memchunk for unix_write(). Instead of
+ * letting pa_sink_render() hand us a new block each cycle we mix straight
+ * into a persistent buffer. It is filled completely, so the data usually
+ * goes out with a single snd_pcm_writei() call. */
+static void render_write_buffer(struct userdata *u, size_t n_bytes) {
+    pa_assert(u->memchunk.length <= 0);
+
+    /* The monitor source may still hold on to what we wrote last time */
+    if (u->write_buffer && !pa_memblock_ref_is_one(u->write_buffer)) {
+        pa_memblock_unref(u->write_buffer);
+        u->write_buffer = NULL;
+    }
+
+    if (!u->write_buffer) {
+        size_t length = pa_mempool_block_size_max(u->core->mempool);
+        void *data;
+
+        /* Not from the pool: a pool block keeps its header in front of the
+         * data within the slot, so the data isn't page aligned */
+        pa_assert_se(posix_memalign(&data, pa_page_size(), length) == 0);
+        pa_assert(data == PA_PAGE_ALIGN_PTR(data));
+
+        u->write_buffer = pa_memblock_new_user(u->core->mempool, data, length, free, data, false);
+    }
+
+    u->memchunk.memblock = pa_memblock_ref(u->write_buffer);
+    u->memchunk.index = 0;
+    u->memchunk.length = pa_frame_align(PA_MIN(n_bytes, pa_memblock_get_length(u->write_buffer)), &u->sink->sample_spec);
+
+    pa_sink_render_into_full(u->sink, &u->memchunk);
+}
+
 static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bool on_timeout) {
     bool work_done = false;
     pa_usec_t max_sleep_usec = 0, process_usec = 0;
@@ -875,7 +956,7 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 /*         pa_log_debug("%lu frames to write", (unsigned long) frames); */
 
             if (u->memchunk.length <= 0)
-                pa_sink_render(u->sink, n_bytes, &u->memchunk);
+                render_write_buffer(u, n_bytes);
 
             pa_assert(u->memchunk.length > 0);
 
@@ -1038,6 +1119,9 @@ static void suspend(struct userdata *u) {
 
     pa_smoother_pause(u->smoother, pa_rtclock_now());
 
+    if (u->use_tsched)
+        remember_watermark(u);
+
     /* Close PCM device */
     close_pcm(u);
 
@@ -1243,9 +1327,12 @@ static int unsuspend(struct userdata *u, bool recovering) {
 
     reset_vars(u);
 
-    /* reset the watermark to the value defined when sink was created */
-    if (u->use_tsched && !recovering)
+    /* reset the watermark to the value defined when sink was created and
+     * then apply what we learned before the suspend */
+    if (u->use_tsched && !recovering) {
         reset_watermark(u, u->tsched_watermark_ref, &u->sink->sample_spec, true);
+        restore_watermark(u, true);
+    }
 
     pa_log_info("Resumed successfully...");
 
@@ -2424,13 +2511,13 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     b = use_mmap;
     d = use_tsched;
 
-    /* Force ALSA to reread its configuration if module-alsa-card didn't
-     * do it for us. This matters if our device was hot-plugged after ALSA
-     * has already read its configuration - see
+    /* Force ALSA to reread its configuration if module-alsa-card or our
+     * pa__prepare() hook didn't do it for us. This matters if our device
+     * was hot-plugged after ALSA has already read its configuration - see
      * https://bugs.freedesktop.org/show_bug.cgi?id=54029
      */
 
-    if (!card)
+    if (!card && !m->prepared)
         snd_config_update_free_global();
 
     if (mapping) {
@@ -2677,6 +2764,16 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     if (u->use_tsched) {
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
+
+        if ((u->tsched_state_key = pa_alsa_tsched_state_key(u->sink->proplist, mapping)) &&
+            pa_alsa_tsched_state_load(u->tsched_state_key, &u->tsched_learned)) {
+            /* The render stats count on from here, so that clients see the
+             * underruns of the device rather than of this sink instance.
+             * The IO thread isn't running yet. */
+            u->sink->thread_info.render_stats.underruns = u->tsched_learned.underruns;
+            pa_render_stats_publish(&u->sink->render_stats, &u->sink->thread_info.render_stats);
+            restore_watermark(u, false);
+        }
     } else
         pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->hwbuf_size, &ss));
 
@@ -2786,12 +2883,28 @@ static void userdata_free(struct userdata *u) {
 
     pa_thread_mq_done(&u->thread_mq);
 
+    /* The IO thread is gone, its state can be read directly */
+    if (u->tsched_state_key && u->sink) {
+        pa_alsa_tsched_state state;
+
+        state.watermark = u->tsched_watermark_usec;
+        state.min_latency = u->sink->thread_info.min_latency;
+        state.underruns = u->sink->thread_info.render_stats.underruns;
+
+        pa_alsa_tsched_state_save(u->tsched_state_key, &state);
+    }
+
+    pa_xfree(u->tsched_state_key);
+
     if (u->sink)
         pa_sink_unref(u->sink);
 
     if (u->memchunk.memblock)
         pa_memblock_unref(u->memchunk.memblock);
 
+    if (u->write_buffer)
+        pa_memblock_unref(u->write_buffer);
+
     if (u->mixer_pd)
         pa_alsa_mixer_pdata_free(u->mixer_pd);
 
@@ -2115,13 +2115,13 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     b = use_mmap;
     d = use_tsched;
 
-    /* Force ALSA to reread its configuration if module-alsa-card didn't
-     * do it for us. This matters if our device was hot-plugged after ALSA
-     * has already read its configuration - see
+    /* Force ALSA to reread its configuration if module-alsa-card or our
+     * pa__prepare() hook didn't do it for us. This matters if our device
+     * was hot-plugged after ALSA has already read its configuration - see
      * https://bugs.freedesktop.org/show_bug.cgi?id=54029
      */
 
-    if (!card)
+    if (!card && !m->prepared)
         snd_config_update_free_global();
 
     if (mapping) {
@@ -40,6 +40,8 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/database.h>
+#include <pulsecore/tagstruct.h>
 
 #include "alsa-util.h"
 #include "alsa-mixer.h"
@@ -194,6 +196,40 @@ static void check_access(snd_pcm_t *pcm_handle, snd_pcm_hw_params_t *hwparams, b
     }
 }
 
+/* Some drivers advertise mmap access but hand out unusable areas. Map
+ * the buffer once and check that it looks like the interleaved layout
+ * we asked for, without committing any frames. */
+static bool mmap_self_test(snd_pcm_t *pcm_handle, const pa_sample_spec *ss) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames = 1;
+    unsigned c, sample_bits;
+    bool ok = true;
+    int err;
+
+    if ((err = snd_pcm_mmap_begin(pcm_handle, &areas, &offset, &frames)) < 0) {
+        pa_log_debug("snd_pcm_mmap_begin() failed: %s", pa_alsa_strerror(err));
+        return false;
+    }
+
+    sample_bits = (unsigned) pa_sample_size(ss) * 8;
+
+    for (c = 0; c < ss->channels; c++)
+        if (!areas[c].addr ||
+            areas[c].addr != areas[0].addr ||
+            areas[c].first != c * sample_bits ||
+            areas[c].step != ss->channels * sample_bits) {
+            ok = false;
+            break;
+        }
+
+    if ((err = snd_pcm_mmap_commit(pcm_handle, offset, 0)) < 0) {
+        pa_log_debug("snd_pcm_mmap_commit() failed: %s", pa_alsa_strerror(err));
+        ok = false;
+    }
+
+    return ok;
+}
+
 /* Set the hardware parameters of the given ALSA device. Returns the
  * selected fragment settings in *buffer_size and *period_size. Determine
  * whether mmap and tsched mode can be enabled. */
@@ -433,6 +469,23 @@ success:
     }
 #endif
 
+    if (_use_mmap && !mmap_self_test(pcm_handle, &_ss)) {
+        bool no_mmap = false;
+
+        pa_log_info("Device %s failed the mmap() self test, falling back to UNIX read/write mode.", snd_pcm_name(pcm_handle));
+
+        if ((ret = snd_pcm_hw_free(pcm_handle)) < 0) {
+            pa_log_info("snd_pcm_hw_free() failed: %s", pa_alsa_strerror(ret));
+            goto finish;
+        }
+
+        if ((ret = pa_alsa_set_hw_params(pcm_handle, ss, period_size, buffer_size, tsched_size,
+                                         &no_mmap, use_tsched, require_exact_channel_number)) >= 0 && use_mmap)
+            *use_mmap = false;
+
+        goto finish;
+    }
+
     ss->rate = _ss.rate;
     ss->channels = _ss.channels;
     ss->format = _ss.format;
@@ -771,6 +824,34 @@ fail:
     return NULL;
 }
 
+int pa_alsa_prepare_device(const char *device, int mode) {
+    snd_pcm_t *pcm_handle;
+    int err;
+
+    pa_assert(device);
+
+    /* Pick up devices that were hot-plugged after ALSA read its
+     * configuration, see the comment in pa_alsa_sink_new() */
+    snd_config_update_free_global();
+
+    if ((err = snd_config_update()) < 0)
+        pa_log_warn("Failed to reload ALSA configuration: %s", pa_alsa_strerror(err));
+
+    if ((err = snd_pcm_open(&pcm_handle, device, mode, SND_PCM_NONBLOCK)) < 0) {
+        pa_log_info("Error opening PCM device %s: %s", device, pa_alsa_strerror(err));
+
+        /* A busy device may become free by the time the module is
+         * initialized, only give up on devices that went away */
+        return err == -ENOENT || err == -ENODEV ? -1 : 0;
+    }
+
+    snd_pcm_close(pcm_handle);
+
+    pa_log_debug("Prepared PCM device %s.", device);
+
+    return 0;
+}
+
 snd_pcm_t *pa_alsa_open_by_template(
         char **template,
         const char *dev_id,
@@ -1610,6 +1691,106 @@ bool pa_alsa_may_tsched(bool want) {
 
 #define SND_MIXER_ELEM_PULSEAUDIO (SND_MIXER_ELEM_LAST + 10)
 
+#define TSCHED_STATE_DB "alsa-tsched"
+#define TSCHED_STATE_VERSION 1
+
+char *pa_alsa_tsched_state_key(pa_proplist *p, pa_alsa_mapping *mapping) {
+    const char *card_name, *device;
+
+    pa_assert(p);
+
+    /* The card index and thus the device string change with hotplug,
+     * the card name doesn't */
+    if (!(card_name = pa_proplist_gets(p, "alsa.card_name")) ||
+        !(device = pa_proplist_gets(p, "alsa.device")))
+        return NULL;
+
+    return pa_sprintf_malloc("%s|%s|%s", card_name, device, mapping ? mapping->name : "");
+}
+
+static pa_database *tsched_state_open(bool for_write) {
+    pa_database *db;
+    char *state_path;
+
+    if (!(state_path = pa_state_path(NULL, true)))
+        return NULL;
+
+    db = pa_database_open(state_path, TSCHED_STATE_DB, true, for_write);
+    pa_xfree(state_path);
+
+    return db;
+}
+
+bool pa_alsa_tsched_state_load(const char *key, pa_alsa_tsched_state *state) {
+    pa_database *db;
+    pa_datum k, d;
+    pa_tagstruct *t;
+    uint8_t version;
+    bool ret = false;
+
+    pa_assert(key);
+    pa_assert(state);
+
+    if (!(db = tsched_state_open(false)))
+        return false;
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    if (pa_database_get(db, &k, &d)) {
+        t = pa_tagstruct_new_fixed(d.data, d.size);
+
+        if (pa_tagstruct_getu8(t, &version) >= 0 &&
+            version == TSCHED_STATE_VERSION &&
+            pa_tagstruct_get_usec(t, &state->watermark) >= 0 &&
+            pa_tagstruct_get_usec(t, &state->min_latency) >= 0 &&
+            pa_tagstruct_getu64(t, &state->underruns) >= 0 &&
+            pa_tagstruct_eof(t))
+            ret = true;
+        else
+            pa_log_debug("Ignoring invalid timer scheduling state for %s.", key);
+
+        pa_tagstruct_free(t);
+        pa_datum_free(&d);
+    }
+
+    pa_database_close(db);
+
+    return ret;
+}
+
+void pa_alsa_tsched_state_save(const char *key, const pa_alsa_tsched_state *state) {
+    pa_database *db;
+    pa_datum k, d;
+    pa_tagstruct *t;
+
+    pa_assert(key);
+    pa_assert(state);
+
+    if (!(db = tsched_state_open(true))) {
+        pa_log_debug("Failed to open the timer scheduling state database.");
+        return;
+    }
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, TSCHED_STATE_VERSION);
+    pa_tagstruct_put_usec(t, state->watermark);
+    pa_tagstruct_put_usec(t, state->min_latency);
+    pa_tagstruct_putu64(t, state->underruns);
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+    d.data = (void *) pa_tagstruct_data(t, &d.size);
+
+    if (pa_database_set(db, &k, &d, true) < 0)
+        pa_log_warn("Failed to store timer scheduling state for %s.", key);
+    else
+        pa_database_sync(db);
+
+    pa_tagstruct_free(t);
+    pa_database_close(db);
+}
+
 static snd_mixer_elem_t *pa_alsa_mixer_find(snd_mixer_t *mixer,
                                             snd_ctl_elem_iface_t iface,
                                             const char *name,
@@ -113,6 +113,12 @@ snd_pcm_t *pa_alsa_open_by_template(
         bool *use_tsched,                 /* modified at return */
         bool require_exact_channel_number);
 
+/* Does the slow part of bringing up a device outside of the main loop:
+ * rereads the ALSA configuration and opens the PCM once, which wakes
+ * up the hardware. Safe to call from any thread. Returns a negative
+ * value only if the device does not exist. */
+int pa_alsa_prepare_device(const char *device, int mode);
+
 void pa_alsa_dump(pa_log_level_t level, snd_pcm_t *pcm);
 void pa_alsa_dump_status(snd_pcm_t *pcm);
 
@@ -148,6 +154,23 @@ const char* pa_alsa_strerror(int errnum);
 
 bool pa_alsa_may_tsched(bool want);
 
+/* What timer-based scheduling learned about a device at runtime. Kept
+ * across suspends and stored on disk, so that a device doesn't have to
+ * go through a series of underruns again each time it is opened. */
+typedef struct pa_alsa_tsched_state {
+    pa_usec_t watermark;   /* wakeup watermark */
+    pa_usec_t min_latency; /* raised once the watermark can't grow anymore */
+    uint64_t underruns;    /* over the lifetime of the device, seeds the
+                            * sink's render.underruns */
+} pa_alsa_tsched_state;
+
+/* Key for a PCM device that is stable across hotplug, built from the
+ * alsa.* properties and the mapping (profile) in use. NULL if the
+ * properties needed are missing. */
+char *pa_alsa_tsched_state_key(pa_proplist *p, pa_alsa_mapping *mapping);
+bool pa_alsa_tsched_state_load(const char *key, pa_alsa_tsched_state *state);
+void pa_alsa_tsched_state_save(const char *key, const pa_alsa_tsched_state *state);
+
 snd_mixer_elem_t *pa_alsa_mixer_find_card(snd_mixer_t *mixer, struct pa_alsa_mixer_id *alsa_id, unsigned int device);
 snd_mixer_elem_t *pa_alsa_mixer_find_pcm(snd_mixer_t *mixer, const char *name, unsigned int device);
 
@@ -24,6 +24,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
@@ -70,6 +71,7 @@ PA_MODULE_USAGE(
         "use_ucm=<load use case manager> "
         "avoid_resampling=<use stream original sample rate if possible?> "
         "control=<name of mixer control> "
+        "probe_cache=<reuse profile probe results from earlier runs?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -99,6 +101,7 @@ static const char* const valid_modargs[] = {
     "use_ucm",
     "avoid_resampling",
     "control",
+    "probe_cache",
     NULL
 };
 
@@ -106,6 +109,8 @@ static const char* const valid_modargs[] = {
 
 #define PULSE_MODARGS "PULSE_MODARGS"
 
+#define PROBE_CACHE_DB "alsa-probe-cache"
+
 /* dynamic profile priority bonus, for all alsa profiles, the original priority
    needs to be less than 0x7fff (32767), then could apply the rule of priority
    bonus. So far there are 2 kinds of alsa profiles, one is from alsa ucm, the
@@ -129,6 +134,11 @@ struct userdata {
 
     pa_alsa_profile_set *profile_set;
 
+    /* Set if the profile set probe results may be cached, probe_cached tells
+     * whether they actually came from the cache */
+    char *probe_cache_key;
+    bool probe_cached;
+
     /* ucm stuffs */
     bool use_ucm;
     pa_alsa_ucm_config ucm;
@@ -139,6 +149,75 @@ struct profile_data {
     pa_alsa_profile *profile;
 };
 
+static pa_database *probe_cache_open(void) {
+    pa_database *db;
+    char *state_path;
+
+    if (!(state_path = pa_state_path(NULL, true)))
+        return NULL;
+
+    db = pa_database_open(state_path, PROBE_CACHE_DB, true, true);
+    pa_xfree(state_path);
+
+    if (!db)
+        pa_log_debug("Failed to open the probe cache database.");
+
+    return db;
+}
+
+static void profile_set_probe(struct userdata *u, const pa_sample_spec *ss, unsigned n_fragments, unsigned fragment_size_msec) {
+    pa_database *db = NULL;
+
+    pa_assert(u);
+
+    if (u->probe_cache_key && (db = probe_cache_open())) {
+        if (pa_alsa_profile_set_probe_cache_load(u->profile_set, db, u->probe_cache_key, u->mixers, u->alsa_card_index)) {
+            pa_log_info("Using cached probe results for card %s.", u->device_id);
+            u->probe_cached = true;
+            pa_database_close(db);
+            return;
+        }
+    }
+
+    pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, ss, n_fragments, fragment_size_msec);
+
+    if (db) {
+        /* Finding nothing at all is most likely a busy or half initialized
+         * device, don't make that stick */
+        if (!pa_hashmap_isempty(u->profile_set->mappings))
+            pa_alsa_profile_set_probe_cache_save(u->profile_set, db, u->probe_cache_key);
+
+        pa_database_close(db);
+    }
+}
+
+/* A mapping that the probe cache claims to work failed to open. The card
+ * may have changed in a way the cache key doesn't capture, so drop the
+ * entry and let the next load probe for real. */
+static void probe_cache_invalidate(struct userdata *u) {
+    pa_database *db;
+    pa_datum key;
+
+    pa_assert(u);
+
+    if (!u->probe_cached)
+        return;
+
+    u->probe_cached = false;
+
+    if (!(db = probe_cache_open()))
+        return;
+
+    key.data = u->probe_cache_key;
+    key.size = strlen(u->probe_cache_key);
+
+    pa_database_unset(db, &key);
+    pa_database_sync(db);
+    pa_database_close(db);
+
+    pa_log_info("Cached probe results for card %s are stale, they will be refreshed on the next load.", u->device_id);
+}
+
 static void add_profiles(struct userdata *u, pa_hashmap *h, pa_hashmap *ports) {
     pa_alsa_profile *ap;
     void *state;
@@ -259,8 +338,8 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
     if (nd->profile && nd->profile->output_mappings)
         PA_IDXSET_FOREACH(am, nd->profile->output_mappings, idx) {
 
-            if (!am->sink)
-                am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am);
+            if (!am->sink && !(am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am)))
+                probe_cache_invalidate(u);
 
             if (sink_inputs && am->sink) {
                 pa_sink_move_all_finish(am->sink, sink_inputs, false);
@@ -271,8 +350,8 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
     if (nd->profile && nd->profile->input_mappings)
         PA_IDXSET_FOREACH(am, nd->profile->input_mappings, idx) {
 
-            if (!am->source)
-                am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am);
+            if (!am->source && !(am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am)))
+                probe_cache_invalidate(u);
 
             if (source_outputs && am->source) {
                 pa_source_move_all_finish(am->source, source_outputs, false);
@@ -310,11 +389,13 @@ static void init_profile(struct userdata *u) {
 
     if (d->profile && d->profile->output_mappings)
         PA_IDXSET_FOREACH(am, d->profile->output_mappings, idx)
-            am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am);
+            if (!(am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am)))
+                probe_cache_invalidate(u);
 
     if (d->profile && d->profile->input_mappings)
         PA_IDXSET_FOREACH(am, d->profile->input_mappings, idx)
-            am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am);
+            if (!(am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am)))
+                probe_cache_invalidate(u);
 }
 
 static pa_available_t calc_port_state(pa_device_port *p, struct userdata *u) {
@@ -844,6 +925,7 @@ static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source
 int pa__init(pa_module *m) {
     pa_card_new_data data;
     bool ignore_dB = false;
+    bool probe_cache = true;
     struct userdata *u;
     pa_reserve_wrapper *reserve = NULL;
     const char *description;
@@ -993,7 +1075,17 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    if (pa_modargs_get_value_boolean(u->modargs, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
+    /* UCM profile sets aren't read from a profile set file and get no key */
+    if (probe_cache)
+        u->probe_cache_key = pa_alsa_profile_set_probe_cache_key(u->profile_set, u->alsa_card_index, &m->core->default_sample_spec,
+                                                                 m->core->default_n_fragments, m->core->default_fragment_size_msec);
+
+    profile_set_probe(u, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
@@ -1176,6 +1268,7 @@ void pa__done(pa_module*m) {
 
     pa_alsa_ucm_free(&u->ucm);
 
+    pa_xfree(u->probe_cache_key);
     pa_xfree(u->device_id);
     pa_xfree(u);
 
@@ -30,10 +30,13 @@
 #include <valgrind/memcheck.h>
 #endif
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/module.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
 
 #include "alsa-util.h"
 #include "alsa-source.h"
@@ -94,6 +97,29 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+int pa__prepare(const char *argument) {
+    pa_modargs *ma;
+    const char *dev_id;
+    char *device;
+    int r;
+
+    /* Argument errors are reported by pa__init() */
+    if (!(ma = pa_modargs_new(argument, valid_modargs)))
+        return 0;
+
+    if ((dev_id = pa_modargs_get_value(ma, "device_id", NULL)))
+        device = pa_sprintf_malloc("hw:%s", dev_id);
+    else
+        device = pa_xstrdup(pa_modargs_get_value(ma, "device", "default"));
+
+    r = pa_alsa_prepare_device(device, SND_PCM_STREAM_CAPTURE);
+
+    pa_xfree(device);
+    pa_modargs_free(ma);
+
+    return r;
+}
+
 int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
 
@@ -67,6 +67,7 @@ static void handle_suspend(DBusConnection *conn, DBusMessage *msg, void *userdat
 static void handle_get_port_by_name(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
 static void handle_sink_get_monitor_source(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_sink_get_render_stats(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
 static void handle_sink_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
@@ -134,6 +135,7 @@ enum property_handler_index {
 
 enum sink_property_handler_index {
     SINK_PROPERTY_HANDLER_MONITOR_SOURCE,
+    SINK_PROPERTY_HANDLER_RENDER_STATS,
     SINK_PROPERTY_HANDLER_MAX
 };
 
@@ -171,7 +173,8 @@ static pa_dbus_property_handler property_handlers[PROPERTY_HANDLER_MAX] = {
 };
 
 static pa_dbus_property_handler sink_property_handlers[SINK_PROPERTY_HANDLER_MAX] = {
-    [SINK_PROPERTY_HANDLER_MONITOR_SOURCE] = { .property_name = "MonitorSource", .type = "o", .get_cb = handle_sink_get_monitor_source, .set_cb = NULL }
+    [SINK_PROPERTY_HANDLER_MONITOR_SOURCE] = { .property_name = "MonitorSource", .type = "o",  .get_cb = handle_sink_get_monitor_source, .set_cb = NULL },
+    [SINK_PROPERTY_HANDLER_RENDER_STATS]   = { .property_name = "RenderStats",   .type = "at", .get_cb = handle_sink_get_render_stats,   .set_cb = NULL }
 };
 
 static pa_dbus_property_handler source_property_handlers[SOURCE_PROPERTY_HANDLER_MAX] = {
@@ -1005,12 +1008,43 @@ static void handle_sink_get_monitor_source(DBusConnection *conn, DBusMessage *ms
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_OBJECT_PATH, &monitor_source);
 }
 
+/* The render statistics are sent as an array of cycles, total ns, max ns,
+ * resampling ns and underruns. */
+#define N_RENDER_STATS 5
+
+static void sink_get_render_stats(pa_dbusiface_device *d, dbus_uint64_t render_stats[N_RENDER_STATS]) {
+    pa_render_stats stats;
+
+    pa_sink_get_render_stats(d->sink, &stats);
+
+    render_stats[0] = stats.cycles;
+    render_stats[1] = stats.total_nsec;
+    render_stats[2] = stats.max_nsec;
+    render_stats[3] = stats.resample_nsec;
+    render_stats[4] = stats.underruns;
+}
+
+static void handle_sink_get_render_stats(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_device *d = userdata;
+    dbus_uint64_t render_stats[N_RENDER_STATS];
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(d);
+    pa_assert(d->type == PA_DEVICE_TYPE_SINK);
+
+    sink_get_render_stats(d, render_stats);
+
+    pa_dbus_send_basic_array_variant_reply(conn, msg, DBUS_TYPE_UINT64, render_stats, N_RENDER_STATS);
+}
+
 static void handle_sink_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     pa_dbusiface_device *d = userdata;
     DBusMessage *reply = NULL;
     DBusMessageIter msg_iter;
     DBusMessageIter dict_iter;
     const char *monitor_source = NULL;
+    dbus_uint64_t render_stats[N_RENDER_STATS];
 
     pa_assert(conn);
     pa_assert(msg);
@@ -1018,6 +1052,7 @@ static void handle_sink_get_all(DBusConnection *conn, DBusMessage *msg, void *us
     pa_assert(d->type == PA_DEVICE_TYPE_SINK);
 
     monitor_source = pa_dbusiface_core_get_source_path(d->core, d->sink->monitor_source);
+    sink_get_render_stats(d, render_stats);
 
     pa_assert_se((reply = dbus_message_new_method_return(msg)));
 
@@ -1025,6 +1060,7 @@ static void handle_sink_get_all(DBusConnection *conn, DBusMessage *msg, void *us
     pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
 
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[SINK_PROPERTY_HANDLER_MONITOR_SOURCE].property_name, DBUS_TYPE_OBJECT_PATH, &monitor_source);
+    pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, sink_property_handlers[SINK_PROPERTY_HANDLER_RENDER_STATS].property_name, DBUS_TYPE_UINT64, render_stats, N_RENDER_STATS);
 
     pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
 
@@ -80,6 +80,7 @@ static void handle_set_mute(DBusConnection *conn, DBusMessage *msg, DBusMessageI
 static void handle_get_buffer_latency(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_device_latency(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_resample_method(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_render_stats(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_property_list(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
 static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata);
@@ -101,6 +102,7 @@ enum property_handler_index {
     PROPERTY_HANDLER_BUFFER_LATENCY,
     PROPERTY_HANDLER_DEVICE_LATENCY,
     PROPERTY_HANDLER_RESAMPLE_METHOD,
+    PROPERTY_HANDLER_RENDER_STATS,
     PROPERTY_HANDLER_PROPERTY_LIST,
     PROPERTY_HANDLER_MAX
 };
@@ -119,6 +121,7 @@ static pa_dbus_property_handler property_handlers[PROPERTY_HANDLER_MAX] = {
     [PROPERTY_HANDLER_BUFFER_LATENCY]  = { .property_name = "BufferLatency",  .type = "t",      .get_cb = handle_get_buffer_latency,  .set_cb = NULL },
     [PROPERTY_HANDLER_DEVICE_LATENCY]  = { .property_name = "DeviceLatency",  .type = "t",      .get_cb = handle_get_device_latency,  .set_cb = NULL },
     [PROPERTY_HANDLER_RESAMPLE_METHOD] = { .property_name = "ResampleMethod", .type = "s",      .get_cb = handle_get_resample_method, .set_cb = NULL },
+    [PROPERTY_HANDLER_RENDER_STATS]    = { .property_name = "RenderStats",    .type = "at",     .get_cb = handle_get_render_stats,    .set_cb = NULL },
     [PROPERTY_HANDLER_PROPERTY_LIST]   = { .property_name = "PropertyList",   .type = "a{say}", .get_cb = handle_get_property_list,   .set_cb = NULL }
 };
 
@@ -499,6 +502,42 @@ static void handle_get_resample_method(DBusConnection *conn, DBusMessage *msg, v
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_STRING, &resample_method);
 }
 
+/* The render statistics are sent as an array of cycles, total ns, max ns,
+ * resampling ns and underruns. */
+#define N_RENDER_STATS 5
+
+static void get_render_stats(pa_dbusiface_stream *s, dbus_uint64_t render_stats[N_RENDER_STATS]) {
+    pa_render_stats stats;
+
+    pa_assert(s->type == STREAM_TYPE_PLAYBACK);
+
+    pa_sink_input_get_render_stats(s->sink_input, &stats);
+
+    render_stats[0] = stats.cycles;
+    render_stats[1] = stats.total_nsec;
+    render_stats[2] = stats.max_nsec;
+    render_stats[3] = stats.resample_nsec;
+    render_stats[4] = stats.underruns;
+}
+
+static void handle_get_render_stats(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_stream *s = userdata;
+    dbus_uint64_t render_stats[N_RENDER_STATS];
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(s);
+
+    if (s->type == STREAM_TYPE_RECORD) {
+        pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY, "Record streams don't have render statistics.");
+        return;
+    }
+
+    get_render_stats(s, render_stats);
+
+    pa_dbus_send_basic_array_variant_reply(conn, msg, DBUS_TYPE_UINT64, render_stats, N_RENDER_STATS);
+}
+
 static void handle_get_property_list(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     pa_dbusiface_stream *s = userdata;
 
@@ -528,6 +567,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     dbus_uint64_t buffer_latency = 0;
     dbus_uint64_t device_latency = 0;
     const char *resample_method = NULL;
+    dbus_uint64_t render_stats[N_RENDER_STATS];
     unsigned i = 0;
 
     pa_assert(conn);
@@ -549,6 +589,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
         channel_map = &s->sink_input->channel_map;
         buffer_latency = pa_sink_input_get_latency(s->sink_input, &device_latency);
         resample_method = pa_resample_method_to_string(s->sink_input->actual_resample_method);
+        get_render_stats(s, render_stats);
     } else {
         idx = s->source_output->index;
         driver = s->source_output->driver;
@@ -598,6 +639,10 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_BUFFER_LATENCY].property_name, DBUS_TYPE_UINT64, &buffer_latency);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_DEVICE_LATENCY].property_name, DBUS_TYPE_UINT64, &device_latency);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_RESAMPLE_METHOD].property_name, DBUS_TYPE_STRING, &resample_method);
+
+    if (s->type == STREAM_TYPE_PLAYBACK)
+        pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_RENDER_STATS].property_name, DBUS_TYPE_UINT64, render_stats, N_RENDER_STATS);
+
     pa_dbus_append_proplist_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_PROPERTY_LIST].property_name, s->proplist);
 
     pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
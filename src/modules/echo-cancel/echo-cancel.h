@@ -111,6 +111,15 @@ struct pa_echo_canceller {
      * returned in out. */
     void        (*run)                  (pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out);
 
+    /* Optional planar variants of play() and record(), for cancellers that
+     * work on deinterleaved PA_SAMPLE_FLOAT32NE samples. Every channel is a
+     * separate array of nframes samples. If these are set, module-echo-cancel
+     * uses them instead of run() or play()+record() and passes single channel
+     * samples straight from its queues, so init() has to pick float for all
+     * three sample specs. */
+    void        (*play_planar)          (pa_echo_canceller *ec, const float * const play[]);
+    void        (*record_planar)        (pa_echo_canceller *ec, const float * const rec[], float * const out[]);
+
     /* Optional callback to set the drift, expressed as the ratio of the
      * difference in number of playback and capture samples to the number of
      * capture samples, for some instant of time. This is used only if the
@@ -180,6 +189,8 @@ bool pa_webrtc_ec_init(pa_core *c, pa_echo_canceller *ec,
                        uint32_t *nframes, const char *args);
 void pa_webrtc_ec_play(pa_echo_canceller *ec, const uint8_t *play);
 void pa_webrtc_ec_record(pa_echo_canceller *ec, const uint8_t *rec, uint8_t *out);
+void pa_webrtc_ec_play_planar(pa_echo_canceller *ec, const float * const play[]);
+void pa_webrtc_ec_record_planar(pa_echo_canceller *ec, const float * const rec[], float * const out[]);
 void pa_webrtc_ec_set_drift(pa_echo_canceller *ec, float drift);
 void pa_webrtc_ec_run(pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out);
 void pa_webrtc_ec_done(pa_echo_canceller *ec);
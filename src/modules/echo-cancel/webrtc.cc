@@ -505,16 +505,12 @@ fail:
     return false;
 }
 
-void pa_webrtc_ec_play(pa_echo_canceller *ec, const uint8_t *play) {
+void pa_webrtc_ec_play_planar(pa_echo_canceller *ec, const float * const play[]) {
     webrtc::AudioProcessing *apm = (webrtc::AudioProcessing*)ec->params.webrtc.apm;
     const pa_sample_spec *ss = &ec->params.webrtc.play_ss;
-    int n = ec->params.webrtc.blocksize;
-    float **buf = ec->params.webrtc.play_buffer;
     webrtc::StreamConfig config(ss->rate, ss->channels, false);
 
-    pa_deinterleave(play, (void **) buf, ss->channels, pa_sample_size(ss), n);
-
-    pa_assert_se(apm->ProcessReverseStream(buf, config, config, buf) == webrtc::AudioProcessing::kNoError);
+    pa_assert_se(apm->ProcessReverseStream(play, config, config, ec->params.webrtc.play_buffer) == webrtc::AudioProcessing::kNoError);
 
     /* FIXME: If ProcessReverseStream() makes any changes to the audio, such as
      * applying intelligibility enhancement, those changes don't have any
@@ -523,18 +519,14 @@ void pa_webrtc_ec_play(pa_echo_canceller *ec, const uint8_t *play) {
      * to speakers. */
 }
 
-void pa_webrtc_ec_record(pa_echo_canceller *ec, const uint8_t *rec, uint8_t *out) {
+void pa_webrtc_ec_record_planar(pa_echo_canceller *ec, const float * const rec[], float * const out[]) {
     webrtc::AudioProcessing *apm = (webrtc::AudioProcessing*)ec->params.webrtc.apm;
     const pa_sample_spec *rec_ss = &ec->params.webrtc.rec_ss;
     const pa_sample_spec *out_ss = &ec->params.webrtc.out_ss;
-    float **buf = ec->params.webrtc.rec_buffer;
-    int n = ec->params.webrtc.blocksize;
     int old_volume, new_volume;
     webrtc::StreamConfig rec_config(rec_ss->rate, rec_ss->channels, false);
     webrtc::StreamConfig out_config(out_ss->rate, out_ss->channels, false);
 
-    pa_deinterleave(rec, (void **) buf, rec_ss->channels, pa_sample_size(rec_ss), n);
-
     if (ec->params.webrtc.agc) {
         pa_volume_t v = pa_echo_canceller_get_capture_volume(ec);
         old_volume = webrtc_volume_from_pa(v);
@@ -542,7 +534,7 @@ void pa_webrtc_ec_record(pa_echo_canceller *ec, const uint8_t *rec, uint8_t *out
     }
 
     apm->set_stream_delay_ms(0);
-    pa_assert_se(apm->ProcessStream(buf, rec_config, out_config, buf) == webrtc::AudioProcessing::kNoError);
+    pa_assert_se(apm->ProcessStream(rec, rec_config, out_config, out) == webrtc::AudioProcessing::kNoError);
 
     if (ec->params.webrtc.agc) {
         if (PA_UNLIKELY(ec->params.webrtc.first)) {
@@ -559,6 +551,27 @@ void pa_webrtc_ec_record(pa_echo_canceller *ec, const uint8_t *rec, uint8_t *out
         if (old_volume != new_volume)
             pa_echo_canceller_set_capture_volume(ec, webrtc_volume_to_pa(new_volume));
     }
+}
+
+void pa_webrtc_ec_play(pa_echo_canceller *ec, const uint8_t *play) {
+    const pa_sample_spec *ss = &ec->params.webrtc.play_ss;
+    int n = ec->params.webrtc.blocksize;
+    float **buf = ec->params.webrtc.play_buffer;
+
+    pa_deinterleave(play, (void **) buf, ss->channels, pa_sample_size(ss), n);
+
+    pa_webrtc_ec_play_planar(ec, buf);
+}
+
+void pa_webrtc_ec_record(pa_echo_canceller *ec, const uint8_t *rec, uint8_t *out) {
+    const pa_sample_spec *rec_ss = &ec->params.webrtc.rec_ss;
+    const pa_sample_spec *out_ss = &ec->params.webrtc.out_ss;
+    float **buf = ec->params.webrtc.rec_buffer;
+    int n = ec->params.webrtc.blocksize;
+
+    pa_deinterleave(rec, (void **) buf, rec_ss->channels, pa_sample_size(rec_ss), n);
+
+    pa_webrtc_ec_record_planar(ec, buf, buf);
 
     pa_interleave((const void **) buf, out_ss->channels, out, pa_sample_size(out_ss), n);
 }
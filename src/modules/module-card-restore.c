@@ -31,7 +31,6 @@
 #include <pulse/gccmacro.h>
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
-#include <pulse/rtclock.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/module.h>
@@ -52,8 +51,6 @@ PA_MODULE_USAGE(
     "restore_bluetooth_profile=<boolean>"
 );
 
-#define SAVE_INTERVAL (10 * PA_USEC_PER_SEC)
-
 static const char* const valid_modargs[] = {
     "restore_bluetooth_profile",
     NULL
@@ -62,8 +59,8 @@ static const char* const valid_modargs[] = {
 struct userdata {
     pa_core *core;
     pa_module *module;
-    pa_time_event *save_time_event;
     pa_database *database;
+    pa_database_journal *journal;
     bool restore_bluetooth_profile;
 };
 
@@ -83,28 +80,6 @@ struct entry {
     bool profile_is_sticky; /* since version 5; must be restored together with profile name */
 };
 
-static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(a);
-    pa_assert(e);
-    pa_assert(u);
-
-    pa_assert(e == u->save_time_event);
-    u->core->mainloop->time_free(u->save_time_event);
-    u->save_time_event = NULL;
-
-    pa_database_sync(u->database);
-    pa_log_info("Synced.");
-}
-
-static void trigger_save(struct userdata *u) {
-    if (u->save_time_event)
-        return;
-
-    u->save_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + SAVE_INTERVAL, save_time_callback, u);
-}
-
 static void port_info_free(struct port_info *p_info) {
     pa_assert(p_info);
 
@@ -229,7 +204,7 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, true) == 0);
+    r = (pa_database_journal_set(u->journal, u->database, &key, &data, true) == 0);
 
     pa_tagstruct_free(t);
 
@@ -378,8 +353,7 @@ fail:
     pa_log_debug("Attempting to load legacy (pre-v1.0) data for key: %s", name);
     if ((e = legacy_entry_read(u, &data))) {
         pa_log_debug("Success. Saving new format for key: %s", name);
-        if (entry_write(u, name, e))
-            trigger_save(u);
+        entry_write(u, name, e);
         pa_datum_free(&data);
         return e;
     } else
@@ -415,8 +389,7 @@ static pa_hook_result_t card_put_hook_callback(pa_core *c, pa_card *card, struct
 
     show_full_info(card);
 
-    if (entry_write(u, card->name, entry))
-        trigger_save(u);
+    entry_write(u, card->name, entry);
 
 finish:
     entry_free(entry);
@@ -470,8 +443,7 @@ static pa_hook_result_t card_profile_changed_callback(pa_core *c, pa_card *card,
     PA_IDXSET_FOREACH(source, card->sources, state)
         update_profile_for_port(entry, card, source->active_port);
 
-    if (entry_write(u, card->name, entry))
-        trigger_save(u);
+    entry_write(u, card->name, entry);
 
     entry_free(entry);
     return PA_HOOK_OK;
@@ -522,8 +494,7 @@ static pa_hook_result_t port_offset_change_callback(pa_core *c, pa_device_port *
         show_full_info(card);
     }
 
-    if (entry_write(u, card->name, entry))
-        trigger_save(u);
+    entry_write(u, card->name, entry);
 
     entry_free(entry);
     return PA_HOOK_OK;
@@ -629,8 +600,7 @@ static pa_hook_result_t card_preferred_port_changed_callback(pa_core *core, pa_c
         e->preferred_output_port = pa_xstrdup(card->preferred_output_port ? card->preferred_output_port->name : NULL);
     }
 
-    if (entry_write(u, card->name, e))
-        trigger_save(u);
+    entry_write(u, card->name, e);
 
     entry_free(e);
 
@@ -680,6 +650,9 @@ int pa__init(pa_module*m) {
 
     pa_xfree(state_path);
 
+    u->journal = pa_database_journal_get(m->core);
+    pa_database_journal_attach(u->journal, u->database, "card-database");
+
     pa_modargs_free(ma);
     return 0;
 
@@ -700,9 +673,9 @@ void pa__done(pa_module*m) {
     if (!(u = m->userdata))
         return;
 
-    if (u->save_time_event) {
-        u->core->mainloop->time_free(u->save_time_event);
-        pa_database_sync(u->database);
+    if (u->journal) {
+        pa_database_journal_detach(u->journal, u->database);
+        pa_database_journal_unref(u->journal);
     }
 
     if (u->database)
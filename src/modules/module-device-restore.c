@@ -33,7 +33,6 @@
 #include <pulse/xmalloc.h>
 #include <pulse/volume.h>
 #include <pulse/timeval.h>
-#include <pulse/rtclock.h>
 #include <pulse/format.h>
 #include <pulse/internal.h>
 
@@ -62,8 +61,6 @@ PA_MODULE_USAGE(
         "restore_muted=<Save/restore muted states?> "
         "restore_formats=<Save/restore saved formats?>");
 
-#define SAVE_INTERVAL (10 * PA_USEC_PER_SEC)
-
 static const char* const valid_modargs[] = {
     "restore_volume",
     "restore_muted",
@@ -76,8 +73,8 @@ struct userdata {
     pa_core *core;
     pa_module *module;
     pa_subscription *subscription;
-    pa_time_event *save_time_event;
     pa_database *database;
+    pa_database_journal *journal;
 
     pa_native_protocol *protocol;
     pa_idxset *subscribed;
@@ -117,21 +114,6 @@ struct perportentry {
     pa_idxset *formats;
 };
 
-static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(a);
-    pa_assert(e);
-    pa_assert(u);
-
-    pa_assert(e == u->save_time_event);
-    u->core->mainloop->time_free(u->save_time_event);
-    u->save_time_event = NULL;
-
-    pa_database_sync(u->database);
-    pa_log_info("Synced.");
-}
-
 static void trigger_save(struct userdata *u, pa_device_type_t type, uint32_t sink_idx) {
     pa_native_connection *c;
     uint32_t idx;
@@ -152,11 +134,6 @@ static void trigger_save(struct userdata *u, pa_device_type_t type, uint32_t sin
             pa_pstream_send_tagstruct(pa_native_connection_get_pstream(c), t);
         }
     }
-
-    if (u->save_time_event)
-        return;
-
-    u->save_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + SAVE_INTERVAL, save_time_callback, u);
 }
 
 #ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
@@ -199,7 +176,7 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, true) == 0);
+    r = (pa_database_journal_set(u->journal, u->database, &key, &data, true) == 0);
 
     pa_tagstruct_free(t);
 
@@ -378,7 +355,7 @@ static bool perportentry_write(struct userdata *u, const char *basekeyname, cons
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, true) == 0);
+    r = (pa_database_journal_set(u->journal, u->database, &key, &data, true) == 0);
 
     pa_tagstruct_free(t);
     pa_xfree(name);
@@ -1269,6 +1246,9 @@ int pa__init(pa_module*m) {
 
     pa_xfree(state_path);
 
+    u->journal = pa_database_journal_get(m->core);
+    pa_database_journal_attach(u->journal, u->database, "device-volumes");
+
     PA_IDXSET_FOREACH(sink, m->core->sinks, idx)
         subscribe_callback(m->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, sink->index, u);
 
@@ -1298,9 +1278,9 @@ void pa__done(pa_module*m) {
     if (u->subscription)
         pa_subscription_free(u->subscription);
 
-    if (u->save_time_event) {
-        u->core->mainloop->time_free(u->save_time_event);
-        pa_database_sync(u->database);
+    if (u->journal) {
+        pa_database_journal_detach(u->journal, u->database);
+        pa_database_journal_unref(u->journal);
     }
 
     if (u->database)
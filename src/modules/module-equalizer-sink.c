@@ -35,14 +35,6 @@
 #include <string.h>
 #include <stdint.h>
 
-//#undef __SSE2__
-#ifdef __SSE2__
-#include <xmmintrin.h>
-#include <emmintrin.h>
-#endif
-
-#include <fftw3.h>
-
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
@@ -63,6 +55,8 @@
 #include <pulsecore/database.h>
 #include <pulsecore/protocol-dbus.h>
 #include <pulsecore/dbus-util.h>
+#include <pulsecore/fft-plan.h>
+#include <pulsecore/stft.h>
 
 PA_MODULE_AUTHOR("Jason Newton");
 PA_MODULE_DESCRIPTION(_("General Purpose Equalizer"));
@@ -96,29 +90,15 @@ struct userdata {
                         *effectively chooses R
                         */
     size_t R;/* the hop size between overlapping windows
-              * the latency of the filter, calculated from window_size
-              * based on constraints of COLA and window function
+              * calculated from window_size based on constraints
+              * of COLA and window function
               */
-    //for twiddling with pulseaudio
-    size_t overlap_size;//window_size-R
-    size_t samples_gathered;
-    size_t input_buffer_max;
-    //message
-    float *W;//windowing function (time domain)
-    float *work_buffer, **input, **overlap_accum;
-    fftwf_complex *output_window;
-    fftwf_plan forward_plan, inverse_plan;
-    //size_t samplings;
+    pa_stft *stft;//windowing, transforms and overlap-add
 
     float **Xs;
     float ***Hs;//thread updatable copies of the freq response filters (magnitude based)
     pa_aupdate **a_H;
     pa_memblockq *input_q;
-    char *output_buffer;
-    size_t output_buffer_length;
-    size_t output_buffer_max_length;
-    pa_memblockq *output_q;
-    bool first_iteration;
 
     pa_dbus_protocol *dbus_protocol;
     char *dbus_path;
@@ -142,7 +122,6 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
-#define v_size 4
 #define SINKLIST "equalized_sinklist"
 #define EQDB "equalizer_db"
 #define EQ_STATE_DB "equalizer-state"
@@ -208,35 +187,6 @@ static bool is_monotonic(const uint32_t *xs, size_t length) {
     return true;
 }
 
-/* ensures memory allocated is a multiple of v_size and aligned */
-static void * alloc(size_t x, size_t s) {
-    size_t f;
-    float *t;
-
-    f = PA_ROUND_UP(x*s, sizeof(float)*v_size);
-    pa_assert_se(t = fftwf_malloc(f));
-    pa_memzero(t, f);
-
-    return t;
-}
-
-static void alloc_input_buffers(struct userdata *u, size_t min_buffer_length) {
-    if (min_buffer_length <= u->input_buffer_max)
-        return;
-
-    pa_assert(min_buffer_length >= u->window_size);
-    for (size_t c = 0; c < u->channels; ++c) {
-        float *tmp = alloc(min_buffer_length, sizeof(float));
-        if (u->input[c]) {
-            if (!u->first_iteration)
-                memcpy(tmp, u->input[c], u->overlap_size * sizeof(float));
-            fftwf_free(u->input[c]);
-        }
-        u->input[c] = tmp;
-    }
-    u->input_buffer_max = min_buffer_length;
-}
-
 /* Called from I/O thread context */
 static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
@@ -244,7 +194,7 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
     switch (code) {
 
         case PA_SINK_MESSAGE_GET_LATENCY: {
-            //size_t fs=pa_frame_size(&u->sink->sample_spec);
+            size_t fs = pa_frame_size(&u->sink->sample_spec);
 
             /* The sink is _put() before the sink input is, so let's
              * make sure we don't access it in that time. Also, the
@@ -260,11 +210,9 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
                 pa_sink_get_latency_within_thread(u->sink_input->sink, true) +
 
                 /* Add the latency internal to our sink input on top */
-                pa_bytes_to_usec(pa_memblockq_get_length(u->output_q) +
+                pa_bytes_to_usec(pa_stft_get_latency(u->stft) * fs +
                                  pa_memblockq_get_length(u->input_q), &u->sink_input->sink->sample_spec) +
                 pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec);
-            //    pa_bytes_to_usec(u->samples_gathered * fs, &u->sink->sample_spec);
-            //+ pa_bytes_to_usec(u->latency * fs, ss)
             return 0;
         }
     }
@@ -364,252 +312,29 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
-#if 1
-//reference implementation
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
-    float * restrict overlap,
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
-    struct userdata *u) {
-
-    //use a linear-phase sliding STFT and overlap-add method (for each channel)
-    //window the data
-    for(size_t j = 0; j < u->window_size; ++j) {
-        dst[j] = X * W[j] * src[j];
-    }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering
-    for(size_t j = 0; j < FILTER_SIZE(u); ++j) {
-        u->output_window[j][0] *= H[j];
-        u->output_window[j][1] *= H[j];
-    }
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    u->work_buffer[j] = u->W[j] * u->input[c][j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
-    for(size_t j = 0; j < u->overlap_size; ++j) {
-        u->work_buffer[j] += overlap[j];
-        overlap[j] = dst[u->R + j];
-    }
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size;++j) {
-    //    u->work_buffer[j] = u->input[c][j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
-}
-#else
-typedef float v4sf __attribute__ ((__aligned__(v_size * sizeof(float))));
-typedef union float_vector {
-    float f[v_size];
-    v4sf v;
-    __m128 m;
-} float_vector_t;
-
-//regardless of sse enabled, the loops in here assume
-//16 byte aligned addresses and memory allocations divisible by v_size
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
-    float * restrict overlap,//The size of the overlap
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
-    struct userdata *u) {//Collection of constants
-    const size_t overlap_size = PA_ROUND_UP(u->overlap_size, v_size);
-    float_vector_t x;
-    x.f[0] = x.f[1] = x.f[2] = x.f[3] = X;
-
-    //assert(u->samples_gathered >= u->R);
-    //use a linear-phase sliding STFT and overlap-add method
-    for(size_t j = 0; j < u->window_size; j += v_size) {
-        //dst[j] = W[j] * src[j];
-        float_vector_t *d = (float_vector_t*) (dst + j);
-        float_vector_t *w = (float_vector_t*) (W + j);
-        float_vector_t *s = (float_vector_t*) (src + j);
-//#if __SSE2__
-        d->m = _mm_mul_ps(x.m, _mm_mul_ps(w->m, s->m));
-//        d->v = x->v * w->v * s->v;
-//#endif
-    }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering - purely magnitude based
-    for(size_t j = 0; j < FILTER_SIZE; j += v_size / 2) {
-        //output_window[j][0]*=H[j];
-        //output_window[j][1]*=H[j];
-        float_vector_t *d = (float_vector_t*)( ((float *) output_window) + 2 * j);
-        float_vector_t h;
-        h.f[0] = h.f[1] = H[j];
-        h.f[2] = h.f[3] = H[j + 1];
-//#if __SSE2__
-        d->m = _mm_mul_ps(d->m, h.m);
-//#else
-//        d->v = d->v * h.v;
-//#endif
-    }
-
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    dst[j] = W[j] * src[j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
-    for(size_t j = 0; j < overlap_size; j += v_size) {
-        //dst[j]+=overlap[j];
-        //overlap[j]+=dst[j+R];
-        float_vector_t *d = (float_vector_t*)(dst + j);
-        float_vector_t *o = (float_vector_t*)(overlap + j);
-//#if __SSE2__
-        d->m = _mm_add_ps(d->m, o->m);
-        o->m = ((float_vector_t*)(dst + u->R + j))->m;
-//#else
-//        d->v = d->v + o->v;
-//        o->v = ((float_vector_t*)(dst + u->R + j))->v;
-//#endif
-    }
-    //memcpy(overlap, dst+u->R, u->overlap_size * sizeof(float)); //overlap preserve (debug)
-    //zero out the bit beyond the real overlap so we don't add garbage next iteration
-    memset(overlap + u->overlap_size, 0, overlap_size - u->overlap_size);
-
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    dst[j] = src[j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
-}
-#endif
-
-static void flatten_to_memblockq(struct userdata *u) {
-    size_t mbs = pa_mempool_block_size_max(u->sink->core->mempool);
-    pa_memchunk tchunk;
-    char *dst;
-    size_t i = 0;
-    while(i < u->output_buffer_length) {
-        tchunk.index = 0;
-        tchunk.length = PA_MIN((u->output_buffer_length - i), mbs);
-        tchunk.memblock = pa_memblock_new(u->sink->core->mempool, tchunk.length);
-        //pa_log_debug("pushing %ld into the q", tchunk.length);
-        dst = pa_memblock_acquire(tchunk.memblock);
-        memcpy(dst, u->output_buffer + i, tchunk.length);
-        pa_memblock_release(tchunk.memblock);
-        pa_memblockq_push(u->output_q, &tchunk);
-        pa_memblock_unref(tchunk.memblock);
-        i += tchunk.length;
-    }
-}
-
-static void process_samples(struct userdata *u) {
-    size_t fs = pa_frame_size(&(u->sink->sample_spec));
+/* Called from I/O thread context */
+static void filter_cb(pa_stft *s, unsigned channel, float *spectrum, void *userdata) {
+    struct userdata *u = userdata;
     unsigned a_i;
     float *H, X;
-    size_t iterations, offset;
-    pa_assert(u->samples_gathered >= u->window_size);
-    iterations = (u->samples_gathered - u->overlap_size) / u->R;
-    //make sure there is enough buffer memory allocated
-    if (iterations * u->R * fs > u->output_buffer_max_length) {
-        u->output_buffer_max_length = iterations * u->R * fs;
-        pa_xfree(u->output_buffer);
-        u->output_buffer = pa_xmalloc(u->output_buffer_max_length);
-    }
-    u->output_buffer_length = iterations * u->R * fs;
-
-    for(size_t iter = 0; iter < iterations; ++iter) {
-        offset = iter * u->R * fs;
-        for(size_t c = 0;c < u->channels; c++) {
-            a_i = pa_aupdate_read_begin(u->a_H[c]);
-            X = u->Xs[c][a_i];
-            H = u->Hs[c][a_i];
-            dsp_logic(
-                u->work_buffer,
-                u->input[c],
-                u->overlap_accum[c],
-                X,
-                H,
-                u->W,
-                u->output_window,
-                u
-            );
-            pa_aupdate_read_end(u->a_H[c]);
-            if (u->first_iteration) {
-                /* The windowing function will make the audio ramped in, as a cheap fix we can
-                 * undo the windowing (for non-zero window values)
-                 */
-                for(size_t i = 0; i < u->overlap_size; ++i) {
-                    u->work_buffer[i] = u->W[i] <= FLT_EPSILON ? u->work_buffer[i] : u->work_buffer[i] / u->W[i];
-                }
-            }
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, u->work_buffer, sizeof(float), u->R);
-        }
-        if (u->first_iteration) {
-            u->first_iteration = false;
-        }
-        u->samples_gathered -= u->R;
-    }
-    flatten_to_memblockq(u);
-}
 
-static void input_buffer(struct userdata *u, pa_memchunk *in) {
-    size_t fs = pa_frame_size(&(u->sink->sample_spec));
-    size_t samples = in->length/fs;
-    float *src = pa_memblock_acquire_chunk(in);
-    pa_assert(u->samples_gathered + samples <= u->input_buffer_max);
-    for(size_t c = 0; c < u->channels; c++) {
-        //buffer with an offset after the overlap from previous
-        //iterations
-        pa_assert_se(
-            u->input[c] + u->samples_gathered + samples <= u->input[c] + u->input_buffer_max
-        );
-        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c] + u->samples_gathered, sizeof(float), src + c, fs, samples);
-    }
-    u->samples_gathered += samples;
-    pa_memblock_release(in->memblock);
+    /* H already has the fft gain divided out, see fix_filter() */
+    a_i = pa_aupdate_read_begin(u->a_H[channel]);
+    X = u->Xs[channel][a_i];
+    H = u->Hs[channel][a_i];
+    for (size_t j = 0; j < FILTER_SIZE(u); ++j) {
+        spectrum[2 * j] *= X * H[j];
+        spectrum[2 * j + 1] *= X * H[j];
+    }
+    pa_aupdate_read_end(u->a_H[channel]);
 }
 
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
-    size_t fs, target_samples;
-    size_t mbs;
-    //struct timeval start, end;
+    size_t fs, mbs;
     pa_memchunk tchunk;
+    float *src, *dst;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
@@ -619,81 +344,42 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     if (!PA_SINK_IS_LINKED(u->sink->thread_info.state))
         return -1;
 
-    /* FIXME: Please clean this up. I see more commented code lines
-     * than uncommented code lines. I am sorry, but I am too dumb to
-     * understand this. */
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
 
     fs = pa_frame_size(&(u->sink->sample_spec));
     mbs = pa_mempool_block_size_max(u->sink->core->mempool);
-    if (pa_memblockq_get_length(u->output_q) > 0) {
-        //pa_log_debug("qsize is %ld", pa_memblockq_get_length(u->output_q));
-        goto END;
-    }
-    //nbytes = PA_MIN(nbytes, pa_mempool_block_size_max(u->sink->core->mempool));
-    target_samples = PA_ROUND_UP(nbytes / fs, u->R);
-    ////pa_log_debug("vanilla mbs = %ld",mbs);
-    //mbs = PA_ROUND_DOWN(mbs / fs, u->R);
-    //mbs = PA_MAX(mbs, u->R);
-    //target_samples = PA_MAX(target_samples, mbs);
-    //pa_log_debug("target samples: %ld", target_samples);
-    if (u->first_iteration) {
-        //allocate request_size
-        target_samples = PA_MAX(target_samples, u->window_size);
-    }else{
-        //allocate request_size + overlap
-        target_samples += u->overlap_size;
+
+    while (pa_memblockq_peek(u->input_q, &tchunk) < 0) {
+        pa_memchunk nchunk;
+
+        pa_sink_render_full(u->sink, PA_MIN(nbytes, mbs), &nchunk);
+        pa_memblockq_push(u->input_q, &nchunk);
+        pa_memblock_unref(nchunk.memblock);
     }
-    alloc_input_buffers(u, target_samples);
-    //pa_log_debug("post target samples: %ld", target_samples);
-    chunk->memblock = NULL;
 
-    /* Hmm, process any rewind request that might be queued up */
-    pa_sink_process_rewind(u->sink, 0);
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    pa_assert(tchunk.length > 0);
+
+    chunk->index = 0;
+    chunk->length = tchunk.length;
+    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
+
+    pa_memblockq_drop(u->input_q, chunk->length);
+
+    /* The STFT keeps its own history and hop state, so any request size
+     * works and there is no need to gather whole hops first */
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    pa_stft_process(u->stft, src, dst, chunk->length / fs);
+    pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst, sizeof(float), dst, sizeof(float), chunk->length / sizeof(float));
+
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_release(chunk->memblock);
+
+    pa_memblock_unref(tchunk.memblock);
 
-    //pa_log_debug("start output-buffered %ld, input-buffered %ld, requested %ld",buffered_samples,u->samples_gathered,samples_requested);
-    //pa_rtclock_get(&start);
-    do{
-        size_t input_remaining = target_samples - u->samples_gathered;
-       // pa_log_debug("input remaining %ld samples", input_remaining);
-        pa_assert(input_remaining > 0);
-        while (pa_memblockq_peek(u->input_q, &tchunk) < 0) {
-            //pa_sink_render(u->sink, input_remaining * fs, &tchunk);
-            pa_sink_render_full(u->sink, PA_MIN(input_remaining * fs, mbs), &tchunk);
-            pa_memblockq_push(u->input_q, &tchunk);
-            pa_memblock_unref(tchunk.memblock);
-        }
-        pa_assert(tchunk.memblock);
-
-        tchunk.length = PA_MIN(input_remaining * fs, tchunk.length);
-
-        pa_memblockq_drop(u->input_q, tchunk.length);
-        //pa_log_debug("asked for %ld input samples, got %ld samples",input_remaining,buffer->length/fs);
-        /* copy new input */
-        //pa_rtclock_get(start);
-       // pa_log_debug("buffering %ld bytes", tchunk.length);
-        input_buffer(u, &tchunk);
-        //pa_rtclock_get(&end);
-        //pa_log_debug("Took %0.5f seconds to setup", pa_timeval_diff(end, start) / (double) PA_USEC_PER_SEC);
-        pa_memblock_unref(tchunk.memblock);
-    } while(u->samples_gathered < target_samples);
-
-    //pa_rtclock_get(&end);
-    //pa_log_debug("Took %0.6f seconds to get data", (double) pa_timeval_diff(&end, &start) / PA_USEC_PER_SEC);
-
-    pa_assert(u->fft_size >= u->window_size);
-    pa_assert(u->R < u->window_size);
-    //pa_rtclock_get(&start);
-    /* process a block */
-    process_samples(u);
-    //pa_rtclock_get(&end);
-    //pa_log_debug("Took %0.6f seconds to process", (double) pa_timeval_diff(&end, &start) / PA_USEC_PER_SEC);
-END:
-    pa_assert_se(pa_memblockq_peek(u->output_q, chunk) >= 0);
-    pa_assert(chunk->memblock);
-    pa_memblockq_drop(u->output_q, chunk->length);
-
-    //pa_log_debug("gave %ld", chunk->length/fs);
-    //pa_log_debug("end pop");
     return 0;
 }
 
@@ -717,24 +403,6 @@ static void sink_input_mute_changed_cb(pa_sink_input *i) {
     pa_sink_mute_changed(u->sink, i->muted);
 }
 
-#if 0
-static void reset_filter(struct userdata *u) {
-    size_t fs = pa_frame_size(&u->sink->sample_spec);
-    size_t max_request;
-
-    u->samples_gathered = 0;
-
-    for(size_t i = 0; i < u->channels; ++i)
-        pa_memzero(u->overlap_accum[i], u->overlap_size * sizeof(float));
-
-    u->first_iteration = true;
-    //set buffer size to max request, no overlap copy
-    max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs , u->R);
-    max_request = PA_MAX(max_request, u->window_size);
-    pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
-}
-#endif
-
 /* Called from I/O thread context */
 static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     struct userdata *u;
@@ -760,13 +428,14 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
         if (amount > 0) {
             //invalidate the output q
             pa_memblockq_seek(u->input_q, - (int64_t) amount, PA_SEEK_RELATIVE, true);
-            pa_log("Resetting filter");
-            //reset_filter(u); //this is the "proper" thing to do...
         }
     }
 
     pa_sink_process_rewind(u->sink, amount);
     pa_memblockq_rewind(u->input_q, nbytes);
+
+    /* Rebuilds the filter state from the kept input history */
+    pa_stft_rewind(u->stft, nbytes / pa_frame_size(&i->sample_spec));
 }
 
 /* Called from I/O thread context */
@@ -779,19 +448,18 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
     pa_memblockq_set_maxrewind(u->input_q, nbytes);
+    pa_stft_set_max_rewind(u->stft, nbytes / pa_frame_size(&i->sample_spec));
     pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
 }
 
 /* Called from I/O thread context */
 static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     struct userdata *u;
-    size_t fs;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
 
-    fs = pa_frame_size(&u->sink_input->sample_spec);
-    pa_sink_set_max_request_within_thread(u->sink, PA_ROUND_UP(nbytes / fs, u->R) * fs);
+    pa_sink_set_max_request_within_thread(u->sink, nbytes);
 }
 
 /* Called from I/O thread context */
@@ -830,7 +498,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
 /* Called from I/O thread context */
 static void sink_input_attach_cb(pa_sink_input *i) {
     struct userdata *u;
-    size_t fs, max_request;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
@@ -839,12 +506,7 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
     pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
 
-    fs = pa_frame_size(&u->sink_input->sample_spec);
-    /* set buffer size to max request, no overlap copy */
-    max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
-    max_request = PA_MAX(max_request, u->window_size);
-
-    pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
+    pa_sink_set_max_request_within_thread(u->sink, pa_sink_input_get_max_request(i));
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
@@ -1108,9 +770,9 @@ int pa__init(pa_module*m) {
     pa_sink *master;
     pa_sink_input_new_data sink_input_data;
     pa_sink_new_data sink_data;
-    size_t i;
+    size_t i, max_rewind;
     unsigned c;
-    float *H;
+    float *H, *W;
     unsigned a_i;
     bool use_volume_sharing = true;
 
@@ -1156,9 +818,6 @@ int pa__init(pa_module*m) {
     if (u->window_size % 2 == 0)
         u->window_size--;
     u->R = (u->window_size + 1) / 2;
-    u->overlap_size = u->window_size - u->R;
-    u->samples_gathered = 0;
-    u->input_buffer_max = 0;
 
     u->a_H = pa_xnew0(pa_aupdate *, u->channels);
     u->Xs = pa_xnew0(float *, u->channels);
@@ -1168,24 +827,24 @@ int pa__init(pa_module*m) {
         u->Xs[c] = pa_xnew0(float, 2);
         u->Hs[c] = pa_xnew0(float *, 2);
         for (i = 0; i < 2; ++i)
-            u->Hs[c][i] = alloc(FILTER_SIZE(u), sizeof(float));
+            u->Hs[c][i] = pa_fft_alloc(FILTER_SIZE(u));
     }
 
-    u->W = alloc(u->window_size, sizeof(float));
-    u->work_buffer = alloc(u->fft_size, sizeof(float));
-    u->input = pa_xnew0(float *, u->channels);
-    u->overlap_accum = pa_xnew0(float *, u->channels);
-    for (c = 0; c < u->channels; ++c) {
+    for (c = 0; c < u->channels; ++c)
         u->a_H[c] = pa_aupdate_new();
-        u->input[c] = NULL;
-        u->overlap_accum[c] = alloc(u->overlap_size, sizeof(float));
-    }
-    u->output_window = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
-    u->forward_plan = fftwf_plan_dft_r2c_1d(u->fft_size, u->work_buffer, u->output_window, FFTW_ESTIMATE);
-    u->inverse_plan = fftwf_plan_dft_c2r_1d(u->fft_size, u->output_window, u->work_buffer, FFTW_ESTIMATE);
 
-    hanning_window(u->W, u->window_size);
-    u->first_iteration = true;
+    W = pa_xnew(float, u->window_size);
+    hanning_window(W, u->window_size);
+    /* Sized for what the master can rewind now, so that the IO thread
+     * normally never has to grow it */
+    max_rewind = pa_usec_to_bytes(pa_bytes_to_usec(pa_sink_get_max_rewind(master), &master->sample_spec), &ss);
+    u->stft = pa_stft_new(u->channels, u->fft_size, W, u->window_size, u->R, max_rewind / pa_frame_size(&ss), filter_cb, u);
+    pa_xfree(W);
+
+    if (!u->stft) {
+        pa_log("Failed to create FFT plans.");
+        goto fail;
+    }
 
     u->base_profiles = pa_xnew0(char *, u->channels);
     for (c = 0; c < u->channels; ++c)
@@ -1246,10 +905,6 @@ int pa__init(pa_module*m) {
     u->sink->userdata = u;
 
     u->input_q = pa_memblockq_new("module-equalizer-sink input_q", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, &u->sink->silence);
-    u->output_q = pa_memblockq_new("module-equalizer-sink output_q", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, NULL);
-    u->output_buffer = NULL;
-    u->output_buffer_length = 0;
-    u->output_buffer_max_length = 0;
 
     pa_sink_set_asyncmsgq(u->sink, master->asyncmsgq);
     //pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->R*fs, &ss));
@@ -1371,29 +1026,20 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    pa_xfree(u->output_buffer);
-    pa_memblockq_free(u->output_q);
-    pa_memblockq_free(u->input_q);
+    if (u->input_q)
+        pa_memblockq_free(u->input_q);
+
+    if (u->stft)
+        pa_stft_free(u->stft);
 
-    fftwf_destroy_plan(u->inverse_plan);
-    fftwf_destroy_plan(u->forward_plan);
-    fftwf_free(u->output_window);
     for (c = 0; c < u->channels; ++c) {
         pa_aupdate_free(u->a_H[c]);
-        fftwf_free(u->overlap_accum[c]);
-        fftwf_free(u->input[c]);
-    }
-    pa_xfree(u->a_H);
-    pa_xfree(u->overlap_accum);
-    pa_xfree(u->input);
-    fftwf_free(u->work_buffer);
-    fftwf_free(u->W);
-    for (c = 0; c < u->channels; ++c) {
         pa_xfree(u->Xs[c]);
         for (size_t i = 0; i < 2; ++i)
-            fftwf_free(u->Hs[c][i]);
-        fftwf_free(u->Hs[c]);
+            pa_fft_free(u->Hs[c][i]);
+        pa_xfree(u->Hs[c]);
     }
+    pa_xfree(u->a_H);
     pa_xfree(u->Xs);
     pa_xfree(u->Hs);
 
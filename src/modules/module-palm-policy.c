@@ -148,6 +148,8 @@ struct sourceoutputnode
     PA_LLIST_FIELDS(struct sourceoutputnode); /* fields that use a pulse defined linked list */
 };
 
+struct device_load;
+
 typedef struct deviceInfo
 {
     int index;
@@ -156,6 +158,7 @@ typedef struct deviceInfo
     char cardName[SINK_NAME_LENGTH];
     char *cardNameDetail;
     pa_module *alsaModule;
+    struct device_load *pendingLoad; /* alsa module load in progress */
 } deviceInfo;
 
 typedef struct multipleDeviceInfo
@@ -276,9 +279,28 @@ struct userdata
     multipleDeviceInfo *internalOutputDeviceInfo;
     multipleDeviceInfo *internalInputDeviceInfo;
 
+    /* device modules being loaded in the background */
+    PA_LLIST_HEAD(struct device_load, deviceLoads);
+    struct device_load *btDiscoverLoad;
+
     pa_palm_policy *palm_policy;
 };
 
+/* A device module load running off the main loop, audiod gets its reply
+ * once the module is up (or failed to load)
+ */
+struct device_load
+{
+    struct userdata *u;
+    pa_module_load_request *request;
+    deviceInfo *device; /* NULL for module-bluetooth-discover */
+    bool isOutput;
+    bool isUsb;
+    int msgID; /* -1 if audiod doesn't wait for a reply */
+
+    PA_LLIST_FIELDS(struct device_load);
+};
+
 static bool virtual_source_output_move_inputdevice(int virtualsourceid, char *inputdevice, struct userdata *u);
 
 static bool virtual_source_set_mute(int sourceid, int mute, struct userdata *u);
@@ -385,7 +407,9 @@ static bool set_default_sink_routing(struct userdata *u, int startsinkid, int en
 
 static bool set_default_source_routing(struct userdata *u, int startsourceid, int endsourceid);
 
-bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int deviceNumber, bool status);
+bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int deviceNumber, bool status, int msgID);
+
+void send_callback_to_audiod(int id, int returnVal, struct userdata *u);
 
 PA_MODULE_AUTHOR("Palm, Inc.");
 PA_MODULE_DESCRIPTION("Implements policy, communication with external app is a socket at /tmp/palmaudio");
@@ -418,6 +442,7 @@ bool initialise_internal_card(struct userdata *u, int maxDeviceCount, int isOutp
         deviceList->cardNumber = -1;
         deviceList->deviceNumber = -1;
         deviceList->alsaModule = NULL;
+        deviceList->pendingLoad = NULL;
     }
     return true;
 }
@@ -446,9 +471,9 @@ bool init_multiple_usb_device_info(struct userdata *u, bool isOutput, int maxDev
             // Unload the previously connected device.
             deviceInfo *deviceList = (mdi->deviceList + i);
             pa_log_debug("%s, index:%d, cardNumber:%d, deviceNumber:%d, alsaModule:%d", __FUNCTION__, deviceList->index, deviceList->cardNumber, deviceList->deviceNumber, deviceList->alsaModule ? 1 : 0);
-            if (deviceList->alsaModule)
+            if (deviceList->alsaModule || deviceList->pendingLoad)
             {
-                detect_usb_device(u, isOutput, deviceList->cardNumber, deviceList->deviceNumber, false);
+                detect_usb_device(u, isOutput, deviceList->cardNumber, deviceList->deviceNumber, false, -1);
             }
         }
         pa_xfree(mdi->deviceList);
@@ -478,6 +503,7 @@ bool init_multiple_usb_device_info(struct userdata *u, bool isOutput, int maxDev
         deviceList->cardNumber = -1;
         deviceList->deviceNumber = -1;
         deviceList->alsaModule = NULL;
+        deviceList->pendingLoad = NULL;
     }
     return true;
 }
@@ -490,7 +516,7 @@ int get_usb_device_index(multipleDeviceInfo *mdi, int cardNumber, int deviceNumb
     for (int i = 0; i < mdi->maxDeviceCount; i++)
     {
         deviceInfo *deviceList = (mdi->deviceList + i);
-        if (deviceList->alsaModule != NULL &&
+        if ((deviceList->alsaModule != NULL || deviceList->pendingLoad != NULL) &&
             deviceList->cardNumber == cardNumber && deviceList->deviceNumber == deviceNumber)
         {
             pa_log_debug("%s, return index(%d) for cardNumber(%d), deviceNumber(%d)", __FUNCTION__, deviceList->index, cardNumber, deviceNumber);
@@ -516,7 +542,7 @@ int get_new_usb_device_index(multipleDeviceInfo *mdi, int cardNumber, int device
     for (int i = 0; i < mdi->maxDeviceCount; i++)
     {
         deviceInfo *deviceList = (mdi->deviceList + i);
-        if (deviceList->alsaModule == NULL)
+        if (deviceList->alsaModule == NULL && deviceList->pendingLoad == NULL)
         {
             pa_log_debug("%s, return index(%d) for cardNumber(%d), deviceNumber(%d)", __FUNCTION__, deviceList->index, cardNumber, deviceNumber);
             return deviceList->index;
@@ -559,18 +585,148 @@ void print_device_info(bool isOutput, multipleDeviceInfo *mdi)
     }
 }
 
-bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int deviceNumber, bool status)
+static void device_load_finish(struct device_load *l, pa_module *m)
+{
+    struct userdata *u = l->u;
+    deviceInfo *deviceList = l->device;
+
+    pa_assert(deviceList);
+
+    deviceList->pendingLoad = NULL;
+
+    if (!m)
+    {
+        deviceList->cardNumber = -1;
+        deviceList->deviceNumber = -1;
+        deviceList->cardNameDetail = NULL;
+        return;
+    }
+
+    deviceList->alsaModule = m;
+    snd_card_get_name(deviceList->cardNumber, &(deviceList->cardNameDetail));
+
+    if (l->isUsb)
+    {
+        multipleDeviceInfo *mdi = l->isOutput ? u->usbOutputDeviceInfo : u->usbInputDeviceInfo;
+
+        pa_log_info("USB %s:%s", deviceList->cardName, deviceList->cardNameDetail);
+        pa_log_info("%s, usb device module is loaded with index %u", __FUNCTION__, m->index);
+        print_device_info(l->isOutput, mdi);
+    }
+    else
+    {
+        pa_log_info("module-alsa-%s loaded for %s", l->isOutput ? "sink" : "source", deviceList->cardName);
+        pa_log_info("%d %d %d %s %s", deviceList->cardNumber, deviceList->deviceNumber, deviceList->index, deviceList->cardName, deviceList->cardNameDetail);
+
+        if (l->isOutput)
+        {
+            u->isPcmOutputConnected = true;
+            u->isPcmHeadphoneConnected = true;
+        }
+    }
+}
+
+static void bt_discover_load_finish(struct device_load *l, pa_module *m)
+{
+    struct userdata *u = l->u;
+
+    u->btDiscoverLoad = NULL;
+    u->btDiscoverModule = m;
+
+    if (NULL == u->btDiscoverModule)
+        pa_log_info("%s :module-bluetooth-discover loading failed", __FUNCTION__);
+    else
+        pa_log_info("%s :module-bluetooth-discover loaded", __FUNCTION__);
+}
+
+static void device_load_free(struct device_load *l)
+{
+    PA_LLIST_REMOVE(struct device_load, l->u->deviceLoads, l);
+    pa_xfree(l);
+}
+
+static void device_load_cb(pa_module *m, int error, void *userdata)
+{
+    struct device_load *l = userdata;
+
+    pa_assert(l);
+
+    if (!m && l->device)
+        pa_log("Error loading alsa %s module for hw:%d,%d", l->isOutput ? "sink" : "source",
+               l->device->cardNumber, l->device->deviceNumber);
+
+    if (l->device)
+        device_load_finish(l, m);
+    else
+        bt_discover_load_finish(l, m);
+
+    if (l->msgID != -1)
+        send_callback_to_audiod(l->msgID, m != NULL, l->u);
+
+    device_load_free(l);
+}
+
+/* Start loading a device module in the background. Returns false if the
+ * load couldn't be started, the caller has to reply to audiod then.
+ */
+static bool device_load_start(struct userdata *u, deviceInfo *device, bool isOutput, bool isUsb,
+                              const char *name, const char *args, int msgID)
+{
+    struct device_load *l = pa_xnew0(struct device_load, 1);
+
+    l->u = u;
+    l->device = device;
+    l->isOutput = isOutput;
+    l->isUsb = isUsb;
+    l->msgID = msgID;
+
+    if (pa_module_load_async(&l->request, u->core, name, args, device_load_cb, l) < 0)
+    {
+        pa_log("Failed to start loading %s", name);
+        pa_xfree(l);
+        return false;
+    }
+
+    PA_LLIST_PREPEND(struct device_load, u->deviceLoads, l);
+
+    if (device)
+        device->pendingLoad = l;
+    else
+        u->btDiscoverLoad = l;
+
+    return true;
+}
+
+static void device_load_cancel(struct device_load *l)
+{
+    pa_assert(l);
+
+    pa_module_load_request_cancel(l->request);
+
+    if (l->device)
+        device_load_finish(l, NULL);
+    else
+        l->u->btDiscoverLoad = NULL;
+
+    if (l->msgID != -1)
+        send_callback_to_audiod(l->msgID, false, l->u);
+
+    device_load_free(l);
+}
+
+bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int deviceNumber, bool status, int msgID)
 {
     pa_assert(u);
     pa_assert(u->usbOutputDeviceInfo);
     pa_assert(u->usbInputDeviceInfo);
 
     multipleDeviceInfo *mdi = isOutput ? u->usbOutputDeviceInfo : u->usbInputDeviceInfo;
+    bool ret = false;
 
     if (!check_multiple_usb_device_info_initialization(mdi))
     {
         pa_log_warn("%s, Haven't initialized the usb device yet", __FUNCTION__);
-        return false;
+        goto reply;
     }
 
     int index;
@@ -580,7 +736,7 @@ bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int de
         if (index == -1 || index >= mdi->maxDeviceCount)
         {
             pa_log_warn("%s, There is no avaliable usb device index", __FUNCTION__);
-            return false;
+            goto reply;
         }
 
         char *args = NULL;
@@ -591,23 +747,25 @@ bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int de
         {
             pa_log_debug("%s, args:%s", __FUNCTION__, args);
             deviceInfo *deviceList = mdi->deviceList + index;
-            // load module
-            pa_module_load(&deviceList->alsaModule, u->core, isOutput ? MODULE_ALSA_SINK_NAME : MODULE_ALSA_SOURCE_NAME, args);
-            if (deviceList->alsaModule)
-            {
-                deviceList->cardNumber = cardNumber;
-                deviceList->deviceNumber = deviceNumber;
-                sprintf(deviceList->cardName, "%s%d", mdi->baseName, (index));
-                snd_card_get_name(cardNumber, &(deviceList->cardNameDetail));
-                pa_log_info("USB %s:%s", deviceList->cardName, deviceList->cardNameDetail);
-                pa_log_info("%s, usb device module is loaded with index %u", __FUNCTION__, deviceList->alsaModule->index);
-            }
+            deviceList->cardNumber = cardNumber;
+            deviceList->deviceNumber = deviceNumber;
+            deviceList->cardNameDetail = NULL;
+            sprintf(deviceList->cardName, "%s%d", mdi->baseName, (index));
+            // load module, audiod gets the reply once it is loaded
+            ret = device_load_start(u, deviceList, isOutput, true,
+                                    isOutput ? MODULE_ALSA_SINK_NAME : MODULE_ALSA_SOURCE_NAME, args, msgID);
             pa_xfree(args);
+            if (ret)
+                return true;
+
+            deviceList->cardNumber = -1;
+            deviceList->deviceNumber = -1;
         }
         else
         {
             pa_log_warn("%s, Failed to load the device due to an internal error", __FUNCTION__);
         }
+        goto reply;
     }
     else
     {
@@ -615,10 +773,16 @@ bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int de
         if (index == -1 || index >= mdi->maxDeviceCount)
         {
             pa_log_warn("%s, There is no connected usb device for cardNumber(%d), deviceNumber(%d)", __FUNCTION__, cardNumber, deviceNumber);
-            return false;
+            goto reply;
         }
 
         deviceInfo *deviceList = mdi->deviceList + index;
+        if (deviceList->pendingLoad)
+        {
+            // unplugged before the module finished loading
+            device_load_cancel(deviceList->pendingLoad);
+            pa_log_info("%s, usb device module load is cancelled", __FUNCTION__);
+        }
         if (deviceList->alsaModule)
         {
             // unload module
@@ -631,7 +795,12 @@ bool detect_usb_device(struct userdata *u, bool isOutput, int cardNumber, int de
         }
     }
     print_device_info(isOutput, mdi);
-    return true;
+    ret = true;
+
+reply:
+    if (msgID != -1)
+        send_callback_to_audiod(msgID, ret, u);
+    return ret;
 }
 
 char *get_device_name_from_detail(char *deviceDetail, struct userdata *u, bool isOutput)
@@ -759,11 +928,11 @@ void find_and_load_usb_devices(struct userdata *u, char *deviceName, snd_pcm_str
                 pa_log_debug("%s, found %s pcm device(%s), carNumber:%d, deviceNumber:%d", __FUNCTION__, snd_pcm_stream_name(stream), deviceName, card, dev);
                 if (stream == SND_PCM_STREAM_PLAYBACK)
                 {
-                    detect_usb_device(u, true, card, dev, true);
+                    detect_usb_device(u, true, card, dev, true, -1);
                 }
                 else if (stream == SND_PCM_STREAM_CAPTURE)
                 {
-                    detect_usb_device(u, false, card, dev, true);
+                    detect_usb_device(u, false, card, dev, true, -1);
                 }
             }
         }
@@ -1818,12 +1987,16 @@ void send_rtp_connection_data_to_audiod(char *ip, char *port, struct userdata *u
         pa_log("Message sent to audiod");
 }
 
-static bool load_Bluetooth_module(struct userdata *u)
+static bool load_Bluetooth_module(struct userdata *u, int msgID)
 {
     u->IsBluetoothEnabled = true;
-    if (NULL == u->btDiscoverModule)
+    if (NULL == u->btDiscoverModule && NULL == u->btDiscoverLoad)
     {
-        pa_module_load(&u->btDiscoverModule, u->core, "module-bluetooth-discover", NULL);
+        // audiod gets the reply once module-bluetooth-discover is loaded
+        if (device_load_start(u, NULL, true, false, "module-bluetooth-discover", NULL, msgID))
+            msgID = -1;
+        else
+            pa_log_info("%s :module-bluetooth-discover loading failed", __FUNCTION__);
         char physicalSinkBT[BLUETOOTH_SINK_NAME_SIZE];
         char btSinkInit[BLUETOOTH_SINK_INIT_SIZE] = "bluez_sink.";
         btSinkInit[BLUETOOTH_SINK_INIT_SIZE - 1] = '\0';
@@ -1846,19 +2019,22 @@ static bool load_Bluetooth_module(struct userdata *u)
                 physicalSinkBT[index] = '_';
         }
         strncpy(u->physicalSinkBT, physicalSinkBT, sizeof(physicalSinkBT) - 1);
-        if (NULL == u->btDiscoverModule)
-            pa_log_info("%s :module-bluetooth-discover loading failed", __FUNCTION__);
-        else
-            pa_log_info("%s :module-bluetooth-discover loaded", __FUNCTION__);
     }
     else
         pa_log_info("%s :module-bluetooth-discover already loaded", __FUNCTION__);
+    if (msgID != -1)
+        send_callback_to_audiod(msgID, true, u);
     return true;
 }
 
 static bool unload_BlueTooth_module(struct userdata *u)
 {
     u->IsBluetoothEnabled = false;
+    if (u->btDiscoverLoad)
+    {
+        pa_log_info("%s : cancelling BT module load", __FUNCTION__);
+        device_load_cancel(u->btDiscoverLoad);
+    }
     if (u->btDiscoverModule)
     {
         pa_log_info("%s : going to unload BT module ", __FUNCTION__);
@@ -1872,14 +2048,16 @@ static bool unload_BlueTooth_module(struct userdata *u)
     return true;
 }
 
-static bool load_lineout_alsa_sink(struct userdata *u, int soundcardNo, int deviceNo, int status, int isOutput)
+static bool load_lineout_alsa_sink(struct userdata *u, int soundcardNo, int deviceNo, int status, int isOutput, int msgID)
 {
     pa_assert(u);
     int sink = 0;
     char *args = NULL;
+    bool ret = true;
     /* Request for lineout loading
-     * Load Alsa Sink Module
-     * Send Error To AudioD in case Alsa sink Load fails
+     * Load Alsa Sink Module in the background
+     * Send the result to AudioD once the load completes, or right
+     * away if it can't be started
      */
     pa_log("[alsa sink loading begins for lineout] [AudioD sent] cardno = %d playback device number = %d deviceName = %s",
            soundcardNo, deviceNo, u->deviceName);
@@ -1890,33 +2068,31 @@ static bool load_lineout_alsa_sink(struct userdata *u, int soundcardNo, int devi
         for (int i = 0; i < mdi->maxDeviceCount; i++)
         {
             deviceInfo *deviceList = (mdi->deviceList + i);
-            if (deviceList->alsaModule == NULL)
+            if (deviceList->alsaModule == NULL && deviceList->pendingLoad == NULL)
             {
                 char *args = NULL;
                 deviceList->cardNumber = soundcardNo;
                 deviceList->deviceNumber = deviceNo;
+                deviceList->cardNameDetail = NULL;
                 deviceList->index = i;
                 pa_log("%s, %s,%s,%d", __FUNCTION__, u->deviceName, deviceList->cardName, strlen(u->deviceName));
                 strncpy(deviceList->cardName, u->deviceName, SINK_NAME_LENGTH);
-                snd_card_get_name(soundcardNo, &(deviceList->cardNameDetail));
-                pa_log_info("lineout %s:%s - %d", deviceList->cardName, deviceList->cardNameDetail, strlen(deviceList->cardName));
+                pa_log_info("lineout %s - %d", deviceList->cardName, strlen(deviceList->cardName));
 
                 args = pa_sprintf_malloc("device=hw:%d,%d mmap=0 sink_name=%s fragment_size=4096 tsched=0", soundcardNo, deviceNo, u->deviceName);
-                pa_module_load(&deviceList->alsaModule, u->core, "module-alsa-sink", args);
+                ret = device_load_start(u, deviceList, true, false, "module-alsa-sink", args, msgID);
                 if (args)
                     pa_xfree(args);
-                if (!deviceList->alsaModule)
+                if (!ret)
                 {
                     pa_log("Error loading in module-alsa-sink for %s", u->deviceName);
-                    return false;
+                    deviceList->cardNumber = -1;
+                    deviceList->deviceNumber = -1;
+                    break;
                 }
 
-                pa_log_info("module-alsa-sink loaded for %s", u->deviceName);
-                pa_log_info("%d %d %d %s %s", deviceList->cardNumber, deviceList->deviceNumber, deviceList->index, deviceList->cardName, deviceList->cardNameDetail);
-
-                u->isPcmOutputConnected = true;
-                u->isPcmHeadphoneConnected = true;
-
+                // audiod gets the reply once the sink is up
+                msgID = -1;
                 break;
             }
             else
@@ -1931,28 +2107,31 @@ static bool load_lineout_alsa_sink(struct userdata *u, int soundcardNo, int devi
         for (int i = 0; i < mdi->maxDeviceCount; i++)
         {
             deviceInfo *deviceList = (mdi->deviceList + i);
-            if (deviceList->alsaModule == NULL)
+            if (deviceList->alsaModule == NULL && deviceList->pendingLoad == NULL)
             {
                 char *args = NULL;
                 deviceList->cardNumber = soundcardNo;
                 deviceList->deviceNumber = deviceNo;
+                deviceList->cardNameDetail = NULL;
                 strncpy(deviceList->cardName, u->deviceName, SINK_NAME_LENGTH);
 
-                snd_card_get_name(soundcardNo, &(deviceList->cardNameDetail));
-                pa_log_info("linein %s", deviceList->cardNameDetail);
+                pa_log_info("linein %s", deviceList->cardName);
 
                 args = pa_sprintf_malloc("device=hw:%d,%d mmap=0 source_name=%s fragment_size=4096 tsched=0",
                                          soundcardNo, deviceNo, u->deviceName);
-                pa_module_load(&deviceList->alsaModule, u->core, "module-alsa-source", args);
+                ret = device_load_start(u, deviceList, false, false, "module-alsa-source", args, msgID);
                 if (args)
                     pa_xfree(args);
-                if (!deviceList->alsaModule)
+                if (!ret)
                 {
                     pa_log("Error loading in module-alsa-source for %s", u->deviceName);
-                    return false;
+                    deviceList->cardNumber = -1;
+                    deviceList->deviceNumber = -1;
+                    break;
                 }
-                pa_log_info("module-alsa-source loaded for %s", u->deviceName);
-                pa_log_info("%d %d %d %s %s", deviceList->cardNumber, deviceList->deviceNumber, deviceList->index, deviceList->cardName, deviceList->cardNameDetail);
+
+                // audiod gets the reply once the source is up
+                msgID = -1;
                 break;
             }
         }
@@ -1975,7 +2154,9 @@ static bool load_lineout_alsa_sink(struct userdata *u, int soundcardNo, int devi
             pa_log_debug("%d %d %d %s %s", deviceList->cardNumber, deviceList->deviceNumber, deviceList->index, deviceList->cardName, deviceList->cardNameDetail);
         }
     }
-    return true;
+    if (msgID != -1)
+        send_callback_to_audiod(msgID, ret, u);
+    return ret;
 }
 
 static bool set_audio_effect(struct userdata *u, const char* effect, int enabled)
@@ -2485,8 +2666,7 @@ static void parse_message(char *msgbuf, int bufsize, struct userdata *u)
                         SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status, SndHdr->isOutput, u->deviceName);
             if (1 == SndHdr->status)
             {
-                ret = load_lineout_alsa_sink(u, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status, SndHdr->isOutput);
-                send_callback_to_audiod(msgHdr->msgID, ret, u);
+                load_lineout_alsa_sink(u, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status, SndHdr->isOutput, msgHdr->msgID);
             }
         }
         break;
@@ -2502,8 +2682,7 @@ static void parse_message(char *msgbuf, int bufsize, struct userdata *u)
         {
             // 'z'
             pa_log_info("received usb headset routing cmd from Audiod");
-            ret = detect_usb_device(u, true, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status);
-            send_callback_to_audiod(msgHdr->msgID, ret, u);
+            detect_usb_device(u, true, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status, msgHdr->msgID);
         }
         break;
         case PAUDIOD_DEVICE_LOAD_USB_MULTIPLE_DEVICE:
@@ -2521,8 +2700,7 @@ static void parse_message(char *msgbuf, int bufsize, struct userdata *u)
         {
             //'j'
             pa_log_info("received mic recording cmd from Audiod");
-            ret = detect_usb_device(u, false, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status);
-            send_callback_to_audiod(msgHdr->msgID, ret, u);
+            detect_usb_device(u, false, SndHdr->cardNo, SndHdr->deviceNo, SndHdr->status, msgHdr->msgID);
         }
         break;
         default:
@@ -2571,8 +2749,7 @@ static void parse_message(char *msgbuf, int bufsize, struct userdata *u)
              * their output sink */
             strncpy(u->address, SndHdr->address, BLUETOOTH_MAC_ADDRESS_SIZE);
             pa_log_info("Bluetooth connected address %s", u->address);
-            ret = load_Bluetooth_module(u);
-            send_callback_to_audiod(msgHdr->msgID, ret, u);
+            load_Bluetooth_module(u, msgHdr->msgID);
         }
         break;
         case PAUDIOD_MODULE_BLUETOOTH_A2DPSOURCE:
@@ -3094,6 +3271,8 @@ int pa__init(pa_module *m)
 
     PA_LLIST_HEAD_INIT(struct sinkinputnode, u->sinkinputnodelist);
     PA_LLIST_HEAD_INIT(struct sourceoutputnode, u->sourceoutputnodelist);
+    PA_LLIST_HEAD_INIT(struct device_load, u->deviceLoads);
+    u->btDiscoverLoad = NULL;
 
     connect_to_hooks(u);
 
@@ -4212,6 +4391,13 @@ void pa__done(pa_module *m)
     if (!(u = m->userdata))
         return;
 
+    /* don't leave module loads behind that would report back to us */
+    while (u->deviceLoads)
+    {
+        u->deviceLoads->msgID = -1;
+        device_load_cancel(u->deviceLoads);
+    }
+
     if (u->connev != NULL)
     {
         /* a connection exists on the socket, tear down */
@@ -33,7 +33,6 @@
 #include <pulse/xmalloc.h>
 #include <pulse/volume.h>
 #include <pulse/timeval.h>
-#include <pulse/rtclock.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/module.h>
@@ -68,7 +67,6 @@ PA_MODULE_USAGE(
         "on_rescue=<This argument is obsolete, please remove it from configuration> "
         "fallback_table=<filename>");
 
-#define SAVE_INTERVAL (10 * PA_USEC_PER_SEC)
 #define IDENTIFICATION_PROPERTY "module-stream-restore.id"
 
 #define DEFAULT_FALLBACK_FILE PA_DEFAULT_CONFIG_DIR"/stream-restore.table"
@@ -96,8 +94,8 @@ struct userdata {
         *source_output_new_hook_slot,
         *source_output_fixate_hook_slot,
         *connection_unlink_hook_slot;
-    pa_time_event *save_time_event;
     pa_database* database;
+    pa_database_journal *journal;
 
     bool restore_device:1;
     bool restore_volume:1;
@@ -938,7 +936,7 @@ static void handle_entry_remove(DBusConnection *conn, DBusMessage *msg, void *us
     key.data = de->entry_name;
     key.size = strlen(de->entry_name);
 
-    pa_assert_se(pa_database_unset(de->userdata->database, &key) == 0);
+    pa_assert_se(pa_database_journal_unset(de->userdata->journal, de->userdata->database, &key) == 0);
 
     send_entry_removed_signal(de);
     trigger_save(de->userdata);
@@ -950,21 +948,6 @@ static void handle_entry_remove(DBusConnection *conn, DBusMessage *msg, void *us
 
 #endif /* HAVE_DBUS */
 
-static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(a);
-    pa_assert(e);
-    pa_assert(u);
-
-    pa_assert(e == u->save_time_event);
-    u->core->mainloop->time_free(u->save_time_event);
-    u->save_time_event = NULL;
-
-    pa_database_sync(u->database);
-    pa_log_info("Synced.");
-}
-
 static struct entry* entry_new(void) {
     struct entry *r = pa_xnew0(struct entry, 1);
     return r;
@@ -1004,7 +987,7 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, replace) == 0);
+    r = (pa_database_journal_set(u->journal, u->database, &key, &data, replace) == 0);
 
     pa_tagstruct_free(t);
 
@@ -1253,11 +1236,6 @@ static void trigger_save(struct userdata *u) {
 
         pa_pstream_send_tagstruct(pa_native_connection_get_pstream(c), t);
     }
-
-    if (u->save_time_event)
-        return;
-
-    u->save_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + SAVE_INTERVAL, save_time_callback, u);
 }
 
 static bool entries_equal(const struct entry *a, const struct entry *b) {
@@ -2041,7 +2019,7 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
                     pa_hashmap_remove_and_free(u->dbus_entries, de->entry_name);
                 }
 #endif
-                pa_database_clear(u->database);
+                pa_database_journal_clear(u->journal, u->database);
             }
 
             while (!pa_tagstruct_eof(t)) {
@@ -2172,7 +2150,7 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
                 key.data = (char*) name;
                 key.size = strlen(name);
 
-                pa_database_unset(u->database, &key);
+                pa_database_journal_unset(u->journal, u->database, &key);
             }
 
             trigger_save(u);
@@ -2291,7 +2269,7 @@ static void clean_up_db(struct userdata *u) {
 
         pa_log_debug("Removing an invalid entry: %s", item->entry_name);
 
-        pa_assert_se(pa_database_unset(u->database, &key) >= 0);
+        pa_assert_se(pa_database_journal_unset(u->journal, u->database, &key) >= 0);
         trigger_save(u);
 
         PA_LLIST_REMOVE(struct clean_up_item, to_be_removed, item);
@@ -2390,6 +2368,9 @@ int pa__init(pa_module*m) {
 
     pa_xfree(state_path);
 
+    u->journal = pa_database_journal_get(u->core);
+    pa_database_journal_attach(u->journal, u->database, "stream-volumes");
+
     clean_up_db(u);
 
     if (fill_db(u, pa_modargs_get_value(ma, "fallback_table", NULL)) < 0)
@@ -2462,8 +2443,10 @@ void pa__done(pa_module*m) {
     if (u->subscription)
         pa_subscription_free(u->subscription);
 
-    if (u->save_time_event)
-        u->core->mainloop->time_free(u->save_time_event);
+    if (u->journal) {
+        pa_database_journal_detach(u->journal, u->database);
+        pa_database_journal_unref(u->journal);
+    }
 
     if (u->database)
         pa_database_close(u->database);
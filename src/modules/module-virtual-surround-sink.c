@@ -27,8 +27,6 @@
 
 #include <math.h>
 
-#include <fftw3.h>
-
 #include <pulse/gccmacro.h>
 #include <pulse/xmalloc.h>
 
@@ -44,6 +42,7 @@
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/sound-file.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/convolver.h>
 
 
 PA_MODULE_AUTHOR("Christopher Snowhill");
@@ -64,11 +63,15 @@ PA_MODULE_USAGE(
           "hrir=/path/to/left_hrir.wav "
           "hrir_left=/path/to/left_hrir.wav "
           "hrir_right=/path/to/optional/right_hrir.wav "
+          "partition_size=<samples per convolution block, a power of two> "
           "autoloaded=<set if this module is being loaded automatically> "
         ));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 #define DEFAULT_AUTOLOADED false
+#define DEFAULT_PARTITION_SIZE 512
+#define MIN_PARTITION_SIZE 16
+#define MAX_PARTITION_SIZE 16384
 
 struct userdata {
     pa_module *module;
@@ -82,16 +85,16 @@ struct userdata {
 
     bool auto_desc;
 
-    size_t fftlen;
+    size_t block_size;
     size_t hrir_samples;
     size_t inputs;
 
-    fftwf_plan *p_fw, p_bw;
-    fftwf_complex *f_in, *f_out, **f_ir;
-    float *revspace, *outspace[2], **inspace;
-};
+    pa_convolver *convolver;
 
-#define BLOCK_SIZE (512)
+    /* Set when the read index of memblockq_sink moved back, the convolver
+     * history has to be replayed before the next block */
+    bool reset_convolver;
+};
 
 static const char* const valid_modargs[] = {
     "sink_name",
@@ -108,22 +111,10 @@ static const char* const valid_modargs[] = {
     "hrir",
     "hrir_left",
     "hrir_right",
+    "partition_size",
     NULL
 };
 
-/* Vector size of 4 floats */
-#define v_size 4
-static void * alloc(size_t x, size_t s) {
-    size_t f;
-    float *t;
-
-    f = PA_ROUND_UP(x*s, sizeof(float)*v_size);
-    pa_assert_se(t = fftwf_malloc(f));
-    pa_memzero(t, f);
-
-    return t;
-}
-
 static size_t sink_input_samples(size_t nbytes)
 {
     return nbytes / 8;
@@ -398,10 +389,8 @@ static size_t memblockq_missing(pa_memblockq *bq) {
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes_input, pa_memchunk *chunk) {
     struct userdata *u;
     float *src, *dst;
-    int c, ear;
-    size_t s, bytes_missing, fftlen;
+    size_t s, n, bytes_missing;
     pa_memchunk tchunk;
-    float fftlen_if, *revspace;
 
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
@@ -418,76 +407,44 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes_input, pa_memchunk
         pa_memblock_unref(nchunk.memblock);
     }
 
-    pa_memblockq_rewind(u->memblockq_sink, sink_bytes(u, u->fftlen - BLOCK_SIZE));
-    pa_memblockq_peek_fixed_size(u->memblockq_sink, sink_bytes(u, u->fftlen), &tchunk);
-
-    pa_memblockq_drop(u->memblockq_sink, tchunk.length);
+    if (u->reset_convolver) {
+        size_t history = pa_convolver_get_history(u->convolver);
 
-    /* Now tchunk contains enough data to perform the FFT
-     * This should be equal to u->fftlen */
+        /* Feed the input that preceded the new read position through the
+         * delay line again, without computing any output for it */
+        pa_memblockq_rewind(u->memblockq_sink, sink_bytes(u, history));
+        pa_memblockq_peek_fixed_size(u->memblockq_sink, sink_bytes(u, history), &tchunk);
+        pa_memblockq_drop(u->memblockq_sink, tchunk.length);
 
-    chunk->index = 0;
-    chunk->length = sink_input_bytes(BLOCK_SIZE);
-    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
+        pa_convolver_reset(u->convolver);
 
-    src = pa_memblock_acquire_chunk(&tchunk);
+        src = pa_memblock_acquire_chunk(&tchunk);
+        for (s = 0; s < history; s += u->block_size)
+            pa_convolver_process(u->convolver, src + s * u->inputs, NULL);
+        pa_memblock_release(tchunk.memblock);
+        pa_memblock_unref(tchunk.memblock);
 
-    for (c = 0; c < u->inputs; c++) {
-        for (s = 0, fftlen = u->fftlen; s < fftlen; s++) {
-            u->inspace[c][s] = src[s * u->inputs + c];
-        }
+        u->reset_convolver = false;
     }
 
-    pa_memblock_release(tchunk.memblock);
-    pa_memblock_unref(tchunk.memblock);
-
-    fftlen_if = 1.0f / (float)u->fftlen;
-    revspace = u->revspace + u->fftlen - BLOCK_SIZE;
-
-    pa_memzero(u->outspace[0], BLOCK_SIZE * 4);
-    pa_memzero(u->outspace[1], BLOCK_SIZE * 4);
-
-    for (c = 0; c < u->inputs; c++) {
-        fftwf_complex *f_in = u->f_in;
-        fftwf_complex *f_out = u->f_out;
-
-        fftwf_execute(u->p_fw[c]);
-
-        for (ear = 0; ear < 2; ear++) {
-            fftwf_complex *f_ir = u->f_ir[c * 2 + ear];
-            float *outspace = u->outspace[ear];
-
-            for (s = 0, fftlen = u->fftlen / 2 + 1; s < fftlen; s++) {
-                float re = f_ir[s][0] * f_in[s][0] - f_ir[s][1] * f_in[s][1];
-                float im = f_ir[s][1] * f_in[s][0] + f_ir[s][0] * f_in[s][1];
-                f_out[s][0] = re;
-                f_out[s][1] = im;
-            }
-
-            fftwf_execute(u->p_bw);
+    pa_memblockq_peek_fixed_size(u->memblockq_sink, sink_bytes(u, u->block_size), &tchunk);
+    pa_memblockq_drop(u->memblockq_sink, tchunk.length);
 
-            for (s = 0, fftlen = BLOCK_SIZE; s < fftlen; ++s)
-                outspace[s] += revspace[s] * fftlen_if;
-        }
-    }
+    chunk->index = 0;
+    chunk->length = sink_input_bytes(u->block_size);
+    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
 
+    src = pa_memblock_acquire_chunk(&tchunk);
     dst = pa_memblock_acquire_chunk(chunk);
 
-    for (s = 0, fftlen = BLOCK_SIZE; s < fftlen; s++) {
-        float output;
-        float *outspace = u->outspace[0];
+    pa_convolver_process(u->convolver, src, dst);
 
-        output = outspace[s];
-        if (output < -1.0) output = -1.0;
-        if (output > 1.0) output = 1.0;
-        dst[s * 2 + 0] = output;
-
-        outspace = u->outspace[1];
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
 
-        output = outspace[s];
-        if (output < -1.0) output = -1.0;
-        if (output > 1.0) output = 1.0;
-        dst[s * 2 + 1] = output;
+    for (s = 0, n = u->block_size * 2; s < n; s++) {
+        if (dst[s] < -1.0f) dst[s] = -1.0f;
+        if (dst[s] > 1.0f) dst[s] = 1.0f;
     }
 
     pa_memblock_release(chunk->memblock);
@@ -521,6 +478,9 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes_input)
     pa_sink_process_rewind(u->sink, amount);
 
     pa_memblockq_rewind(u->memblockq_sink, nbytes_sink);
+
+    if (nbytes_sink > 0)
+        u->reset_convolver = true;
 }
 
 /* Called from I/O thread context */
@@ -532,7 +492,7 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes_inpu
     pa_assert_se(u = i->userdata);
 
     nbytes_sink = sink_bytes(u, sink_input_samples(nbytes_input));
-    nbytes_memblockq = sink_bytes(u, sink_input_samples(nbytes_input) + u->fftlen);
+    nbytes_memblockq = sink_bytes(u, sink_input_samples(nbytes_input) + pa_convolver_get_history(u->convolver));
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
@@ -551,7 +511,7 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes_inp
 
     nbytes_sink = sink_bytes(u, sink_input_samples(nbytes_input));
 
-    nbytes_sink = PA_ROUND_UP(nbytes_sink, sink_bytes(u, BLOCK_SIZE));
+    nbytes_sink = PA_ROUND_UP(nbytes_sink, sink_bytes(u, u->block_size));
     pa_sink_set_max_request_within_thread(u->sink, nbytes_sink);
 }
 
@@ -602,7 +562,7 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
 
     max_request = sink_bytes(u, sink_input_samples(pa_sink_input_get_max_request(i)));
-    max_request = PA_ROUND_UP(max_request, sink_bytes(u, BLOCK_SIZE));
+    max_request = PA_ROUND_UP(max_request, sink_bytes(u, u->block_size));
     pa_sink_set_max_request_within_thread(u->sink, max_request);
 
     /* FIXME: Too small max_rewind:
@@ -720,15 +680,13 @@ int pa__init(pa_module*m) {
     size_t hrir_samples;
     size_t hrir_copied_length, hrir_total_length;
     int hrir_channels;
-    int fftlen;
+    uint32_t block_size = DEFAULT_PARTITION_SIZE;
 
     float *impulse_temp=NULL;
 
     unsigned *mapping_left=NULL;
     unsigned *mapping_right=NULL;
 
-    fftwf_plan p;
-
     pa_channel_map hrir_map, hrir_right_map;
 
     pa_sample_spec hrir_left_temp_ss;
@@ -830,10 +788,18 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    /* Latency is one partition, CPU load per sample grows as it shrinks */
+    if (pa_modargs_get_value_u32(ma, "partition_size", &block_size) < 0 ||
+        block_size < MIN_PARTITION_SIZE || block_size > MAX_PARTITION_SIZE || !pa_is_power_of_two(block_size)) {
+        pa_log("partition_size= expects a power of two between %u and %u", MIN_PARTITION_SIZE, MAX_PARTITION_SIZE);
+        goto fail;
+    }
+
     pa_channel_map_init_stereo(&map_output);
 
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
+    u->block_size = block_size;
     m->userdata = u;
 
     /* Create sink */
@@ -1041,78 +1007,30 @@ int pa__init(pa_module*m) {
         }
     }
 
-    fftlen = (hrir_samples + BLOCK_SIZE + 1); /* Grow a bit for overlap */
-    {
-        /* Round up to a power of two */
-        int pow = 1;
-        while (fftlen > 2) { pow++; fftlen /= 2; }
-        fftlen = 2 << pow;
+    if (!(u->convolver = pa_convolver_new(block_size, hrir_channels, 2, hrir_samples))) {
+        pa_log("Failed to create the convolver.");
+        goto fail;
     }
 
-    u->fftlen = fftlen;
-
-    u->f_in = (fftwf_complex*) alloc(sizeof(fftwf_complex), (fftlen/2+1));
-    u->f_out = (fftwf_complex*) alloc(sizeof(fftwf_complex), (fftlen/2+1));
-
-    u->f_ir = (fftwf_complex**) alloc(sizeof(fftwf_complex*), (hrir_channels*2));
-    for (i = 0, j = hrir_channels*2; i < j; i++)
-        u->f_ir[i] = (fftwf_complex*) alloc(sizeof(fftwf_complex), (fftlen/2+1));
-
-    u->revspace = (float*) alloc(sizeof(float), fftlen);
-
-    u->outspace[0] = (float*) alloc(sizeof(float), BLOCK_SIZE);
-    u->outspace[1] = (float*) alloc(sizeof(float), BLOCK_SIZE);
-
-    u->inspace = (float**) alloc(sizeof(float*), hrir_channels);
-    for (i = 0; i < hrir_channels; i++)
-        u->inspace[i] = (float*) alloc(sizeof(float), fftlen);
-
-    u->p_fw = (fftwf_plan*) alloc(sizeof(fftwf_plan), hrir_channels);
-    for (i = 0; i < hrir_channels; i++)
-        pa_assert_se(u->p_fw[i] = fftwf_plan_dft_r2c_1d(fftlen, u->inspace[i], u->f_in, FFTW_ESTIMATE));
+    impulse_temp = pa_xnew(float, hrir_samples);
 
-    pa_assert_se(u->p_bw = fftwf_plan_dft_c2r_1d(fftlen, u->f_out, u->revspace, FFTW_ESTIMATE));
-
-    impulse_temp = (float*) alloc(sizeof(float), fftlen);
-
-    if (hrir_right_data) {
-        for (i = 0; i < hrir_channels; i++) {
-            for (ear = 0; ear < 2; ear++) {
-                size_t index = i * 2 + ear;
-                size_t impulse_index = mapping_left[i];
-                float *impulse = (ear == 0) ? hrir_data : hrir_right_data;
-                for (j = 0; j < hrir_samples; j++) {
-                    impulse_temp[j] = impulse[j * hrir_channels + impulse_index];
-                }
+    for (i = 0; i < hrir_channels; i++) {
+        for (ear = 0; ear < 2; ear++) {
+            float *impulse;
+            size_t impulse_index;
 
-                p = fftwf_plan_dft_r2c_1d(fftlen, impulse_temp, u->f_ir[index], FFTW_ESTIMATE);
-                if (p) {
-                    fftwf_execute(p);
-                    fftwf_destroy_plan(p);
-                } else {
-                    pa_log("fftw plan creation failed for %s ear speaker index %d", (ear == 0) ? "left" : "right", i);
-                    goto fail;
-                }
+            if (hrir_right_data) {
+                impulse = (ear == 0) ? hrir_data : hrir_right_data;
+                impulse_index = mapping_left[i];
+            } else {
+                impulse = hrir_data;
+                impulse_index = (ear == 0) ? mapping_left[i] : mapping_right[i];
             }
-        }
-    } else {
-        for (i = 0; i < hrir_channels; i++) {
-            for (ear = 0; ear < 2; ear++) {
-                size_t index = i * 2 + ear;
-                size_t impulse_index = (ear == 0) ? mapping_left[i] : mapping_right[i];
-                for (j = 0; j < hrir_samples; j++) {
-                    impulse_temp[j] = hrir_data[j * hrir_channels + impulse_index];
-                }
 
-                p = fftwf_plan_dft_r2c_1d(fftlen, impulse_temp, u->f_ir[index], FFTW_ESTIMATE);
-                if (p) {
-                    fftwf_execute(p);
-                    fftwf_destroy_plan(p);
-                } else {
-                    pa_log("fftw plan creation failed for %s ear speaker index %d", (ear == 0) ? "left" : "right", i);
-                    goto fail;
-                }
-            }
+            for (j = 0; j < hrir_samples; j++)
+                impulse_temp[j] = impulse[j * hrir_channels + impulse_index];
+
+            pa_convolver_set_ir(u->convolver, i, ear, impulse_temp, hrir_samples);
         }
     }
 
@@ -1125,10 +1043,10 @@ int pa__init(pa_module*m) {
     pa_xfree(mapping_left);
     pa_xfree(mapping_right);
 
-    u->memblockq_sink = pa_memblockq_new("module-virtual-surround-sink memblockq (input)", 0, MEMBLOCKQ_MAXLENGTH, sink_bytes(u, BLOCK_SIZE), &ss_input, 0, 0, sink_bytes(u, u->fftlen), &silence);
+    u->memblockq_sink = pa_memblockq_new("module-virtual-surround-sink memblockq (input)", 0, MEMBLOCKQ_MAXLENGTH, sink_bytes(u, u->block_size), &ss_input, 0, 0, sink_bytes(u, pa_convolver_get_history(u->convolver)), &silence);
     pa_memblock_unref(silence.memblock);
 
-    pa_memblockq_seek(u->memblockq_sink, sink_bytes(u, u->fftlen - BLOCK_SIZE), PA_SEEK_RELATIVE, false);
+    pa_memblockq_seek(u->memblockq_sink, sink_bytes(u, pa_convolver_get_history(u->convolver)), PA_SEEK_RELATIVE, false);
     pa_memblockq_flush_read(u->memblockq_sink);
 
     pa_sink_put(u->sink);
@@ -1184,7 +1102,6 @@ int pa__get_n_used(pa_module *m) {
 }
 
 void pa__done(pa_module*m) {
-    size_t i, j;
     struct userdata *u;
 
     pa_assert(m);
@@ -1210,46 +1127,8 @@ void pa__done(pa_module*m) {
     if (u->memblockq_sink)
         pa_memblockq_free(u->memblockq_sink);
 
-    if (u->p_fw) {
-        for (i = 0, j = u->inputs; i < j; i++) {
-            if (u->p_fw[i])
-                fftwf_destroy_plan(u->p_fw[i]);
-        }
-        fftwf_free(u->p_fw);
-    }
-
-    if (u->p_bw)
-        fftwf_destroy_plan(u->p_bw);
-
-    if (u->f_ir) {
-        for (i = 0, j = u->inputs * 2; i < j; i++) {
-            if (u->f_ir[i])
-                fftwf_free(u->f_ir[i]);
-        }
-        fftwf_free(u->f_ir);
-    }
-
-    if (u->f_out)
-        fftwf_free(u->f_out);
-
-    if (u->f_in)
-        fftwf_free(u->f_in);
-
-    if (u->revspace)
-        fftwf_free(u->revspace);
-
-    if (u->outspace[0])
-        fftwf_free(u->outspace[0]);
-    if (u->outspace[1])
-        fftwf_free(u->outspace[1]);
-
-    if (u->inspace) {
-        for (i = 0, j = u->inputs; i < j; i++) {
-            if (u->inspace[i])
-                fftwf_free(u->inspace[i]);
-        }
-        fftwf_free(u->inspace);
-    }
+    if (u->convolver)
+        pa_convolver_free(u->convolver);
 
     pa_xfree(u);
 }
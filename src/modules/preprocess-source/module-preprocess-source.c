@@ -25,6 +25,7 @@
 #include <pulsecore/module.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/drift-comp.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
@@ -104,11 +105,13 @@ typedef enum {
  *    samples (because else the echo canceller does not work) or when the
  *    playback pointer drifts too far away.
  *
- * 2) periodically check the difference between capture and playback. We use a
- *    low and high watermark for adjusting the alignment. Playback should always
- *    be before capture and the difference should not be bigger than one frame
- *    size. We would ideally like to resample the sink_input but most driver
- *    don't give enough accuracy to be able to do that right now.
+ * 2) the sink IO thread regularly sends a snapshot of its latency to the
+ *    source IO thread, where pa_drift_comp tracks the difference between
+ *    capture and playback and the drift between the two clocks. Playback
+ *    should always be before capture and the difference should not be bigger
+ *    than adjust_threshold; if it leaves that window we resync, otherwise the
+ *    sink_input is resampled slightly so that the drift is cancelled and the
+ *    difference stays in the middle of the window.
  */
 
 struct userdata;
@@ -122,20 +125,6 @@ struct pa_preprocess_msg {
 PA_DEFINE_PRIVATE_CLASS(pa_preprocess_msg, pa_msgobject);
 #define PA_PREPROCESS_MSG(o) (pa_preprocess_msg_cast(o))
 
-struct snapshot {
-    pa_usec_t sink_now;
-    pa_usec_t sink_latency;
-    size_t sink_delay;
-    int64_t send_counter;
-
-    pa_usec_t source_now;
-    pa_usec_t source_latency;
-    size_t source_delay;
-    int64_t recv_counter;
-    size_t rlen;
-    size_t plen;
-};
-
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -168,11 +157,8 @@ struct userdata {
     int64_t recv_counter;
     size_t sink_skip;
 
-    /* Bytes left over from previous iteration */
-    size_t sink_rem;
-    size_t source_rem;
-
     pa_atomic_t request_resync;
+    pa_drift_comp *drift;
 
     pa_time_event *time_event;
     pa_usec_t adjust_time;
@@ -195,7 +181,7 @@ struct userdata {
     } thread_info;
 };
 
-static void source_output_snapshot_within_thread(struct userdata *u, struct snapshot *snapshot);
+static void source_output_snapshot_within_thread(struct userdata *u, pa_drift_snapshot *snapshot);
 
 static const char* const valid_modargs[] = {
     "source_name",
@@ -222,8 +208,7 @@ static const char* const valid_modargs[] = {
 enum {
     SOURCE_OUTPUT_MESSAGE_POST = PA_SOURCE_OUTPUT_MESSAGE_MAX,
     SOURCE_OUTPUT_MESSAGE_REWIND,
-    SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT,
-    SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME
+    SOURCE_OUTPUT_MESSAGE_SINK_SNAPSHOT
 };
 
 enum {
@@ -263,51 +248,10 @@ static pa_hook_result_t palm_policy_set_parameters_cb(pa_palm_policy *pp, pa_pal
 }
 
 
-static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
-    int64_t diff_time, buffer_latency;
-    pa_usec_t plen, rlen, source_delay, sink_delay, recv_counter, send_counter;
-
-    /* get latency difference between playback and record */
-    plen = pa_bytes_to_usec(snapshot->plen, &u->sink_input->sample_spec);
-    rlen = pa_bytes_to_usec(snapshot->rlen, &u->source_output->sample_spec);
-    if (plen > rlen)
-        buffer_latency = plen - rlen;
-    else
-        buffer_latency = 0;
-
-    source_delay = pa_bytes_to_usec(snapshot->source_delay, &u->source_output->sample_spec);
-    sink_delay = pa_bytes_to_usec(snapshot->sink_delay, &u->sink_input->sample_spec);
-    buffer_latency += source_delay + sink_delay;
-
-    /* add the latency difference due to samples not yet transferred */
-    send_counter = pa_bytes_to_usec(snapshot->send_counter, &u->sink->sample_spec);
-    recv_counter = pa_bytes_to_usec(snapshot->recv_counter, &u->sink->sample_spec);
-    if (recv_counter <= send_counter)
-        buffer_latency += (int64_t) (send_counter - recv_counter);
-    else
-        buffer_latency = PA_CLIP_SUB(buffer_latency, (int64_t) (recv_counter - send_counter));
-
-    /* capture and playback are perfectly aligned when diff_time is 0 */
-    diff_time = (snapshot->sink_now + snapshot->sink_latency - buffer_latency) -
-          (snapshot->source_now - snapshot->source_latency);
-
-    pa_log_debug("Diff %lld (%lld - %lld + %lld) %lld %lld %lld %lld", (long long) diff_time,
-        (long long) snapshot->sink_latency,
-        (long long) buffer_latency, (long long) snapshot->source_latency,
-        (long long) source_delay, (long long) sink_delay,
-        (long long) (send_counter - recv_counter),
-        (long long) (snapshot->sink_now - snapshot->source_now));
-
-    return diff_time;
-}
-
 /* Called from main context */
 static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
-    uint32_t old_rate, base_rate, new_rate;
-    int64_t diff_time;
-    /*size_t fs*/
-    struct snapshot latency_snapshot;
+    uint32_t old_rate, new_rate;
 
     pa_assert(u);
     pa_assert(a);
@@ -317,45 +261,14 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     if (!IS_ACTIVE(u))
         return;
 
-    /* update our snapshots */
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
-
-    /* calculate drift between capture and playback */
-    diff_time = calc_diff(u, &latency_snapshot);
-
-    /*fs = pa_frame_size(&u->source_output->sample_spec);*/
+    /* The source I/O thread keeps track of the alignment and resyncs when
+     * needed, all that is left to do here is to apply the playback rate
+     * that cancels the drift. */
     old_rate = u->sink_input->sample_spec.rate;
-    base_rate = u->source_output->sample_spec.rate;
-
-    if (diff_time < 0) {
-        /* recording before playback, we need to adjust quickly. The echo
-         * canceller does not work in this case. */
-        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
-            NULL, diff_time, NULL, NULL);
-        /*new_rate = base_rate - ((pa_usec_to_bytes(-diff_time, &u->source_output->sample_spec) / fs) * PA_USEC_PER_SEC) / u->adjust_time;*/
-        new_rate = base_rate;
-    }
-    else {
-        if (diff_time > u->adjust_threshold) {
-            /* diff too big, quickly adjust */
-            pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
-                NULL, diff_time, NULL, NULL);
-        }
-
-        /* recording behind playback, we need to slowly adjust the rate to match */
-        /*new_rate = base_rate + ((pa_usec_to_bytes(diff_time, &u->source_output->sample_spec) / fs) * PA_USEC_PER_SEC) / u->adjust_time;*/
-
-        /* assume equal samplerates for now */
-        new_rate = base_rate;
-    }
-
-    /* make sure we don't make too big adjustments because that sounds horrible */
-    if (new_rate > base_rate * 1.1 || new_rate < base_rate * 0.9)
-        new_rate = base_rate;
+    new_rate = pa_drift_comp_get_rate(u->drift);
 
     if (new_rate != old_rate) {
-        pa_log_info("Old rate %lu Hz, new rate %lu Hz", (unsigned long) old_rate, (unsigned long) new_rate);
+        pa_log_debug("Old rate %lu Hz, new rate %lu Hz", (unsigned long) old_rate, (unsigned long) new_rate);
 
         pa_sink_input_set_rate(u->sink_input, new_rate);
     }
@@ -637,37 +550,13 @@ static void sink_set_mute_cb(pa_sink *s) {
 
 /* Called from source I/O thread context. */
 static void apply_diff_time(struct userdata *u, int64_t diff_time) {
-    int64_t diff;
-
-    if (diff_time < 0) {
-        diff = pa_usec_to_bytes(-diff_time, &u->sink_input->sample_spec);
-
-        if (diff > 0) {
-            /* add some extra safety samples to compensate for jitter in the
-             * timings */
-            diff += 10 * pa_frame_size (&u->sink_input->sample_spec);
-
-            pa_log("Playback after capture (%lld), drop sink %lld", (long long) diff_time, (long long) diff);
-
-            u->sink_skip = diff;
-            u->source_skip = 0;
-        }
-    } else if (diff_time > 0) {
-        diff = pa_usec_to_bytes(diff_time, &u->source_output->sample_spec);
-
-        if (diff > 0) {
-            pa_log("Playback too far ahead (%lld), drop source %lld", (long long) diff_time, (long long) diff);
-
-            u->source_skip = diff;
-            u->sink_skip = 0;
-        }
-    }
+    pa_drift_comp_get_skip(u->drift, diff_time, &u->sink_skip, &u->source_skip);
 }
 
 /* Called from source I/O thread context. */
 static void do_resync(struct userdata *u) {
     int64_t diff_time;
-    struct snapshot latency_snapshot;
+    pa_drift_snapshot latency_snapshot;
 
     pa_log("Doing resync");
 
@@ -681,110 +570,12 @@ static void do_resync(struct userdata *u) {
     source_output_snapshot_within_thread(u, &latency_snapshot);
 
     /* calculate drift between capture and playback */
-    diff_time = calc_diff(u, &latency_snapshot);
+    diff_time = pa_drift_comp_resync(u->drift, &latency_snapshot);
 
     /* and adjust for the drift */
     apply_diff_time(u, diff_time);
 }
 
-/* 1. Calculate drift at this point, pass to canceller
- * 2. Push out playback samples in blocksize chunks
- * 3. Push out capture samples in blocksize chunks
- * 4. ???
- * 5. Profit
- *
- * Called from source I/O thread context.
- */
-// TODO : this is not used
-#if 0
-static void do_push_drift_comp(struct userdata *u) {
-    size_t rlen, plen;
-    pa_memchunk rchunk, pchunk, cchunk;
-    uint8_t *rdata, *pdata, *cdata;
-    float drift;
-    int unused PA_GCC_UNUSED;
-
-    rlen = pa_memblockq_get_length(u->source_memblockq);
-    plen = pa_memblockq_get_length(u->sink_memblockq);
-
-    /* Estimate snapshot drift as follows:
-     *   pd: amount of data consumed since last time
-     *   rd: amount of data consumed since last time
-     *
-     *   drift = (pd - rd) / rd;
-     *
-     * We calculate pd and rd as the memblockq length less the number of
-     * samples left from the last iteration (to avoid double counting
-     * those remainder samples.
-     */
-    drift = ((float)(plen - u->sink_rem) - (rlen - u->source_rem)) / ((float)(rlen - u->source_rem));
-    u->sink_rem = plen % u->sink_blocksize;
-    u->source_rem = rlen % u->source_output_blocksize;
-
-    if (u->save_aec) {
-        if (u->drift_file)
-            fprintf(u->drift_file, "d %a\n", drift);
-    }
-
-    /* Send in the playback samples first */
-    while (plen >= u->sink_blocksize) {
-        pa_memblockq_peek_fixed_size(u->sink_memblockq, u->sink_blocksize, &pchunk);
-        pdata = pa_memblock_acquire(pchunk.memblock);
-        pdata += pchunk.index;
-
-        u->ec->play(u->ec, pdata);
-
-        if (u->save_aec) {
-            if (u->drift_file)
-                fprintf(u->drift_file, "p %d\n", u->sink_blocksize);
-            if (u->played_file)
-                unused = fwrite(pdata, 1, u->sink_blocksize, u->played_file);
-        }
-
-        pa_memblock_release(pchunk.memblock);
-        pa_memblockq_drop(u->sink_memblockq, u->sink_blocksize);
-        pa_memblock_unref(pchunk.memblock);
-
-        plen -= u->sink_blocksize;
-    }
-
-    /* And now the capture samples */
-    while (rlen >= u->source_output_blocksize) {
-        pa_memblockq_peek_fixed_size(u->source_memblockq, u->source_output_blocksize, &rchunk);
-
-        rdata = pa_memblock_acquire(rchunk.memblock);
-        rdata += rchunk.index;
-
-        cchunk.index = 0;
-        cchunk.length = u->source_output_blocksize;
-        cchunk.memblock = pa_memblock_new(u->source->core->mempool, cchunk.length);
-        cdata = pa_memblock_acquire(cchunk.memblock);
-
-        u->ec->set_drift(u->ec, drift);
-        u->ec->record(u->ec, rdata, cdata);
-
-        if (u->save_aec) {
-            if (u->drift_file)
-                fprintf(u->drift_file, "c %d\n", u->source_output_blocksize);
-            if (u->captured_file)
-                unused = fwrite(rdata, 1, u->source_output_blocksize, u->captured_file);
-            if (u->canceled_file)
-                unused = fwrite(cdata, 1, u->source_output_blocksize, u->canceled_file);
-        }
-
-        pa_memblock_release(cchunk.memblock);
-        pa_memblock_release(rchunk.memblock);
-
-        pa_memblock_unref(rchunk.memblock);
-
-        pa_source_post(u->source, &cchunk);
-        pa_memblock_unref(cchunk.memblock);
-
-        pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
-        rlen -= u->source_output_blocksize;
-    }
-}
-#endif
 /* This one's simpler than the drift compensation case -- we just iterate over
  * the capture buffer, and pass the canceller blocksize bytes of playback and
  * capture data. If playback is currently inactive, we just push silence.
@@ -941,6 +732,7 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
 /* Called from sink I/O thread context. */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
+    pa_drift_snapshot *snapshot;
 
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
@@ -965,6 +757,14 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
         NULL, 0, chunk, NULL);
     u->send_counter += chunk->length;
 
+    /* and every now and then where playback stands, so that it can keep
+     * track of the alignment */
+    if ((snapshot = pa_drift_comp_snapshot_get(u->drift, pa_rtclock_now()))) {
+        pa_drift_snapshot_sink(snapshot, i, u->send_counter);
+        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_SINK_SNAPSHOT,
+            snapshot, 0, NULL, NULL);
+    }
+
     return 0;
 }
 
@@ -1012,24 +812,13 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 }
 
 /* Called from source I/O thread context. */
-static void source_output_snapshot_within_thread(struct userdata *u, struct snapshot *snapshot) {
-    size_t delay, rlen, plen;
-    pa_usec_t now, latency;
-
-    now = pa_rtclock_now();
-    latency = pa_source_get_latency_within_thread(u->source_output->source, false);
-    delay = pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq);
+static void source_output_snapshot_within_thread(struct userdata *u, pa_drift_snapshot *snapshot) {
+    size_t rlen, plen;
 
-    delay = (u->source_output->thread_info.resampler ? pa_resampler_request(u->source_output->thread_info.resampler, delay) : delay);
     rlen = pa_memblockq_get_length(u->source_memblockq);
     plen = pa_memblockq_get_length(u->sink_memblockq);
 
-    snapshot->source_now = now;
-    snapshot->source_latency = latency;
-    snapshot->source_delay = delay;
-    snapshot->recv_counter = u->recv_counter;
-    snapshot->rlen = rlen + u->sink_skip;
-    snapshot->plen = plen + u->source_skip;
+    pa_drift_snapshot_source(snapshot, u->source_output, u->recv_counter, rlen + u->sink_skip, plen + u->source_skip);
 }
 
 /* Called from source I/O thread context. */
@@ -1066,16 +855,22 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
 
             return 0;
 
-        case SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            struct snapshot *snapshot = (struct snapshot *) data;
+        case SOURCE_OUTPUT_MESSAGE_SINK_SNAPSHOT: {
+            pa_drift_snapshot *snapshot = (pa_drift_snapshot *) data;
+            int64_t diff_time;
 
-            source_output_snapshot_within_thread(u, snapshot);
-            return 0;
-        }
+            pa_source_output_assert_io_context(u->source_output);
+
+            if (u->source_output->source->thread_info.state == PA_SOURCE_RUNNING) {
+                source_output_snapshot_within_thread(u, snapshot);
+
+                if (pa_drift_comp_update(u->drift, snapshot, &diff_time))
+                    apply_diff_time(u, diff_time);
+            }
 
-        case SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME:
-            apply_diff_time(u, offset);
+            pa_drift_comp_snapshot_release(u->drift, snapshot);
             return 0;
+        }
 
     }
 
@@ -1089,22 +884,11 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
     switch (code) {
 
         case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            size_t delay;
-            pa_usec_t now, latency;
-            struct snapshot *snapshot = (struct snapshot *) data;
+            pa_drift_snapshot *snapshot = (pa_drift_snapshot *) data;
 
             pa_sink_input_assert_io_context(u->sink_input);
 
-            now = pa_rtclock_now();
-            latency = pa_sink_get_latency_within_thread(u->sink_input->sink, false);
-            delay = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
-
-            delay = (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, delay) : delay);
-
-            snapshot->sink_now = now;
-            snapshot->sink_latency = latency;
-            snapshot->sink_delay = delay;
-            snapshot->send_counter = u->send_counter;
+            pa_drift_snapshot_sink(snapshot, u->sink_input, u->send_counter);
             return 0;
         }
     }
@@ -1964,10 +1748,12 @@ int pa__init(pa_module*m) {
 
     pa_sink_input_get_silence(u->sink_input, &silence);
 
-    u->source_memblockq = pa_memblockq_new("module-preprocess source_memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
-        &source_output_ss, 1, 1, 0, &silence);
-    u->sink_memblockq = pa_memblockq_new("module-preprocess sink_memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
-        &sink_ss, 0, 1, 0, &silence);
+    /* The canceller consumes fixed size blocks, use ring queues so
+     * that these can be peeked without merging memblocks */
+    u->source_memblockq = pa_memblockq_new_ring("module-preprocess source_memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
+        &source_output_ss, 1, 1, 0, &silence, m->core->mempool);
+    u->sink_memblockq = pa_memblockq_new_ring("module-preprocess sink_memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
+        &sink_ss, 0, 1, 0, &silence, m->core->mempool);
 
     pa_memblock_unref(silence.memblock);
 
@@ -1976,6 +1762,12 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    u->drift = pa_drift_comp_new(&u->sink->sample_spec, &u->source_output->sample_spec,
+                                 u->adjust_time > 0, u->adjust_threshold);
+
+    if (u->adjust_time > 0)
+        u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
+
     if (u->save_aec) {
         pa_log("Creating AEC files in /tmp");
         u->captured_file = fopen("/tmp/aec_rec.sw", "wb");
@@ -2098,6 +1890,9 @@ void pa__done(pa_module*m) {
     if (u->sink_memblockq)
         pa_memblockq_free(u->sink_memblockq);
 
+    if (u->drift)
+        pa_drift_comp_free(u->drift);
+
     lge_preprocess_done(u->ec);
 
     if (u->asyncmsgq)
@@ -5,39 +5,22 @@
 #include "module_ecnr.h"
 
 void shECNR::fftExecute(const kiss_fft_cpx in[N], kiss_fft_cpx out[N]) {
-    kiss_fft_cfg cfg;
-
-    if ((cfg = kiss_fft_alloc(N, 0, NULL, NULL)) != NULL)
-    {
-        size_t i;
-
-        kiss_fft(cfg, in, out);
-        free(cfg);
-    }
-    else
-    {
-        printf("not enough memory?\n");
-        exit(-1);
-    }
+    kiss_fft(fft_cfg, in, out);
 }
 void shECNR::ifftExecute(const kiss_fft_cpx in[N], kiss_fft_cpx out[N]) {
-    kiss_fft_cfg cfg;
+    kiss_fft(ifft_cfg, in, out);
+}
 
-    if ((cfg = kiss_fft_alloc(N, 1, NULL, NULL)) != NULL)
-    {
-        size_t i;
+void shECNR::init(int mode, char* tfliteFilePath, char* windowFilePath) {
 
-        kiss_fft(cfg, in, out);
-        free(cfg);
-    }
-    else
+    // The twiddle tables only depend on N, set them up once instead of per frame
+    fft_cfg = kiss_fft_alloc(N, 0, NULL, NULL);
+    ifft_cfg = kiss_fft_alloc(N, 1, NULL, NULL);
+    if (fft_cfg == NULL || ifft_cfg == NULL)
     {
         printf("not enough memory?\n");
         exit(-1);
     }
-}
-
-void shECNR::init(int mode, char* tfliteFilePath, char* windowFilePath) {
 
     model = tflite::FlatBufferModel::BuildFromFile(tfliteFilePath);
     //model = tflite::FlatBufferModel::BuildFromFile("/home/seunghun/ECNR/TFlite_convert/model_nsmin3_test.tflite");
@@ -113,6 +96,9 @@ void shECNR::init(int mode, char* tfliteFilePath, char* windowFilePath) {
 }
 
 void shECNR::close(){
+    kiss_fft_free(fft_cfg);
+    kiss_fft_free(ifft_cfg);
+    fft_cfg = ifft_cfg = NULL;
     closelog();
 }
 
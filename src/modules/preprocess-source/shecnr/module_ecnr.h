@@ -32,6 +32,7 @@ private:
     tflite::ops::builtin::BuiltinOpResolver resolver;
     std::unique_ptr<tflite::Interpreter> interpreter;
 
+    kiss_fft_cfg fft_cfg = NULL, ifft_cfg = NULL;
     kiss_fft_cpx in[N], out[N], prev_out[3][N];
     kiss_fft_cpx fs_t[N], fs_f[N];
     std::deque<std::deque<float>> input_data, input_data2, freq2erb_matrix, freq2erb_matrix_norm, erb2freq_matrix;
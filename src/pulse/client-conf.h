@@ -40,6 +40,8 @@ typedef struct pa_client_conf {
     bool autospawn, disable_shm, disable_memfd, auto_connect_localhost, auto_connect_display;
     bool allow_autospawn_for_root;
     size_t shm_size;
+    size_t srbchannel_size;
+    unsigned srbchannel_busy_poll_usec;
 } pa_client_conf;
 
 /* Create a new configuration data object and reset it to defaults */
@@ -398,6 +398,13 @@ static void handle_srbchannel_memblock(pa_context *c, pa_memblock *memblock) {
         return;
     }
 
+    /* Spinning stalls whatever else runs in the thread of the main loop,
+     * which is only known to be nothing under pa_threaded_mainloop */
+    if (pa_mainloop_api_has_own_thread(c->mainloop))
+        pa_srbchannel_set_busy_poll(sr, c->conf->srbchannel_busy_poll_usec);
+    else if (c->conf->srbchannel_busy_poll_usec > 0)
+        pa_log_debug("Not busy polling the srbchannel, the main loop doesn't run in a thread of its own.");
+
     /* Ack the enable command */
     t = pa_tagstruct_new();
     pa_tagstruct_putu32(t, PA_COMMAND_ENABLE_SRBCHANNEL);
@@ -614,6 +621,7 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
     uint8_t cookie[PA_NATIVE_COOKIE_LENGTH];
     pa_tagstruct *t;
     uint32_t tag;
+    uint32_t srbchannel_size_log2 = 0;
 
     pa_assert(c);
     pa_assert(io);
@@ -643,9 +651,15 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     /* Starting with protocol version 13 we use the MSB of the version
      * tag for informing the other side if we could do SHM or not.
-     * Starting from version 31, second MSB is used to flag memfd support. */
+     * Starting from version 31, second MSB is used to flag memfd support.
+     * Starting from version 36, bits 16-20 carry log2 of the srbchannel
+     * ring size we'd like to have, older servers ignore them. */
+    if (c->conf->srbchannel_size > 0)
+        srbchannel_size_log2 = pa_ulog2(pa_make_power_of_two((unsigned) PA_MIN(c->conf->srbchannel_size, (size_t) 1 << 24)));
+
     pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? PA_PROTOCOL_FLAG_SHM : 0) |
-                        (c->memfd_on_local ? PA_PROTOCOL_FLAG_MEMFD: 0));
+                        (c->memfd_on_local ? PA_PROTOCOL_FLAG_MEMFD: 0) |
+                        (srbchannel_size_log2 << PA_PROTOCOL_SRBCHANNEL_SIZE_SHIFT));
     pa_tagstruct_put_arbitrary(t, cookie, sizeof(cookie));
 
 #ifdef HAVE_CREDS
@@ -1669,3 +1683,23 @@ int pa_context_load_cookie_from_file(pa_context *c, const char *cookie_file_path
 
     return 0;
 }
+
+int pa_context_set_memfd_pool(pa_context *c, int fd) {
+    pa_mempool *pool;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(c, c->state == PA_CONTEXT_UNCONNECTED, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(c, fd >= 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(c, !c->conf->disable_shm && c->memfd_on_local, PA_ERR_NOTSUPPORTED);
+
+    if (!(pool = pa_mempool_new_from_memfd(fd, true)))
+        PA_FAIL(c, PA_ERR_INVALID);
+
+    pa_mempool_unref(c->mempool);
+    c->mempool = pool;
+
+    return 0;
+}
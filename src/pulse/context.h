@@ -290,6 +290,17 @@ size_t pa_context_get_tile_size(const pa_context *c, const pa_sample_spec *ss);
  * location, feel free to use this function. \since 5.0 */
 int pa_context_load_cookie_from_file(pa_context *c, const char *cookie_file_path);
 
+/** Use the memfd region \a fd as the memory pool of this context, in place
+ * of one the library creates. Buffers from pa_stream_alloc_buffer() are
+ * then allocated in this region, so that a process that maps it too can
+ * produce audio right into them. The region is shared with the server like
+ * the library's own pool. It has to be large enough for a few blocks of
+ * pa_context_get_tile_size() bytes at least. The context keeps a duplicate
+ * of \a fd, the caller may close it. Only valid before
+ * pa_context_connect(), and if memfd shared memory is in use. Returns
+ * zero on success. \since 15.0 */
+int pa_context_set_memfd_pool(pa_context *c, int fd);
+
 PA_C_DECL_END
 
 #endif
@@ -22,6 +22,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulse/mainloop.h>
 #include <pulse/context.h>
 #include <pulse/stream.h>
 #include <pulse/operation.h>
@@ -55,6 +56,11 @@
 #define PA_PROTOCOL_FLAG_SHM 0x80000000U
 #define PA_PROTOCOL_FLAG_MEMFD 0x40000000U
 
+/* Since protocol version 36 clients put log2 of the srbchannel ring size
+ * they would like to get into these bits, 0 meaning no preference */
+#define PA_PROTOCOL_SRBCHANNEL_SIZE_MASK 0x001F0000U
+#define PA_PROTOCOL_SRBCHANNEL_SIZE_SHIFT 16
+
 typedef struct pa_context_error {
     int error;
 } pa_context_error;
@@ -183,6 +189,7 @@ struct pa_stream {
     /* playback */
     pa_memblock *write_memblock;
     void *write_data;
+    pa_hashmap *write_buffers;
     int64_t latest_underrun_at_index;
 
     /* recording */
@@ -320,4 +327,9 @@ void pa_ext_stream_restore_command(pa_context *c, uint32_t tag, pa_tagstruct *t)
 
 bool pa_mainloop_is_our_api(const pa_mainloop_api*m);
 
+/* Whether m is run by a pa_threaded_mainloop, so that the application
+ * doesn't do anything else in that thread */
+void pa_mainloop_set_has_own_thread(pa_mainloop *m);
+bool pa_mainloop_api_has_own_thread(const pa_mainloop_api *m);
+
 #endif
@@ -1306,6 +1306,138 @@ pa_operation* pa_context_get_sink_input_info_list(pa_context *c, void (*cb)(pa_c
     return pa_context_send_simple_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+static void context_get_sink_input_info_delta_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    pa_sink_input_info_delta d;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    pa_zero(d);
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+        bool full = false;
+
+        if (pa_tagstruct_getu64(t, &d.generation) < 0 ||
+            pa_tagstruct_get_boolean(t, &full) < 0 ||
+            pa_tagstruct_getu32(t, &d.fields) < 0) {
+
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        d.full = (int) full;
+
+        while (!pa_tagstruct_eof(t)) {
+            pa_sink_input_info i;
+            bool removed = false, mute = false, corked = false, has_volume = false, volume_writable = true;
+
+            pa_zero(i);
+            i.proplist = pa_proplist_new();
+            i.format = pa_format_info_new();
+
+            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+                pa_tagstruct_get_boolean(t, &removed) < 0 ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_VOLUME) &&
+                 (pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+                  pa_tagstruct_get_boolean(t, &mute) < 0 ||
+                  pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
+                  pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_STATE) &&
+                 (pa_tagstruct_getu32(t, &i.sink) < 0 ||
+                  pa_tagstruct_get_boolean(t, &corked) < 0)) ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_NAME) &&
+                 (pa_tagstruct_gets(t, &i.name) < 0 ||
+                  pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+                  pa_tagstruct_getu32(t, &i.client) < 0 ||
+                  pa_tagstruct_gets(t, &i.driver) < 0)) ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_FORMAT) &&
+                 (pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+                  pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
+                  pa_tagstruct_get_format_info(t, i.format) < 0 ||
+                  pa_tagstruct_gets(t, &i.resample_method) < 0)) ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_LATENCY) &&
+                 (pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
+                  pa_tagstruct_get_usec(t, &i.sink_usec) < 0)) ||
+                (!removed && (d.fields & PA_SINK_INPUT_INFO_FIELD_PROPLIST) &&
+                 pa_tagstruct_get_proplist(t, i.proplist) < 0)) {
+
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                pa_proplist_free(i.proplist);
+                pa_format_info_free(i.format);
+                goto finish;
+            }
+
+            i.mute = (int) mute;
+            i.corked = (int) corked;
+            i.has_volume = (int) has_volume;
+            i.volume_writable = (int) volume_writable;
+
+            d.index = i.index;
+            d.removed = (int) removed;
+            d.info = removed ? NULL : &i;
+
+            if (o->callback) {
+                pa_sink_input_info_delta_cb_t cb = (pa_sink_input_info_delta_cb_t) o->callback;
+                cb(o->context, &d, 0, o->userdata);
+            }
+
+            pa_proplist_free(i.proplist);
+            pa_format_info_free(i.format);
+        }
+    }
+
+    /* The generation is valid on the last call too, so that clients
+     * learn it even if nothing changed */
+    d.index = PA_INVALID_INDEX;
+    d.removed = 0;
+    d.info = NULL;
+
+    if (o->callback) {
+        pa_sink_input_info_delta_cb_t cb = (pa_sink_input_info_delta_cb_t) o->callback;
+        cb(o->context, eol < 0 ? NULL : &d, eol, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+pa_operation* pa_context_get_sink_input_info_delta(pa_context *c, uint64_t generation, uint32_t fields, pa_sink_input_info_delta_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !(fields & ~PA_SINK_INPUT_INFO_FIELD_ALL), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 37, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_DELTA, &tag);
+    pa_tagstruct_putu64(t, generation);
+    pa_tagstruct_putu32(t, fields);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_sink_input_info_delta_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
 /*** Source output info ***/
 
 static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
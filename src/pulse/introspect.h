@@ -673,6 +673,57 @@ pa_operation* pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sin
 /** Get the complete sink input list */
 pa_operation* pa_context_get_sink_input_info_list(pa_context *c, pa_sink_input_info_cb_t cb, void *userdata);
 
+/** Groups of pa_sink_input_info fields to fetch with
+ * pa_context_get_sink_input_info_delta(). \since 15.0 */
+typedef enum pa_sink_input_info_field {
+    PA_SINK_INPUT_INFO_FIELD_VOLUME = 0x0001U,
+    /**< volume, mute, has_volume and volume_writable */
+
+    PA_SINK_INPUT_INFO_FIELD_STATE = 0x0002U,
+    /**< sink and corked */
+
+    PA_SINK_INPUT_INFO_FIELD_NAME = 0x0004U,
+    /**< name, owner_module, client and driver */
+
+    PA_SINK_INPUT_INFO_FIELD_FORMAT = 0x0008U,
+    /**< sample_spec, channel_map, format and resample_method */
+
+    PA_SINK_INPUT_INFO_FIELD_LATENCY = 0x0010U,
+    /**< buffer_usec and sink_usec. Latency changes alone don't make a
+     * sink input count as changed. */
+
+    PA_SINK_INPUT_INFO_FIELD_PROPLIST = 0x0020U,
+    /**< proplist */
+
+    PA_SINK_INPUT_INFO_FIELD_ALL = 0x003FU
+    /**< All of the above */
+} pa_sink_input_info_field_t;
+
+/** A sink input that changed, as passed to pa_sink_input_info_delta_cb_t. \since 15.0 */
+typedef struct pa_sink_input_info_delta {
+    uint64_t generation;                 /**< Generation of the server's state this reply describes. Pass it to the next pa_context_get_sink_input_info_delta() call. */
+    int full;                            /**< If set, the reply lists all sink inputs and the client should forget those it doesn't list */
+    uint32_t fields;                     /**< The pa_sink_input_info_field_t groups that are valid in info */
+    uint32_t index;                      /**< Index of the sink input */
+    int removed;                         /**< The sink input is gone, info is NULL */
+    const pa_sink_input_info *info;      /**< The fields selected by fields, the others are zero */
+} pa_sink_input_info_delta;
+
+/** Callback prototype for pa_context_get_sink_input_info_delta(). Called
+ * once per changed sink input, then once with eol set. Unlike with the other
+ * list callbacks, d is not NULL on that last call unless an error occurred,
+ * and carries the generation and full flag, with index set to
+ * PA_INVALID_INDEX. \since 15.0 */
+typedef void (*pa_sink_input_info_delta_cb_t) (pa_context *c, const pa_sink_input_info_delta *d, int eol, void *userdata);
+
+/** Get the sink inputs that were created, changed or removed since
+ * generation, with only the field groups in fields, a mask of
+ * pa_sink_input_info_field_t. Pass 0 as generation the first time and
+ * the generation from the previous reply after that. This is much cheaper
+ * than pa_context_get_sink_input_info_list() for polling. Needs a server
+ * that implements protocol version 37. \since 15.0 */
+pa_operation* pa_context_get_sink_input_info_delta(pa_context *c, uint64_t generation, uint32_t fields, pa_sink_input_info_delta_cb_t cb, void *userdata);
+
 /** Move the specified sink input to a different sink. \since 0.9.5 */
 pa_operation* pa_context_move_sink_input_by_name(pa_context *c, uint32_t idx, const char *sink_name, pa_context_success_cb_t cb, void* userdata);
 
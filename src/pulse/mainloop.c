@@ -36,6 +36,12 @@
 #include <winsock2.h>
 #endif
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define USE_EPOLL
+#endif
+
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
@@ -43,6 +49,7 @@
 #include <pulsecore/poll.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/log.h>
@@ -66,8 +73,29 @@ struct pa_io_event {
     pa_io_event_destroy_cb_t destroy_callback;
 
     PA_LLIST_FIELDS(pa_io_event);
+
+#ifdef USE_EPOLL
+    /* Next io event watching the same fd, see struct io_fd */
+    pa_io_event *fd_next;
+#endif
+};
+
+#ifdef USE_EPOLL
+/* All io events on one fd share a single epoll registration, which
+ * watches the union of their flags */
+struct io_fd {
+    int fd;
+    bool registered:1;
+    uint32_t events;
+    pa_io_event *io_events;
 };
 
+struct ready_io_event {
+    pa_io_event *event;
+    pa_io_event_flags_t events;
+};
+#endif
+
 struct pa_time_event {
     pa_mainloop *mainloop;
     bool dead:1;
@@ -76,6 +104,9 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the mainloop's timer heap while enabled */
+    unsigned heap_idx;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -109,12 +140,35 @@ struct pa_mainloop {
     unsigned max_pollfds, n_pollfds;
 
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+    pa_usec_t prepared_deadline;
+
+    /* The enabled time events as a binary min-heap on their expiry
+     * time, n_enabled_time_events long */
+    pa_time_event **time_heap;
+    unsigned max_time_heap;
+    pa_time_event **due_time_events;
+    unsigned max_due_time_events;
+
+#ifdef USE_EPOLL
+    /* If epoll_fd is valid the io events are watched through it instead
+     * of pollfds, and the next timer deadline is programmed into
+     * timer_fd. */
+    int epoll_fd, timer_fd;
+    pa_usec_t timer_fd_deadline;
+    bool polled_epoll:1;
+    pa_hashmap *io_fds; /* fd -> struct io_fd */
+    struct epoll_event *epoll_events;
+    unsigned max_epoll_events;
+    struct ready_io_event *ready_io_events;
+    unsigned max_ready_io_events;
+#endif
 
     pa_mainloop_api api;
 
     int retval;
     bool quit:1;
+    /* Set by pa_threaded_mainloop, nothing but the loop runs in its thread */
+    bool has_own_thread:1;
 
     int wakeup_pipe[2];
     int wakeup_pipe_type;
@@ -132,6 +186,14 @@ struct pa_mainloop {
     int poll_func_ret;
 };
 
+static bool using_epoll(pa_mainloop *m) {
+#ifdef USE_EPOLL
+    return m->epoll_fd >= 0;
+#else
+    return false;
+#endif
+}
+
 static short map_flags_to_libc(pa_io_event_flags_t flags) {
     return (short)
         ((flags & PA_IO_EVENT_INPUT ? POLLIN : 0) |
@@ -148,6 +210,153 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+#ifdef USE_EPOLL
+static uint32_t map_flags_to_epoll(pa_io_event_flags_t flags) {
+    return
+        (flags & PA_IO_EVENT_INPUT ? EPOLLIN : 0) |
+        (flags & PA_IO_EVENT_OUTPUT ? EPOLLOUT : 0) |
+        (flags & PA_IO_EVENT_ERROR ? EPOLLERR : 0) |
+        (flags & PA_IO_EVENT_HANGUP ? EPOLLHUP : 0);
+}
+
+static pa_io_event_flags_t map_flags_from_epoll(uint32_t flags) {
+    return
+        (flags & EPOLLIN ? PA_IO_EVENT_INPUT : 0) |
+        (flags & EPOLLOUT ? PA_IO_EVENT_OUTPUT : 0) |
+        (flags & EPOLLERR ? PA_IO_EVENT_ERROR : 0) |
+        (flags & EPOLLHUP ? PA_IO_EVENT_HANGUP : 0);
+}
+
+static void epoll_done(pa_mainloop *m) {
+    if (m->io_fds) {
+        pa_hashmap_free(m->io_fds);
+        m->io_fds = NULL;
+    }
+
+    if (m->timer_fd >= 0) {
+        pa_close(m->timer_fd);
+        m->timer_fd = -1;
+    }
+
+    if (m->epoll_fd >= 0) {
+        pa_close(m->epoll_fd);
+        m->epoll_fd = -1;
+    }
+
+    m->rebuild_pollfds = true;
+}
+
+static void epoll_init(pa_mainloop *m) {
+    struct epoll_event ev;
+
+    m->epoll_fd = m->timer_fd = -1;
+    m->timer_fd_deadline = PA_USEC_INVALID;
+
+    if (getenv("PULSE_MAINLOOP_NO_EPOLL"))
+        return;
+
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (m->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        goto fail;
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = m->wakeup_pipe[0];
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->wakeup_pipe[0], &ev) < 0)
+        goto fail;
+
+    ev.data.fd = m->timer_fd;
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->timer_fd, &ev) < 0)
+        goto fail;
+
+    m->io_fds = pa_hashmap_new_full(NULL, NULL, NULL, pa_xfree);
+    return;
+
+fail:
+    pa_log_debug("Not using epoll: %s", pa_cstrerror(errno));
+    epoll_done(m);
+}
+
+/* Brings the epoll registration of f in line with its io events, and
+ * forgets about f once there are none left */
+static int io_fd_sync(pa_mainloop *m, struct io_fd *f) {
+    struct epoll_event ev;
+    pa_io_event *e;
+    uint32_t events = 0;
+    int r;
+
+    if (!f->io_events) {
+        /* Fails if the fd was closed already, nothing to do then */
+        if (f->registered)
+            (void) epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+
+        pa_hashmap_remove_and_free(m->io_fds, PA_INT_TO_PTR(f->fd));
+        return 0;
+    }
+
+    for (e = f->io_events; e; e = e->fd_next)
+        events |= map_flags_to_epoll(e->events);
+
+    if (f->registered && f->events == events)
+        return 0;
+
+    pa_zero(ev);
+    ev.events = events;
+    ev.data.fd = f->fd;
+
+    /* The fd may have been closed and reopened behind our back while
+     * an io event was still watching it, which drops or keeps the
+     * registration depending on whether it was shared */
+    if (f->registered) {
+        if ((r = epoll_ctl(m->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev)) < 0 && errno == ENOENT)
+            r = epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev);
+    } else {
+        if ((r = epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev)) < 0 && errno == EEXIST)
+            r = epoll_ctl(m->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev);
+    }
+
+    if (r < 0) {
+        /* E.g. regular files, which poll() handles but epoll doesn't */
+        pa_log_debug("Falling back to poll(), epoll_ctl() failed for fd %d: %s", f->fd, pa_cstrerror(errno));
+        epoll_done(m);
+        return -1;
+    }
+
+    f->registered = true;
+    f->events = events;
+    return 0;
+}
+
+static void io_fd_attach(pa_mainloop *m, pa_io_event *e) {
+    struct io_fd *f;
+
+    if (!(f = pa_hashmap_get(m->io_fds, PA_INT_TO_PTR(e->fd)))) {
+        f = pa_xnew0(struct io_fd, 1);
+        f->fd = e->fd;
+        pa_hashmap_put(m->io_fds, PA_INT_TO_PTR(f->fd), f);
+    }
+
+    e->fd_next = f->io_events;
+    f->io_events = e;
+
+    io_fd_sync(m, f);
+}
+
+static void io_fd_detach(pa_mainloop *m, pa_io_event *e) {
+    struct io_fd *f;
+    pa_io_event **i;
+
+    pa_assert_se(f = pa_hashmap_get(m->io_fds, PA_INT_TO_PTR(e->fd)));
+
+    for (i = &f->io_events; *i != e; i = &(*i)->fd_next)
+        pa_assert(*i);
+
+    *i = e->fd_next;
+
+    io_fd_sync(m, f);
+}
+#endif
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api *a,
@@ -180,6 +389,11 @@ static pa_io_event* mainloop_io_new(
     m->rebuild_pollfds = true;
     m->n_io_events ++;
 
+#ifdef USE_EPOLL
+    if (m->epoll_fd >= 0)
+        io_fd_attach(m, e);
+#endif
+
     pa_mainloop_wakeup(m);
 
     return e;
@@ -199,6 +413,11 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
     else
         e->mainloop->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    if (e->mainloop->epoll_fd >= 0)
+        io_fd_sync(e->mainloop, pa_hashmap_get(e->mainloop->io_fds, PA_INT_TO_PTR(e->fd)));
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -212,6 +431,11 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->n_io_events --;
     e->mainloop->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    if (e->mainloop->epoll_fd >= 0)
+        io_fd_detach(e->mainloop, e);
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -290,6 +514,74 @@ static void mainloop_defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy
 }
 
 /* Time events */
+static void time_heap_set(pa_mainloop *m, unsigned i, pa_time_event *e) {
+    m->time_heap[i] = e;
+    e->heap_idx = i;
+}
+
+static void time_heap_up(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[parent]);
+        i = parent;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_down(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= m->n_enabled_time_events)
+            break;
+
+        if (child + 1 < m->n_enabled_time_events && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[child]);
+        i = child;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    if (m->n_enabled_time_events >= m->max_time_heap) {
+        m->max_time_heap = m->max_time_heap ? m->max_time_heap * 2 : 16;
+        m->time_heap = pa_xrealloc(m->time_heap, sizeof(pa_time_event*) * m->max_time_heap);
+    }
+
+    time_heap_set(m, m->n_enabled_time_events++, e);
+    time_heap_up(m, e->heap_idx);
+}
+
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    pa_time_event *last;
+
+    pa_assert(m->n_enabled_time_events > 0);
+    pa_assert(m->time_heap[e->heap_idx] == e);
+
+    last = m->time_heap[--m->n_enabled_time_events];
+
+    if (last != e) {
+        time_heap_set(m, e->heap_idx, last);
+        time_heap_up(m, last->heap_idx);
+        time_heap_down(m, last->heap_idx);
+    }
+}
+
 static pa_usec_t make_rt(const struct timeval *tv, bool *use_rtclock) {
     struct timeval ttv;
 
@@ -336,14 +628,7 @@ static pa_time_event* mainloop_time_new(
         e->time = t;
         e->use_rtclock = use_rtclock;
 
-        m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -368,27 +653,22 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     t = make_rt(tv, &use_rtclock);
 
     valid = (t != PA_USEC_INVALID);
-    if (e->enabled && !valid) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && valid)
-        e->mainloop->n_enabled_time_events++;
 
-    if ((e->enabled = valid)) {
+    if (valid) {
         e->time = t;
         e->use_rtclock = use_rtclock;
-        pa_mainloop_wakeup(e->mainloop);
-    }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+        if (e->enabled) {
+            time_heap_up(e->mainloop, e->heap_idx);
+            time_heap_down(e->mainloop, e->heap_idx);
+        } else
+            time_heap_insert(e->mainloop, e);
 
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
+        pa_mainloop_wakeup(e->mainloop);
+    } else if (e->enabled)
+        time_heap_remove(e->mainloop, e);
 
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
-    }
+    e->enabled = valid;
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -399,14 +679,10 @@ static void mainloop_time_free(pa_time_event *e) {
     e->mainloop->time_events_please_scan ++;
 
     if (e->enabled) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
+        time_heap_remove(e->mainloop, e);
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
     /* no wakeup needed here. Think about it! */
 }
 
@@ -480,6 +756,10 @@ pa_mainloop *pa_mainloop_new(void) {
 
     m->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    epoll_init(m);
+#endif
+
     m->api = vtable;
     m->api.userdata = m;
 
@@ -535,8 +815,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
             }
 
             if (!e->dead && e->enabled) {
-                pa_assert(m->n_enabled_time_events > 0);
-                m->n_enabled_time_events--;
+                time_heap_remove(m, e);
                 e->enabled = false;
             }
 
@@ -590,6 +869,14 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->time_heap);
+    pa_xfree(m->due_time_events);
+
+#ifdef USE_EPOLL
+    epoll_done(m);
+    pa_xfree(m->epoll_events);
+    pa_xfree(m->ready_io_events);
+#endif
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -705,30 +992,76 @@ static unsigned dispatch_defer(pa_mainloop *m) {
     return r;
 }
 
-static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
-    pa_assert(m);
+#ifdef USE_EPOLL
+static unsigned dispatch_epoll(pa_mainloop *m) {
+    pa_io_event *e;
+    unsigned r = 0, n = 0, i;
+    int k;
+
+    pa_assert(m->poll_func_ret > 0);
 
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
+    if (m->max_ready_io_events < m->n_io_events) {
+        m->max_ready_io_events = m->n_io_events * 2;
+        m->ready_io_events = pa_xrealloc(m->ready_io_events, sizeof(struct ready_io_event) * m->max_ready_io_events);
+    }
+
+    /* Resolve everything before running any callback, they may free or
+     * add io events */
+    for (k = 0; k < m->poll_func_ret; k++) {
+        struct epoll_event *ev = &m->epoll_events[k];
+        struct io_fd *f;
 
-    PA_LLIST_FOREACH(t, m->time_events) {
+        if (ev->data.fd == m->timer_fd) {
+            uint64_t expirations;
+
+            /* Only there to wake us up, the timers are dispatched
+             * by dispatch_timeout() */
+            if (read(m->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                m->timer_fd_deadline = PA_USEC_INVALID;
+            continue;
+        }
+
+        /* The wakeup pipe is drained in pa_mainloop_prepare() */
+        if (ev->data.fd == m->wakeup_pipe[0])
+            continue;
 
-        if (t->dead || !t->enabled)
+        /* A timer callback may have made us fall back to poll() */
+        if (!m->io_fds || !(f = pa_hashmap_get(m->io_fds, PA_INT_TO_PTR(ev->data.fd))))
             continue;
 
-        if (!n || t->time < n->time) {
-            n = t;
+        for (e = f->io_events; e; e = e->fd_next) {
+            pa_io_event_flags_t flags;
 
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
+            /* Like poll(), always report errors and hangups */
+            flags = map_flags_from_epoll(ev->events) & (e->events | PA_IO_EVENT_ERROR | PA_IO_EVENT_HANGUP);
+            if (!flags)
+                continue;
+
+            pa_assert(n < m->max_ready_io_events);
+            m->ready_io_events[n].event = e;
+            m->ready_io_events[n].events = flags;
+            n++;
         }
     }
 
-    m->cached_next_time_event = n;
-    return n;
+    for (i = 0; i < n; i++) {
+
+        if (m->quit)
+            break;
+
+        e = m->ready_io_events[i].event;
+
+        if (e->dead)
+            continue;
+
+        pa_assert(e->callback);
+        e->callback(&m->api, e, e->fd, m->ready_io_events[i].events, e->userdata);
+        r++;
+    }
+
+    return r;
 }
+#endif
 
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     pa_time_event *t;
@@ -737,7 +1070,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     if (m->n_enabled_time_events <= 0)
         return PA_USEC_INVALID;
 
-    pa_assert_se(t = find_next_time_event(m));
+    t = m->time_heap[0];
 
     if (t->time <= 0)
         return 0;
@@ -750,10 +1083,16 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     return t->time - clock_now;
 }
 
+static int time_event_compare(const void *a, const void *b) {
+    const pa_time_event *x = *(const pa_time_event * const *) a, *y = *(const pa_time_event * const *) b;
+
+    return x->time < y->time ? -1 : (x->time > y->time ? 1 : 0);
+}
+
 static unsigned dispatch_timeout(pa_mainloop *m) {
     pa_time_event *e;
     pa_usec_t now;
-    unsigned r = 0;
+    unsigned r = 0, n = 0, i;
     pa_assert(m);
 
     if (m->n_enabled_time_events <= 0)
@@ -761,25 +1100,51 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    if (m->time_heap[0]->time > now)
+        return 0;
+
+    if (m->max_due_time_events < m->n_enabled_time_events) {
+        m->max_due_time_events = m->max_time_heap;
+        m->due_time_events = pa_xrealloc(m->due_time_events, sizeof(pa_time_event*) * m->max_due_time_events);
+    }
+
+    /* The expired events form a subtree at the top of the heap. Collect
+     * them before running any callback, as those reshuffle the heap. */
+    m->due_time_events[n++] = m->time_heap[0];
+
+    for (i = 0; i < n; i++) {
+        unsigned child = 2 * m->due_time_events[i]->heap_idx + 1;
+
+        if (child < m->n_enabled_time_events && m->time_heap[child]->time <= now)
+            m->due_time_events[n++] = m->time_heap[child];
+
+        if (child + 1 < m->n_enabled_time_events && m->time_heap[child + 1]->time <= now)
+            m->due_time_events[n++] = m->time_heap[child + 1];
+    }
+
+    if (n > 1)
+        qsort(m->due_time_events, n, sizeof(pa_time_event*), time_event_compare);
+
+    for (i = 0; i < n; i++) {
+        struct timeval tv;
 
         if (m->quit)
             break;
 
-        if (e->dead || !e->enabled)
+        e = m->due_time_events[i];
+
+        /* An earlier callback may have freed or moved it */
+        if (e->dead || !e->enabled || e->time > now)
             continue;
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        pa_assert(e->callback);
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
 
-            r++;
-        }
+        r++;
     }
 
     return r;
@@ -815,13 +1180,17 @@ int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
 
     if (m->n_enabled_defer_events <= 0) {
 
-        if (m->rebuild_pollfds)
+        if (m->rebuild_pollfds && !using_epoll(m))
             rebuild_pollfds(m);
 
         m->prepared_timeout = calc_next_timeout(m);
+        m->prepared_deadline = m->n_enabled_time_events > 0 ? m->time_heap[0]->time : PA_USEC_INVALID;
+
         if (timeout >= 0) {
-            if (timeout < m->prepared_timeout || m->prepared_timeout == PA_USEC_INVALID)
+            if (timeout < m->prepared_timeout || m->prepared_timeout == PA_USEC_INVALID) {
                 m->prepared_timeout = timeout;
+                m->prepared_deadline = PA_USEC_INVALID;
+            }
         }
     }
 
@@ -845,6 +1214,45 @@ static int usec_to_timeout(pa_usec_t u) {
     return timeout;
 }
 
+#ifdef USE_EPOLL
+static int epoll_poll(pa_mainloop *m) {
+    int timeout;
+    unsigned l;
+
+    if (m->prepared_timeout == 0)
+        timeout = 0;
+    else if (m->prepared_deadline != PA_USEC_INVALID) {
+        /* Wait for the timer fd rather than passing a timeout, which
+         * epoll_wait() only takes in milliseconds. Usually the next
+         * deadline stays the same over many iterations. */
+        timeout = -1;
+
+        if (m->prepared_deadline != m->timer_fd_deadline) {
+            struct itimerspec its;
+
+            pa_zero(its);
+            pa_timespec_store(&its.it_value, m->prepared_deadline);
+
+            if (timerfd_settime(m->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+                pa_log_debug("timerfd_settime(): %s", pa_cstrerror(errno));
+                timeout = usec_to_timeout(m->prepared_timeout);
+            } else
+                m->timer_fd_deadline = m->prepared_deadline;
+        }
+    } else
+        timeout = usec_to_timeout(m->prepared_timeout);
+
+    l = pa_hashmap_size(m->io_fds) + 2;
+    if (m->max_epoll_events < l) {
+        l *= 2;
+        m->epoll_events = pa_xrealloc(m->epoll_events, sizeof(struct epoll_event) * l);
+        m->max_epoll_events = l;
+    }
+
+    return epoll_wait(m->epoll_fd, m->epoll_events, (int) m->max_epoll_events, timeout);
+}
+#endif
+
 int pa_mainloop_poll(pa_mainloop *m) {
     pa_assert(m);
     pa_assert(m->state == STATE_PREPARED);
@@ -854,8 +1262,24 @@ int pa_mainloop_poll(pa_mainloop *m) {
 
     m->state = STATE_POLLING;
 
+#ifdef USE_EPOLL
+    m->polled_epoll = false;
+#endif
+
     if (m->n_enabled_defer_events)
         m->poll_func_ret = 0;
+#ifdef USE_EPOLL
+    else if (using_epoll(m)) {
+        m->polled_epoll = true;
+
+        if ((m->poll_func_ret = epoll_poll(m)) < 0) {
+            if (errno == EINTR)
+                m->poll_func_ret = 0;
+            else
+                pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+        }
+    }
+#endif
     else {
         pa_assert(!m->rebuild_pollfds);
 
@@ -913,8 +1337,14 @@ int pa_mainloop_dispatch(pa_mainloop *m) {
         if (m->quit)
             goto quit;
 
-        if (m->poll_func_ret > 0)
-            dispatched += dispatch_pollfds(m);
+        if (m->poll_func_ret > 0) {
+#ifdef USE_EPOLL
+            if (m->polled_epoll)
+                dispatched += dispatch_epoll(m);
+            else
+#endif
+                dispatched += dispatch_pollfds(m);
+        }
     }
 
     if (m->quit)
@@ -988,6 +1418,12 @@ void pa_mainloop_set_poll_func(pa_mainloop *m, pa_poll_func poll_func, void *use
 
     m->poll_func = poll_func;
     m->poll_func_userdata = userdata;
+
+#ifdef USE_EPOLL
+    /* The poll function expects to see the pollfds */
+    if (poll_func && using_epoll(m))
+        epoll_done(m);
+#endif
 }
 
 bool pa_mainloop_is_our_api(const pa_mainloop_api *m) {
@@ -995,3 +1431,15 @@ bool pa_mainloop_is_our_api(const pa_mainloop_api *m) {
 
     return m->io_new == mainloop_io_new;
 }
+
+void pa_mainloop_set_has_own_thread(pa_mainloop *m) {
+    pa_assert(m);
+
+    m->has_own_thread = true;
+}
+
+bool pa_mainloop_api_has_own_thread(const pa_mainloop_api *m) {
+    pa_assert(m);
+
+    return pa_mainloop_is_our_api(m) && ((pa_mainloop *) m->userdata)->has_own_thread;
+}
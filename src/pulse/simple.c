@@ -318,6 +318,89 @@ unlock_and_fail:
     return -1;
 }
 
+void* pa_simple_alloc_buffer(pa_simple *p, size_t *length, int *rerror) {
+    void *data = NULL;
+    int r;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, NULL);
+    CHECK_VALIDITY_RETURN_ANY(rerror, length && *length > 0, PA_ERR_INVALID, NULL);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+
+    r = pa_stream_alloc_buffer(p->stream, &data, length);
+    CHECK_SUCCESS_GOTO(p, rerror, r >= 0, unlock_and_fail);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return data;
+
+unlock_and_fail:
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return NULL;
+}
+
+int pa_simple_write_buffer(pa_simple *p, void *data, size_t length, int *rerror) {
+    size_t l;
+    int r;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, data, PA_ERR_INVALID, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, length > 0, PA_ERR_INVALID, -1);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+
+    /* The buffer isn't split, it may overshoot the request by less than
+     * a block */
+    while (!(l = pa_stream_writable_size(p->stream))) {
+        pa_threaded_mainloop_wait(p->mainloop);
+        CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+    }
+
+    CHECK_SUCCESS_GOTO(p, rerror, l != (size_t) -1, unlock_and_fail);
+
+    r = pa_stream_write_buffer(p->stream, data, length, 0LL, PA_SEEK_RELATIVE);
+    CHECK_SUCCESS_GOTO(p, rerror, r >= 0, unlock_and_fail);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return 0;
+
+unlock_and_fail:
+    if (p->stream)
+        pa_stream_free_buffer(p->stream, data);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return -1;
+}
+
+int pa_simple_free_buffer(pa_simple *p, void *data, int *rerror) {
+    int r;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, data, PA_ERR_INVALID, -1);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    CHECK_SUCCESS_GOTO(p, rerror, p->stream, unlock_and_fail);
+
+    r = pa_stream_free_buffer(p->stream, data);
+    CHECK_SUCCESS_GOTO(p, rerror, r >= 0, unlock_and_fail);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return 0;
+
+unlock_and_fail:
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return -1;
+}
+
 int pa_simple_read(pa_simple *p, void*data, size_t length, int *rerror) {
     pa_assert(p);
 
@@ -134,6 +134,21 @@ void pa_simple_free(pa_simple *s);
 /** Write some data to the server. Returns zero on success, negative on error. */
 int pa_simple_write(pa_simple *s, const void *data, size_t bytes, int *error);
 
+/** Allocate a buffer of up to \a *bytes bytes to place audio data in, see
+ * pa_stream_alloc_buffer(). On return \a *bytes is the actual size.
+ * Returns NULL on error. \since 15.0 */
+void* pa_simple_alloc_buffer(pa_simple *s, size_t *bytes, int *error);
+
+/** Write a buffer from pa_simple_alloc_buffer() to the server without
+ * copying it. Blocks until the server asks for more data. Afterwards the
+ * buffer may no longer be accessed, also if the call failed. Returns zero
+ * on success, negative on error. \since 15.0 */
+int pa_simple_write_buffer(pa_simple *s, void *data, size_t bytes, int *error);
+
+/** Give back a buffer from pa_simple_alloc_buffer() without writing it.
+ * Returns zero on success, negative on error. \since 15.0 */
+int pa_simple_free_buffer(pa_simple *s, void *data, int *error);
+
 /** Cork on=1/off=0 stream */
 int pa_simple_cork(pa_simple *p, int cork, int *rerror);
 
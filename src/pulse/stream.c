@@ -81,6 +81,11 @@ static void reset_callbacks(pa_stream *s) {
     s->buffer_attr_userdata = NULL;
 }
 
+static void write_buffer_free(pa_memblock *b) {
+    pa_memblock_release(b);
+    pa_memblock_unref(b);
+}
+
 static pa_stream *pa_stream_new_with_proplist_internal(
         pa_context *c,
         const char *name,
@@ -172,6 +177,7 @@ static pa_stream *pa_stream_new_with_proplist_internal(
 
     s->write_memblock = NULL;
     s->write_data = NULL;
+    s->write_buffers = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) write_buffer_free);
 
     pa_memchunk_reset(&s->peek_memchunk);
     s->peek_data = NULL;
@@ -290,6 +296,8 @@ static void stream_free(pa_stream *s) {
         pa_memblock_unref(s->write_memblock);
     }
 
+    pa_hashmap_free(s->write_buffers);
+
     if (s->peek_memchunk.memblock) {
         if (s->peek_data)
             pa_memblock_release(s->peek_memchunk.memblock);
@@ -1471,6 +1479,138 @@ int pa_stream_cancel_write(
     return 0;
 }
 
+/* Moves the write index on by what was just sent */
+static void account_write(pa_stream *s, size_t length, int64_t offset, pa_seek_mode_t seek) {
+    /* This is obviously wrong since we ignore the seeking index . But
+     * that's OK, the server side applies the same error */
+    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
+
+#ifdef STREAM_DEBUG
+    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
+#endif
+
+    if (s->direction == PA_STREAM_PLAYBACK) {
+
+        /* Update latency request correction */
+        if (s->write_index_corrections[s->current_write_index_correction].valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
+                s->write_index_corrections[s->current_write_index_correction].absolute = true;
+                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
+                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
+            } else
+                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
+        }
+
+        /* Update the write index in the already available latency data */
+        if (s->timing_info_valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->timing_info.write_index_corrupt = false;
+                s->timing_info.write_index = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->timing_info.write_index_corrupt)
+                    s->timing_info.write_index += offset + (int64_t) length;
+            } else
+                s->timing_info.write_index_corrupt = true;
+        }
+
+        if (!s->timing_info_valid || s->timing_info.write_index_corrupt)
+            request_auto_timing_update(s, true);
+    }
+}
+
+int pa_stream_alloc_buffer(
+        pa_stream *s,
+        void **data,
+        size_t *nbytes) {
+
+    pa_memblock *b;
+    void *d;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, data, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
+
+    /* Larger blocks would not come from the pool and had to be copied */
+    *nbytes = PA_MIN(*nbytes, pa_frame_align(pa_mempool_block_size_max(s->context->mempool), &s->sample_spec));
+    PA_CHECK_VALIDITY(s->context, *nbytes != 0, PA_ERR_INVALID);
+
+    b = pa_memblock_new(s->context->mempool, *nbytes);
+    d = pa_memblock_acquire(b);
+
+    pa_assert_se(pa_hashmap_put(s->write_buffers, d, b) == 0);
+
+    *data = d;
+    *nbytes = pa_memblock_get_length(b);
+
+    return 0;
+}
+
+int pa_stream_write_buffer(
+        pa_stream *s,
+        void *data,
+        size_t length,
+        int64_t offset,
+        pa_seek_mode_t seek) {
+
+    pa_memblock *b;
+    pa_memchunk chunk;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    b = data ? pa_hashmap_get(s->write_buffers, data) : NULL;
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, seek <= PA_SEEK_RELATIVE_END, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || (seek == PA_SEEK_RELATIVE && offset == 0), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, b, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, length > 0 && length <= pa_memblock_get_length(b), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, offset % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+
+    pa_assert_se(pa_hashmap_remove(s->write_buffers, data) == b);
+    pa_memblock_release(b);
+
+    chunk.memblock = b;
+    chunk.index = 0;
+    chunk.length = length;
+
+    /* The block goes out by reference if it can be exported */
+    pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, &chunk);
+    pa_memblock_unref(chunk.memblock);
+
+    account_write(s, length, offset, seek);
+
+    return 0;
+}
+
+int pa_stream_free_buffer(
+        pa_stream *s,
+        void *data) {
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, data && pa_hashmap_get(s->write_buffers, data), PA_ERR_INVALID);
+
+    pa_hashmap_remove_and_free(s->write_buffers, data);
+
+    return 0;
+}
+
 int pa_stream_write_ext_free(
         pa_stream *s,
         const void *data,
@@ -1561,46 +1701,7 @@ int pa_stream_write_ext_free(
             free_cb(free_cb_data);
     }
 
-    /* This is obviously wrong since we ignore the seeking index . But
-     * that's OK, the server side applies the same error */
-    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
-
-#ifdef STREAM_DEBUG
-    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
-#endif
-
-    if (s->direction == PA_STREAM_PLAYBACK) {
-
-        /* Update latency request correction */
-        if (s->write_index_corrections[s->current_write_index_correction].valid) {
-
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
-                s->write_index_corrections[s->current_write_index_correction].absolute = true;
-                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
-                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
-            } else
-                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
-        }
-
-        /* Update the write index in the already available latency data */
-        if (s->timing_info_valid) {
-
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->timing_info.write_index_corrupt = false;
-                s->timing_info.write_index = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->timing_info.write_index_corrupt)
-                    s->timing_info.write_index += offset + (int64_t) length;
-            } else
-                s->timing_info.write_index_corrupt = true;
-        }
-
-        if (!s->timing_info_valid || s->timing_info.write_index_corrupt)
-            request_auto_timing_update(s, true);
-    }
+    account_write(s, length, offset, seek);
 
     return 0;
 }
@@ -529,6 +529,44 @@ int pa_stream_write_ext_free(
         int64_t offset           /**< Offset for seeking, must be 0 for upload streams */,
         pa_seek_mode_t seek      /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */);
 
+/** Allocate a buffer of up to \a *nbytes bytes from the context's
+ * memory pool, for the application to place audio data in and hand to
+ * pa_stream_write_buffer(). Pass (size_t) -1 in \a *nbytes for the largest
+ * size that is available. On return \a *nbytes is the actual size, which
+ * may be smaller than requested.
+ *
+ * Unlike with pa_stream_begin_write(), any number of buffers may be
+ * outstanding at a time, and they may be filled from any thread. When
+ * shared memory is in use, the server reads the written data right out of
+ * the buffer, it is not copied. If the context's pool was set with
+ * pa_context_set_memfd_pool(), the buffers lie in that memfd region.
+ *
+ * Buffers that are not written have to be given back with
+ * pa_stream_free_buffer(). Freeing the stream frees them too. Returns
+ * zero on success. \since 15.0 */
+int pa_stream_alloc_buffer(
+        pa_stream *p,
+        void **data,
+        size_t *nbytes);
+
+/** Write a buffer returned by pa_stream_alloc_buffer() to the server, in
+ * the same way as pa_stream_write(). \a data has to be the pointer
+ * returned by pa_stream_alloc_buffer(), \a nbytes may be less than the
+ * size of the buffer. On success the buffer is owned by the library again
+ * and may no longer be accessed. Returns zero on success. \since 15.0 */
+int pa_stream_write_buffer(
+        pa_stream *p             /**< The stream to use */,
+        void *data               /**< A buffer from pa_stream_alloc_buffer() */,
+        size_t nbytes            /**< The length of the data to write in bytes, must be in multiples of the stream's sample spec frame size */,
+        int64_t offset           /**< Offset for seeking, must be 0 for upload streams, must be in multiples of the stream's sample spec frame size */,
+        pa_seek_mode_t seek      /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */);
+
+/** Give back a buffer returned by pa_stream_alloc_buffer() without
+ * writing it. Returns zero on success. \since 15.0 */
+int pa_stream_free_buffer(
+        pa_stream *p,
+        void *data);
+
 /** Read the next fragment from the buffer (for recording streams).
  * If there is data at the current read index, \a data will point to
  * the actual data and \a nbytes will contain the size of the data in
@@ -31,6 +31,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/mainloop.h>
+#include <pulse/internal.h>
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/log.h>
@@ -120,6 +121,7 @@ pa_threaded_mainloop *pa_threaded_mainloop_new(void) {
     m->accept_cond = pa_cond_new();
 
     pa_mainloop_set_poll_func(m->real_mainloop, poll_func, m->mutex);
+    pa_mainloop_set_has_own_thread(m->real_mainloop);
 
     return m;
 }
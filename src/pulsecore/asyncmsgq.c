@@ -35,6 +35,13 @@
 
 #include "asyncmsgq.h"
 
+/* The queue grows up to this many entries before writers start to
+ * queue locally or block */
+#define ASYNCMSGQ_SIZE_MAX 4096
+
+/* How many messages the reader takes off the queue per wake-up */
+#define ASYNCMSGQ_BATCH 32
+
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
 
@@ -55,13 +62,18 @@ struct pa_asyncmsgq {
     pa_mutex *mutex; /* only for the writer side */
 
     struct asyncmsgq_item *current;
+
+    /* Items already taken off the asyncq but not handed out yet. Only
+     * accessed from the reader side. */
+    void *batch[ASYNCMSGQ_BATCH];
+    unsigned batch_idx, n_batch;
 };
 
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_asyncq *asyncq;
     pa_asyncmsgq *a;
 
-    asyncq = pa_asyncq_new(size);
+    asyncq = pa_asyncq_new_growable(size, PA_MAX(size, ASYNCMSGQ_SIZE_MAX));
     if (!asyncq)
         return NULL;
 
@@ -71,15 +83,30 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     a->asyncq = asyncq;
     pa_assert_se(a->mutex = pa_mutex_new(false, true));
     a->current = NULL;
+    a->batch_idx = a->n_batch = 0;
 
     return a;
 }
 
+static struct asyncmsgq_item *next_item(pa_asyncmsgq *a, bool wait_op) {
+    pa_assert(a);
+
+    if (a->batch_idx >= a->n_batch) {
+        a->batch_idx = 0;
+        a->n_batch = pa_asyncq_pop_many(a->asyncq, a->batch, ASYNCMSGQ_BATCH, wait_op);
+
+        if (a->n_batch == 0)
+            return NULL;
+    }
+
+    return a->batch[a->batch_idx++];
+}
+
 static void asyncmsgq_free(pa_asyncmsgq *a) {
     struct asyncmsgq_item *i;
     pa_assert(a);
 
-    while ((i = pa_asyncq_pop(a->asyncq, false))) {
+    while ((i = next_item(a, false))) {
 
         pa_assert(!i->semaphore);
 
@@ -177,7 +204,7 @@ int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **u
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
 
-    if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
+    if (!(a->current = next_item(a, wait_op))) {
 /*         pa_log("failure"); */
         return -1;
     }
@@ -290,6 +317,9 @@ int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
+    if (a->batch_idx < a->n_batch)
+        return -1;
+
     return pa_asyncq_read_before_poll(a->asyncq);
 }
 
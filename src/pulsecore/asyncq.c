@@ -55,8 +55,20 @@ struct localq {
     PA_LLIST_FIELDS(struct localq);
 };
 
-struct pa_asyncq {
+/* The ring is made of one or more segments. When a growable queue runs
+ * full the writer allocates a segment twice the size of the current one,
+ * links it in and continues writing there. The reader drains the old
+ * segment completely, then follows the link and frees it. Only the writer
+ * ever touches write_segment/write_idx and only the reader ever touches
+ * read_segment/read_idx, so no locking is needed. */
+struct segment {
     unsigned size;
+    pa_atomic_ptr_t next;
+};
+
+struct pa_asyncq {
+    unsigned max_size;
+    struct segment *read_segment, *write_segment;
     unsigned read_idx;
     unsigned write_idx;
     pa_fdsem *read_fdsem, *write_fdsem;
@@ -68,35 +80,48 @@ struct pa_asyncq {
 
 PA_STATIC_FLIST_DECLARE(localq, 0, pa_xfree);
 
-#define PA_ASYNCQ_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_asyncq))))
+#define PA_SEGMENT_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct segment))))
 
-static unsigned reduce(pa_asyncq *l, unsigned value) {
-    return value & (unsigned) (l->size - 1);
+static unsigned reduce(struct segment *s, unsigned value) {
+    return value & (unsigned) (s->size - 1);
 }
 
-pa_asyncq *pa_asyncq_new(unsigned size) {
+static struct segment *segment_new(unsigned size) {
+    struct segment *s;
+
+    s = pa_xmalloc0(PA_ALIGN(sizeof(struct segment)) + (sizeof(pa_atomic_ptr_t) * size));
+    s->size = size;
+
+    return s;
+}
+
+pa_asyncq *pa_asyncq_new_growable(unsigned size, unsigned max_size) {
     pa_asyncq *l;
 
     if (!size)
         size = ASYNCQ_SIZE;
 
     pa_assert(pa_is_power_of_two(size));
+    pa_assert(max_size == 0 || max_size >= size);
 
-    l = pa_xmalloc0(PA_ALIGN(sizeof(pa_asyncq)) + (sizeof(pa_atomic_ptr_t) * size));
+    l = pa_xnew0(pa_asyncq, 1);
 
-    l->size = size;
+    l->max_size = PA_MAX(size, max_size);
+    l->read_segment = l->write_segment = segment_new(size);
 
     PA_LLIST_HEAD_INIT(struct localq, l->localq);
     l->last_localq = NULL;
     l->waiting_for_post = false;
 
     if (!(l->read_fdsem = pa_fdsem_new())) {
+        pa_xfree(l->read_segment);
         pa_xfree(l);
         return NULL;
     }
 
     if (!(l->write_fdsem = pa_fdsem_new())) {
         pa_fdsem_free(l->read_fdsem);
+        pa_xfree(l->read_segment);
         pa_xfree(l);
         return NULL;
     }
@@ -104,8 +129,13 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
     return l;
 }
 
+pa_asyncq *pa_asyncq_new(unsigned size) {
+    return pa_asyncq_new_growable(size, 0);
+}
+
 void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
     struct localq *q;
+    struct segment *s;
     pa_assert(l);
 
     if (free_cb) {
@@ -125,28 +155,59 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
             pa_xfree(q);
     }
 
+    while ((s = l->read_segment)) {
+        l->read_segment = pa_atomic_ptr_load(&s->next);
+        pa_xfree(s);
+    }
+
     pa_fdsem_free(l->read_fdsem);
     pa_fdsem_free(l->write_fdsem);
     pa_xfree(l);
 }
 
+/* Stores one item without waking up the reader, the caller needs to post
+ * write_fdsem once it is done pushing. */
 static int push(pa_asyncq*l, void *p, bool wait_op) {
+    struct segment *s;
     unsigned idx;
     pa_atomic_ptr_t *cells;
 
     pa_assert(l);
     pa_assert(p);
 
-    cells = PA_ASYNCQ_CELLS(l);
+    s = l->write_segment;
+    cells = PA_SEGMENT_CELLS(s);
 
     _Y;
-    idx = reduce(l, l->write_idx);
+    idx = reduce(s, l->write_idx);
 
     if (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p)) {
 
+        if (s->size < l->max_size) {
+            struct segment *n;
+
+            /* The new segment is private until it is linked in, so the
+             * first item can be stored without further ado */
+            n = segment_new(s->size * 2);
+            pa_atomic_ptr_store(&PA_SEGMENT_CELLS(n)[0], p);
+
+            _Y;
+            pa_atomic_ptr_store(&s->next, n);
+
+            l->write_segment = n;
+            l->write_idx = 1;
+
+            pa_log_debug("Grew asyncq %p to %u entries.", (void*) l, n->size);
+            return 0;
+        }
+
         if (!wait_op)
             return -1;
 
+        /* Make sure the reader knows about whatever we pushed so far,
+         * otherwise we might wait for each other forever */
+        pa_fdsem_post(l->write_fdsem);
+
 /*         pa_log("sleeping on push"); */
 
         do {
@@ -157,21 +218,23 @@ static int push(pa_asyncq*l, void *p, bool wait_op) {
     _Y;
     l->write_idx++;
 
-    pa_fdsem_post(l->write_fdsem);
-
     return 0;
 }
 
 static bool flush_postq(pa_asyncq *l, bool wait_op) {
     struct localq *q;
+    bool pushed = false, ret = true;
 
     pa_assert(l);
 
     while ((q = l->last_localq)) {
 
-        if (push(l, q->data, wait_op) < 0)
-            return false;
+        if (push(l, q->data, wait_op) < 0) {
+            ret = false;
+            break;
+        }
 
+        pushed = true;
         l->last_localq = q->prev;
 
         PA_LLIST_REMOVE(struct localq, l->localq, q);
@@ -180,16 +243,35 @@ static bool flush_postq(pa_asyncq *l, bool wait_op) {
             pa_xfree(q);
     }
 
-    return true;
+    if (pushed)
+        pa_fdsem_post(l->write_fdsem);
+
+    return ret;
 }
 
-int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
+unsigned pa_asyncq_push_many(pa_asyncq *l, void *p[], unsigned n, bool wait_op) {
+    unsigned k;
+
     pa_assert(l);
+    pa_assert(p || n == 0);
 
     if (!flush_postq(l, wait_op))
-        return -1;
+        return 0;
+
+    for (k = 0; k < n; k++)
+        if (push(l, p[k], wait_op) < 0)
+            break;
+
+    if (k > 0)
+        pa_fdsem_post(l->write_fdsem);
+
+    return k;
+}
+
+int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
+    pa_assert(l);
 
-    return push(l, p, wait_op);
+    return pa_asyncq_push_many(l, &p, 1, wait_op) == 1 ? 0 : -1;
 }
 
 void pa_asyncq_post(pa_asyncq*l, void *p) {
@@ -220,39 +302,82 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     return;
 }
 
-void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
-    unsigned idx;
-    void *ret;
-    pa_atomic_ptr_t *cells;
+/* Returns the cell the next item will be read from. If the writer has
+ * moved on to a newer segment and the current one is drained, the old
+ * segment is released first. */
+static pa_atomic_ptr_t *read_cell(pa_asyncq *l) {
+
+    for (;;) {
+        struct segment *s, *n;
+        pa_atomic_ptr_t *cell;
+
+        s = l->read_segment;
+
+        _Y;
+        cell = &PA_SEGMENT_CELLS(s)[reduce(s, l->read_idx)];
+
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        if (!(n = pa_atomic_ptr_load(&s->next)))
+            return cell;
+
+        /* The writer may have filled this cell before it switched */
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        l->read_segment = n;
+        l->read_idx = 0;
+        pa_xfree(s);
+    }
+}
+
+unsigned pa_asyncq_pop_many(pa_asyncq *l, void *p[], unsigned n, bool wait_op) {
+    unsigned k = 0;
 
     pa_assert(l);
+    pa_assert(p || n == 0);
 
-    cells = PA_ASYNCQ_CELLS(l);
+    while (k < n) {
+        pa_atomic_ptr_t *cell;
+        void *ret;
 
-    _Y;
-    idx = reduce(l, l->read_idx);
+        cell = read_cell(l);
 
-    if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
+        if (!(ret = pa_atomic_ptr_load(cell))) {
 
-        if (!wait_op)
-            return NULL;
+            /* Only block if we have nothing to return at all */
+            if (!wait_op || k > 0)
+                break;
 
-/*         pa_log("sleeping on pop"); */
+/*             pa_log("sleeping on pop"); */
 
-        do {
             pa_fdsem_wait(l->write_fdsem);
-        } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+            continue;
+        }
+
+        /* Guaranteed to succeed if we only have a single reader */
+        pa_assert_se(pa_atomic_ptr_cmpxchg(cell, ret, NULL));
+
+        _Y;
+        l->read_idx++;
+
+        p[k++] = ret;
     }
 
-    pa_assert(ret);
+    if (k > 0)
+        pa_fdsem_post(l->read_fdsem);
 
-    /* Guaranteed to succeed if we only have a single reader */
-    pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+    return k;
+}
 
-    _Y;
-    l->read_idx++;
+void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
+    void *ret;
 
-    pa_fdsem_post(l->read_fdsem);
+    pa_assert(l);
+
+    if (pa_asyncq_pop_many(l, &ret, 1, wait_op) < 1)
+        return NULL;
 
     return ret;
 }
@@ -264,18 +389,10 @@ int pa_asyncq_read_fd(pa_asyncq *q) {
 }
 
 int pa_asyncq_read_before_poll(pa_asyncq *l) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
-
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
-    _Y;
-    idx = reduce(l, l->read_idx);
-
     for (;;) {
-        if (pa_atomic_ptr_load(&cells[idx]))
+        if (pa_atomic_ptr_load(read_cell(l)))
             return -1;
 
         if (pa_fdsem_before_poll(l->write_fdsem) >= 0)
@@ -41,11 +41,26 @@
 typedef struct pa_asyncq pa_asyncq;
 
 pa_asyncq* pa_asyncq_new(unsigned size);
+
+/* Like pa_asyncq_new(), but instead of blocking or failing when the
+ * queue runs full the writer doubles the ring size, up to max_size
+ * entries. */
+pa_asyncq* pa_asyncq_new_growable(unsigned size, unsigned max_size);
+
 void pa_asyncq_free(pa_asyncq* q, pa_free_cb_t free_cb);
 
 void* pa_asyncq_pop(pa_asyncq *q, bool wait);
 int pa_asyncq_push(pa_asyncq *q, void *p, bool wait);
 
+/* Batched versions of pa_asyncq_pop() and pa_asyncq_push(), which wake
+ * up the other side only once per call. pa_asyncq_pop_many() returns the
+ * number of items stored in p, if wait is true it blocks until at least
+ * one is available. pa_asyncq_push_many() returns the number of items
+ * taken from p, which is only less than n if wait is false and the queue
+ * is full. */
+unsigned pa_asyncq_pop_many(pa_asyncq *q, void *p[], unsigned n, bool wait);
+unsigned pa_asyncq_push_many(pa_asyncq *q, void *p[], unsigned n, bool wait);
+
 /* Similar to pa_asyncq_push(), but if the queue is full, postpone the
  * appending of the item locally and delay until
  * pa_asyncq_before_poll_post() is called. */
@@ -36,6 +36,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/error.h>
+#include <pulse/util.h>
 
 #include <pulsecore/module.h>
 #include <pulsecore/sink.h>
@@ -57,6 +58,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/modinfo.h>
 #include <pulsecore/dynarray.h>
+#include <pulsecore/startup-trace.h>
 
 #include "cli-command.h"
 
@@ -93,6 +95,7 @@ static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_info(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_load_deferred(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_unload(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_describe(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_sink_volume(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -113,6 +116,7 @@ static int pa_cli_command_scache_remove(pa_core *c, pa_tokenizer *t, pa_strbuf *
 static int pa_cli_command_scache_list(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_load_dir(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_scache_prefetch(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_play_file(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_dump(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_list_shared_props(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -136,6 +140,7 @@ static int pa_cli_command_sink_port(pa_core *c, pa_tokenizer *t, pa_strbuf *buf,
 static int pa_cli_command_source_port(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_port_offset(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_dump_volumes(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_startup_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_send_message_to_object(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 
 /* A method table for all available commands */
@@ -149,11 +154,12 @@ static const struct command commands[] = {
     { "list-clients",            pa_cli_command_clients,            "List loaded clients",          1 },
     { "list-sink-inputs",        pa_cli_command_sink_inputs,        "List sink inputs",             1 },
     { "list-source-outputs",     pa_cli_command_source_outputs,     "List source outputs",          1 },
-    { "stat",                    pa_cli_command_stat,               "Show memory block statistics", 1 },
+    { "stat",                    pa_cli_command_stat,               "Show memory block, render and wakeup statistics", 1 },
     { "info",                    pa_cli_command_info,               "Show comprehensive status",    1 },
     { "ls",                      pa_cli_command_info,               NULL,                           1 },
     { "list",                    pa_cli_command_info,               NULL,                           1 },
     { "load-module",             pa_cli_command_load,               "Load a module (args: name, arguments)", 3},
+    { "load-module-deferred",    pa_cli_command_load_deferred,      "Load a module in the background, after the current commands (args: name, arguments)", 3},
     { "unload-module",           pa_cli_command_unload,             "Unload a module (args: index|name)", 2},
     { "describe-module",         pa_cli_command_describe,           "Describe a module (arg: name)", 2},
     { "set-sink-volume",         pa_cli_command_sink_volume,        "Set the volume of a sink (args: index|name, volume)", 3},
@@ -185,6 +191,7 @@ static const struct command commands[] = {
     { "load-sample",             pa_cli_command_scache_load,        "Load a sound file into the sample cache (args: name, filename)", 3},
     { "load-sample-lazy",        pa_cli_command_scache_load,        "Lazily load a sound file into the sample cache (args: name, filename)", 3},
     { "load-sample-dir-lazy",    pa_cli_command_scache_load_dir,    "Lazily load all files in a directory into the sample cache (args: pathname)", 2},
+    { "prefetch-sample",         pa_cli_command_scache_prefetch,    "Decode a lazily loaded sample in the background and keep it loaded (args: name)", 2},
     { "kill-client",             pa_cli_command_kill_client,        "Kill a client (args: index)", 2},
     { "kill-sink-input",         pa_cli_command_kill_sink_input,    "Kill a sink input (args: index)", 2},
     { "kill-source-output",      pa_cli_command_kill_source_output, "Kill a source output (args: index)", 2},
@@ -197,6 +204,7 @@ static const struct command commands[] = {
     { "play-file",               pa_cli_command_play_file,          "Play a sound file (args: filename, sink|index)", 3},
     { "dump",                    pa_cli_command_dump,               "Dump daemon configuration", 1},
     { "dump-volumes",            pa_cli_command_dump_volumes,       "Debug: Show the state of all volumes", 1 },
+    { "dump-startup-trace",      pa_cli_command_dump_startup_trace, "Debug: Show the startup timeline as Chrome trace event JSON", 1 },
     { "shared",                  pa_cli_command_list_shared_props,  "Debug: Show shared properties", 1},
     { "exit",                    pa_cli_command_exit,               "Terminate the daemon",         1 },
     { "vacuum",                  pa_cli_command_vacuum,             NULL, 1},
@@ -341,11 +349,36 @@ static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf
     return 0;
 }
 
+static void append_render_stats(pa_strbuf *buf, const pa_render_stats *stats) {
+    pa_strbuf_printf(buf, "%" PRIu64 " cycles, %" PRIu64 " ns total, %" PRIu64 " ns max, %" PRIu64 " ns resampling, %" PRIu64 " underruns.\n",
+                     stats->cycles,
+                     stats->total_nsec,
+                     stats->max_nsec,
+                     stats->resample_nsec,
+                     stats->underruns);
+}
+
+static void append_rtpoll_stats(pa_strbuf *buf, const pa_rtpoll_stats *stats) {
+    pa_strbuf_printf(buf, "%" PRIu64 " iterations, woken by fds %" PRIu64 ", timer %" PRIu64 ", signals %" PRIu64 "; %" PRIu64 " skipped sleeping for work, %" PRIu64 " in before callbacks.\n",
+                     stats->runs,
+                     stats->fds,
+                     stats->timer,
+                     stats->interrupted,
+                     stats->work,
+                     stats->before);
+}
+
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     char ss[PA_SAMPLE_SPEC_SNPRINT_MAX];
     char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
     char bytes[PA_BYTES_SNPRINT_MAX];
     const pa_mempool_stat *mstat;
+    pa_render_stats stats;
+    pa_rtpoll_stats rtpoll_stats;
+    pa_sink *sink;
+    pa_source *source;
+    pa_sink_input *i;
+    uint32_t sink_idx, idx;
     unsigned k;
 
     static const char* const type_table[PA_MEMBLOCK_TYPE_MAX] = {
@@ -401,6 +434,59 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                          (unsigned) pa_atomic_load(&mstat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&mstat->n_accumulated_by_type[k]));
 
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++)
+        pa_strbuf_printf(buf,
+                         "Memory pool class %s (%u slots): %u hits/%u misses, %u allocated/%u high water.\n",
+                         pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_mempool_class_block_size(c->mempool, k)),
+                         pa_mempool_class_n_blocks(c->mempool, k),
+                         (unsigned) pa_atomic_load(&mstat->n_class_hits[k]),
+                         (unsigned) pa_atomic_load(&mstat->n_class_misses[k]),
+                         (unsigned) pa_atomic_load(&mstat->n_class_allocated[k]),
+                         (unsigned) pa_atomic_load(&mstat->n_class_high_water[k]));
+
+    PA_IDXSET_FOREACH(sink, c->sinks, sink_idx) {
+        pa_sink_get_render_stats(sink, &stats);
+        pa_strbuf_printf(buf, "Render time of sink #%u (%s): ", sink->index, sink->name);
+        append_render_stats(buf, &stats);
+
+        PA_IDXSET_FOREACH(i, sink->inputs, idx) {
+            pa_sink_input_get_render_stats(i, &stats);
+            pa_strbuf_printf(buf, "    sink input #%u (%s): ", i->index, pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME)));
+            append_render_stats(buf, &stats);
+
+            /* Filter streams render their own sink from within pop(), take
+             * that out to get the time spent in the filter itself */
+            if (i->origin_sink && i->module) {
+                pa_render_stats origin_stats;
+
+                pa_sink_get_render_stats(i->origin_sink, &origin_stats);
+                pa_strbuf_printf(buf, "        filter module #%u (%s): %" PRIu64 " ns self.\n",
+                                 i->module->index,
+                                 i->module->name,
+                                 stats.total_nsec > origin_stats.total_nsec ? stats.total_nsec - origin_stats.total_nsec : 0);
+            }
+        }
+    }
+
+    /* Filter sinks and sources run in the IO thread of their master */
+    PA_IDXSET_FOREACH(sink, c->sinks, sink_idx) {
+        if (sink->input_to_master)
+            continue;
+
+        pa_sink_get_rtpoll_stats(sink, &rtpoll_stats);
+        pa_strbuf_printf(buf, "IO thread of sink #%u (%s): ", sink->index, sink->name);
+        append_rtpoll_stats(buf, &rtpoll_stats);
+    }
+
+    PA_IDXSET_FOREACH(source, c->sources, idx) {
+        if (source->output_from_master || source->monitor_of)
+            continue;
+
+        pa_source_get_rtpoll_stats(source, &rtpoll_stats);
+        pa_strbuf_printf(buf, "IO thread of source #%u (%s): ", source->index, source->name);
+        append_rtpoll_stats(buf, &rtpoll_stats);
+    }
+
     return 0;
 }
 
@@ -449,6 +535,29 @@ static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
     return 0;
 }
 
+static int pa_cli_command_load_deferred(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *name;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(name = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify the module name and optionally arguments.\n");
+        return -1;
+    }
+
+    /* Only errors that show up before the module's code runs can be
+     * reported here, later ones end up in the log */
+    if (pa_module_load_deferred(c, name, pa_tokenizer_get(t, 2)) < 0) {
+        pa_strbuf_puts(buf, "Module load failed.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int pa_cli_command_unload(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     pa_module *m;
     uint32_t idx;
@@ -1266,6 +1375,27 @@ static int pa_cli_command_scache_load_dir(pa_core *c, pa_tokenizer *t, pa_strbuf
     return 0;
 }
 
+static int pa_cli_command_scache_prefetch(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *n;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(n = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a sample name.\n");
+        return -1;
+    }
+
+    if (pa_scache_prefetch_item(c, n) < 0) {
+        pa_strbuf_puts(buf, "Failed to prefetch sample.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int pa_cli_command_play_file(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     const char *fname, *sink_name;
     pa_sink *sink;
@@ -1285,7 +1415,7 @@ static int pa_cli_command_play_file(pa_core *c, pa_tokenizer *t, pa_strbuf *buf,
         return -1;
     }
 
-    if (pa_play_file(sink, fname, NULL) < 0) {
+    if (pa_play_file(sink, fname, PA_VOLUME_INVALID, NULL, 0, NULL) < 0) {
         pa_strbuf_puts(buf, "Failed to play sound file.\n");
         return -1;
     }
@@ -1303,6 +1433,26 @@ static int pa_cli_command_list_shared_props(pa_core *c, pa_tokenizer *t, pa_strb
     return 0;
 }
 
+static int pa_cli_command_dump_startup_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    char *json;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(json = pa_startup_trace_to_json())) {
+        pa_strbuf_puts(buf, "No startup trace was recorded.\n");
+        return -1;
+    }
+
+    pa_strbuf_puts(buf, json);
+    pa_strbuf_puts(buf, "\n");
+    pa_xfree(json);
+
+    return 0;
+}
+
 static int pa_cli_command_vacuum(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     pa_core_assert_ref(c);
     pa_assert(t);
@@ -2198,9 +2348,12 @@ int pa_cli_command_execute_line_stateful(pa_core *c, const char *s, pa_strbuf *b
         for (command = commands; command->name; command++)
             if (strlen(command->name) == l && !strncmp(cs, command->name, l)) {
                 int ret;
+                pa_startup_trace_span span;
                 pa_tokenizer *t = pa_tokenizer_new(cs, command->args);
                 pa_assert(t);
+                span = pa_startup_trace_begin("command", command->name, cs);
                 ret = command->proc(c, t, buf, fail);
+                pa_startup_trace_end(span);
                 pa_tokenizer_free(t);
                 unknown = 0;
 
@@ -2253,6 +2406,7 @@ fail:
 
 int pa_cli_command_execute_file(pa_core *c, const char *fn, pa_strbuf *buf, bool *fail) {
     FILE *f = NULL;
+    pa_startup_trace_span span;
     int ret = -1;
     bool _fail = true;
 
@@ -2271,7 +2425,9 @@ int pa_cli_command_execute_file(pa_core *c, const char *fn, pa_strbuf *buf, bool
     }
 
     pa_log_debug("Parsing script '%s'", fn);
+    span = pa_startup_trace_begin("script", pa_path_get_filename(fn), fn);
     ret = pa_cli_command_execute_file_stream(c, f, buf, fail);
+    pa_startup_trace_end(span);
 
 fail:
     if (f)
@@ -201,6 +201,8 @@ char *pa_sink_list_to_string(pa_core *c) {
             cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
         const char *cmn;
         char suspend_cause_buf[PA_SUSPEND_CAUSE_TO_STRING_BUF_SIZE];
+        pa_render_stats stats;
+        pa_proplist *p;
 
         cmn = pa_channel_map_to_pretty_name(&sink->channel_map);
 
@@ -282,9 +284,12 @@ char *pa_sink_list_to_string(pa_core *c) {
         if (sink->module)
             pa_strbuf_printf(s, "\tmodule: %u\n", sink->module->index);
 
-        t = pa_proplist_to_string_sep(sink->proplist, "\n\t\t");
+        pa_sink_get_render_stats(sink, &stats);
+        p = pa_render_stats_proplist_copy(&stats, sink->proplist);
+        t = pa_proplist_to_string_sep(p, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
+        pa_proplist_free(p);
 
         append_port_list(s, sink->ports);
 
@@ -528,6 +533,8 @@ char *pa_sink_input_list_to_string(pa_core *c) {
         const char *cmn;
         pa_cvolume v;
         char *volume_str = NULL;
+        pa_render_stats stats;
+        pa_proplist *p;
 
         cmn = pa_channel_map_to_pretty_name(&i->channel_map);
 
@@ -593,9 +600,12 @@ char *pa_sink_input_list_to_string(pa_core *c) {
         if (i->client)
             pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
 
-        t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
+        pa_sink_input_get_render_stats(i, &stats);
+        p = pa_render_stats_proplist_copy(&stats, i->proplist);
+        t = pa_proplist_to_string_sep(p, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
+        pa_proplist_free(p);
     }
 
     return pa_strbuf_to_string_free(s);
@@ -0,0 +1,231 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/fft-plan.h>
+#include <pulsecore/macro.h>
+
+#include "convolver.h"
+
+/* Keep every time block and spectrum on a 32 byte boundary, as the
+ * shared plans expect */
+#define ALIGN_FLOATS 8
+
+struct pa_convolver {
+    size_t block_size;
+    size_t fft_size;
+    size_t n_bins, bin_stride;  /* bin_stride counts floats */
+    size_t time_stride;
+    size_t n_partitions;
+    unsigned n_inputs, n_outputs;
+
+    pa_fft_plan *plan;
+
+    /* Per input: the previous and the current block */
+    float *time;
+
+    /* Per input: the spectra of the last n_partitions blocks. pos is the
+     * slot of the most recent one. */
+    float *fdl;
+    size_t pos;
+
+    /* Per input/output pair: the spectra of the impulse response
+     * partitions, and how many of them are in use */
+    float *ir;
+    size_t *ir_partitions;
+
+    float *acc;
+    float *out;
+};
+
+static float *fdl_slot(pa_convolver *c, unsigned input, size_t slot) {
+    return c->fdl + (input * c->n_partitions + slot) * c->bin_stride;
+}
+
+static float *ir_partition(pa_convolver *c, unsigned input, unsigned output, size_t k) {
+    return c->ir + ((input * c->n_outputs + output) * c->n_partitions + k) * c->bin_stride;
+}
+
+pa_convolver *pa_convolver_new(size_t block_size, unsigned n_inputs, unsigned n_outputs, size_t max_ir_length) {
+    pa_convolver *c;
+
+    pa_assert(block_size > 0);
+    pa_assert(n_inputs > 0);
+    pa_assert(n_outputs > 0);
+
+    c = pa_xnew0(pa_convolver, 1);
+    c->block_size = block_size;
+    c->fft_size = 2 * block_size;
+    c->n_bins = block_size + 1;
+    c->bin_stride = PA_ROUND_UP(2 * c->n_bins, ALIGN_FLOATS);
+    c->time_stride = PA_ROUND_UP(c->fft_size, ALIGN_FLOATS);
+    c->n_partitions = PA_MAX((max_ir_length + block_size - 1) / block_size, (size_t) 1);
+    c->n_inputs = n_inputs;
+    c->n_outputs = n_outputs;
+
+    if (!(c->plan = pa_fft_plan_get(c->fft_size))) {
+        pa_xfree(c);
+        return NULL;
+    }
+
+    c->time = pa_fft_alloc(n_inputs * c->time_stride);
+    c->fdl = pa_fft_alloc(n_inputs * c->n_partitions * c->bin_stride);
+    c->ir = pa_fft_alloc(n_inputs * n_outputs * c->n_partitions * c->bin_stride);
+    c->ir_partitions = pa_xnew0(size_t, n_inputs * n_outputs);
+    c->acc = pa_fft_alloc(c->bin_stride);
+    c->out = pa_fft_alloc(c->time_stride);
+
+    return c;
+}
+
+void pa_convolver_free(pa_convolver *c) {
+    pa_assert(c);
+
+    pa_fft_plan_unref(c->plan);
+
+    pa_fft_free(c->time);
+    pa_fft_free(c->fdl);
+    pa_fft_free(c->ir);
+    pa_fft_free(c->acc);
+    pa_fft_free(c->out);
+    pa_xfree(c->ir_partitions);
+    pa_xfree(c);
+}
+
+void pa_convolver_set_ir(pa_convolver *c, unsigned input, unsigned output, const float *ir, size_t ir_length) {
+    float scale;
+    size_t k, n;
+
+    pa_assert(c);
+    pa_assert(input < c->n_inputs);
+    pa_assert(output < c->n_outputs);
+    pa_assert(ir || ir_length == 0);
+    pa_assert(ir_length <= c->n_partitions * c->block_size);
+
+    /* The inverse transform is unnormalized, fold that into the filter */
+    scale = 1.0f / (float) c->fft_size;
+    n = (ir_length + c->block_size - 1) / c->block_size;
+
+    for (k = 0; k < n; k++) {
+        size_t s, l;
+
+        l = PA_MIN(c->block_size, ir_length - k * c->block_size);
+
+        /* Each partition is zero padded to twice its length, so the last
+         * block_size samples of the circular convolution are the linear
+         * one (overlap-save) */
+        memset(c->out, 0, c->fft_size * sizeof(float));
+        for (s = 0; s < l; s++)
+            c->out[s] = ir[k * c->block_size + s] * scale;
+
+        pa_fft_plan_forward(c->plan, c->out, ir_partition(c, input, output, k));
+    }
+
+    c->ir_partitions[input * c->n_outputs + output] = n;
+}
+
+static void complex_mac(float * restrict acc, const float * restrict a, const float * restrict b, size_t n_bins) {
+    size_t s;
+
+    for (s = 0; s < 2 * n_bins; s += 2) {
+        acc[s] += a[s] * b[s] - a[s + 1] * b[s + 1];
+        acc[s + 1] += a[s] * b[s + 1] + a[s + 1] * b[s];
+    }
+}
+
+void pa_convolver_process(pa_convolver *c, const float *src, float *dst) {
+    unsigned i, o;
+    size_t s, k;
+
+    pa_assert(c);
+    pa_assert(src);
+
+    c->pos = (c->pos + 1) % c->n_partitions;
+
+    for (i = 0; i < c->n_inputs; i++) {
+        float *t = c->time + i * c->time_stride;
+
+        for (s = 0; s < c->block_size; s++)
+            t[c->block_size + s] = src[s * c->n_inputs + i];
+
+        /* The forward transform preserves its input, so the block can be
+         * shifted afterwards */
+        pa_fft_plan_forward(c->plan, t, fdl_slot(c, i, c->pos));
+        memcpy(t, t + c->block_size, c->block_size * sizeof(float));
+    }
+
+    if (!dst)
+        return;
+
+    for (o = 0; o < c->n_outputs; o++) {
+        bool any = false;
+
+        memset(c->acc, 0, 2 * c->n_bins * sizeof(float));
+
+        for (i = 0; i < c->n_inputs; i++) {
+            size_t n = c->ir_partitions[i * c->n_outputs + o];
+
+            /* Partition k of the filter meets the input block from k
+             * blocks ago */
+            for (k = 0; k < n; k++) {
+                size_t slot = (c->pos + c->n_partitions - k) % c->n_partitions;
+
+                complex_mac(c->acc, fdl_slot(c, i, slot), ir_partition(c, i, o, k), c->n_bins);
+            }
+
+            any = any || n > 0;
+        }
+
+        if (!any) {
+            for (s = 0; s < c->block_size; s++)
+                dst[s * c->n_outputs + o] = 0.0f;
+            continue;
+        }
+
+        pa_fft_plan_inverse(c->plan, c->acc, c->out);
+
+        for (s = 0; s < c->block_size; s++)
+            dst[s * c->n_outputs + o] = c->out[c->block_size + s];
+    }
+}
+
+void pa_convolver_reset(pa_convolver *c) {
+    pa_assert(c);
+
+    memset(c->time, 0, c->n_inputs * c->time_stride * sizeof(float));
+    memset(c->fdl, 0, c->n_inputs * c->n_partitions * c->bin_stride * sizeof(float));
+    c->pos = 0;
+}
+
+size_t pa_convolver_get_block_size(pa_convolver *c) {
+    pa_assert(c);
+
+    return c->block_size;
+}
+
+size_t pa_convolver_get_history(pa_convolver *c) {
+    pa_assert(c);
+
+    return c->n_partitions * c->block_size;
+}
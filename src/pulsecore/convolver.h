@@ -0,0 +1,59 @@
+#ifndef fooconvolverhfoo
+#define fooconvolverhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+/* Uniformly partitioned overlap-save convolution (only available when
+ * built with FFTW). Every output channel is the sum of the input channels
+ * convolved with one impulse response per input/output pair. The impulse
+ * responses are cut into partitions of block_size samples whose spectra
+ * are multiplied with a frequency-domain delay line of the last input
+ * blocks, so latency is one block and the work per block grows only
+ * linearly with the impulse response length. */
+typedef struct pa_convolver pa_convolver;
+
+/* max_ir_length is the length in samples of the longest impulse response
+ * that will be set. Returns NULL if the FFT plans cannot be created. */
+pa_convolver *pa_convolver_new(size_t block_size, unsigned n_inputs, unsigned n_outputs, size_t max_ir_length);
+void pa_convolver_free(pa_convolver *c);
+
+/* Sets the impulse response from input to output; ir_length must not
+ * exceed max_ir_length. Pairs without an impulse response (or set with
+ * ir_length 0) contribute nothing and cost nothing. Does not touch the
+ * input history. */
+void pa_convolver_set_ir(pa_convolver *c, unsigned input, unsigned output, const float *ir, size_t ir_length);
+
+/* Filters one block: src holds block_size interleaved frames of n_inputs
+ * channels, dst receives block_size interleaved frames of n_outputs
+ * channels. dst may be NULL to only feed src into the history, e.g. to
+ * prime the convolver again after a rewind. */
+void pa_convolver_process(pa_convolver *c, const float *src, float *dst);
+
+/* Forgets the input history, as if only silence had been processed */
+void pa_convolver_reset(pa_convolver *c);
+
+size_t pa_convolver_get_block_size(pa_convolver *c);
+
+/* Number of samples of input history the output depends on, a multiple of
+ * block_size. Feeding this much input through pa_convolver_process() with
+ * dst == NULL after pa_convolver_reset() restores the exact state. */
+size_t pa_convolver_get_history(pa_convolver *c);
+
+#endif
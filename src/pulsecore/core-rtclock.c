@@ -114,6 +114,19 @@ struct timeval *pa_rtclock_get(struct timeval *tv) {
     return pa_gettimeofday(tv);
 }
 
+uint64_t pa_rtclock_now_nsec(void) {
+    struct timeval tv;
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC) && !defined(OS_IS_DARWIN)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t) ts.tv_sec * PA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+#endif
+
+    return pa_timeval_load(pa_rtclock_get(&tv)) * PA_NSEC_PER_USEC;
+}
+
 bool pa_rtclock_hrtimer(void) {
 
 #if defined (OS_IS_DARWIN)
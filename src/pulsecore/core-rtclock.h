@@ -30,6 +30,10 @@ struct timeval;
 struct timeval *pa_rtclock_get(struct timeval *ts);
 
 pa_usec_t pa_rtclock_age(const struct timeval *tv);
+
+/* Like pa_rtclock_now(), but with nanosecond resolution where the
+ * platform offers it. Meant for measuring short intervals. */
+uint64_t pa_rtclock_now_nsec(void);
 bool pa_rtclock_hrtimer(void);
 void pa_rtclock_hrtimer_enable(void);
 
@@ -49,9 +49,16 @@
 
 #include <pulsecore/sink-input.h>
 #include <pulsecore/play-memchunk.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/resampler.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sound-file.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
@@ -62,6 +69,69 @@
 
 #define UNLOAD_POLL_TIME (60 * PA_USEC_PER_SEC)
 
+/* What the decoding thread decodes at a time. Playbacks can use each step
+ * as soon as it is done, and cancelling waits for one step at most. */
+#define LOAD_STEP (64 * 1024)
+
+struct pa_scache_converted {
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+
+    /* Empty if the sample could not be converted, so that this isn't tried
+     * again on every playback */
+    pa_memchunk memchunk;
+
+    PA_LLIST_FIELDS(pa_scache_converted);
+};
+
+/* The sample as far as it is decoded, shared with the playbacks that start
+ * before the decoding is done */
+typedef struct load_progress {
+    PA_REFCNT_DECLARE;
+
+    pa_memblock *memblock;
+    /* Bytes of memblock decoded so far, whole frames */
+    pa_atomic_t decoded;
+    /* Set once decoded doesn't grow anymore */
+    pa_atomic_t finished;
+} load_progress;
+
+struct pa_scache_load {
+    pa_scache_entry *entry;
+    pa_sound_file *file;
+    size_t length;
+    size_t step;
+    load_progress *progress;
+
+    pa_thread *thread;
+    int fds[2];
+    pa_io_event *io_event;
+
+    /* Makes the thread stop at the next step */
+    pa_atomic_t cancel;
+
+    /* Written by the thread */
+    int result;
+};
+
+/* Plays a sample from its load_progress */
+typedef struct load_stream {
+    pa_msgobject parent;
+    pa_sink_input *sink_input;
+    load_progress *progress;
+
+    /* Only touched by the IO thread */
+    size_t index;
+    bool ended;
+} load_stream;
+
+enum {
+    LOAD_STREAM_MESSAGE_UNLINK,
+};
+
+PA_DEFINE_PRIVATE_CLASS(load_stream, pa_msgobject);
+#define LOAD_STREAM(o) (load_stream_cast(o))
+
 static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
     pa_core *c = userdata;
 
@@ -74,14 +144,552 @@ static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct
     pa_core_rttime_restart(c, e, pa_rtclock_now() + UNLOAD_POLL_TIME);
 }
 
+static void free_converted(pa_scache_entry *e) {
+    pa_scache_converted *cv;
+
+    pa_assert(e);
+
+    while ((cv = e->converted)) {
+        PA_LLIST_REMOVE(pa_scache_converted, e->converted, cv);
+
+        if (cv->memchunk.memblock)
+            pa_memblock_unref(cv->memchunk.memblock);
+        pa_xfree(cv);
+    }
+}
+
+static bool converted_fits_sink(pa_scache_converted *cv, pa_sink *s) {
+    return pa_sample_spec_equal(&cv->sample_spec, &s->sample_spec) &&
+        pa_channel_map_equal(&cv->channel_map, &s->channel_map);
+}
+
+static bool needs_conversion(pa_scache_entry *e, pa_sink *s) {
+    if (!PA_SINK_IS_LINKED(s->state) || pa_sink_is_passthrough(s))
+        return false;
+
+    return !pa_sample_spec_equal(&e->sample_spec, &s->sample_spec) ||
+        !pa_channel_map_equal(&e->channel_map, &s->channel_map);
+}
+
+static pa_scache_converted *find_converted(pa_scache_entry *e, pa_sink *s) {
+    pa_scache_converted *cv;
+
+    PA_LLIST_FOREACH(cv, e->converted)
+        if (converted_fits_sink(cv, s))
+            return cv;
+
+    return NULL;
+}
+
+/* Runs the sample through the resampler a sink input on s would use */
+static int convert_entry(pa_scache_entry *e, pa_sink *s, pa_memchunk *result) {
+    pa_core *c = e->core;
+    pa_resampler *r;
+    pa_memblockq *q;
+    pa_memchunk in, out, silence;
+    size_t max_block, length;
+    int ret = -1;
+
+    if (!(r = pa_resampler_new(c->mempool,
+                               &e->sample_spec, &e->channel_map,
+                               &s->sample_spec, &s->channel_map,
+                               c->lfe_crossover_freq,
+                               c->resample_method,
+                               (c->disable_remixing ? PA_RESAMPLER_NO_REMIX : 0) |
+                               (c->remixing_use_all_sink_channels ? 0 : PA_RESAMPLER_NO_FILL_SINK) |
+                               (c->remixing_produce_lfe ? PA_RESAMPLER_PRODUCE_LFE : 0) |
+                               (c->remixing_consume_lfe ? PA_RESAMPLER_CONSUME_LFE : 0))))
+        return -1;
+
+    if (pa_resampler_result(r, e->memchunk.length) > PA_SCACHE_ENTRY_SIZE_MAX) {
+        pa_resampler_free(r);
+        return -1;
+    }
+
+    pa_silence_memchunk_get(&c->silence_cache, c->mempool, &silence, &s->sample_spec, 0);
+    q = pa_memblockq_new("scache conversion q", 0, PA_SCACHE_ENTRY_SIZE_MAX, 0, &s->sample_spec, 0, 1, 0, &silence);
+    pa_memblock_unref(silence.memblock);
+
+    max_block = pa_resampler_max_block_size(r);
+    in = e->memchunk;
+
+    while (in.length > 0) {
+        pa_memchunk block = in;
+
+        block.length = PA_MIN(in.length, max_block);
+        pa_resampler_run(r, &block, &out);
+
+        if (out.memblock) {
+            pa_memblockq_push_align(q, &out);
+            pa_memblock_unref(out.memblock);
+        }
+
+        in.index += block.length;
+        in.length -= block.length;
+    }
+
+    if ((length = pa_memblockq_get_length(q)) > 0 &&
+        pa_memblockq_peek_fixed_size(q, length, result) >= 0)
+        ret = 0;
+
+    pa_memblockq_free(q);
+    pa_resampler_free(r);
+
+    return ret;
+}
+
+/* Drops the copies no sink can use anymore, because it was removed or
+ * reconfigured */
+static void drop_unused_converted(pa_scache_entry *e) {
+    pa_scache_converted *cv, *next;
+    pa_sink *s;
+    uint32_t idx;
+
+    for (cv = e->converted; cv; cv = next) {
+        bool used = false;
+
+        next = cv->next;
+
+        PA_IDXSET_FOREACH(s, e->core->sinks, idx)
+            if (PA_SINK_IS_LINKED(s->state) && converted_fits_sink(cv, s)) {
+                used = true;
+                break;
+            }
+
+        if (used)
+            continue;
+
+        PA_LLIST_REMOVE(pa_scache_converted, e->converted, cv);
+
+        if (cv->memchunk.memblock)
+            pa_memblock_unref(cv->memchunk.memblock);
+        pa_xfree(cv);
+    }
+}
+
+static void cancel_convert(pa_scache_entry *e) {
+    if (!e->convert_event)
+        return;
+
+    e->core->mainloop->defer_free(e->convert_event);
+    e->convert_event = NULL;
+}
+
+/* Makes one missing copy per main loop iteration, so that other events get
+ * their turn between conversions */
+static void convert_cb(pa_mainloop_api *a, pa_defer_event *ev, void *userdata) {
+    pa_scache_entry *e = userdata;
+    pa_scache_converted *cv;
+    char st[PA_SAMPLE_SPEC_SNPRINT_MAX];
+    pa_sink *s;
+    uint32_t idx;
+
+    pa_assert(e);
+    pa_assert(e->convert_event == ev);
+
+    drop_unused_converted(e);
+
+    PA_IDXSET_FOREACH(s, e->core->sinks, idx)
+        if (needs_conversion(e, s) && !find_converted(e, s))
+            break;
+
+    if (!s) {
+        cancel_convert(e);
+        return;
+    }
+
+    cv = pa_xnew(pa_scache_converted, 1);
+    cv->sample_spec = s->sample_spec;
+    cv->channel_map = s->channel_map;
+    PA_LLIST_INIT(pa_scache_converted, cv);
+
+    if (convert_entry(e, s, &cv->memchunk) < 0) {
+        pa_log_debug("Failed to convert sample \"%s\" to %s, will resample when playing it",
+                     e->name, pa_sample_spec_snprint(st, sizeof(st), &s->sample_spec));
+        pa_memchunk_reset(&cv->memchunk);
+    } else
+        pa_log_debug("Converted sample \"%s\" to %s, %lu bytes",
+                     e->name, pa_sample_spec_snprint(st, sizeof(st), &s->sample_spec),
+                     (unsigned long) cv->memchunk.length);
+
+    PA_LLIST_PREPEND(pa_scache_converted, e->converted, cv);
+}
+
+/* Brings the copies up to date with the sinks, off the current call path */
+static void schedule_convert(pa_scache_entry *e) {
+    pa_core *c = e->core;
+
+    if (!c->scache_preconvert || !e->memchunk.memblock || e->convert_event)
+        return;
+
+    pa_assert_se(e->convert_event = c->mainloop->defer_new(c->mainloop, convert_cb, e));
+}
+
+static load_progress *load_progress_ref(load_progress *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    PA_REFCNT_INC(p);
+    return p;
+}
+
+static void load_progress_unref(load_progress *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    if (PA_REFCNT_DEC(p) > 0)
+        return;
+
+    pa_memblock_unref(p->memblock);
+    pa_xfree(p);
+}
+
+static void load_free(pa_scache_load *l) {
+    pa_assert(l);
+
+    if (l->io_event)
+        l->entry->core->mainloop->io_free(l->io_event);
+
+    /* The thread stops after the step it is in, rather than decoding the
+     * rest of the file first */
+    if (l->thread) {
+        pa_atomic_store(&l->cancel, 1);
+        pa_thread_free(l->thread);
+    }
+
+    if (l->file)
+        pa_sound_file_close(l->file);
+
+    pa_close_pipe(l->fds);
+
+    if (l->progress)
+        load_progress_unref(l->progress);
+
+    pa_xfree(l);
+}
+
+static void cancel_load(pa_scache_entry *e) {
+    pa_assert(e);
+
+    if (!e->load)
+        return;
+
+    pa_log_debug("Cancelling decoding of sample \"%s\"", e->name);
+
+    load_free(e->load);
+    e->load = NULL;
+}
+
+static void load_thread_func(void *userdata) {
+    pa_scache_load *l = userdata;
+    load_progress *p;
+    uint8_t *data;
+    size_t decoded = 0;
+    ssize_t n;
+    char x = 'x';
+
+    pa_assert(l);
+
+    p = l->progress;
+    data = pa_memblock_acquire(p->memblock);
+
+    while (decoded < l->length && !pa_atomic_load(&l->cancel)) {
+        if ((n = pa_sound_file_read(l->file, data + decoded, PA_MIN(l->step, l->length - decoded))) <= 0)
+            break;
+
+        decoded += (size_t) n;
+        pa_atomic_store(&p->decoded, (int) decoded);
+    }
+
+    pa_memblock_release(p->memblock);
+
+    l->result = decoded == l->length ? 0 : -1;
+    pa_atomic_store(&p->finished, 1);
+
+    if (pa_write(l->fds[1], &x, sizeof(x), NULL) != sizeof(x))
+        pa_log_error("Failed to signal completion of sample decoding: %s", pa_cstrerror(errno));
+}
+
+/* Promotes the decoded sample to the entry's memchunk */
+static void load_io_cb(pa_mainloop_api *a, pa_io_event *ev, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_scache_load *l = userdata;
+    pa_scache_entry *e;
+    char st[PA_SAMPLE_SPEC_SNPRINT_MAX];
+    char x;
+
+    pa_assert(l);
+    pa_assert(l->io_event == ev);
+
+    e = l->entry;
+    pa_assert(e->load == l);
+
+    (void) pa_read(fd, &x, sizeof(x), NULL);
+
+    a->io_free(l->io_event);
+    l->io_event = NULL;
+
+    pa_thread_free(l->thread);
+    l->thread = NULL;
+
+    e->load = NULL;
+
+    if (l->result < 0) {
+        pa_log_warn("Failed to decode sample \"%s\" from %s", e->name, e->filename);
+        load_free(l);
+        return;
+    }
+
+    e->memchunk.memblock = pa_memblock_ref(l->progress->memblock);
+    e->memchunk.index = 0;
+    e->memchunk.length = l->length;
+
+    pa_log_debug("Decoded sample \"%s\", %lu bytes with sample spec %s",
+                 e->name, (unsigned long) e->memchunk.length,
+                 pa_sample_spec_snprint(st, sizeof(st), &e->sample_spec));
+
+    schedule_convert(e);
+
+    pa_subscription_post(e->core, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_CHANGE, e->index);
+
+    load_free(l);
+}
+
+/* Decodes a lazy entry in a thread of its own, so that large files don't
+ * stall the main loop. Only the header is read here. */
+static int start_load(pa_scache_entry *e) {
+    pa_scache_load *l;
+    pa_core *c;
+    pa_sample_spec ss;
+    pa_channel_map map, old_channel_map;
+
+    pa_assert(e);
+    pa_assert(e->lazy);
+    pa_assert(!e->load);
+
+    c = e->core;
+
+    l = pa_xnew0(pa_scache_load, 1);
+    l->entry = e;
+    l->fds[0] = l->fds[1] = -1;
+
+    if (!(l->file = pa_sound_file_open(e->filename, &ss, &map, e->proplist, &l->length)))
+        goto fail;
+
+    if (l->length == 0) {
+        pa_log("Sample file %s is empty", e->filename);
+        goto fail;
+    }
+
+    old_channel_map = e->channel_map;
+
+    e->sample_spec = ss;
+    e->channel_map = map;
+
+    if (e->volume_is_set) {
+        if (pa_cvolume_valid(&e->volume))
+            pa_cvolume_remap(&e->volume, &old_channel_map, &e->channel_map);
+        else
+            pa_cvolume_reset(&e->volume, e->sample_spec.channels);
+    }
+
+    l->step = pa_frame_align(LOAD_STEP, &ss);
+
+    l->progress = pa_xnew0(load_progress, 1);
+    PA_REFCNT_INIT(l->progress);
+    l->progress->memblock = pa_memblock_new(c->mempool, l->length);
+
+    if (pa_pipe_cloexec(l->fds) < 0) {
+        pa_log("pipe() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    pa_make_fd_nonblock(l->fds[0]);
+    pa_assert_se(l->io_event = c->mainloop->io_new(c->mainloop, l->fds[0], PA_IO_EVENT_INPUT, load_io_cb, l));
+
+    if (!(l->thread = pa_thread_new("scache-load", load_thread_func, l))) {
+        pa_log("Failed to create sample decoding thread.");
+        goto fail;
+    }
+
+    pa_log_debug("Decoding sample \"%s\" from %s in the background", e->name, e->filename);
+
+    e->load = l;
+    return 0;
+
+fail:
+    load_free(l);
+    return -1;
+}
+
+static void load_stream_unlink(load_stream *u) {
+    pa_assert(u);
+
+    if (!u->sink_input)
+        return;
+
+    pa_sink_input_unlink(u->sink_input);
+    pa_sink_input_unref(u->sink_input);
+    u->sink_input = NULL;
+
+    load_stream_unref(u);
+}
+
+static void load_stream_free(pa_object *o) {
+    load_stream *u = LOAD_STREAM(o);
+    pa_assert(u);
+
+    load_progress_unref(u->progress);
+    pa_xfree(u);
+}
+
+static int load_stream_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    load_stream *u = LOAD_STREAM(o);
+    load_stream_assert_ref(u);
+
+    switch (code) {
+        case LOAD_STREAM_MESSAGE_UNLINK:
+            load_stream_unlink(u);
+            break;
+    }
+
+    return 0;
+}
+
+static void load_stream_kill_cb(pa_sink_input *i) {
+    load_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = LOAD_STREAM(i->userdata);
+    load_stream_assert_ref(u);
+
+    load_stream_unlink(u);
+}
+
+/* Called from IO thread context */
+static void load_stream_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
+    load_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = LOAD_STREAM(i->userdata);
+    load_stream_assert_ref(u);
+
+    /* If we are added for the first time, ask for a rewinding so that
+     * we are heard right-away. */
+    if (PA_SINK_INPUT_IS_LINKED(state) &&
+        i->thread_info.state == PA_SINK_INPUT_INIT && i->sink)
+        pa_sink_input_request_rewind(i, 0, false, true, true);
+}
+
+/* Called from IO thread context */
+static int load_stream_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    load_stream *u;
+    size_t decoded;
+    bool finished;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(chunk);
+    u = LOAD_STREAM(i->userdata);
+    load_stream_assert_ref(u);
+
+    if (u->ended)
+        return -1;
+
+    /* In this order, so that decoded is final if finished is set */
+    finished = pa_atomic_load(&u->progress->finished);
+    decoded = (size_t) pa_atomic_load(&u->progress->decoded);
+
+    if (u->index >= decoded) {
+        /* Unless this is the end, the decoding thread is behind and we
+         * underrun until it catches up */
+        if (finished && pa_sink_input_safe_to_remove(i)) {
+            u->ended = true;
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u), LOAD_STREAM_MESSAGE_UNLINK, NULL, 0, NULL, NULL);
+        }
+
+        return -1;
+    }
+
+    chunk->memblock = pa_memblock_ref(u->progress->memblock);
+    chunk->index = u->index;
+    chunk->length = PA_MIN(nbytes, decoded - u->index);
+
+    u->index += chunk->length;
+
+    return 0;
+}
+
+/* Called from IO thread context */
+static void load_stream_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    load_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = LOAD_STREAM(i->userdata);
+    load_stream_assert_ref(u);
+
+    /* What was played stays in the memblock */
+    u->index -= PA_MIN(nbytes, u->index);
+}
+
+/* Plays a sample while it is being decoded, from the part that is */
+static int play_load(pa_sink *sink, pa_scache_entry *e, pa_cvolume *volume, pa_proplist *p, uint32_t *sink_input_index) {
+    load_stream *u;
+    pa_sink_input_new_data data;
+
+    pa_assert(e->load);
+
+    u = pa_msgobject_new(load_stream);
+    u->parent.parent.free = load_stream_free;
+    u->parent.process_msg = load_stream_process_msg;
+    u->sink_input = NULL;
+    u->progress = load_progress_ref(e->load->progress);
+    u->index = 0;
+    u->ended = false;
+
+    pa_sink_input_new_data_init(&data);
+    pa_sink_input_new_data_set_sink(&data, sink, false, true);
+    data.driver = __FILE__;
+    pa_sink_input_new_data_set_sample_spec(&data, &e->sample_spec);
+    pa_sink_input_new_data_set_channel_map(&data, &e->channel_map);
+    pa_sink_input_new_data_set_volume(&data, volume);
+    pa_proplist_update(data.proplist, PA_UPDATE_REPLACE, p);
+    data.flags |= PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND;
+
+    pa_sink_input_new(&u->sink_input, sink->core, &data);
+    pa_sink_input_new_data_done(&data);
+
+    if (!u->sink_input) {
+        load_stream_unref(u);
+        return -1;
+    }
+
+    u->sink_input->pop = load_stream_pop_cb;
+    u->sink_input->process_rewind = load_stream_process_rewind_cb;
+    u->sink_input->kill = load_stream_kill_cb;
+    u->sink_input->state_change = load_stream_state_change_cb;
+    u->sink_input->userdata = u;
+
+    pa_sink_input_put(u->sink_input);
+
+    if (sink_input_index)
+        *sink_input_index = u->sink_input->index;
+
+    /* The reference to u is dangling here, because we want to keep this
+     * stream around until it is fully played. */
+
+    return 0;
+}
+
 static void free_entry(pa_scache_entry *e) {
     pa_assert(e);
 
     pa_namereg_unregister(e->core, e->name);
     pa_subscription_post(e->core, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_REMOVE, e->index);
     pa_hook_fire(&e->core->hooks[PA_CORE_HOOK_SAMPLE_CACHE_UNLINK], e);
+    cancel_load(e);
+    cancel_convert(e);
     pa_xfree(e->name);
     pa_xfree(e->filename);
+    free_converted(e);
     if (e->memchunk.memblock)
         pa_memblock_unref(e->memchunk.memblock);
     if (e->proplist)
@@ -97,6 +705,9 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
     pa_assert(new_sample);
 
     if ((e = pa_namereg_get(c, name, PA_NAMEREG_SAMPLE))) {
+        cancel_load(e);
+        cancel_convert(e);
+        free_converted(e);
         if (e->memchunk.memblock)
             pa_memblock_unref(e->memchunk.memblock);
 
@@ -118,6 +729,9 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
         e->name = pa_xstrdup(name);
         e->core = c;
         e->proplist = pa_proplist_new();
+        e->converted = NULL;
+        e->convert_event = NULL;
+        e->load = NULL;
 
         pa_idxset_put(c->scache, e, &e->index);
 
@@ -129,6 +743,7 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
     pa_memchunk_reset(&e->memchunk);
     e->filename = NULL;
     e->lazy = false;
+    e->prefetched = false;
     e->last_used_time = 0;
 
     pa_sample_spec_init(&e->sample_spec);
@@ -199,6 +814,8 @@ int pa_scache_add_item(
                  name, e->index, (unsigned long) e->memchunk.length,
                  pa_sample_spec_snprint(st, sizeof(st), &e->sample_spec));
 
+    schedule_convert(e);
+
     pa_hook_fire(&e->core->hooks[new_sample ? PA_CORE_HOOK_SAMPLE_CACHE_NEW : PA_CORE_HOOK_SAMPLE_CACHE_CHANGED], e);
 
     return 0;
@@ -289,6 +906,23 @@ int pa_scache_remove_item(pa_core *c, const char *name) {
     return 0;
 }
 
+int pa_scache_prefetch_item(pa_core *c, const char *name) {
+    pa_scache_entry *e;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    if (!(e = pa_namereg_get(c, name, PA_NAMEREG_SAMPLE)))
+        return -1;
+
+    e->prefetched = true;
+
+    if (!e->lazy || e->memchunk.memblock || e->load)
+        return 0;
+
+    return start_load(e);
+}
+
 void pa_scache_free_all(pa_core *c) {
     pa_assert(c);
 
@@ -300,11 +934,45 @@ void pa_scache_free_all(pa_core *c) {
     }
 }
 
+const pa_memchunk *pa_scache_entry_select(pa_scache_entry *e, pa_sink *s, const pa_sample_spec **ss, const pa_channel_map **map) {
+    pa_scache_converted *cv;
+
+    pa_assert(e);
+    pa_sink_assert_ref(s);
+    pa_assert(ss);
+    pa_assert(map);
+
+    if (!e->memchunk.memblock)
+        return NULL;
+
+    if (e->core->scache_preconvert && needs_conversion(e, s)) {
+        if ((cv = find_converted(e, s))) {
+            /* An empty copy means the conversion failed */
+            if (cv->memchunk.memblock) {
+                *ss = &cv->sample_spec;
+                *map = &cv->channel_map;
+                return &cv->memchunk;
+            }
+        } else
+            /* A new sink, or one that was reconfigured since the copies
+             * were made. The sink input resamples this time. */
+            schedule_convert(e);
+    }
+
+    *ss = &e->sample_spec;
+    *map = &e->channel_map;
+    return &e->memchunk;
+}
+
 int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx) {
     pa_scache_entry *e;
+    const pa_sample_spec *ss;
+    const pa_channel_map *map;
+    const pa_memchunk *chunk;
     pa_cvolume r;
     pa_proplist *merged;
     bool pass_volume;
+    int ret;
 
     pa_assert(c);
     pa_assert(name);
@@ -313,30 +981,20 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     if (!(e = pa_namereg_get(c, name, PA_NAMEREG_SAMPLE)))
         return -1;
 
-    merged = pa_proplist_new();
-    pa_proplist_sets(merged, PA_PROP_MEDIA_NAME, name);
-    pa_proplist_sets(merged, PA_PROP_EVENT_ID, name);
-
     if (e->lazy && !e->memchunk.memblock) {
-        pa_channel_map old_channel_map = e->channel_map;
-
-        if (pa_sound_file_load(c->mempool, e->filename, &e->sample_spec, &e->channel_map, &e->memchunk, merged) < 0)
-            goto fail;
-
-        pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_CHANGE, e->index);
-
-        if (e->volume_is_set) {
-            if (pa_cvolume_valid(&e->volume))
-                pa_cvolume_remap(&e->volume, &old_channel_map, &e->channel_map);
-            else
-                pa_cvolume_reset(&e->volume, e->sample_spec.channels);
-        }
-    }
+        /* This one plays what the decoding thread has decoded so far, the
+         * next one the cached sample */
+        if (!e->load && start_load(e) < 0)
+            return -1;
 
-    if (!e->memchunk.memblock)
-        goto fail;
+        ss = &e->sample_spec;
+        map = &e->channel_map;
+        chunk = NULL;
+    } else if (!(chunk = pa_scache_entry_select(e, sink, &ss, &map)))
+        return -1;
 
-    pa_log_debug("Playing sample \"%s\" on \"%s\"", name, sink->name);
+    pa_log_debug("Playing sample \"%s\" on \"%s\"%s", name, sink->name,
+                 !chunk ? " (while decoding)" : chunk != &e->memchunk ? " (preconverted)" : "");
 
     pass_volume = true;
 
@@ -350,29 +1008,37 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     else
         pass_volume = false;
 
+    if (pass_volume && map != &e->channel_map)
+        pa_cvolume_remap(&r, &e->channel_map, map);
+
+    merged = pa_proplist_new();
+    pa_proplist_sets(merged, PA_PROP_MEDIA_NAME, name);
+    pa_proplist_sets(merged, PA_PROP_EVENT_ID, name);
+
     pa_proplist_update(merged, PA_UPDATE_REPLACE, e->proplist);
 
     if (p)
         pa_proplist_update(merged, PA_UPDATE_REPLACE, p);
 
-    if (pa_play_memchunk(sink,
-                         &e->sample_spec, &e->channel_map,
-                         &e->memchunk,
-                         pass_volume ? &r : NULL,
-                         merged,
-                         PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx) < 0)
-        goto fail;
+    if (chunk)
+        ret = pa_play_memchunk(sink,
+                               ss, map,
+                               chunk,
+                               pass_volume ? &r : NULL,
+                               merged,
+                               PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx);
+    else
+        ret = play_load(sink, e, pass_volume ? &r : NULL, merged, sink_input_idx);
 
     pa_proplist_free(merged);
 
+    if (ret < 0)
+        return -1;
+
     if (e->lazy)
         time(&e->last_used_time);
 
     return 0;
-
-fail:
-    pa_proplist_free(merged);
-    return -1;
 }
 
 int pa_scache_play_item_by_name(pa_core *c, const char *name, const char*sink_name, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx) {
@@ -442,12 +1108,14 @@ void pa_scache_unload_unused(pa_core *c) {
 
     PA_IDXSET_FOREACH(e, c->scache, idx) {
 
-        if (!e->lazy || !e->memchunk.memblock)
+        if (!e->lazy || !e->memchunk.memblock || e->prefetched)
             continue;
 
         if (e->last_used_time + c->scache_idle_time > now)
             continue;
 
+        cancel_convert(e);
+        free_converted(e);
         pa_memblock_unref(e->memchunk.memblock);
         pa_memchunk_reset(&e->memchunk);
 
@@ -27,6 +27,9 @@
 
 #define PA_SCACHE_ENTRY_SIZE_MAX (1024*1024*16)
 
+typedef struct pa_scache_converted pa_scache_converted;
+typedef struct pa_scache_load pa_scache_load;
+
 typedef struct pa_scache_entry {
     uint32_t index;
     pa_core *core;
@@ -39,11 +42,22 @@ typedef struct pa_scache_entry {
     pa_channel_map channel_map;
     pa_memchunk memchunk;
 
+    /* Copies of memchunk in the formats of the sinks, kept if
+     * core->scache_preconvert is set, and the deferred event that makes
+     * the missing ones */
+    pa_scache_converted *converted;
+    pa_defer_event *convert_event;
+
     char *filename;
 
     bool lazy;
     time_t last_used_time;
 
+    /* Decoding of a lazy entry in progress */
+    pa_scache_load *load;
+    /* Warmed by pa_scache_prefetch_item(), never unloaded when idle */
+    bool prefetched;
+
     pa_proplist *proplist;
 } pa_scache_entry;
 
@@ -54,6 +68,12 @@ int pa_scache_add_file_lazy(pa_core *c, const char *name, const char *filename,
 int pa_scache_add_directory_lazy(pa_core *c, const char *pathname);
 
 int pa_scache_remove_item(pa_core *c, const char *name);
+int pa_scache_prefetch_item(pa_core *c, const char *name);
+/* What pa_scache_play_item() plays on s: the copy preconverted to the
+ * sink's format if there is one, the sample itself otherwise. A missing
+ * copy is made later on a deferred event, never while playing. NULL if the
+ * sample isn't loaded. */
+const pa_memchunk *pa_scache_entry_select(pa_scache_entry *e, pa_sink *s, const pa_sample_spec **ss, const pa_channel_map **map);
 int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx);
 int pa_scache_play_item_by_name(pa_core *c, const char *name, const char*sink_name, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx);
 void pa_scache_free_all(pa_core *c);
@@ -27,6 +27,7 @@
 
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/sink-input.h>
 
 #include "core-subscribe.h"
 
@@ -202,11 +203,41 @@ static void sched_event(pa_core *c) {
     c->mainloop->defer_enable(c->subscription_defer_event, 1);
 }
 
+/* Keep track of what changed when, for clients that only want to hear
+ * about the sink inputs that changed since they last asked */
+static void update_generation(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_sink_input *i;
+    pa_core_tombstone *ts;
+
+    if ((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != PA_SUBSCRIPTION_EVENT_SINK_INPUT)
+        return;
+
+    c->generation++;
+
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_REMOVE) {
+        if ((i = pa_idxset_get_by_index(c->sink_inputs, idx)))
+            i->generation = c->generation;
+        return;
+    }
+
+    ts = &c->tombstones[c->tombstone_next];
+    if (c->n_tombstones < PA_CORE_TOMBSTONES_MAX)
+        c->n_tombstones++;
+    else
+        c->tombstone_horizon = ts->generation;
+
+    ts->index = idx;
+    ts->generation = c->generation;
+    c->tombstone_next = (c->tombstone_next + 1) % PA_CORE_TOMBSTONES_MAX;
+}
+
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
     pa_subscription_event *e;
     pa_assert(c);
 
+    update_generation(c, t, idx);
+
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
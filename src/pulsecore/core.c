@@ -162,12 +162,18 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     c->module_defer_unload_event = NULL;
     c->modules_pending_unload = pa_hashmap_new(NULL, NULL);
+    c->modules_pending_load = pa_hashmap_new(NULL, NULL);
 
     c->subscription_defer_event = NULL;
     PA_LLIST_HEAD_INIT(pa_subscription, c->subscriptions);
     PA_LLIST_HEAD_INIT(pa_subscription_event, c->subscription_event_queue);
     c->subscription_event_last = NULL;
 
+    /* Clients pass 0 to ask for everything, so no reply may carry it */
+    c->generation = 1;
+    c->tombstone_horizon = 0;
+    c->n_tombstones = c->tombstone_next = 0;
+
     c->mempool = pool;
     c->shm_size = shm_size;
     pa_silence_cache_init(&c->silence_cache);
@@ -190,6 +196,7 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
     c->remixing_consume_lfe = false;
     c->lfe_crossover_freq = 0;
     c->deferred_volume = true;
+    c->scache_preconvert = false;
     c->resample_method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
@@ -252,6 +259,9 @@ static void core_free(pa_object *o) {
     pa_assert(pa_hashmap_isempty(c->modules_pending_unload));
     pa_hashmap_free(c->modules_pending_unload);
 
+    pa_assert(pa_hashmap_isempty(c->modules_pending_load));
+    pa_hashmap_free(c->modules_pending_load);
+
     pa_subscription_free_all(c);
 
     if (c->exit_event)
@@ -147,6 +147,15 @@ typedef enum pa_core_hook {
     PA_CORE_HOOK_MAX
 } pa_core_hook_t;
 
+/* Number of sink input removals remembered for
+ * PA_COMMAND_GET_SINK_INPUT_INFO_DELTA */
+#define PA_CORE_TOMBSTONES_MAX 64
+
+typedef struct pa_core_tombstone {
+    uint32_t index;
+    uint64_t generation;
+} pa_core_tombstone;
+
 /* The core structure of PulseAudio. Every PulseAudio daemon contains
  * exactly one of these. It is used for storing kind of global
  * variables for the daemon. */
@@ -194,12 +203,21 @@ struct pa_core {
 
     pa_defer_event *module_defer_unload_event;
     pa_hashmap *modules_pending_unload; /* pa_module -> pa_module (hashmap-as-a-set) */
+    pa_hashmap *modules_pending_load; /* pa_module_load_request -> pa_module_load_request (hashmap-as-a-set) */
 
     pa_defer_event *subscription_defer_event;
     PA_LLIST_HEAD(pa_subscription, subscriptions);
     PA_LLIST_HEAD(pa_subscription_event, subscription_event_queue);
     pa_subscription_event *subscription_event_last;
 
+    /* Bumped for every sink input event. New and changed sink inputs take
+     * the new value as their generation, removals go to the tombstone ring.
+     * Removals at or before tombstone_horizon have been forgotten. */
+    uint64_t generation;
+    uint64_t tombstone_horizon;
+    pa_core_tombstone tombstones[PA_CORE_TOMBSTONES_MAX];
+    unsigned n_tombstones, tombstone_next;
+
     /* The mempool is used for data we write to, it's readonly for the client. */
     pa_mempool *mempool;
 
@@ -226,6 +244,7 @@ struct pa_core {
     bool remixing_produce_lfe:1;
     bool remixing_consume_lfe:1;
     bool deferred_volume:1;
+    bool scache_preconvert:1;
 
     pa_resample_method_t resample_method;
     int realtime_priority;
@@ -23,7 +23,10 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -35,16 +38,91 @@
 
 #include "database.h"
 
+/* The database file is memory-mapped and used as is, without reading it
+ * into memory first:
+ *
+ *   file_header
+ *   uint32_t buckets[n_buckets]    record offsets; open addressing with
+ *                                  linear probing, 0 is empty, 1 is deleted
+ *   records                        record_header, key, data, padded to
+ *                                  4 bytes, with room for data to grow
+ *                                  up to capacity bytes in place
+ *
+ * Changes are collected in memory and only touch the file on sync. They
+ * are first written to a small write-ahead log next to the database,
+ * which is replayed on open if we crashed while updating the file in
+ * place. That way both opening and syncing cost in proportion to what
+ * changed rather than to the size of the database. Everything is in host
+ * byte order; the database does not have to be arch independent.
+ *
+ * Files in the old format, a plain sequence of length-prefixed keys and
+ * values, are converted on open. */
+
+#define FILE_MAGIC "PADB"
+#define FILE_VERSION 2
+#define WAL_MAGIC "PAWL"
+
+#define BUCKET_EMPTY 0
+#define BUCKET_DELETED 1
+#define MIN_BUCKETS 64
+
+/* Rebuild the file when more than this much of it is dead records */
+#define GARBAGE_MIN (64 * 1024)
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t) 3)
+
+typedef struct file_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_buckets;
+    uint32_t n_entries;
+    uint32_t n_deleted;
+    uint32_t data_end;
+    uint32_t garbage;
+    uint32_t reserved;
+} file_header;
+
+typedef struct record_header {
+    uint32_t key_size;
+    uint32_t data_size;
+    uint32_t capacity;
+    uint32_t checksum;
+} record_header;
+
+typedef struct wal_header {
+    char magic[4];
+    uint32_t n_records;
+    uint32_t length;
+    uint32_t checksum;
+} wal_header;
+
+typedef struct wal_record {
+    uint32_t removed;
+    uint32_t key_size;
+    uint32_t data_size;
+} wal_record;
+
 typedef struct simple_data {
     char *filename;
     char *tmp_filename;
-    pa_hashmap *map;
+    char *wal_filename;
+
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+
+    /* Changes since the last sync, which take precedence over the file.
+     * If cleared is set, the file contents are gone as a whole. */
+    pa_hashmap *changes;
+    bool cleared;
+
     bool read_only;
 } simple_data;
 
 typedef struct entry {
     pa_datum key;
     pa_datum data;
+    bool removed;
 } entry;
 
 void pa_datum_free(pa_datum *d) {
@@ -85,17 +163,35 @@ static unsigned hash_func(const void *p) {
     return hash;
 }
 
+/* FNV-1a, used for bucket placement and to spot torn writes */
+static uint32_t fnv1a(uint32_t h, const void *p, size_t length) {
+    const uint8_t *c = p;
+
+    while (length--) {
+        h ^= *c++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+#define FNV_BASIS 2166136261U
+
 static entry* new_entry(const pa_datum *key, const pa_datum *data) {
     entry *e;
 
     pa_assert(key);
-    pa_assert(data);
 
     e = pa_xnew0(entry, 1);
     e->key.data = key->size > 0 ? pa_xmemdup(key->data, key->size) : NULL;
     e->key.size = key->size;
-    e->data.data = data->size > 0 ? pa_xmemdup(data->data, data->size) : NULL;
-    e->data.size = data->size;
+
+    if (data) {
+        e->data.data = data->size > 0 ? pa_xmemdup(data->data, data->size) : NULL;
+        e->data.size = data->size;
+    } else
+        e->removed = true;
+
     return e;
 }
 
@@ -109,6 +205,615 @@ static void free_entry(entry *e) {
     }
 }
 
+static void put_change(simple_data *db, entry *e) {
+    pa_hashmap_remove_and_free(db->changes, &e->key);
+    pa_assert_se(pa_hashmap_put(db->changes, &e->key, e) >= 0);
+}
+
+/* Accessors for the mapped file */
+
+static file_header *get_header(simple_data *db) {
+    return (file_header *) db->map;
+}
+
+static uint32_t *get_buckets(simple_data *db) {
+    return (uint32_t *) (db->map + sizeof(file_header));
+}
+
+static size_t records_start(uint32_t n_buckets) {
+    return sizeof(file_header) + n_buckets * sizeof(uint32_t);
+}
+
+static size_t record_size(size_t key_size, size_t capacity) {
+    return sizeof(record_header) + ALIGN4(key_size) + capacity;
+}
+
+static record_header *get_record(simple_data *db, uint32_t offset) {
+    return (record_header *) (db->map + offset);
+}
+
+static void record_key(record_header *r, pa_datum *key) {
+    key->data = (uint8_t *) r + sizeof(record_header);
+    key->size = r->key_size;
+}
+
+static void record_data(record_header *r, pa_datum *data) {
+    data->data = (uint8_t *) r + sizeof(record_header) + ALIGN4(r->key_size);
+    data->size = r->data_size;
+}
+
+static uint32_t record_checksum(record_header *r) {
+    pa_datum key, data;
+
+    record_key(r, &key);
+    record_data(r, &data);
+
+    return fnv1a(fnv1a(FNV_BASIS, key.data, key.size), data.data, data.size);
+}
+
+/* Fills in a new record at r, returns its size */
+static size_t put_record(record_header *r, const pa_datum *key, const pa_datum *data) {
+    r->key_size = key->size;
+    r->data_size = data->size;
+    r->capacity = ALIGN4(data->size);
+    memcpy((uint8_t *) r + sizeof(record_header), key->data, key->size);
+    if (data->size > 0)
+        memcpy((uint8_t *) r + sizeof(record_header) + ALIGN4(key->size), data->data, data->size);
+    r->checksum = record_checksum(r);
+
+    return record_size(r->key_size, r->capacity);
+}
+
+/* Bucket offsets and record sizes come straight from the file, so check
+ * that the record lies within the mapping before touching it */
+static bool record_in_bounds(simple_data *db, uint32_t offset) {
+    file_header *h = get_header(db);
+    record_header *r;
+    size_t room;
+
+    if (offset < records_start(h->n_buckets) || offset % 4 != 0 ||
+        offset >= db->map_size || db->map_size - offset < sizeof(record_header))
+        return false;
+
+    r = get_record(db, offset);
+    room = db->map_size - offset - sizeof(record_header);
+
+    return r->data_size <= r->capacity &&
+        r->key_size <= room &&
+        ALIGN4((size_t) r->key_size) <= room &&
+        r->capacity <= room - ALIGN4((size_t) r->key_size);
+}
+
+static bool record_valid(simple_data *db, uint32_t offset) {
+    record_header *r;
+
+    if (!record_in_bounds(db, offset))
+        return false;
+
+    r = get_record(db, offset);
+
+    return record_checksum(r) == r->checksum;
+}
+
+/* Returns the record bucket i points to, or NULL if the bucket is free or
+ * points somewhere it shouldn't */
+static record_header *bucket_record(simple_data *db, uint32_t i) {
+    uint32_t o = get_buckets(db)[i];
+
+    if (o == BUCKET_EMPTY || o == BUCKET_DELETED || !record_in_bounds(db, o))
+        return NULL;
+
+    return get_record(db, o);
+}
+
+/* Returns the bucket holding key, or -1. If free is not NULL it is set
+ * to the bucket key should be inserted into. */
+static int64_t file_lookup(simple_data *db, const pa_datum *key, int64_t *free) {
+    file_header *h = get_header(db);
+    uint32_t *buckets = get_buckets(db);
+    uint32_t mask = h->n_buckets - 1;
+    uint32_t i, n;
+
+    if (free)
+        *free = -1;
+
+    i = fnv1a(FNV_BASIS, key->data, key->size) & mask;
+
+    for (n = 0; n < h->n_buckets; n++, i = (i + 1) & mask) {
+        pa_datum k;
+
+        if (buckets[i] == BUCKET_EMPTY) {
+            if (free && *free < 0)
+                *free = i;
+            return -1;
+        }
+
+        if (buckets[i] == BUCKET_DELETED) {
+            if (free && *free < 0)
+                *free = i;
+            continue;
+        }
+
+        if (!record_in_bounds(db, buckets[i]))
+            continue;
+
+        record_key(get_record(db, buckets[i]), &k);
+        if (compare_func(&k, key) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static bool file_has_entries(simple_data *db) {
+    return db->map && !db->cleared;
+}
+
+static record_header *file_get(simple_data *db, const pa_datum *key) {
+    int64_t i;
+
+    if (!file_has_entries(db))
+        return NULL;
+
+    if ((i = file_lookup(db, key, NULL)) < 0)
+        return NULL;
+
+    /* A torn record from a crash we haven't recovered from, because the
+     * file was opened read-only */
+    if (!record_valid(db, get_buckets(db)[i]))
+        return NULL;
+
+    return get_record(db, get_buckets(db)[i]);
+}
+
+static void unmap_file(simple_data *db) {
+    if (db->map) {
+        munmap(db->map, db->map_size);
+        db->map = NULL;
+        db->map_size = 0;
+    }
+
+    if (db->fd >= 0) {
+        pa_close(db->fd);
+        db->fd = -1;
+    }
+}
+
+static int map_file(simple_data *db) {
+    struct stat st;
+
+    if (db->map) {
+        munmap(db->map, db->map_size);
+        db->map = NULL;
+    }
+
+    if (fstat(db->fd, &st) < 0)
+        return -1;
+
+    db->map_size = (size_t) st.st_size;
+    db->map = mmap(NULL, db->map_size, db->read_only ? PROT_READ : PROT_READ|PROT_WRITE, MAP_SHARED, db->fd, 0);
+
+    if (db->map == MAP_FAILED) {
+        db->map = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Opens and maps a file in the current format, checking the header */
+static int open_file(simple_data *db) {
+    file_header *h;
+
+    if ((db->fd = pa_open_cloexec(db->filename, db->read_only ? O_RDONLY : O_RDWR, 0)) < 0)
+        return -1;
+
+    if (map_file(db) < 0)
+        goto fail;
+
+    h = get_header(db);
+    if (db->map_size < sizeof(file_header) ||
+        memcmp(h->magic, FILE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != FILE_VERSION ||
+        h->n_buckets < MIN_BUCKETS || (h->n_buckets & (h->n_buckets - 1)) != 0 ||
+        h->n_buckets > (db->map_size - sizeof(file_header)) / sizeof(uint32_t) ||
+        records_start(h->n_buckets) > h->data_end ||
+        h->data_end > db->map_size) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    unmap_file(db);
+    return -1;
+}
+
+/* Writes the current view of the database to a new file and atomically
+ * replaces the old one with it, dropping dead records on the way */
+static int rebuild(simple_data *db) {
+    uint8_t *buffer;
+    file_header *h;
+    uint32_t *buckets;
+    size_t length, offset;
+    unsigned n_entries = 0, n_buckets;
+    entry *e;
+    void *state;
+    int fd;
+    bool ok;
+
+    /* Size everything up first */
+    length = 0;
+
+    if (file_has_entries(db)) {
+        uint32_t i;
+
+        for (i = 0; i < get_header(db)->n_buckets; i++) {
+            record_header *r;
+            pa_datum k;
+
+            if (!(r = bucket_record(db, i)) || record_checksum(r) != r->checksum)
+                continue;
+
+            record_key(r, &k);
+            if (pa_hashmap_get(db->changes, &k))
+                continue;
+
+            length += record_size(k.size, ALIGN4(r->data_size));
+            n_entries++;
+        }
+    }
+
+    PA_HASHMAP_FOREACH(e, db->changes, state) {
+        if (e->removed)
+            continue;
+
+        length += record_size(e->key.size, ALIGN4(e->data.size));
+        n_entries++;
+    }
+
+    n_buckets = MIN_BUCKETS;
+    while (n_buckets < n_entries * 2)
+        n_buckets *= 2;
+
+    length += records_start(n_buckets);
+    buffer = pa_xmalloc0(length);
+
+    h = (file_header *) buffer;
+    memcpy(h->magic, FILE_MAGIC, sizeof(h->magic));
+    h->version = FILE_VERSION;
+    h->n_buckets = n_buckets;
+    buckets = (uint32_t *) (buffer + sizeof(file_header));
+    offset = records_start(n_buckets);
+
+#define ADD_RECORD(k, d)                                                \
+    do {                                                                \
+        uint32_t _i = fnv1a(FNV_BASIS, (k)->data, (k)->size) & (n_buckets - 1); \
+                                                                        \
+        while (buckets[_i] != BUCKET_EMPTY)                             \
+            _i = (_i + 1) & (n_buckets - 1);                            \
+        buckets[_i] = offset;                                           \
+                                                                        \
+        offset += put_record((record_header *) (buffer + offset), (k), (d)); \
+        h->n_entries++;                                                 \
+    } while (0)
+
+    if (file_has_entries(db)) {
+        uint32_t i;
+
+        for (i = 0; i < get_header(db)->n_buckets; i++) {
+            record_header *r;
+            pa_datum k, d;
+
+            if (!(r = bucket_record(db, i)) || record_checksum(r) != r->checksum)
+                continue;
+
+            record_key(r, &k);
+            if (pa_hashmap_get(db->changes, &k))
+                continue;
+
+            record_data(r, &d);
+            ADD_RECORD(&k, &d);
+        }
+    }
+
+    PA_HASHMAP_FOREACH(e, db->changes, state)
+        if (!e->removed)
+            ADD_RECORD(&e->key, &e->data);
+
+#undef ADD_RECORD
+
+    pa_assert(offset == length);
+    h->data_end = offset;
+
+    ok = false;
+    if ((fd = pa_open_cloexec(db->tmp_filename, O_WRONLY|O_CREAT|O_TRUNC, 0600)) >= 0) {
+        ok = pa_loop_write(fd, buffer, length, NULL) == (ssize_t) length && fsync(fd) >= 0;
+        pa_close(fd);
+    }
+
+    pa_xfree(buffer);
+
+    if (!ok || rename(db->tmp_filename, db->filename) < 0) {
+        pa_log_warn("Failed to write database file '%s': %s", db->filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    /* A log left over from before is stale now */
+    unlink(db->wal_filename);
+
+    unmap_file(db);
+    pa_hashmap_remove_all(db->changes);
+    db->cleared = false;
+
+    if (open_file(db) < 0) {
+        pa_log_warn("Failed to reopen database file '%s': %s", db->filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Grows the file so that everything in the changes could be appended */
+static int reserve(simple_data *db) {
+    size_t needed;
+    entry *e;
+    void *state;
+
+    needed = get_header(db)->data_end;
+    PA_HASHMAP_FOREACH(e, db->changes, state)
+        if (!e->removed)
+            needed += record_size(e->key.size, ALIGN4(e->data.size));
+
+    if (needed <= db->map_size)
+        return 0;
+
+    if (needed > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    if (ftruncate(db->fd, (off_t) needed) < 0)
+        return -1;
+
+    return map_file(db);
+}
+
+/* Applies the changes to the mapped file in place. Any record that is
+ * only partially written when we crash here gets fixed up by replaying
+ * the log on the next open. */
+static int apply(simple_data *db) {
+    file_header *h;
+    uint32_t *buckets;
+    entry *e;
+    void *state;
+
+    if (reserve(db) < 0)
+        return -1;
+
+    h = get_header(db);
+    buckets = get_buckets(db);
+
+    PA_HASHMAP_FOREACH(e, db->changes, state) {
+        int64_t i, free;
+        record_header *r = NULL;
+
+        if ((i = file_lookup(db, &e->key, &free)) >= 0)
+            r = get_record(db, buckets[i]);
+
+        if (e->removed) {
+            if (!r)
+                continue;
+
+            h->garbage += record_size(r->key_size, r->capacity);
+            buckets[i] = BUCKET_DELETED;
+            h->n_entries--;
+            h->n_deleted++;
+            continue;
+        }
+
+        if (r && r->capacity >= e->data.size) {
+            pa_datum d;
+
+            record_data(r, &d);
+            memcpy(d.data, e->data.data, e->data.size);
+            r->data_size = e->data.size;
+            r->checksum = record_checksum(r);
+            continue;
+        }
+
+        if (r)
+            h->garbage += record_size(r->key_size, r->capacity);
+        else {
+            if (free < 0) {
+                errno = ENOSPC;
+                return -1;
+            }
+
+            i = free;
+            if (buckets[i] == BUCKET_DELETED)
+                h->n_deleted--;
+            h->n_entries++;
+        }
+
+        buckets[i] = h->data_end;
+        h->data_end += put_record(get_record(db, h->data_end), &e->key, &e->data);
+    }
+
+    if (msync(db->map, db->map_size, MS_SYNC) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int write_wal(simple_data *db) {
+    uint8_t *buffer;
+    wal_header *w;
+    size_t length, offset;
+    entry *e;
+    void *state;
+    int fd;
+    bool ok;
+
+    length = sizeof(wal_header);
+    PA_HASHMAP_FOREACH(e, db->changes, state)
+        length += sizeof(wal_record) + e->key.size + e->data.size;
+
+    buffer = pa_xmalloc0(length);
+    w = (wal_header *) buffer;
+    memcpy(w->magic, WAL_MAGIC, sizeof(w->magic));
+    offset = sizeof(wal_header);
+
+    PA_HASHMAP_FOREACH(e, db->changes, state) {
+        wal_record *r = (wal_record *) (buffer + offset);
+
+        r->removed = e->removed;
+        r->key_size = e->key.size;
+        r->data_size = e->data.size;
+        offset += sizeof(wal_record);
+        memcpy(buffer + offset, e->key.data, e->key.size);
+        offset += e->key.size;
+        if (e->data.size > 0)
+            memcpy(buffer + offset, e->data.data, e->data.size);
+        offset += e->data.size;
+        w->n_records++;
+    }
+
+    w->length = length - sizeof(wal_header);
+    w->checksum = fnv1a(FNV_BASIS, buffer + sizeof(wal_header), w->length);
+
+    ok = false;
+    if ((fd = pa_open_cloexec(db->wal_filename, O_WRONLY|O_CREAT|O_TRUNC, 0600)) >= 0) {
+        ok = pa_loop_write(fd, buffer, length, NULL) == (ssize_t) length && fsync(fd) >= 0;
+        pa_close(fd);
+    }
+
+    pa_xfree(buffer);
+
+    return ok ? 0 : -1;
+}
+
+/* Loads a complete log into the changes. A log that is incomplete was
+ * never acted upon and is simply ignored. */
+static bool read_wal(simple_data *db) {
+    uint8_t *buffer = NULL;
+    struct stat st;
+    wal_header w;
+    size_t offset;
+    uint32_t n;
+    int fd;
+    bool ok = false;
+
+    if ((fd = pa_open_cloexec(db->wal_filename, O_RDONLY, 0)) < 0)
+        return false;
+
+    if (fstat(fd, &st) < 0 ||
+        pa_loop_read(fd, &w, sizeof(w), NULL) != sizeof(w) ||
+        memcmp(w.magic, WAL_MAGIC, sizeof(w.magic)) != 0)
+        goto finish;
+
+    /* Don't trust the length before allocating for it; a torn log is
+     * shorter than it claims */
+    if (w.length == 0 || (uint64_t) w.length > (uint64_t) st.st_size - sizeof(w))
+        goto finish;
+
+    buffer = pa_xmalloc(w.length);
+    if (pa_loop_read(fd, buffer, w.length, NULL) != (ssize_t) w.length ||
+        fnv1a(FNV_BASIS, buffer, w.length) != w.checksum)
+        goto finish;
+
+    for (n = 0, offset = 0; n < w.n_records; n++) {
+        wal_record r;
+        pa_datum key, data;
+
+        if (offset + sizeof(r) > w.length)
+            goto finish;
+
+        memcpy(&r, buffer + offset, sizeof(r));
+        offset += sizeof(r);
+
+        if (r.key_size > w.length - offset || r.data_size > w.length - offset - r.key_size)
+            goto finish;
+
+        key.data = buffer + offset;
+        key.size = r.key_size;
+        data.data = buffer + offset + r.key_size;
+        data.size = r.data_size;
+        offset += r.key_size + r.data_size;
+
+        put_change(db, new_entry(&key, r.removed ? NULL : &data));
+    }
+
+    ok = true;
+
+finish:
+    if (!ok)
+        pa_hashmap_remove_all(db->changes);
+
+    pa_xfree(buffer);
+    pa_close(fd);
+
+    return ok;
+}
+
+/* After a crash the file may hold torn records and records past
+ * data_end. Drop the former, the log brings them back, and skip the
+ * latter. */
+static void recover(simple_data *db) {
+    file_header *h = get_header(db);
+    uint32_t *buckets = get_buckets(db);
+    uint32_t i;
+
+    for (i = 0; i < h->n_buckets; i++) {
+        record_header *r;
+        size_t end;
+
+        if (buckets[i] == BUCKET_EMPTY || buckets[i] == BUCKET_DELETED)
+            continue;
+
+        if (!record_valid(db, buckets[i])) {
+            buckets[i] = BUCKET_DELETED;
+            continue;
+        }
+
+        r = get_record(db, buckets[i]);
+        end = buckets[i] + record_size(r->key_size, r->capacity);
+        if (end > h->data_end)
+            h->data_end = end;
+    }
+
+    /* Recount, the header may be from before or after the crash */
+    h->n_entries = h->n_deleted = 0;
+    for (i = 0; i < h->n_buckets; i++) {
+        if (buckets[i] == BUCKET_DELETED)
+            h->n_deleted++;
+        else if (buckets[i] != BUCKET_EMPTY)
+            h->n_entries++;
+    }
+}
+
+static void replay_wal(simple_data *db) {
+    if (!read_wal(db)) {
+        unlink(db->wal_filename);
+        return;
+    }
+
+    pa_log_info("Replaying %u changes to database file '%s' after unclean shutdown.",
+                pa_hashmap_size(db->changes), db->filename);
+
+    recover(db);
+
+    if (apply(db) < 0)
+        pa_log_warn("Failed to replay changes to database file '%s': %s", db->filename, pa_cstrerror(errno));
+    else {
+        pa_hashmap_remove_all(db->changes);
+        unlink(db->wal_filename);
+    }
+}
+
+/* Reads a file in the old format into the changes */
+
 static int read_uint(FILE *f, uint32_t *res) {
     size_t items = 0;
     uint8_t values[4];
@@ -177,7 +882,7 @@ static int fill_data(simple_data *db, FILE *f) {
     enum { FIELD_KEY = 0, FIELD_DATA } field = FIELD_KEY;
 
     pa_assert(db);
-    pa_assert(db->map);
+    pa_assert(db->changes);
 
     errno = 0;
 
@@ -205,7 +910,7 @@ static int fill_data(simple_data *db, FILE *f) {
             e->key.size = key.size;
             e->data.data = data.data;
             e->data.size = data.size;
-            pa_hashmap_put(db->map, &e->key, e);
+            put_change(db, e);
             append = false;
             field = FIELD_KEY;
         }
@@ -213,13 +918,32 @@ static int fill_data(simple_data *db, FILE *f) {
 
     if (ferror(f)) {
         pa_log_warn("read error. %s", pa_cstrerror(errno));
-        pa_database_clear((pa_database*)db);
+        pa_hashmap_remove_all(db->changes);
     }
 
     if (field == FIELD_DATA && d)
         pa_xfree(d);
 
-    return pa_hashmap_size(db->map);
+    return pa_hashmap_size(db->changes);
+}
+
+static void migrate(simple_data *db) {
+    FILE *f;
+
+    if (!(f = pa_fopen_cloexec(db->filename, "r")))
+        return;
+
+    fill_data(db, f);
+    fclose(f);
+
+    /* The old contents only live in the changes from here on */
+    db->cleared = true;
+
+    if (db->read_only)
+        return;
+
+    if (rebuild(db) >= 0)
+        pa_log_info("Converted database file '%s' to the indexed format.", db->filename);
 }
 
 const char* pa_database_get_filename_suffix(void) {
@@ -227,30 +951,31 @@ const char* pa_database_get_filename_suffix(void) {
 }
 
 pa_database* pa_database_open_internal(const char *path, bool for_write) {
-    FILE *f;
     simple_data *db;
 
     pa_assert(path);
 
     errno = 0;
 
-    f = pa_fopen_cloexec(path, "r");
-
-    if (f || errno == ENOENT) { /* file not found is ok */
-        db = pa_xnew0(simple_data, 1);
-        db->map = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) free_entry);
-        db->filename = pa_xstrdup(path);
-        db->tmp_filename = pa_sprintf_malloc(".%s.tmp", db->filename);
-        db->read_only = !for_write;
-
-        if (f) {
-            fill_data(db, f);
-            fclose(f);
-        }
-    } else {
-        if (errno == 0)
-            errno = EIO;
-        db = NULL;
+    db = pa_xnew0(simple_data, 1);
+    db->changes = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) free_entry);
+    db->filename = pa_xstrdup(path);
+    db->tmp_filename = pa_sprintf_malloc("%s.tmp", db->filename);
+    db->wal_filename = pa_sprintf_malloc("%s.wal", db->filename);
+    db->read_only = !for_write;
+    db->fd = -1;
+
+    if (open_file(db) >= 0) {
+        if (!db->read_only)
+            replay_wal(db);
+    } else if (errno == EINVAL)
+        migrate(db);
+    else if (errno != ENOENT) { /* file not found is ok */
+        int saved_errno = errno ? errno : EIO;
+
+        pa_database_close((pa_database*) db);
+        errno = saved_errno;
+        return NULL;
     }
 
     return (pa_database*) db;
@@ -261,35 +986,56 @@ void pa_database_close(pa_database *database) {
     pa_assert(db);
 
     pa_database_sync(database);
+    unmap_file(db);
     pa_xfree(db->filename);
     pa_xfree(db->tmp_filename);
-    pa_hashmap_free(db->map);
+    pa_xfree(db->wal_filename);
+    pa_hashmap_free(db->changes);
     pa_xfree(db);
 }
 
+/* Finds key in the changes or the file; returns false if it is absent */
+static bool lookup(simple_data *db, const pa_datum *key, pa_datum *data) {
+    entry *e;
+    record_header *r;
+
+    if ((e = pa_hashmap_get(db->changes, key))) {
+        if (e->removed)
+            return false;
+
+        if (data)
+            *data = e->data;
+        return true;
+    }
+
+    if (!(r = file_get(db, key)))
+        return false;
+
+    if (data)
+        record_data(r, data);
+
+    return true;
+}
+
 pa_datum* pa_database_get(pa_database *database, const pa_datum *key, pa_datum* data) {
     simple_data *db = (simple_data*)database;
-    entry *e;
+    pa_datum d;
 
     pa_assert(db);
     pa_assert(key);
     pa_assert(data);
 
-    e = pa_hashmap_get(db->map, key);
-
-    if (!e)
+    if (!lookup(db, key, &d))
         return NULL;
 
-    data->data = e->data.size > 0 ? pa_xmemdup(e->data.data, e->data.size) : NULL;
-    data->size = e->data.size;
+    data->data = d.size > 0 ? pa_xmemdup(d.data, d.size) : NULL;
+    data->size = d.size;
 
     return data;
 }
 
 int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum* data, bool overwrite) {
     simple_data *db = (simple_data*)database;
-    entry *e;
-    int ret = 0;
 
     pa_assert(db);
     pa_assert(key);
@@ -298,24 +1044,12 @@ int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum*
     if (db->read_only)
         return -1;
 
-    e = new_entry(key, data);
-
-    if (pa_hashmap_put(db->map, &e->key, e) < 0) {
-        /* entry with same key exists in hashmap */
-        entry *r;
-        if (overwrite) {
-            r = pa_hashmap_remove(db->map, key);
-            pa_hashmap_put(db->map, &e->key, e);
-        } else {
-            /* won't overwrite, so clean new entry */
-            r = e;
-            ret = -1;
-        }
+    if (!overwrite && lookup(db, key, NULL))
+        return -1;
 
-        free_entry(r);
-    }
+    put_change(db, new_entry(key, data));
 
-    return ret;
+    return 0;
 }
 
 int pa_database_unset(pa_database *database, const pa_datum *key) {
@@ -324,7 +1058,15 @@ int pa_database_unset(pa_database *database, const pa_datum *key) {
     pa_assert(db);
     pa_assert(key);
 
-    return pa_hashmap_remove_and_free(db->map, key);
+    if (!lookup(db, key, NULL))
+        return -1;
+
+    if (file_get(db, key))
+        put_change(db, new_entry(key, NULL));
+    else
+        pa_hashmap_remove_and_free(db->changes, key);
+
+    return 0;
 }
 
 int pa_database_clear(pa_database *database) {
@@ -332,164 +1074,181 @@ int pa_database_clear(pa_database *database) {
 
     pa_assert(db);
 
-    pa_hashmap_remove_all(db->map);
+    pa_hashmap_remove_all(db->changes);
+    db->cleared = true;
 
     return 0;
 }
 
 signed pa_database_size(pa_database *database) {
     simple_data *db = (simple_data*)database;
-    pa_assert(db);
-
-    return (signed) pa_hashmap_size(db->map);
-}
-
-pa_datum* pa_database_first(pa_database *database, pa_datum *key, pa_datum *data) {
-    simple_data *db = (simple_data*)database;
+    signed n = 0;
     entry *e;
+    void *state;
 
     pa_assert(db);
-    pa_assert(key);
 
-    e = pa_hashmap_first(db->map);
+    if (file_has_entries(db))
+        n = get_header(db)->n_entries;
 
-    if (!e)
-        return NULL;
-
-    key->data = e->key.size > 0 ? pa_xmemdup(e->key.data, e->key.size) : NULL;
-    key->size = e->key.size;
+    PA_HASHMAP_FOREACH(e, db->changes, state) {
+        bool in_file = !!file_get(db, &e->key);
 
-    if (data) {
-        data->data = e->data.size > 0 ? pa_xmemdup(e->data.data, e->data.size) : NULL;
-        data->size = e->data.size;
+        if (e->removed && in_file)
+            n--;
+        else if (!e->removed && !in_file)
+            n++;
     }
 
-    return key;
+    return n;
 }
 
-pa_datum* pa_database_next(pa_database *database, const pa_datum *key, pa_datum *next, pa_datum *data) {
-    simple_data *db = (simple_data*)database;
+/* Iteration goes over the file in bucket order, skipping what the
+ * changes override, and then over the changes */
+
+static entry *changes_next(simple_data *db, entry *after) {
     entry *e;
-    entry *search;
     void *state;
-    bool pick_now;
+    bool pick = !after;
 
-    pa_assert(db);
-    pa_assert(next);
+    PA_HASHMAP_FOREACH(e, db->changes, state) {
+        if (pick && !e->removed)
+            return e;
 
-    if (!key)
-        return pa_database_first(database, next, data);
+        if (e == after)
+            pick = true;
+    }
+
+    return NULL;
+}
+
+static record_header *file_next(simple_data *db, int64_t after) {
+    uint32_t i;
 
-    search = pa_hashmap_get(db->map, key);
+    if (!file_has_entries(db))
+        return NULL;
 
-    state = NULL;
-    pick_now = false;
+    for (i = after + 1; i < get_header(db)->n_buckets; i++) {
+        record_header *r;
+        pa_datum k;
 
-    while ((e = pa_hashmap_iterate(db->map, &state, NULL))) {
-        if (pick_now)
-            break;
+        if (!(r = bucket_record(db, i)) || record_checksum(r) != r->checksum)
+            continue;
 
-        if (search == e)
-            pick_now = true;
+        record_key(r, &k);
+        if (!pa_hashmap_get(db->changes, &k))
+            return r;
     }
 
-    if (!pick_now || !e)
-        return NULL;
+    return NULL;
+}
 
-    next->data = e->key.size > 0 ? pa_xmemdup(e->key.data, e->key.size) : NULL;
-    next->size = e->key.size;
+static pa_datum *return_pair(const pa_datum *k, const pa_datum *d, pa_datum *key, pa_datum *data) {
+    key->data = k->size > 0 ? pa_xmemdup(k->data, k->size) : NULL;
+    key->size = k->size;
 
     if (data) {
-        data->data = e->data.size > 0 ? pa_xmemdup(e->data.data, e->data.size) : NULL;
-        data->size = e->data.size;
+        data->data = d->size > 0 ? pa_xmemdup(d->data, d->size) : NULL;
+        data->size = d->size;
     }
 
-    return next;
+    return key;
 }
 
-static int write_uint(FILE *f, const uint32_t num) {
-    size_t items;
-    uint8_t values[4];
-    int i;
-    errno = 0;
-
-    for (i = 0; i < 4; i++)
-        values[i] = (num >> (i*8)) & 0xFF;
+static pa_datum *return_position(record_header *r, entry *e, pa_datum *key, pa_datum *data) {
+    pa_datum k, d;
 
-    items = fwrite(&values, sizeof(values), sizeof(uint8_t), f);
+    if (r) {
+        record_key(r, &k);
+        record_data(r, &d);
+        return return_pair(&k, &d, key, data);
+    }
 
-    if (ferror(f))
-        return -1;
+    if (e)
+        return return_pair(&e->key, &e->data, key, data);
 
-    return items;
+    return NULL;
 }
 
-static int write_data(FILE *f, void *data, const size_t length) {
-    size_t items;
-    uint32_t len;
-
-    len = length;
-    if ((items = write_uint(f, len)) <= 0)
-        return -1;
+pa_datum* pa_database_first(pa_database *database, pa_datum *key, pa_datum *data) {
+    simple_data *db = (simple_data*)database;
+    record_header *r;
 
-    items = fwrite(data, length, 1, f);
+    pa_assert(db);
+    pa_assert(key);
 
-    if (ferror(f) || items != 1)
-        return -1;
+    if ((r = file_next(db, -1)))
+        return return_position(r, NULL, key, data);
 
-    return 0;
+    return return_position(NULL, changes_next(db, NULL), key, data);
 }
 
-static int write_entry(FILE *f, const entry *e) {
-    pa_assert(f);
-    pa_assert(e);
+pa_datum* pa_database_next(pa_database *database, const pa_datum *key, pa_datum *next, pa_datum *data) {
+    simple_data *db = (simple_data*)database;
+    entry *e;
+    int64_t i;
 
-    if (write_data(f, e->key.data, e->key.size) < 0)
-        return -1;
-    if (write_data(f, e->data.data, e->data.size) < 0)
-        return -1;
+    pa_assert(db);
+    pa_assert(next);
 
-    return 0;
+    if (!key)
+        return pa_database_first(database, next, data);
+
+    if ((e = pa_hashmap_get(db->changes, key))) {
+        if (e->removed)
+            return NULL;
+
+        return return_position(NULL, changes_next(db, e), next, data);
+    }
+
+    if (!file_has_entries(db) || (i = file_lookup(db, key, NULL)) < 0)
+        return NULL;
+
+    return return_position(file_next(db, i), changes_next(db, NULL), next, data);
 }
 
 int pa_database_sync(pa_database *database) {
     simple_data *db = (simple_data*)database;
-    FILE *f;
-    void *state;
+    file_header *h;
+    unsigned n_inserts = 0;
     entry *e;
+    void *state;
 
     pa_assert(db);
 
     if (db->read_only)
         return 0;
 
-    errno = 0;
+    if (pa_hashmap_isempty(db->changes) && !db->cleared)
+        return 0;
 
-    f = pa_fopen_cloexec(db->tmp_filename, "w");
+    if (!db->map || db->cleared)
+        return rebuild(db);
 
-    if (!f)
-        goto fail;
+    h = get_header(db);
 
-    state = NULL;
-    while((e = pa_hashmap_iterate(db->map, &state, NULL))) {
-        if (write_entry(f, e) < 0) {
-            pa_log_warn("error while writing to file. %s", pa_cstrerror(errno));
-            goto fail;
-        }
-    }
+    PA_HASHMAP_FOREACH(e, db->changes, state)
+        if (!e->removed)
+            n_inserts++;
 
-    fclose(f);
-    f = NULL;
+    /* Keep the table at most three quarters full and the file mostly
+     * live; otherwise start over with a fresh file */
+    if ((h->n_entries + h->n_deleted + n_inserts) * 4 > h->n_buckets * 3 ||
+        (h->garbage > GARBAGE_MIN && h->garbage > h->data_end / 2))
+        return rebuild(db);
 
-    if (rename(db->tmp_filename, db->filename) < 0) {
-        pa_log_warn("error while renaming file. %s", pa_cstrerror(errno));
-        goto fail;
+    if (write_wal(db) < 0) {
+        pa_log_warn("Failed to write log for database file '%s': %s", db->filename, pa_cstrerror(errno));
+        return -1;
     }
 
-    return 0;
+    if (apply(db) < 0) {
+        pa_log_warn("Failed to update database file '%s': %s", db->filename, pa_cstrerror(errno));
+        return -1;
+    }
 
-fail:
-    if (f)
-        fclose(f);
-    return -1;
+    pa_hashmap_remove_all(db->changes);
+    unlink(db->wal_filename);
+
+    return 0;
 }
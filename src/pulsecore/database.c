@@ -23,10 +23,22 @@
 
 #include <errno.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <pulse/xmalloc.h>
+#include <pulse/rtclock.h>
+#include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/log.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
 
 #include "database.h"
 #include "core-error.h"
@@ -105,3 +117,530 @@ pa_database* pa_database_open(const char *path, const char *fn, bool prependmid,
 
     return f;
 }
+
+#define JOURNAL_SHARED_NAME "database-journal"
+#define JOURNAL_FILE_NAME "restore-journal"
+#define JOURNAL_MAGIC "PAJ1"
+#define JOURNAL_MAGIC_SIZE 4
+#define JOURNAL_FLUSH_INTERVAL (10 * PA_USEC_PER_SEC)
+#define JOURNAL_COMPACT_SIZE (256 * 1024)
+
+/* Records are stored in host byte order, like the databases themselves:
+ *
+ *   uint32 checksum of everything that follows, up to the end of the record
+ *   uint32 type
+ *   uint32 name, key and data lengths
+ *   name, key and data bytes */
+enum {
+    RECORD_SET = 1,
+    RECORD_UNSET = 2,
+    RECORD_CLEAR = 3
+};
+
+#define RECORD_HEADER_SIZE (5 * sizeof(uint32_t))
+
+struct journal_database {
+    pa_database *db;
+    char *name;
+};
+
+/* Records loaded at startup for a database nobody attached yet */
+struct journal_backlog {
+    char *name;
+    uint8_t *data;
+    size_t length;
+    unsigned n_records;
+};
+
+struct pa_database_journal {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    char *path;
+    char *tmp_path;
+    int fd;
+    size_t size;
+
+    uint8_t *pending;
+    size_t pending_length, pending_allocated;
+
+    pa_hashmap *databases; /* pa_database -> struct journal_database */
+    pa_hashmap *backlogs; /* name -> struct journal_backlog */
+
+    pa_time_event *flush_event;
+};
+
+static uint32_t checksum(const uint8_t *p, size_t length) {
+    uint32_t h = 2166136261U;
+
+    /* FNV-1a, enough to spot a record torn by a crash */
+    while (length--) {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static void buffer_append(uint8_t **buffer, size_t *length, size_t *allocated, const void *p, size_t n) {
+    if (*length + n > *allocated) {
+        *allocated = PA_MAX(*allocated * 2, *length + n);
+        *buffer = pa_xrealloc(*buffer, *allocated);
+    }
+
+    memcpy(*buffer + *length, p, n);
+    *length += n;
+}
+
+static void append_record(pa_database_journal *j, uint32_t type, const char *name, const pa_datum *key, const pa_datum *data) {
+    uint32_t header[5];
+    size_t start;
+
+    header[0] = 0;
+    header[1] = type;
+    header[2] = strlen(name);
+    header[3] = key ? key->size : 0;
+    header[4] = data ? data->size : 0;
+
+    start = j->pending_length;
+    buffer_append(&j->pending, &j->pending_length, &j->pending_allocated, header, sizeof(header));
+    buffer_append(&j->pending, &j->pending_length, &j->pending_allocated, name, header[2]);
+    if (header[3] > 0)
+        buffer_append(&j->pending, &j->pending_length, &j->pending_allocated, key->data, header[3]);
+    if (header[4] > 0)
+        buffer_append(&j->pending, &j->pending_length, &j->pending_allocated, data->data, header[4]);
+
+    header[0] = checksum(j->pending + start + sizeof(uint32_t), j->pending_length - start - sizeof(uint32_t));
+    memcpy(j->pending + start, &header[0], sizeof(uint32_t));
+}
+
+/* Returns the length of the valid record at p, or 0 */
+static size_t parse_record(const uint8_t *p, size_t left, uint32_t *type, pa_datum *name, pa_datum *key, pa_datum *data) {
+    uint32_t header[5];
+    size_t length;
+
+    if (left < RECORD_HEADER_SIZE)
+        return 0;
+
+    memcpy(header, p, sizeof(header));
+
+    if (header[2] > left || header[3] > left || header[4] > left)
+        return 0;
+
+    length = RECORD_HEADER_SIZE + (size_t) header[2] + header[3] + header[4];
+    if (length > left || header[2] == 0)
+        return 0;
+
+    if (checksum(p + sizeof(uint32_t), length - sizeof(uint32_t)) != header[0])
+        return 0;
+
+    if (header[1] != RECORD_SET && header[1] != RECORD_UNSET && header[1] != RECORD_CLEAR)
+        return 0;
+
+    *type = header[1];
+    name->data = (void *) (p + RECORD_HEADER_SIZE);
+    name->size = header[2];
+    key->data = (uint8_t *) name->data + name->size;
+    key->size = header[3];
+    data->data = (uint8_t *) key->data + key->size;
+    data->size = header[4];
+
+    return length;
+}
+
+static void backlog_free(struct journal_backlog *b) {
+    pa_xfree(b->name);
+    pa_xfree(b->data);
+    pa_xfree(b);
+}
+
+static void journal_database_free(struct journal_database *d) {
+    pa_xfree(d->name);
+    pa_xfree(d);
+}
+
+/* Sorts the valid records of the journal file into per database backlogs */
+static void load(pa_database_journal *j) {
+    struct stat st;
+    uint8_t *map;
+    size_t offset;
+    int fd;
+
+    if ((fd = pa_open_cloexec(j->path, O_RDONLY, 0)) < 0) {
+        if (errno != ENOENT)
+            pa_log_warn("Failed to open database journal '%s': %s", j->path, pa_cstrerror(errno));
+        return;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < JOURNAL_MAGIC_SIZE) {
+        pa_close(fd);
+        return;
+    }
+
+#ifdef HAVE_SYS_MMAN_H
+    if ((map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        pa_log_warn("Failed to map database journal '%s': %s", j->path, pa_cstrerror(errno));
+        pa_close(fd);
+        return;
+    }
+#else
+    map = pa_xmalloc((size_t) st.st_size);
+    if (pa_loop_read(fd, map, (size_t) st.st_size, NULL) != (ssize_t) st.st_size) {
+        pa_log_warn("Failed to read database journal '%s'", j->path);
+        pa_xfree(map);
+        pa_close(fd);
+        return;
+    }
+#endif
+
+    pa_close(fd);
+
+    if (memcmp(map, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+        pa_log_warn("Database journal '%s' has an unknown format, ignoring it.", j->path);
+        goto finish;
+    }
+
+    offset = JOURNAL_MAGIC_SIZE;
+    while (offset < (size_t) st.st_size) {
+        struct journal_backlog *b;
+        uint32_t type;
+        pa_datum name, key, data;
+        size_t length;
+        char *n;
+
+        if (!(length = parse_record(map + offset, (size_t) st.st_size - offset, &type, &name, &key, &data))) {
+            pa_log_warn("Database journal '%s' is truncated at offset %zu, dropping the rest.", j->path, offset);
+            break;
+        }
+
+        n = pa_xstrndup(name.data, name.size);
+        if (!(b = pa_hashmap_get(j->backlogs, n))) {
+            b = pa_xnew0(struct journal_backlog, 1);
+            b->name = n;
+            pa_hashmap_put(j->backlogs, b->name, b);
+        } else
+            pa_xfree(n);
+
+        b->data = pa_xrealloc(b->data, b->length + length);
+        memcpy(b->data + b->length, map + offset, length);
+        b->length += length;
+        b->n_records++;
+
+        offset += length;
+    }
+
+finish:
+#ifdef HAVE_SYS_MMAN_H
+    munmap(map, (size_t) st.st_size);
+#else
+    pa_xfree(map);
+#endif
+}
+
+/* Replaces the journal file with one that only holds the backlogs, and
+ * reopens it for appending */
+static int rewrite(pa_database_journal *j) {
+    struct journal_backlog *b;
+    void *state;
+    int fd;
+
+    if (j->fd >= 0) {
+        pa_close(j->fd);
+        j->fd = -1;
+    }
+
+    if ((fd = pa_open_cloexec(j->tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0600)) < 0)
+        goto fail;
+
+    j->size = JOURNAL_MAGIC_SIZE;
+    if (pa_loop_write(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE, NULL) != JOURNAL_MAGIC_SIZE)
+        goto fail_close;
+
+    PA_HASHMAP_FOREACH(b, j->backlogs, state) {
+        if (pa_loop_write(fd, b->data, b->length, NULL) != (ssize_t) b->length)
+            goto fail_close;
+        j->size += b->length;
+    }
+
+    if (fsync(fd) < 0)
+        goto fail_close;
+
+    pa_close(fd);
+
+    if (rename(j->tmp_path, j->path) < 0)
+        goto fail;
+
+    if ((j->fd = pa_open_cloexec(j->path, O_WRONLY|O_APPEND, 0600)) < 0)
+        goto fail;
+
+    return 0;
+
+fail_close:
+    pa_close(fd);
+
+fail:
+    pa_log_warn("Failed to write database journal '%s': %s", j->path, pa_cstrerror(errno));
+    return -1;
+}
+
+/* Everything journaled for attached databases becomes redundant once they
+ * are synced, so only the backlogs need to be carried over */
+static void compact(pa_database_journal *j) {
+    struct journal_database *d;
+    void *state;
+
+    PA_HASHMAP_FOREACH(d, j->databases, state)
+        if (pa_database_sync(d->db) < 0) {
+            pa_log_warn("Failed to sync database '%s', not compacting the journal.", d->name);
+            return;
+        }
+
+    if (!j->path)
+        return;
+
+    if (rewrite(j) >= 0)
+        pa_log_debug("Compacted database journal to %zu bytes.", j->size);
+}
+
+static void flush(pa_database_journal *j) {
+    if (j->flush_event) {
+        j->core->mainloop->time_free(j->flush_event);
+        j->flush_event = NULL;
+    }
+
+    if (j->pending_length <= 0)
+        return;
+
+    if (j->fd < 0 ||
+        pa_loop_write(j->fd, j->pending, j->pending_length, NULL) != (ssize_t) j->pending_length ||
+        fsync(j->fd) < 0) {
+
+        if (j->fd >= 0)
+            pa_log_warn("Failed to append to database journal '%s': %s", j->path, pa_cstrerror(errno));
+
+        /* Without a usable journal fall back to syncing the databases,
+         * which also starts a fresh journal file if possible */
+        j->pending_length = 0;
+        compact(j);
+        return;
+    }
+
+    pa_log_debug("Journaled %zu bytes of database changes.", j->pending_length);
+
+    j->size += j->pending_length;
+    j->pending_length = 0;
+
+    if (j->size >= JOURNAL_COMPACT_SIZE)
+        compact(j);
+}
+
+static void flush_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_database_journal *j = userdata;
+
+    pa_assert(j);
+    pa_assert(e == j->flush_event);
+
+    flush(j);
+}
+
+void pa_database_journal_flush(pa_database_journal *j) {
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+
+    flush(j);
+}
+
+static void schedule_flush(pa_database_journal *j) {
+    if (j->flush_event)
+        return;
+
+    j->flush_event = pa_core_rttime_new(j->core, pa_rtclock_now() + JOURNAL_FLUSH_INTERVAL, flush_cb, j);
+}
+
+pa_database_journal* pa_database_journal_get(pa_core *c) {
+    pa_database_journal *j;
+
+    pa_assert(c);
+
+    if ((j = pa_shared_get(c, JOURNAL_SHARED_NAME)))
+        return pa_database_journal_ref(j);
+
+    j = pa_xnew0(pa_database_journal, 1);
+    PA_REFCNT_INIT(j);
+    j->core = c;
+    j->fd = -1;
+    j->databases = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                       NULL, (pa_free_cb_t) journal_database_free);
+    j->backlogs = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                      NULL, (pa_free_cb_t) backlog_free);
+
+    if ((j->path = pa_state_path(JOURNAL_FILE_NAME, true))) {
+        j->tmp_path = pa_sprintf_malloc("%s.tmp", j->path);
+
+        load(j);
+
+        /* Start out with a clean file, without whatever was torn off at
+         * the end of the old one */
+        rewrite(j);
+    }
+
+    pa_shared_set(c, JOURNAL_SHARED_NAME, j);
+
+    return j;
+}
+
+pa_database_journal* pa_database_journal_ref(pa_database_journal *j) {
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+
+    PA_REFCNT_INC(j);
+
+    return j;
+}
+
+void pa_database_journal_unref(pa_database_journal *j) {
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+
+    if (PA_REFCNT_DEC(j) > 0)
+        return;
+
+    flush(j);
+
+    /* Drop what the detached databases no longer need */
+    if (j->size > JOURNAL_MAGIC_SIZE)
+        compact(j);
+
+    pa_assert_se(pa_shared_remove(j->core, JOURNAL_SHARED_NAME) >= 0);
+
+    if (j->fd >= 0)
+        pa_close(j->fd);
+
+    pa_hashmap_free(j->databases);
+    pa_hashmap_free(j->backlogs);
+    pa_xfree(j->pending);
+    pa_xfree(j->path);
+    pa_xfree(j->tmp_path);
+    pa_xfree(j);
+}
+
+void pa_database_journal_attach(pa_database_journal *j, pa_database *db, const char *name) {
+    struct journal_database *d;
+    struct journal_backlog *b;
+    size_t offset;
+
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+    pa_assert(db);
+    pa_assert(name);
+    pa_assert(!pa_hashmap_get(j->databases, db));
+
+    d = pa_xnew(struct journal_database, 1);
+    d->db = db;
+    d->name = pa_xstrdup(name);
+    pa_hashmap_put(j->databases, db, d);
+
+    if (!(b = pa_hashmap_get(j->backlogs, name)))
+        return;
+
+    /* Replaying is idempotent: the records describe how the database got
+     * from its last synced state to the journaled one, and applying them
+     * to any state in between ends up in the same place */
+    for (offset = 0; offset < b->length;) {
+        uint32_t type;
+        pa_datum n, key, data;
+        size_t length;
+
+        length = parse_record(b->data + offset, b->length - offset, &type, &n, &key, &data);
+        pa_assert(length > 0);
+        offset += length;
+
+        switch (type) {
+            case RECORD_SET:
+                pa_database_set(db, &key, &data, true);
+                break;
+            case RECORD_UNSET:
+                pa_database_unset(db, &key);
+                break;
+            case RECORD_CLEAR:
+                pa_database_clear(db);
+                break;
+        }
+    }
+
+    pa_log_info("Replayed %u journaled changes into database '%s'.", b->n_records, name);
+
+    /* The records stay in the journal file until the next compaction,
+     * which syncs db first */
+    pa_hashmap_remove_and_free(j->backlogs, name);
+}
+
+void pa_database_journal_detach(pa_database_journal *j, pa_database *db) {
+    struct journal_database *d;
+
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+    pa_assert(db);
+
+    pa_assert_se(d = pa_hashmap_get(j->databases, db));
+
+    pa_database_journal_flush(j);
+
+    if (pa_database_sync(db) < 0)
+        pa_log_warn("Failed to sync database '%s'.", d->name);
+
+    pa_hashmap_remove_and_free(j->databases, db);
+}
+
+static const char *attached_name(pa_database_journal *j, pa_database *db) {
+    struct journal_database *d;
+
+    pa_assert(j);
+    pa_assert(PA_REFCNT_VALUE(j) >= 1);
+    pa_assert(db);
+
+    pa_assert_se(d = pa_hashmap_get(j->databases, db));
+
+    return d->name;
+}
+
+int pa_database_journal_set(pa_database_journal *j, pa_database *db, const pa_datum *key, const pa_datum* data, bool overwrite) {
+    const char *name = attached_name(j, db);
+
+    pa_assert(key);
+    pa_assert(data);
+
+    if (pa_database_set(db, key, data, overwrite) < 0)
+        return -1;
+
+    append_record(j, RECORD_SET, name, key, data);
+    schedule_flush(j);
+
+    return 0;
+}
+
+int pa_database_journal_unset(pa_database_journal *j, pa_database *db, const pa_datum *key) {
+    const char *name = attached_name(j, db);
+
+    pa_assert(key);
+
+    if (pa_database_unset(db, key) < 0)
+        return -1;
+
+    append_record(j, RECORD_UNSET, name, key, NULL);
+    schedule_flush(j);
+
+    return 0;
+}
+
+int pa_database_journal_clear(pa_database_journal *j, pa_database *db) {
+    const char *name = attached_name(j, db);
+
+    if (pa_database_clear(db) < 0)
+        return -1;
+
+    append_record(j, RECORD_CLEAR, name, NULL, NULL);
+    schedule_flush(j);
+
+    return 0;
+}
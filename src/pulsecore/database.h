@@ -23,6 +23,7 @@
 #include <sys/types.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/typedefs.h>
 
 /* A little abstraction over simple databases, such as gdbm, tdb, and
  * so on. We only make minimal assumptions about the supported
@@ -77,4 +78,31 @@ pa_datum* pa_database_next(pa_database *db, const pa_datum *key, pa_datum *next,
 
 int pa_database_sync(pa_database *db);
 
+/* Write-behind persistence shared by several databases, such as the ones
+ * of the restore modules. Changes made through pa_database_journal_set()
+ * and friends are applied to the database right away and appended to one
+ * journal file a little later, with a single fsync for all attached
+ * databases. The databases themselves are only synced when the journal is
+ * compacted or when they are detached. Main thread only. */
+
+typedef struct pa_database_journal pa_database_journal;
+
+/* Returns the journal of the core, creating it on first use */
+pa_database_journal* pa_database_journal_get(pa_core *c);
+pa_database_journal* pa_database_journal_ref(pa_database_journal *j);
+void pa_database_journal_unref(pa_database_journal *j);
+
+/* Journaled changes for name that did not make it into the database file
+ * before the last shutdown are replayed into db here */
+void pa_database_journal_attach(pa_database_journal *j, pa_database *db, const char *name);
+/* Flushes the journal and syncs db; call before pa_database_close() */
+void pa_database_journal_detach(pa_database_journal *j, pa_database *db);
+
+int pa_database_journal_set(pa_database_journal *j, pa_database *db, const pa_datum *key, const pa_datum* data, bool overwrite);
+int pa_database_journal_unset(pa_database_journal *j, pa_database *db, const pa_datum *key);
+int pa_database_journal_clear(pa_database_journal *j, pa_database *db);
+
+/* Writes out pending changes now instead of waiting for the timer */
+void pa_database_journal_flush(pa_database_journal *j);
+
 #endif
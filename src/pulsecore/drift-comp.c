@@ -0,0 +1,392 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/resampler.h>
+
+#include "drift-comp.h"
+
+/* Weight of a sample in the fit halves about every 7 seconds */
+#define FIT_TIME_CONSTANT (10 * PA_USEC_PER_SEC)
+/* Span of samples needed before the fit is trusted */
+#define FIT_SETTLE_TIME (2 * PA_USEC_PER_SEC)
+/* Longer gaps between samples, e.g. while suspended, restart the fit */
+#define FIT_MAX_GAP (1 * PA_USEC_PER_SEC)
+/* Samples further off the fit than this and the threshold are a jump in
+ * the alignment rather than timing jitter */
+#define MIN_JUMP (5 * PA_USEC_PER_MSEC)
+
+/* The alignment error is corrected over this time on top of the drift */
+#define CORRECTION_TIME (10 * PA_USEC_PER_SEC)
+/* 1000 ppm shift the pitch by less than two cents */
+#define MAX_CORRECTION 0.001
+
+struct pa_drift_comp {
+    pa_sample_spec sink_ss, source_ss;
+    bool correct;
+    int64_t threshold, target;
+
+    /* Playback I/O thread */
+    pa_usec_t last_snapshot;
+    unsigned next_snapshot;
+
+    /* Handed from the playback to the capture I/O thread without
+     * allocating; a slot is busy until the latter releases it */
+    pa_drift_snapshot snapshots[2];
+    pa_atomic_t snapshot_busy[2];
+
+    /* Capture I/O thread. The fit runs on the alignment plus whatever the
+     * rate correction and the resyncs moved it by, so that its slope only
+     * depends on the device clocks. Sums are over seconds relative to the
+     * last sample and usec of alignment. */
+    double s0, st, sc, stt, stc;
+    pa_usec_t first, last;
+    double shift;
+
+    bool have_drift;
+    double drift;
+
+    /* Written by the capture I/O thread and the main thread respectively */
+    pa_atomic_t wanted_rate, applied_rate;
+};
+
+pa_drift_comp *pa_drift_comp_new(const pa_sample_spec *sink_ss, const pa_sample_spec *source_ss, bool correct, pa_usec_t threshold) {
+    pa_drift_comp *d;
+
+    pa_assert(sink_ss);
+    pa_assert(source_ss);
+
+    d = pa_xnew0(pa_drift_comp, 1);
+    d->sink_ss = *sink_ss;
+    d->source_ss = *source_ss;
+    d->correct = correct;
+    d->threshold = (int64_t) threshold;
+    d->target = d->threshold / 2;
+
+    pa_atomic_store(&d->wanted_rate, (int) sink_ss->rate);
+    pa_atomic_store(&d->applied_rate, (int) sink_ss->rate);
+
+    return d;
+}
+
+void pa_drift_comp_free(pa_drift_comp *d) {
+    pa_assert(d);
+
+    pa_xfree(d);
+}
+
+pa_drift_snapshot *pa_drift_comp_snapshot_get(pa_drift_comp *d, pa_usec_t now) {
+    unsigned n;
+
+    pa_assert(d);
+
+    if (now < d->last_snapshot + PA_DRIFT_COMP_SNAPSHOT_INTERVAL)
+        return NULL;
+
+    d->last_snapshot = now;
+
+    /* The capture thread is lagging behind, skip this one */
+    n = d->next_snapshot;
+    if (!pa_atomic_cmpxchg(&d->snapshot_busy[n], 0, 1))
+        return NULL;
+
+    d->next_snapshot = (n + 1) % PA_ELEMENTSOF(d->snapshots);
+
+    return &d->snapshots[n];
+}
+
+void pa_drift_comp_snapshot_release(pa_drift_comp *d, pa_drift_snapshot *s) {
+    size_t n;
+
+    pa_assert(d);
+    pa_assert(s >= d->snapshots);
+
+    n = (size_t) (s - d->snapshots);
+    pa_assert(n < PA_ELEMENTSOF(d->snapshots));
+
+    pa_atomic_store(&d->snapshot_busy[n], 0);
+}
+
+void pa_drift_snapshot_sink(pa_drift_snapshot *s, pa_sink_input *i, int64_t send_counter) {
+    size_t delay;
+
+    pa_assert(s);
+    pa_sink_input_assert_ref(i);
+
+    delay = pa_memblockq_get_length(i->thread_info.render_memblockq);
+
+    s->sink_now = pa_rtclock_now();
+    s->sink_latency = pa_sink_get_latency_within_thread(i->sink, false);
+    s->sink_delay = i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, delay) : delay;
+    s->send_counter = send_counter;
+}
+
+void pa_drift_snapshot_source(pa_drift_snapshot *s, pa_source_output *o, int64_t recv_counter, size_t rlen, size_t plen) {
+    size_t delay;
+
+    pa_assert(s);
+    pa_source_output_assert_ref(o);
+
+    delay = pa_memblockq_get_length(o->thread_info.delay_memblockq);
+
+    s->source_now = pa_rtclock_now();
+    s->source_latency = pa_source_get_latency_within_thread(o->source, false);
+    s->source_delay = o->thread_info.resampler ? pa_resampler_request(o->thread_info.resampler, delay) : delay;
+    s->recv_counter = recv_counter;
+    s->rlen = rlen;
+    s->plen = plen;
+}
+
+static int64_t calc_diff(pa_drift_comp *d, const pa_drift_snapshot *s, bool verbose) {
+    int64_t diff_time, buffer_latency;
+    pa_usec_t plen, rlen, source_delay, sink_delay, recv_counter, send_counter;
+
+    /* get latency difference between playback and record */
+    plen = pa_bytes_to_usec(s->plen, &d->sink_ss);
+    rlen = pa_bytes_to_usec(s->rlen, &d->source_ss);
+    if (plen > rlen)
+        buffer_latency = plen - rlen;
+    else
+        buffer_latency = 0;
+
+    source_delay = pa_bytes_to_usec(s->source_delay, &d->source_ss);
+    sink_delay = pa_bytes_to_usec(s->sink_delay, &d->sink_ss);
+    buffer_latency += source_delay + sink_delay;
+
+    /* add the latency difference due to samples not yet transferred */
+    send_counter = pa_bytes_to_usec(s->send_counter, &d->sink_ss);
+    recv_counter = pa_bytes_to_usec(s->recv_counter, &d->sink_ss);
+    if (recv_counter <= send_counter)
+        buffer_latency += (int64_t) (send_counter - recv_counter);
+    else
+        buffer_latency = PA_CLIP_SUB(buffer_latency, (int64_t) (recv_counter - send_counter));
+
+    /* capture and playback are perfectly aligned when diff_time is 0 */
+    diff_time = (s->sink_now + s->sink_latency - buffer_latency) -
+          (s->source_now - s->source_latency);
+
+    if (verbose)
+        pa_log_debug("Diff %lld (%lld - %lld + %lld) %lld %lld %lld %lld", (long long) diff_time,
+            (long long) s->sink_latency,
+            (long long) buffer_latency, (long long) s->source_latency,
+            (long long) source_delay, (long long) sink_delay,
+            (long long) (send_counter - recv_counter),
+            (long long) (s->sink_now - s->source_now));
+
+    return diff_time;
+}
+
+int64_t pa_drift_comp_calc_diff(pa_drift_comp *d, const pa_drift_snapshot *s) {
+    pa_assert(d);
+    pa_assert(s);
+
+    return calc_diff(d, s, true);
+}
+
+static void fit_reset(pa_drift_comp *d) {
+    d->s0 = d->st = d->sc = d->stt = d->stc = 0;
+    d->shift = 0;
+}
+
+static void fit_add(pa_drift_comp *d, pa_usec_t now, double c) {
+    double dt, w;
+
+    if (d->s0 <= 0) {
+        d->first = d->last = now;
+        d->s0 = 1;
+        d->sc = c;
+        return;
+    }
+
+    /* Move the origin to the new sample, then age the old ones */
+    dt = (double) (now - d->last) / PA_USEC_PER_SEC;
+    d->stt += dt * dt * d->s0 - 2 * dt * d->st;
+    d->st -= dt * d->s0;
+    d->stc -= dt * d->sc;
+
+    w = exp(-dt * PA_USEC_PER_SEC / FIT_TIME_CONSTANT);
+    d->s0 = d->s0 * w + 1;
+    d->st *= w;
+    d->sc = d->sc * w + c;
+    d->stt *= w;
+    d->stc *= w;
+
+    d->last = now;
+}
+
+/* Slope in usec per second and value at the last sample */
+static bool fit_get(pa_drift_comp *d, double *slope, double *value) {
+    double den;
+
+    if (d->last - d->first < FIT_SETTLE_TIME)
+        return false;
+
+    den = d->s0 * d->stt - d->st * d->st;
+    if (den <= 0)
+        return false;
+
+    *slope = (d->s0 * d->stc - d->st * d->sc) / den;
+    *value = (d->sc - *slope * d->st) / d->s0;
+
+    return true;
+}
+
+static double applied_correction(pa_drift_comp *d) {
+    return (double) pa_atomic_load(&d->applied_rate) / d->sink_ss.rate - 1;
+}
+
+bool pa_drift_comp_update(pa_drift_comp *d, const pa_drift_snapshot *s, int64_t *diff_time) {
+    pa_usec_t now = s->source_now;
+    double slope, value, offset, ratio;
+    int64_t diff;
+
+    pa_assert(d);
+    pa_assert(s);
+    pa_assert(diff_time);
+
+    diff = calc_diff(d, s, false);
+
+    if (d->s0 > 0 && (now < d->last || now > d->last + FIT_MAX_GAP))
+        fit_reset(d);
+
+    /* A faster playback stream eats into the alignment, at the rate that
+     * was in effect since the last sample */
+    if (d->s0 > 0)
+        d->shift += applied_correction(d) * (double) (now - d->last);
+
+    fit_add(d, now, (double) diff + d->shift);
+
+    offset = (double) diff;
+
+    if (fit_get(d, &slope, &value)) {
+        if (fabs(value - d->shift - offset) <= PA_MAX(d->threshold, (int64_t) MIN_JUMP)) {
+            d->drift = -slope / PA_USEC_PER_SEC;
+            d->have_drift = true;
+            offset = value - d->shift;
+        } else {
+            /* Something other than drift moved the streams, start over
+             * from here */
+            fit_reset(d);
+            fit_add(d, now, offset);
+        }
+    }
+
+    if (!d->correct)
+        return false;
+
+    if (offset < 0 || offset > d->threshold) {
+        /* Land in the middle of the window, the fit carries on */
+        *diff_time = (int64_t) offset - d->target;
+        d->shift += (double) *diff_time;
+
+        pa_log_debug("Alignment %lld usec out of window, shifting by %lld usec", (long long) offset, (long long) *diff_time);
+        calc_diff(d, s, true);
+
+        return true;
+    }
+
+    if (d->have_drift) {
+        int rate;
+
+        ratio = (offset - d->target) / CORRECTION_TIME - d->drift;
+        ratio = PA_CLAMP(ratio, -MAX_CORRECTION, MAX_CORRECTION);
+
+        rate = (int) d->sink_ss.rate + (int) lrint(d->sink_ss.rate * ratio);
+        pa_atomic_store(&d->wanted_rate, rate);
+    }
+
+    return false;
+}
+
+int64_t pa_drift_comp_resync(pa_drift_comp *d, const pa_drift_snapshot *s) {
+    int64_t diff;
+
+    pa_assert(d);
+    pa_assert(s);
+
+    diff = calc_diff(d, s, true);
+
+    /* Whatever forced the resync was not drift, start the fit over but
+     * keep the drift estimate */
+    fit_reset(d);
+
+    return d->correct ? diff - d->target : diff;
+}
+
+void pa_drift_comp_get_skip(pa_drift_comp *d, int64_t diff_time, size_t *sink_skip, size_t *source_skip) {
+    size_t diff;
+
+    pa_assert(d);
+    pa_assert(sink_skip);
+    pa_assert(source_skip);
+
+    if (diff_time < 0) {
+        diff = pa_usec_to_bytes(-diff_time, &d->sink_ss);
+
+        if (diff > 0) {
+            /* add some extra safety samples to compensate for jitter in the
+             * timings */
+            diff += 10 * pa_frame_size(&d->sink_ss);
+
+            pa_log("Playback after capture (%lld), drop sink %lld", (long long) diff_time, (long long) diff);
+
+            *sink_skip = diff;
+            *source_skip = 0;
+        }
+    } else if (diff_time > 0) {
+        diff = pa_usec_to_bytes(diff_time, &d->source_ss);
+
+        if (diff > 0) {
+            pa_log("Playback too far ahead (%lld), drop source %lld", (long long) diff_time, (long long) diff);
+
+            *source_skip = diff;
+            *sink_skip = 0;
+        }
+    }
+}
+
+float pa_drift_comp_get_drift(pa_drift_comp *d) {
+    pa_assert(d);
+
+    if (!d->have_drift)
+        return 0;
+
+    return (float) (d->drift + applied_correction(d));
+}
+
+uint32_t pa_drift_comp_get_rate(pa_drift_comp *d) {
+    int rate;
+
+    pa_assert(d);
+
+    rate = pa_atomic_load(&d->wanted_rate);
+    pa_atomic_store(&d->applied_rate, rate);
+
+    return (uint32_t) rate;
+}
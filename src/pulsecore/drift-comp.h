@@ -0,0 +1,99 @@
+#ifndef foopulsecoredriftcomphfoo
+#define foopulsecoredriftcomphfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source-output.h>
+
+/* Keeps a capture stream aligned with a playback stream whose samples are
+ * handed to it, such as the reference signal of an echo canceller.
+ *
+ * The playback I/O thread fills the sink half of a snapshot every
+ * PA_DRIFT_COMP_SNAPSHOT_INTERVAL and posts it to the capture I/O thread,
+ * which completes it and feeds it to pa_drift_comp_update(). A weighted
+ * linear fit over the last seconds gives the alignment and the clock drift
+ * between the two devices, from which a playback rate is derived that
+ * cancels the drift and slowly pulls the alignment back into the middle of
+ * the allowed window. The main thread applies that rate to the playback
+ * stream, so samples only need to be dropped when the alignment jumps. */
+
+#define PA_DRIFT_COMP_SNAPSHOT_INTERVAL (100 * PA_USEC_PER_MSEC)
+
+typedef struct pa_drift_snapshot {
+    pa_usec_t sink_now;
+    pa_usec_t sink_latency;
+    size_t sink_delay;
+    int64_t send_counter;
+
+    pa_usec_t source_now;
+    pa_usec_t source_latency;
+    size_t source_delay;
+    int64_t recv_counter;
+    size_t rlen;
+    size_t plen;
+} pa_drift_snapshot;
+
+typedef struct pa_drift_comp pa_drift_comp;
+
+/* sink_ss describes the played samples, source_ss the captured ones. When
+ * correct is false the drift is only estimated, otherwise the alignment is
+ * kept between 0 and threshold usec. */
+pa_drift_comp *pa_drift_comp_new(const pa_sample_spec *sink_ss, const pa_sample_spec *source_ss, bool correct, pa_usec_t threshold);
+void pa_drift_comp_free(pa_drift_comp *d);
+
+/* Called from the playback I/O thread. Returns one of two preallocated
+ * snapshots at most once per PA_DRIFT_COMP_SNAPSHOT_INTERVAL, or NULL if
+ * none is due or the capture thread still holds both. The capture thread
+ * hands it back with pa_drift_comp_snapshot_release() when done. */
+pa_drift_snapshot *pa_drift_comp_snapshot_get(pa_drift_comp *d, pa_usec_t now);
+void pa_drift_comp_snapshot_release(pa_drift_comp *d, pa_drift_snapshot *s);
+
+/* Fill in the sink and the source half of a snapshot, each from its own
+ * I/O thread */
+void pa_drift_snapshot_sink(pa_drift_snapshot *s, pa_sink_input *i, int64_t send_counter);
+void pa_drift_snapshot_source(pa_drift_snapshot *s, pa_source_output *o, int64_t recv_counter, size_t rlen, size_t plen);
+
+/* Alignment of capture and playback in usec. 0 means perfectly aligned,
+ * negative means capture is ahead of playback. */
+int64_t pa_drift_comp_calc_diff(pa_drift_comp *d, const pa_drift_snapshot *s);
+
+/* Called from the capture I/O thread. Returns true if the alignment left the
+ * window, in which case the caller has to shift it by *diff_time. */
+bool pa_drift_comp_update(pa_drift_comp *d, const pa_drift_snapshot *s, int64_t *diff_time);
+
+/* Called from the capture I/O thread when the caller needs to realign right
+ * away. Returns the shift to apply. */
+int64_t pa_drift_comp_resync(pa_drift_comp *d, const pa_drift_snapshot *s);
+
+/* Bytes to drop from the playback or the capture queue to shift the
+ * alignment by diff_time. Leaves the other one untouched. */
+void pa_drift_comp_get_skip(pa_drift_comp *d, int64_t diff_time, size_t *sink_skip, size_t *source_skip);
+
+/* Called from the capture I/O thread. The estimated number of playback
+ * samples in excess of capture samples, relative to the latter, as taken
+ * by pa_echo_canceller's set_drift(). 0 until the estimate settled. */
+float pa_drift_comp_get_drift(pa_drift_comp *d);
+
+/* Called from the main thread. Returns the rate the playback stream should
+ * run at, which the caller is expected to apply. */
+uint32_t pa_drift_comp_get_rate(pa_drift_comp *d);
+
+#endif
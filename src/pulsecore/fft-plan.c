@@ -0,0 +1,153 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <fftw3.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/llist.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+
+#include "fft-plan.h"
+
+#define ALLOC_FLOATS 8
+
+struct pa_fft_plan {
+    size_t n;
+    unsigned ref;
+    fftwf_plan forward, inverse;
+
+    PA_LLIST_FIELDS(pa_fft_plan);
+};
+
+/* Protects the list and the FFTW planner */
+static pa_static_mutex mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(pa_fft_plan, plans) = NULL;
+
+static pa_fft_plan *plan_new(size_t n) {
+    pa_fft_plan *p;
+    float *in, *out;
+
+    /* The plans are reused on other arrays with the new-array execute
+     * functions, so they are made on arrays aligned like those */
+    in = pa_fft_alloc(n);
+    out = pa_fft_alloc(n + 2);
+
+    p = pa_xnew0(pa_fft_plan, 1);
+    p->n = n;
+    p->ref = 1;
+    p->forward = fftwf_plan_dft_r2c_1d(n, in, (fftwf_complex *) out, FFTW_ESTIMATE);
+    p->inverse = fftwf_plan_dft_c2r_1d(n, (fftwf_complex *) out, in, FFTW_ESTIMATE);
+
+    pa_fft_free(in);
+    pa_fft_free(out);
+
+    if (!p->forward || !p->inverse) {
+        if (p->forward)
+            fftwf_destroy_plan(p->forward);
+        if (p->inverse)
+            fftwf_destroy_plan(p->inverse);
+        pa_xfree(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+pa_fft_plan *pa_fft_plan_get(size_t n) {
+    pa_mutex *m;
+    pa_fft_plan *p;
+
+    pa_assert(n > 0);
+
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+
+    PA_LLIST_FOREACH(p, plans)
+        if (p->n == n) {
+            p->ref++;
+            goto finish;
+        }
+
+    if ((p = plan_new(n)))
+        PA_LLIST_PREPEND(pa_fft_plan, plans, p);
+
+finish:
+    pa_mutex_unlock(m);
+
+    return p;
+}
+
+void pa_fft_plan_unref(pa_fft_plan *p) {
+    pa_mutex *m;
+
+    pa_assert(p);
+    pa_assert(p->ref >= 1);
+
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (--p->ref == 0) {
+        PA_LLIST_REMOVE(pa_fft_plan, plans, p);
+        fftwf_destroy_plan(p->forward);
+        fftwf_destroy_plan(p->inverse);
+        pa_xfree(p);
+    }
+
+    pa_mutex_unlock(m);
+}
+
+size_t pa_fft_plan_get_size(pa_fft_plan *p) {
+    pa_assert(p);
+
+    return p->n;
+}
+
+void pa_fft_plan_forward(pa_fft_plan *p, const float *in, float *out) {
+    pa_assert(p);
+
+    /* r2c leaves its input alone */
+    fftwf_execute_dft_r2c(p->forward, (float *) in, (fftwf_complex *) out);
+}
+
+void pa_fft_plan_inverse(pa_fft_plan *p, float *in, float *out) {
+    pa_assert(p);
+
+    fftwf_execute_dft_c2r(p->inverse, (fftwf_complex *) in, out);
+}
+
+float *pa_fft_alloc(size_t n) {
+    float *f;
+
+    n = PA_ROUND_UP(PA_MAX(n, (size_t) 1), ALLOC_FLOATS);
+
+    pa_assert_se(f = fftwf_malloc(n * sizeof(float)));
+    memset(f, 0, n * sizeof(float));
+
+    return f;
+}
+
+void pa_fft_free(float *f) {
+    fftwf_free(f);
+}
@@ -0,0 +1,47 @@
+#ifndef foofftplanhfoo
+#define foofftplanhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+/* Real forward and inverse FFTs of one size (only available when built
+ * with FFTW). Plans are cached and shared between all users in the
+ * process; creating them is serialized because the FFTW planner is not
+ * thread-safe, executing them is. Spectra hold n/2+1 interleaved complex
+ * values. All arrays must come from pa_fft_alloc(). */
+typedef struct pa_fft_plan pa_fft_plan;
+
+/* Returns a reference to the plan for size n, or NULL if FFTW cannot
+ * plan it */
+pa_fft_plan *pa_fft_plan_get(size_t n);
+void pa_fft_plan_unref(pa_fft_plan *p);
+
+size_t pa_fft_plan_get_size(pa_fft_plan *p);
+
+/* Unnormalized: inverse(forward(x)) == n * x. in and out must not overlap.
+ * The inverse transform overwrites its input. */
+void pa_fft_plan_forward(pa_fft_plan *p, const float *in, float *out);
+void pa_fft_plan_inverse(pa_fft_plan *p, float *in, float *out);
+
+/* Zeroed, suitably aligned memory for n floats, rounded up to a multiple
+ * of 8 so that vector loops need no scalar tail */
+float *pa_fft_alloc(size_t n);
+void pa_fft_free(float *f);
+
+#endif
@@ -0,0 +1,384 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "cpu-arm.h"
+
+#include <arm_neon.h>
+
+/* The structured loads and stores of NEON (vld2/vld3/vld4 and friends) do
+ * the (de)interleaving for 2, 3 and 4 channels in a single instruction, so
+ * the kernels below are just loops around them. */
+
+#define DEFINE_INTERLEAVE_NEON(bits, type, vtype, q, lanes)             \
+static void interleave_##bits##_2_neon(const void *src[], void *dst, unsigned n) { \
+    const type *s0 = src[0], *s1 = src[1];                              \
+    type *d = dst;                                                      \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x2_t v;                                                  \
+        v.val[0] = vld1q_##q(s0);                                       \
+        v.val[1] = vld1q_##q(s1);                                       \
+        vst2q_##q(d, v);                                                \
+        s0 += lanes;                                                    \
+        s1 += lanes;                                                    \
+        d += 2 * lanes;                                                 \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        d[0] = *(s0++);                                                 \
+        d[1] = *(s1++);                                                 \
+        d += 2;                                                         \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void interleave_##bits##_3_neon(const void *src[], void *dst, unsigned n) { \
+    const type *s0 = src[0], *s1 = src[1], *s2 = src[2];                \
+    type *d = dst;                                                      \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x3_t v;                                                  \
+        v.val[0] = vld1q_##q(s0);                                       \
+        v.val[1] = vld1q_##q(s1);                                       \
+        v.val[2] = vld1q_##q(s2);                                       \
+        vst3q_##q(d, v);                                                \
+        s0 += lanes;                                                    \
+        s1 += lanes;                                                    \
+        s2 += lanes;                                                    \
+        d += 3 * lanes;                                                 \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        d[0] = *(s0++);                                                 \
+        d[1] = *(s1++);                                                 \
+        d[2] = *(s2++);                                                 \
+        d += 3;                                                         \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void interleave_##bits##_4_neon(const void *src[], void *dst, unsigned n) { \
+    const type *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];  \
+    type *d = dst;                                                      \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x4_t v;                                                  \
+        v.val[0] = vld1q_##q(s0);                                       \
+        v.val[1] = vld1q_##q(s1);                                       \
+        v.val[2] = vld1q_##q(s2);                                       \
+        v.val[3] = vld1q_##q(s3);                                       \
+        vst4q_##q(d, v);                                                \
+        s0 += lanes;                                                    \
+        s1 += lanes;                                                    \
+        s2 += lanes;                                                    \
+        s3 += lanes;                                                    \
+        d += 4 * lanes;                                                 \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        d[0] = *(s0++);                                                 \
+        d[1] = *(s1++);                                                 \
+        d[2] = *(s2++);                                                 \
+        d[3] = *(s3++);                                                 \
+        d += 4;                                                         \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void deinterleave_##bits##_2_neon(const void *src, void *dst[], unsigned n) { \
+    const type *s = src;                                                \
+    type *d0 = dst[0], *d1 = dst[1];                                    \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x2_t v = vld2q_##q(s);                                   \
+        vst1q_##q(d0, v.val[0]);                                        \
+        vst1q_##q(d1, v.val[1]);                                        \
+        s += 2 * lanes;                                                 \
+        d0 += lanes;                                                    \
+        d1 += lanes;                                                    \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        *(d0++) = s[0];                                                 \
+        *(d1++) = s[1];                                                 \
+        s += 2;                                                         \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void deinterleave_##bits##_3_neon(const void *src, void *dst[], unsigned n) { \
+    const type *s = src;                                                \
+    type *d0 = dst[0], *d1 = dst[1], *d2 = dst[2];                      \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x3_t v = vld3q_##q(s);                                   \
+        vst1q_##q(d0, v.val[0]);                                        \
+        vst1q_##q(d1, v.val[1]);                                        \
+        vst1q_##q(d2, v.val[2]);                                        \
+        s += 3 * lanes;                                                 \
+        d0 += lanes;                                                    \
+        d1 += lanes;                                                    \
+        d2 += lanes;                                                    \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        *(d0++) = s[0];                                                 \
+        *(d1++) = s[1];                                                 \
+        *(d2++) = s[2];                                                 \
+        s += 3;                                                         \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void deinterleave_##bits##_4_neon(const void *src, void *dst[], unsigned n) { \
+    const type *s = src;                                                \
+    type *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];        \
+                                                                        \
+    for (; n >= lanes; n -= lanes) {                                    \
+        vtype##x4_t v = vld4q_##q(s);                                   \
+        vst1q_##q(d0, v.val[0]);                                        \
+        vst1q_##q(d1, v.val[1]);                                        \
+        vst1q_##q(d2, v.val[2]);                                        \
+        vst1q_##q(d3, v.val[3]);                                        \
+        s += 4 * lanes;                                                 \
+        d0 += lanes;                                                    \
+        d1 += lanes;                                                    \
+        d2 += lanes;                                                    \
+        d3 += lanes;                                                    \
+    }                                                                   \
+                                                                        \
+    for (; n > 0; n--) {                                                \
+        *(d0++) = s[0];                                                 \
+        *(d1++) = s[1];                                                 \
+        *(d2++) = s[2];                                                 \
+        *(d3++) = s[3];                                                 \
+        s += 4;                                                         \
+    }                                                                   \
+}
+
+DEFINE_INTERLEAVE_NEON(16, int16_t, int16x8, s16, 8)
+DEFINE_INTERLEAVE_NEON(32, float, float32x4, f32, 4)
+
+/* Conversions follow sconv_neon.c: s16 -> float is a fixed-point convert
+ * with 15 fractional bits, float -> s16 converts to 1:31 fixed-point and
+ * narrows with rounding and saturation. */
+
+static inline float32x4_t s16_to_float(int16x4_t v) {
+    return vcvtq_n_f32_s32(vmovl_s16(v), 15);
+}
+
+static inline int16x4_t float_to_s16(float32x4_t v) {
+    return vqrshrn_n_s32(vcvtq_n_s32_f32(v, 31), 16);
+}
+
+static inline int16_t float_to_s16_scalar(float f) {
+    return (int16_t) PA_CLAMP_UNLIKELY(lrintf(f * (1 << 15)), -0x8000, 0x7FFF);
+}
+
+static void interleave_to_s16ne_1_neon(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0];
+
+    for (; n >= 4; n -= 4) {
+        vst1_s16(d, float_to_s16(vld1q_f32(s0)));
+        s0 += 4;
+        d += 4;
+    }
+
+    for (; n > 0; n--)
+        *(d++) = float_to_s16_scalar(*(s0++));
+}
+
+static void interleave_to_s16ne_2_neon(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x2_t v;
+        v.val[0] = float_to_s16(vld1q_f32(s0));
+        v.val[1] = float_to_s16(vld1q_f32(s1));
+        vst2_s16(d, v);
+        s0 += 4;
+        s1 += 4;
+        d += 8;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = float_to_s16_scalar(*(s0++));
+        d[1] = float_to_s16_scalar(*(s1++));
+        d += 2;
+    }
+}
+
+static void interleave_to_s16ne_3_neon(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1], *s2 = src[2];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x3_t v;
+        v.val[0] = float_to_s16(vld1q_f32(s0));
+        v.val[1] = float_to_s16(vld1q_f32(s1));
+        v.val[2] = float_to_s16(vld1q_f32(s2));
+        vst3_s16(d, v);
+        s0 += 4;
+        s1 += 4;
+        s2 += 4;
+        d += 12;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = float_to_s16_scalar(*(s0++));
+        d[1] = float_to_s16_scalar(*(s1++));
+        d[2] = float_to_s16_scalar(*(s2++));
+        d += 3;
+    }
+}
+
+static void interleave_to_s16ne_4_neon(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x4_t v;
+        v.val[0] = float_to_s16(vld1q_f32(s0));
+        v.val[1] = float_to_s16(vld1q_f32(s1));
+        v.val[2] = float_to_s16(vld1q_f32(s2));
+        v.val[3] = float_to_s16(vld1q_f32(s3));
+        vst4_s16(d, v);
+        s0 += 4;
+        s1 += 4;
+        s2 += 4;
+        s3 += 4;
+        d += 16;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = float_to_s16_scalar(*(s0++));
+        d[1] = float_to_s16_scalar(*(s1++));
+        d[2] = float_to_s16_scalar(*(s2++));
+        d[3] = float_to_s16_scalar(*(s3++));
+        d += 4;
+    }
+}
+
+static void deinterleave_to_float32ne_1_neon(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0];
+
+    for (; n >= 4; n -= 4) {
+        vst1q_f32(d0, s16_to_float(vld1_s16(s)));
+        s += 4;
+        d0 += 4;
+    }
+
+    for (; n > 0; n--)
+        *(d0++) = *(s++) * (1.0f / (1 << 15));
+}
+
+static void deinterleave_to_float32ne_2_neon(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0], *d1 = dst[1];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x2_t v = vld2_s16(s);
+        vst1q_f32(d0, s16_to_float(v.val[0]));
+        vst1q_f32(d1, s16_to_float(v.val[1]));
+        s += 8;
+        d0 += 4;
+        d1 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0] * (1.0f / (1 << 15));
+        *(d1++) = s[1] * (1.0f / (1 << 15));
+        s += 2;
+    }
+}
+
+static void deinterleave_to_float32ne_3_neon(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x3_t v = vld3_s16(s);
+        vst1q_f32(d0, s16_to_float(v.val[0]));
+        vst1q_f32(d1, s16_to_float(v.val[1]));
+        vst1q_f32(d2, s16_to_float(v.val[2]));
+        s += 12;
+        d0 += 4;
+        d1 += 4;
+        d2 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0] * (1.0f / (1 << 15));
+        *(d1++) = s[1] * (1.0f / (1 << 15));
+        *(d2++) = s[2] * (1.0f / (1 << 15));
+        s += 3;
+    }
+}
+
+static void deinterleave_to_float32ne_4_neon(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+
+    for (; n >= 4; n -= 4) {
+        int16x4x4_t v = vld4_s16(s);
+        vst1q_f32(d0, s16_to_float(v.val[0]));
+        vst1q_f32(d1, s16_to_float(v.val[1]));
+        vst1q_f32(d2, s16_to_float(v.val[2]));
+        vst1q_f32(d3, s16_to_float(v.val[3]));
+        s += 16;
+        d0 += 4;
+        d1 += 4;
+        d2 += 4;
+        d3 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0] * (1.0f / (1 << 15));
+        *(d1++) = s[1] * (1.0f / (1 << 15));
+        *(d2++) = s[2] * (1.0f / (1 << 15));
+        *(d3++) = s[3] * (1.0f / (1 << 15));
+        s += 4;
+    }
+}
+
+void pa_interleave_func_init_neon(pa_cpu_arm_flag_t flags) {
+    pa_log_info("Initialising ARM NEON optimized interleaving.");
+
+    pa_set_interleave_func(2, 2, interleave_16_2_neon);
+    pa_set_interleave_func(2, 3, interleave_16_3_neon);
+    pa_set_interleave_func(2, 4, interleave_16_4_neon);
+    pa_set_interleave_func(4, 2, interleave_32_2_neon);
+    pa_set_interleave_func(4, 3, interleave_32_3_neon);
+    pa_set_interleave_func(4, 4, interleave_32_4_neon);
+
+    pa_set_deinterleave_func(2, 2, deinterleave_16_2_neon);
+    pa_set_deinterleave_func(2, 3, deinterleave_16_3_neon);
+    pa_set_deinterleave_func(2, 4, deinterleave_16_4_neon);
+    pa_set_deinterleave_func(4, 2, deinterleave_32_2_neon);
+    pa_set_deinterleave_func(4, 3, deinterleave_32_3_neon);
+    pa_set_deinterleave_func(4, 4, deinterleave_32_4_neon);
+
+    pa_set_interleave_to_s16ne_func(1, interleave_to_s16ne_1_neon);
+    pa_set_interleave_to_s16ne_func(2, interleave_to_s16ne_2_neon);
+    pa_set_interleave_to_s16ne_func(3, interleave_to_s16ne_3_neon);
+    pa_set_interleave_to_s16ne_func(4, interleave_to_s16ne_4_neon);
+
+    pa_set_deinterleave_to_float32ne_func(1, deinterleave_to_float32ne_1_neon);
+    pa_set_deinterleave_to_float32ne_func(2, deinterleave_to_float32ne_2_neon);
+    pa_set_deinterleave_to_float32ne_func(3, deinterleave_to_float32ne_3_neon);
+    pa_set_deinterleave_to_float32ne_func(4, deinterleave_to_float32ne_4_neon);
+}
@@ -0,0 +1,570 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "cpu-x86.h"
+
+#if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
+
+#include <xmmintrin.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* All loads and stores are unaligned, the planes handed to us by the
+ * callers carry no alignment guarantees. Leftover frames that do not fill a
+ * full vector are handled by the scalar tail loops. */
+
+static void interleave_32_2_sse(const void *src[], void *dst, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1];
+    float *d = dst;
+
+    for (; n >= 4; n -= 4) {
+        __m128 a = _mm_loadu_ps(s0);
+        __m128 b = _mm_loadu_ps(s1);
+
+        _mm_storeu_ps(d, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(d + 4, _mm_unpackhi_ps(a, b));
+
+        s0 += 4;
+        s1 += 4;
+        d += 8;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = *(s0++);
+        d[1] = *(s1++);
+        d += 2;
+    }
+}
+
+static void deinterleave_32_2_sse(const void *src, void *dst[], unsigned n) {
+    const float *s = src;
+    float *d0 = dst[0], *d1 = dst[1];
+
+    for (; n >= 4; n -= 4) {
+        __m128 a = _mm_loadu_ps(s);
+        __m128 b = _mm_loadu_ps(s + 4);
+
+        _mm_storeu_ps(d0, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(d1, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        s += 8;
+        d0 += 4;
+        d1 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0];
+        *(d1++) = s[1];
+        s += 2;
+    }
+}
+
+/* A 4x4 transpose turns four planes of four samples into four frames and
+ * back, so the same kernel serves both directions. */
+static void interleave_32_4_sse(const void *src[], void *dst, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+    float *d = dst;
+
+    for (; n >= 4; n -= 4) {
+        __m128 a = _mm_loadu_ps(s0);
+        __m128 b = _mm_loadu_ps(s1);
+        __m128 c = _mm_loadu_ps(s2);
+        __m128 e = _mm_loadu_ps(s3);
+
+        _MM_TRANSPOSE4_PS(a, b, c, e);
+
+        _mm_storeu_ps(d, a);
+        _mm_storeu_ps(d + 4, b);
+        _mm_storeu_ps(d + 8, c);
+        _mm_storeu_ps(d + 12, e);
+
+        s0 += 4;
+        s1 += 4;
+        s2 += 4;
+        s3 += 4;
+        d += 16;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = *(s0++);
+        d[1] = *(s1++);
+        d[2] = *(s2++);
+        d[3] = *(s3++);
+        d += 4;
+    }
+}
+
+static void deinterleave_32_4_sse(const void *src, void *dst[], unsigned n) {
+    const float *s = src;
+    float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+
+    for (; n >= 4; n -= 4) {
+        __m128 a = _mm_loadu_ps(s);
+        __m128 b = _mm_loadu_ps(s + 4);
+        __m128 c = _mm_loadu_ps(s + 8);
+        __m128 e = _mm_loadu_ps(s + 12);
+
+        _MM_TRANSPOSE4_PS(a, b, c, e);
+
+        _mm_storeu_ps(d0, a);
+        _mm_storeu_ps(d1, b);
+        _mm_storeu_ps(d2, c);
+        _mm_storeu_ps(d3, e);
+
+        s += 16;
+        d0 += 4;
+        d1 += 4;
+        d2 += 4;
+        d3 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0];
+        *(d1++) = s[1];
+        *(d2++) = s[2];
+        *(d3++) = s[3];
+        s += 4;
+    }
+}
+
+/* Eight channels are two independent 4x4 transposes, one for each half of
+ * the frame. */
+static void interleave_32_8_sse(const void *src[], void *dst, unsigned n) {
+    const float *s[8];
+    float *d = dst;
+    unsigned i, c;
+
+    for (c = 0; c < 8; c++)
+        s[c] = src[c];
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        for (c = 0; c < 8; c += 4) {
+            __m128 a = _mm_loadu_ps(s[c] + i);
+            __m128 b = _mm_loadu_ps(s[c + 1] + i);
+            __m128 e = _mm_loadu_ps(s[c + 2] + i);
+            __m128 f = _mm_loadu_ps(s[c + 3] + i);
+
+            _MM_TRANSPOSE4_PS(a, b, e, f);
+
+            _mm_storeu_ps(d + c, a);
+            _mm_storeu_ps(d + c + 8, b);
+            _mm_storeu_ps(d + c + 16, e);
+            _mm_storeu_ps(d + c + 24, f);
+        }
+
+        d += 32;
+    }
+
+    for (; i < n; i++)
+        for (c = 0; c < 8; c++)
+            *(d++) = s[c][i];
+}
+
+static void deinterleave_32_8_sse(const void *src, void *dst[], unsigned n) {
+    const float *s = src;
+    float *d[8];
+    unsigned i, c;
+
+    for (c = 0; c < 8; c++)
+        d[c] = dst[c];
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        for (c = 0; c < 8; c += 4) {
+            __m128 a = _mm_loadu_ps(s + c);
+            __m128 b = _mm_loadu_ps(s + c + 8);
+            __m128 e = _mm_loadu_ps(s + c + 16);
+            __m128 f = _mm_loadu_ps(s + c + 24);
+
+            _MM_TRANSPOSE4_PS(a, b, e, f);
+
+            _mm_storeu_ps(d[c] + i, a);
+            _mm_storeu_ps(d[c + 1] + i, b);
+            _mm_storeu_ps(d[c + 2] + i, e);
+            _mm_storeu_ps(d[c + 3] + i, f);
+        }
+
+        s += 32;
+    }
+
+    for (; i < n; i++)
+        for (c = 0; c < 8; c++)
+            d[c][i] = *(s++);
+}
+
+#ifdef __SSE2__
+
+static void interleave_16_2_sse2(const void *src[], void *dst, unsigned n) {
+    const int16_t *s0 = src[0], *s1 = src[1];
+    int16_t *d = dst;
+
+    for (; n >= 8; n -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) s0);
+        __m128i b = _mm_loadu_si128((const __m128i *) s1);
+
+        _mm_storeu_si128((__m128i *) d, _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i *) (d + 8), _mm_unpackhi_epi16(a, b));
+
+        s0 += 8;
+        s1 += 8;
+        d += 16;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = *(s0++);
+        d[1] = *(s1++);
+        d += 2;
+    }
+}
+
+/* Sign extend the even and odd 16 bit lanes into 32 bit lanes, packing them
+ * back together afterwards cannot saturate. */
+static inline __m128i even_epi16(__m128i v) {
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+static inline __m128i odd_epi16(__m128i v) {
+    return _mm_srai_epi32(v, 16);
+}
+
+static void deinterleave_16_2_sse2(const void *src, void *dst[], unsigned n) {
+    const int16_t *s = src;
+    int16_t *d0 = dst[0], *d1 = dst[1];
+
+    for (; n >= 8; n -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) s);
+        __m128i b = _mm_loadu_si128((const __m128i *) (s + 8));
+
+        _mm_storeu_si128((__m128i *) d0, _mm_packs_epi32(even_epi16(a), even_epi16(b)));
+        _mm_storeu_si128((__m128i *) d1, _mm_packs_epi32(odd_epi16(a), odd_epi16(b)));
+
+        s += 16;
+        d0 += 8;
+        d1 += 8;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0];
+        *(d1++) = s[1];
+        s += 2;
+    }
+}
+
+static void interleave_16_4_sse2(const void *src[], void *dst, unsigned n) {
+    const int16_t *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+    int16_t *d = dst;
+
+    for (; n >= 8; n -= 8) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *) s0);
+        __m128i c1 = _mm_loadu_si128((const __m128i *) s1);
+        __m128i c2 = _mm_loadu_si128((const __m128i *) s2);
+        __m128i c3 = _mm_loadu_si128((const __m128i *) s3);
+
+        /* c0/c1 and c2/c3 pairs for frames 0-3 and 4-7 */
+        __m128i b0 = _mm_unpacklo_epi16(c0, c1);
+        __m128i b1 = _mm_unpackhi_epi16(c0, c1);
+        __m128i b2 = _mm_unpacklo_epi16(c2, c3);
+        __m128i b3 = _mm_unpackhi_epi16(c2, c3);
+
+        _mm_storeu_si128((__m128i *) d, _mm_unpacklo_epi32(b0, b2));
+        _mm_storeu_si128((__m128i *) (d + 8), _mm_unpackhi_epi32(b0, b2));
+        _mm_storeu_si128((__m128i *) (d + 16), _mm_unpacklo_epi32(b1, b3));
+        _mm_storeu_si128((__m128i *) (d + 24), _mm_unpackhi_epi32(b1, b3));
+
+        s0 += 8;
+        s1 += 8;
+        s2 += 8;
+        s3 += 8;
+        d += 32;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = *(s0++);
+        d[1] = *(s1++);
+        d[2] = *(s2++);
+        d[3] = *(s3++);
+        d += 4;
+    }
+}
+
+/* Transposes eight 4 channel frames held in four registers into one
+ * register per channel. */
+static inline void deinterleave_16_4_regs(const int16_t *s, __m128i *c0, __m128i *c1, __m128i *c2, __m128i *c3) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *) s);
+    __m128i v1 = _mm_loadu_si128((const __m128i *) (s + 8));
+    __m128i v2 = _mm_loadu_si128((const __m128i *) (s + 16));
+    __m128i v3 = _mm_loadu_si128((const __m128i *) (s + 24));
+
+    __m128i a0 = _mm_unpacklo_epi16(v0, v1);
+    __m128i a1 = _mm_unpackhi_epi16(v0, v1);
+    __m128i a2 = _mm_unpacklo_epi16(v2, v3);
+    __m128i a3 = _mm_unpackhi_epi16(v2, v3);
+
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+
+    *c0 = _mm_unpacklo_epi64(b0, b2);
+    *c1 = _mm_unpackhi_epi64(b0, b2);
+    *c2 = _mm_unpacklo_epi64(b1, b3);
+    *c3 = _mm_unpackhi_epi64(b1, b3);
+}
+
+static void deinterleave_16_4_sse2(const void *src, void *dst[], unsigned n) {
+    const int16_t *s = src;
+    int16_t *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+
+    for (; n >= 8; n -= 8) {
+        __m128i c0, c1, c2, c3;
+
+        deinterleave_16_4_regs(s, &c0, &c1, &c2, &c3);
+
+        _mm_storeu_si128((__m128i *) d0, c0);
+        _mm_storeu_si128((__m128i *) d1, c1);
+        _mm_storeu_si128((__m128i *) d2, c2);
+        _mm_storeu_si128((__m128i *) d3, c3);
+
+        s += 32;
+        d0 += 8;
+        d1 += 8;
+        d2 += 8;
+        d3 += 8;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0];
+        *(d1++) = s[1];
+        *(d2++) = s[2];
+        *(d3++) = s[3];
+        s += 4;
+    }
+}
+
+/* Conversions use the same scaling and rounding as the generic sconv code:
+ * s16 -> float divides by 0x8000, float -> s16 multiplies by 0x8000, clamps
+ * and rounds according to the current rounding mode like lrintf() does. */
+
+static inline __m128i float_to_s32(__m128 v) {
+    v = _mm_mul_ps(v, _mm_set1_ps((float) 0x8000));
+    v = _mm_max_ps(v, _mm_set1_ps((float) -0x8000));
+    v = _mm_min_ps(v, _mm_set1_ps((float) 0x7FFF));
+
+    return _mm_cvtps_epi32(v);
+}
+
+static inline __m128 s32_to_float(__m128i v) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / (1 << 15)));
+}
+
+static inline void store_s16_as_float(float *d, __m128i v) {
+    _mm_storeu_ps(d, s32_to_float(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+    _mm_storeu_ps(d + 4, s32_to_float(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+}
+
+static inline int16_t float_to_s16_scalar(float f) {
+    f *= 1 << 15;
+    return (int16_t) PA_CLAMP_UNLIKELY(lrintf(f), -0x8000, 0x7FFF);
+}
+
+static void interleave_to_s16ne_1_sse2(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0];
+
+    for (; n >= 8; n -= 8) {
+        __m128i a = float_to_s32(_mm_loadu_ps(s0));
+        __m128i b = float_to_s32(_mm_loadu_ps(s0 + 4));
+
+        _mm_storeu_si128((__m128i *) d, _mm_packs_epi32(a, b));
+
+        s0 += 8;
+        d += 8;
+    }
+
+    for (; n > 0; n--)
+        *(d++) = float_to_s16_scalar(*(s0++));
+}
+
+static void interleave_to_s16ne_2_sse2(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1];
+
+    for (; n >= 4; n -= 4) {
+        __m128i a = float_to_s32(_mm_loadu_ps(s0));
+        __m128i b = float_to_s32(_mm_loadu_ps(s1));
+
+        _mm_storeu_si128((__m128i *) d, _mm_packs_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b)));
+
+        s0 += 4;
+        s1 += 4;
+        d += 8;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = float_to_s16_scalar(*(s0++));
+        d[1] = float_to_s16_scalar(*(s1++));
+        d += 2;
+    }
+}
+
+static void interleave_to_s16ne_4_sse2(const float *src[], int16_t *d, unsigned n) {
+    const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+
+    for (; n >= 4; n -= 4) {
+        __m128i c0 = float_to_s32(_mm_loadu_ps(s0));
+        __m128i c1 = float_to_s32(_mm_loadu_ps(s1));
+        __m128i c2 = float_to_s32(_mm_loadu_ps(s2));
+        __m128i c3 = float_to_s32(_mm_loadu_ps(s3));
+
+        /* 4x4 transpose of 32 bit lanes, one register per frame */
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+        __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+        __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+        __m128i f0 = _mm_unpacklo_epi64(t0, t1);
+        __m128i f1 = _mm_unpackhi_epi64(t0, t1);
+        __m128i f2 = _mm_unpacklo_epi64(t2, t3);
+        __m128i f3 = _mm_unpackhi_epi64(t2, t3);
+
+        _mm_storeu_si128((__m128i *) d, _mm_packs_epi32(f0, f1));
+        _mm_storeu_si128((__m128i *) (d + 8), _mm_packs_epi32(f2, f3));
+
+        s0 += 4;
+        s1 += 4;
+        s2 += 4;
+        s3 += 4;
+        d += 16;
+    }
+
+    for (; n > 0; n--) {
+        d[0] = float_to_s16_scalar(*(s0++));
+        d[1] = float_to_s16_scalar(*(s1++));
+        d[2] = float_to_s16_scalar(*(s2++));
+        d[3] = float_to_s16_scalar(*(s3++));
+        d += 4;
+    }
+}
+
+static void deinterleave_to_float32ne_1_sse2(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0];
+
+    for (; n >= 8; n -= 8) {
+        store_s16_as_float(d0, _mm_loadu_si128((const __m128i *) s));
+
+        s += 8;
+        d0 += 8;
+    }
+
+    for (; n > 0; n--)
+        *(d0++) = *(s++) * (1.0f / (1 << 15));
+}
+
+static void deinterleave_to_float32ne_2_sse2(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0], *d1 = dst[1];
+
+    for (; n >= 4; n -= 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) s);
+
+        _mm_storeu_ps(d0, s32_to_float(even_epi16(v)));
+        _mm_storeu_ps(d1, s32_to_float(odd_epi16(v)));
+
+        s += 8;
+        d0 += 4;
+        d1 += 4;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0] * (1.0f / (1 << 15));
+        *(d1++) = s[1] * (1.0f / (1 << 15));
+        s += 2;
+    }
+}
+
+static void deinterleave_to_float32ne_4_sse2(const int16_t *s, float *dst[], unsigned n) {
+    float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+
+    for (; n >= 8; n -= 8) {
+        __m128i c0, c1, c2, c3;
+
+        deinterleave_16_4_regs(s, &c0, &c1, &c2, &c3);
+
+        store_s16_as_float(d0, c0);
+        store_s16_as_float(d1, c1);
+        store_s16_as_float(d2, c2);
+        store_s16_as_float(d3, c3);
+
+        s += 32;
+        d0 += 8;
+        d1 += 8;
+        d2 += 8;
+        d3 += 8;
+    }
+
+    for (; n > 0; n--) {
+        *(d0++) = s[0] * (1.0f / (1 << 15));
+        *(d1++) = s[1] * (1.0f / (1 << 15));
+        *(d2++) = s[2] * (1.0f / (1 << 15));
+        *(d3++) = s[3] * (1.0f / (1 << 15));
+        s += 4;
+    }
+}
+
+#endif /* __SSE2__ */
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_interleave_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
+
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized interleaving.");
+        pa_set_interleave_func(4, 2, interleave_32_2_sse);
+        pa_set_interleave_func(4, 4, interleave_32_4_sse);
+        pa_set_interleave_func(4, 8, interleave_32_8_sse);
+        pa_set_deinterleave_func(4, 2, deinterleave_32_2_sse);
+        pa_set_deinterleave_func(4, 4, deinterleave_32_4_sse);
+        pa_set_deinterleave_func(4, 8, deinterleave_32_8_sse);
+    }
+
+#ifdef __SSE2__
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized interleaving.");
+        pa_set_interleave_func(2, 2, interleave_16_2_sse2);
+        pa_set_interleave_func(2, 4, interleave_16_4_sse2);
+        pa_set_deinterleave_func(2, 2, deinterleave_16_2_sse2);
+        pa_set_deinterleave_func(2, 4, deinterleave_16_4_sse2);
+
+        pa_set_interleave_to_s16ne_func(1, interleave_to_s16ne_1_sse2);
+        pa_set_interleave_to_s16ne_func(2, interleave_to_s16ne_2_sse2);
+        pa_set_interleave_to_s16ne_func(4, interleave_to_s16ne_4_sse2);
+        pa_set_deinterleave_to_float32ne_func(1, deinterleave_to_float32ne_1_sse2);
+        pa_set_deinterleave_to_float32ne_func(2, deinterleave_to_float32ne_2_sse2);
+        pa_set_deinterleave_to_float32ne_func(4, deinterleave_to_float32ne_4_sse2);
+    }
+#endif
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
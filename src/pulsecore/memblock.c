@@ -57,6 +57,32 @@
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
+/* The pool memory is split into one slab per size class. The class
+ * with PA_MEMPOOL_SLOT_SIZE slots is the "standard" one. It gets all of
+ * the requested pool size, i.e. PA_MEMPOOL_SLOTS_MAX slots by default,
+ * just like the pool had before it was split, and its size is what
+ * pa_mempool_block_size_max() reports, so that render and transfer
+ * sizes computed by the rest of the code don't change. The other
+ * classes come on top of that, each with the given share (in 1/16ths)
+ * of the requested size: 1024 slots of 4 KiB, 256 of 16 KiB and 32 of
+ * 256 KiB by default, 16 MiB in total. The larger class only catches
+ * requests that used to fall back to PA_MEMBLOCK_APPENDED and hence
+ * couldn't be shared via SHM. */
+static const struct {
+    size_t slot_size;
+    unsigned share;
+} mempool_class_layout[PA_MEMPOOL_N_CLASSES] = {
+    {   4*1024, 1 },
+    {  16*1024, 1 },
+    {  PA_MEMPOOL_SLOT_SIZE, 16 },
+    { 256*1024, 2 },
+};
+
+/* Sum of the shares above */
+#define PA_MEMPOOL_SHARES 20
+
+#define PA_MEMPOOL_STANDARD_CLASS 2
+
 #define PA_MEMEXPORT_SLOTS_MAX 128
 
 #define PA_MEMIMPORT_SLOTS_MAX 160
@@ -163,6 +189,20 @@ struct pa_memexport {
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+/* One slab of equally sized slots inside the pool memory */
+struct mempool_class {
+    size_t block_size;
+    unsigned n_blocks;
+
+    /* Offset of the first slot of this class in the pool memory */
+    size_t offset;
+
+    pa_atomic_t n_init;
+
+    /* A list of free slots that may be reused */
+    pa_flist *free_slots;
+};
+
 struct pa_mempool {
     /* Reference count the mempool
      *
@@ -188,18 +228,13 @@ struct pa_mempool {
 
     bool global;
 
-    size_t block_size;
+    struct mempool_class classes[PA_MEMPOOL_N_CLASSES];
     unsigned n_blocks;
     bool is_remote_writable;
 
-    pa_atomic_t n_init;
-
     PA_LLIST_HEAD(pa_memimport, imports);
     PA_LLIST_HEAD(pa_memexport, exports);
 
-    /* A list of free slots that may be reused */
-    pa_flist *free_slots;
-
     pa_mempool_stat stat;
 };
 
@@ -292,31 +327,50 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
+static void mempool_class_stat_inc(pa_mempool *p, unsigned k) {
+    int n, high_water;
+
+    n = pa_atomic_inc(&p->stat.n_class_allocated[k]) + 1;
+
+    for (;;) {
+        high_water = pa_atomic_load(&p->stat.n_class_high_water[k]);
+
+        if (n <= high_water || pa_atomic_cmpxchg(&p->stat.n_class_high_water[k], high_water, n))
+            break;
+    }
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_allocate_slot(pa_mempool *p, unsigned k) {
+    struct mempool_class *c;
     struct mempool_slot *slot;
     pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_N_CLASSES);
+
+    c = &p->classes[k];
 
-    if (!(slot = pa_flist_pop(p->free_slots))) {
+    if (!(slot = pa_flist_pop(c->free_slots))) {
         int idx;
 
         /* The free list was empty, we have to allocate a new entry */
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
+        if ((unsigned) (idx = pa_atomic_inc(&c->n_init)) >= c->n_blocks)
+            pa_atomic_dec(&c->n_init);
         else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + c->offset + (c->block_size * (size_t) idx));
 
         if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
+            pa_atomic_inc(&p->stat.n_class_misses[k]);
             return NULL;
         }
     }
 
+    pa_atomic_inc(&p->stat.n_class_hits[k]);
+    mempool_class_stat_inc(p, k);
+
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
 /*     if (PA_UNLIKELY(pa_in_valgrind())) { */
-/*         VALGRIND_MALLOCLIKE_BLOCK(slot, p->block_size, 0, 0); */
+/*         VALGRIND_MALLOCLIKE_BLOCK(slot, c->block_size, 0, 0); */
 /*     } */
 /* #endif */
 
@@ -329,23 +383,41 @@ static inline void* mempool_slot_data(struct mempool_slot *slot) {
 }
 
 /* No lock necessary */
-static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
+static unsigned mempool_class_by_ptr(pa_mempool *p, void *ptr) {
+    size_t offset;
+    unsigned k;
+
     pa_assert(p);
 
     pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
     pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+    offset = (size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr);
+
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++)
+        if (offset >= p->classes[k].offset &&
+            offset < p->classes[k].offset + p->classes[k].n_blocks * p->classes[k].block_size)
+            return k;
+
+    return (unsigned) -1;
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
-    unsigned idx;
+static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr, unsigned *class) {
+    struct mempool_class *c;
+    unsigned k;
+    size_t idx;
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
+    if ((k = mempool_class_by_ptr(p, ptr)) == (unsigned) -1)
         return NULL;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    c = &p->classes[k];
+    idx = ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) - c->offset) / c->block_size;
+
+    if (class)
+        *class = k;
+
+    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + c->offset + (idx * c->block_size));
 }
 
 /* No lock necessary */
@@ -364,8 +436,10 @@ void pa_mempool_set_is_remote_writable(pa_mempool *p, bool writable) {
 /* No lock necessary */
 pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     pa_memblock *b = NULL;
-    struct mempool_slot *slot;
+    struct mempool_slot *slot = NULL;
     static int mempool_disable = 0;
+    bool fits = false;
+    unsigned k;
 
     pa_assert(p);
     pa_assert(length);
@@ -377,35 +451,50 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
         return NULL;
 
     /* If -1 is passed as length we choose the size for the caller: we
-     * take the largest size that fits in one of our slots. */
+     * take the largest size that fits in one of our standard slots. */
 
     if (length == (size_t) -1)
         length = pa_mempool_block_size_max(p);
 
-    if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
+    /* Find the smallest class that fits, and spill over into the
+     * larger ones if it is exhausted */
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++) {
+        if (p->classes[k].block_size < length)
+            continue;
 
-        if (!(slot = mempool_allocate_slot(p)))
-            return NULL;
+        fits = true;
+
+        if ((slot = mempool_allocate_slot(p, k)))
+            break;
+    }
+
+    if (!slot) {
+        if (!fits) {
+            pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length,
+                         (unsigned long) p->classes[PA_MEMPOOL_N_CLASSES - 1].block_size);
+            pa_atomic_inc(&p->stat.n_too_large_for_pool);
+        } else {
+            if (pa_log_ratelimit(PA_LOG_DEBUG))
+                pa_log_debug("Pool full");
+            pa_atomic_inc(&p->stat.n_pool_full);
+        }
+
+        return NULL;
+    }
+
+    if (p->classes[k].block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
 
         b = mempool_slot_data(slot);
         b->type = PA_MEMBLOCK_POOL;
         pa_atomic_ptr_store(&b->data, (uint8_t*) b + PA_ALIGN(sizeof(pa_memblock)));
 
-    } else if (p->block_size >= length) {
-
-        if (!(slot = mempool_allocate_slot(p)))
-            return NULL;
+    } else {
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
             b = pa_xnew(pa_memblock, 1);
 
         b->type = PA_MEMBLOCK_POOL_EXTERNAL;
         pa_atomic_ptr_store(&b->data, mempool_slot_data(slot));
-
-    } else {
-        pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) p->block_size);
-        pa_atomic_inc(&p->stat.n_too_large_for_pool);
-        return NULL;
     }
 
     PA_REFCNT_INIT(b);
@@ -644,21 +733,24 @@ static void memblock_free(pa_memblock *b) {
         case PA_MEMBLOCK_POOL: {
             struct mempool_slot *slot;
             bool call_free;
+            unsigned k;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
+            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data), &k));
 
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
 /*             if (PA_UNLIKELY(pa_in_valgrind())) { */
-/*                 VALGRIND_FREELIKE_BLOCK(slot, b->pool->block_size); */
+/*                 VALGRIND_FREELIKE_BLOCK(slot, b->pool->classes[k].block_size); */
 /*             } */
 /* #endif */
 
+            pa_atomic_dec(&b->pool->stat.n_class_allocated[k]);
+
             /* The free list dimensions should easily allow all slots
              * to fit in, hence try harder if pushing this slot into
              * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
+            while (pa_flist_push(b->pool->classes[k].free_slots, slot) < 0)
                 ;
 
             if (call_free)
@@ -707,14 +799,19 @@ static void memblock_wait(pa_memblock *b) {
 
 /* No lock necessary. This function is not multiple caller safe! */
 static void memblock_make_local(pa_memblock *b) {
+    unsigned k;
+
     pa_assert(b);
 
     pa_atomic_dec(&b->pool->stat.n_allocated_by_type[b->type]);
 
-    if (b->length <= b->pool->block_size) {
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++) {
         struct mempool_slot *slot;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if (b->length > b->pool->classes[k].block_size)
+            continue;
+
+        if ((slot = mempool_allocate_slot(b->pool, k))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -798,6 +895,68 @@ static void memblock_replace_import(pa_memblock *b) {
     pa_mutex_unlock(import->mutex);
 }
 
+/* Gives size bytes to the standard class and the configured shares of it
+ * to the others, returns the number of bytes they take up */
+static size_t mempool_layout(pa_mempool *p, size_t size) {
+    const size_t page_size = pa_page_size();
+    size_t total = 0;
+    unsigned k;
+
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++) {
+        struct mempool_class *c = &p->classes[k];
+
+        c->block_size = PA_PAGE_ALIGN(mempool_class_layout[k].slot_size);
+        if (c->block_size < page_size)
+            c->block_size = page_size;
+
+        c->n_blocks = (unsigned) (size / 16 * mempool_class_layout[k].share / c->block_size);
+
+        /* Small pools may leave the non-standard classes empty, but
+         * the standard class always needs a few slots */
+        if (k == PA_MEMPOOL_STANDARD_CLASS && c->n_blocks < 2)
+            c->n_blocks = 2;
+
+        c->offset = total;
+        total += c->n_blocks * c->block_size;
+
+        p->n_blocks += c->n_blocks;
+    }
+
+    return total;
+}
+
+static pa_mempool *mempool_init(pa_mempool *p, size_t total, bool per_client) {
+    char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
+    unsigned k;
+
+    pa_log_debug("Using %s memory pool with %u slots in %u size classes, total size is %s, maximum usable slot size is %lu",
+                 pa_mem_type_to_string(p->memory.type),
+                 p->n_blocks,
+                 PA_MEMPOOL_N_CLASSES,
+                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) total),
+                 (unsigned long) pa_mempool_block_size_max(p));
+
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++) {
+        struct mempool_class *c = &p->classes[k];
+
+        pa_log_debug("Memory pool class %u: %u slots of size %s each",
+                     k, c->n_blocks, pa_bytes_snprint(t1, sizeof(t1), (unsigned) c->block_size));
+
+        pa_atomic_store(&c->n_init, 0);
+        c->free_slots = pa_flist_new(PA_MAX(c->n_blocks, 1U));
+    }
+
+    p->global = !per_client;
+
+    PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
+    PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
+
+    p->mutex = pa_mutex_new(true, true);
+    p->semaphore = pa_semaphore_new(0);
+
+    return p;
+}
+
 /*@per_client: This is a security measure. By default this should
  * be set to true where the created mempool is never shared with more
  * than one client in the system. Set this to false if a global
@@ -827,53 +986,56 @@ static void memblock_replace_import(pa_memblock *b) {
  * TODO-2: Remove global mempools support */
 pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
     pa_mempool *p;
-    char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
-    const size_t page_size = pa_page_size();
+    size_t total;
 
     p = pa_xnew0(pa_mempool, 1);
     PA_REFCNT_INIT(p);
 
-    p->block_size = PA_PAGE_ALIGN(PA_MEMPOOL_SLOT_SIZE);
-    if (p->block_size < page_size)
-        p->block_size = page_size;
-
     if (size <= 0)
-        p->n_blocks = PA_MEMPOOL_SLOTS_MAX;
-    else {
-        p->n_blocks = (unsigned) (size / p->block_size);
+        size = (size_t) PA_MEMPOOL_SLOTS_MAX * PA_MEMPOOL_SLOT_SIZE;
 
-        if (p->n_blocks < 2)
-            p->n_blocks = 2;
-    }
+    total = mempool_layout(p, size);
 
-    if (pa_shm_create_rw(&p->memory, type, p->n_blocks * p->block_size, 0700) < 0) {
+    if (pa_shm_create_rw(&p->memory, type, total, 0700) < 0) {
         pa_xfree(p);
         return NULL;
     }
 
-    pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
-                 pa_mem_type_to_string(type),
-                 p->n_blocks,
-                 pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
-                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
-                 (unsigned long) pa_mempool_block_size_max(p));
+    return mempool_init(p, total, per_client);
+}
 
-    p->global = !per_client;
+/* A pool in a memfd region the application owns, e.g. to have audio
+ * produced right into it by another process that maps the same region. The
+ * region is registered with the other PA endpoint like any memfd pool.
+ * The caller keeps ownership of @memfd_fd. */
+pa_mempool *pa_mempool_new_from_memfd(int memfd_fd, bool per_client) {
+    pa_mempool *p;
+    size_t total;
 
-    pa_atomic_store(&p->n_init, 0);
+    pa_assert(memfd_fd >= 0);
 
-    PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
-    PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
+    p = pa_xnew0(pa_mempool, 1);
+    PA_REFCNT_INIT(p);
 
-    p->mutex = pa_mutex_new(true, true);
-    p->semaphore = pa_semaphore_new(0);
+    if (pa_shm_create_from_memfd(&p->memory, memfd_fd) < 0) {
+        pa_xfree(p);
+        return NULL;
+    }
 
-    p->free_slots = pa_flist_new(p->n_blocks);
+    /* Here the size classes have to share the region */
+    if ((total = mempool_layout(p, p->memory.size / PA_MEMPOOL_SHARES * 16)) > p->memory.size) {
+        pa_log("memfd region of %lu bytes is too small for a memory pool", (unsigned long) p->memory.size);
+        pa_shm_free(&p->memory);
+        pa_xfree(p);
+        return NULL;
+    }
 
-    return p;
+    return mempool_init(p, total, per_client);
 }
 
 static void mempool_free(pa_mempool *p) {
+    unsigned k;
+
     pa_assert(p);
 
     pa_mutex_lock(p->mutex);
@@ -886,44 +1048,46 @@ static void mempool_free(pa_mempool *p) {
 
     pa_mutex_unlock(p->mutex);
 
-    pa_flist_free(p->free_slots, NULL);
-
     if (pa_atomic_load(&p->stat.n_allocated) > 0) {
 
         /* Ouch, somebody is retaining a memory block reference! */
 
 #ifdef DEBUG_REF
-        unsigned i;
+        unsigned i, c;
         pa_flist *list;
 
         /* Let's try to find at least one of those leaked memory blocks */
 
-        list = pa_flist_new(p->n_blocks);
+        for (c = 0; c < PA_MEMPOOL_N_CLASSES; c++) {
+            pa_flist *free_slots = p->classes[c].free_slots;
 
-        for (i = 0; i < (unsigned) pa_atomic_load(&p->n_init); i++) {
-            struct mempool_slot *slot;
-            pa_memblock *b, *k;
+            list = pa_flist_new(PA_MAX(p->classes[c].n_blocks, 1U));
 
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
-            b = mempool_slot_data(slot);
+            for (i = 0; i < (unsigned) pa_atomic_load(&p->classes[c].n_init); i++) {
+                struct mempool_slot *slot;
+                pa_memblock *b, *k;
 
-            while ((k = pa_flist_pop(p->free_slots))) {
-                while (pa_flist_push(list, k) < 0)
-                    ;
+                slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + p->classes[c].offset + (p->classes[c].block_size * (size_t) i));
+                b = mempool_slot_data(slot);
 
-                if (b == k)
-                    break;
-            }
+                while ((k = pa_flist_pop(free_slots))) {
+                    while (pa_flist_push(list, k) < 0)
+                        ;
 
-            if (!k)
-                pa_log("REF: Leaked memory block %p", b);
+                    if (b == k)
+                        break;
+                }
 
-            while ((k = pa_flist_pop(list)))
-                while (pa_flist_push(p->free_slots, k) < 0)
-                    ;
-        }
+                if (!k)
+                    pa_log("REF: Leaked memory block %p", b);
 
-        pa_flist_free(list, NULL);
+                while ((k = pa_flist_pop(list)))
+                    while (pa_flist_push(free_slots, k) < 0)
+                        ;
+            }
+
+            pa_flist_free(list, NULL);
+        }
 
 #endif
 
@@ -932,6 +1096,9 @@ static void mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++)
+        pa_flist_free(p->classes[k].free_slots, NULL);
+
     pa_shm_free(&p->memory);
 
     pa_mutex_free(p->mutex);
@@ -951,30 +1118,58 @@ const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p) {
 size_t pa_mempool_block_size_max(pa_mempool *p) {
     pa_assert(p);
 
-    return p->block_size - PA_ALIGN(sizeof(pa_memblock));
+    return p->classes[PA_MEMPOOL_STANDARD_CLASS].block_size - PA_ALIGN(sizeof(pa_memblock));
+}
+
+/* No lock necessary */
+size_t pa_mempool_class_block_size(pa_mempool *p, unsigned k) {
+    pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_N_CLASSES);
+
+    return p->classes[k].block_size;
+}
+
+/* No lock necessary */
+unsigned pa_mempool_class_n_blocks(pa_mempool *p, unsigned k) {
+    pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_N_CLASSES);
+
+    return p->classes[k].n_blocks;
+}
+
+/* No lock necessary */
+void pa_mempool_advise_hugepages(pa_mempool *p) {
+    pa_assert(p);
+
+    pa_shm_advise_hugepages(&p->memory);
 }
 
 /* No lock necessary */
 void pa_mempool_vacuum(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_flist *list;
+    unsigned k;
 
     pa_assert(p);
 
-    list = pa_flist_new(p->n_blocks);
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++) {
+        struct mempool_class *c = &p->classes[k];
 
-    while ((slot = pa_flist_pop(p->free_slots)))
-        while (pa_flist_push(list, slot) < 0)
-            ;
+        list = pa_flist_new(PA_MAX(c->n_blocks, 1U));
 
-    while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        while ((slot = pa_flist_pop(c->free_slots)))
+            while (pa_flist_push(list, slot) < 0)
+                ;
 
-        while (pa_flist_push(p->free_slots, slot))
-            ;
-    }
+        while ((slot = pa_flist_pop(list))) {
+            pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), c->block_size);
 
-    pa_flist_free(list, NULL);
+            while (pa_flist_push(c->free_slots, slot))
+                ;
+        }
+
+        pa_flist_free(list, NULL);
+    }
 }
 
 /* No lock necessary */
@@ -57,6 +57,9 @@ typedef struct pa_memexport pa_memexport;
 typedef void (*pa_memimport_release_cb_t)(pa_memimport *i, uint32_t block_id, void *userdata);
 typedef void (*pa_memexport_revoke_cb_t)(pa_memexport *e, uint32_t block_id, void *userdata);
 
+/* Number of slot size classes a memory pool is split into */
+#define PA_MEMPOOL_N_CLASSES 4
+
 /* Please note that updates to this structure are not locked,
  * i.e. n_allocated might be updated at a point in time where
  * n_accumulated is not yet. Take these values with a grain of salt,
@@ -76,6 +79,14 @@ struct pa_mempool_stat {
 
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
+
+    /* Per size class: slots handed out, allocation attempts that found
+     * the class exhausted, slots currently in use and the maximum
+     * number of slots ever in use at the same time */
+    pa_atomic_t n_class_hits[PA_MEMPOOL_N_CLASSES];
+    pa_atomic_t n_class_misses[PA_MEMPOOL_N_CLASSES];
+    pa_atomic_t n_class_allocated[PA_MEMPOOL_N_CLASSES];
+    pa_atomic_t n_class_high_water[PA_MEMPOOL_N_CLASSES];
 };
 
 /* Allocate a new memory block of type PA_MEMBLOCK_MEMPOOL or PA_MEMBLOCK_APPENDED, depending on the size */
@@ -125,6 +136,7 @@ pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
 /* The memory block manager */
 pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client);
+pa_mempool *pa_mempool_new_from_memfd(int memfd_fd, bool per_client);
 void pa_mempool_unref(pa_mempool *p);
 pa_mempool* pa_mempool_ref(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
@@ -137,6 +149,12 @@ bool pa_mempool_is_per_client(pa_mempool *p);
 bool pa_mempool_is_remote_writable(pa_mempool *p);
 void pa_mempool_set_is_remote_writable(pa_mempool *p, bool writable);
 size_t pa_mempool_block_size_max(pa_mempool *p);
+size_t pa_mempool_class_block_size(pa_mempool *p, unsigned k);
+unsigned pa_mempool_class_n_blocks(pa_mempool *p, unsigned k);
+
+/* Ask the kernel to back the pool with transparent huge pages. Needs
+ * to be called before the pool memory is touched for the first time. */
+void pa_mempool_advise_hugepages(pa_mempool *p);
 
 int pa_mempool_take_memfd_fd(pa_mempool *p);
 int pa_mempool_get_memfd_fd(pa_mempool *p);
@@ -24,6 +24,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <pulse/xmalloc.h>
 
@@ -31,6 +37,13 @@
 #include <pulsecore/mcalign.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/sample-util.h>
+
+#ifdef HAVE_MEMFD
+#include <pulsecore/memfd-wrappers.h>
+#endif
 
 #include "memblockq.h"
 
@@ -44,6 +57,20 @@ struct list_item {
 
 PA_STATIC_FLIST_DECLARE(list_items, 0, pa_xfree);
 
+/* Start size of the ring buffer used by ring mode queues. The ring
+ * grows on demand up to maxlength + maxrewind. */
+#define RING_SIZE_MIN (64*1024)
+
+/* The memory behind a ring mode queue. The memory is mapped twice
+ * back to back, so that every window of up to 'size' bytes starting
+ * in the first half is contiguous. If the platform can't do that, the
+ * second half is kept in sync by copying instead. */
+struct ring_memory {
+    uint8_t *data;
+    size_t size;
+    bool mirrored;
+};
+
 struct pa_memblockq {
     struct list_item *blocks, *blocks_tail;
     struct list_item *current_read, *current_write;
@@ -56,8 +83,21 @@ struct pa_memblockq {
     int64_t missing, requested;
     char *name;
     pa_sample_spec sample_spec;
+
+    /* Only for ring mode queues: the buffered data covers the stream
+     * indexes [ring_start, ring_end) and lives in ring_memblock. */
+    bool ring;
+    pa_mempool *ring_pool;
+    pa_memblock *ring_memblock;
+    struct ring_memory *ring_memory;
+    int64_t ring_start, ring_end;
 };
 
+static size_t ring_offset(pa_memblockq *bq, int64_t idx);
+static void ring_drop_backlog(pa_memblockq *bq);
+static int ring_push(pa_memblockq *bq, const pa_memchunk *chunk);
+static int ring_peek(pa_memblockq *bq, pa_memchunk *chunk);
+
 pa_memblockq* pa_memblockq_new(
         const char *name,
         int64_t idx,
@@ -105,11 +145,42 @@ pa_memblockq* pa_memblockq_new(
     return bq;
 }
 
+pa_memblockq* pa_memblockq_new_ring(
+        const char *name,
+        int64_t idx,
+        size_t maxlength,
+        size_t tlength,
+        const pa_sample_spec *sample_spec,
+        size_t prebuf,
+        size_t minreq,
+        size_t maxrewind,
+        pa_memchunk *silence,
+        pa_mempool *pool) {
+
+    pa_memblockq* bq;
+
+    pa_assert(pool);
+
+    bq = pa_memblockq_new(name, idx, maxlength, tlength, sample_spec, prebuf, minreq, maxrewind, silence);
+
+    bq->ring = true;
+    bq->ring_pool = pa_mempool_ref(pool);
+    bq->ring_start = bq->ring_end = idx;
+
+    return bq;
+}
+
 void pa_memblockq_free(pa_memblockq* bq) {
     pa_assert(bq);
 
     pa_memblockq_silence(bq);
 
+    if (bq->ring_memblock)
+        pa_memblock_unref(bq->ring_memblock);
+
+    if (bq->ring_pool)
+        pa_mempool_unref(bq->ring_pool);
+
     if (bq->silence.memblock)
         pa_memblock_unref(bq->silence.memblock);
 
@@ -214,6 +285,11 @@ static void drop_backlog(pa_memblockq *bq) {
     int64_t boundary;
     pa_assert(bq);
 
+    if (bq->ring) {
+        ring_drop_backlog(bq);
+        return;
+    }
+
     boundary = bq->read_index - (int64_t) bq->maxrewind;
 
     while (bq->blocks && (bq->blocks->index + (int64_t) bq->blocks->chunk.length <= boundary))
@@ -234,7 +310,10 @@ static bool can_push(pa_memblockq *bq, size_t l) {
             return true;
     }
 
-    end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
+    if (bq->ring)
+        end = bq->ring_end > bq->ring_start ? bq->ring_end : bq->write_index;
+    else
+        end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
 
     /* Make sure that the list doesn't get too long */
     if (bq->write_index + (int64_t) l > end)
@@ -291,6 +370,9 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     if (!can_push(bq, uchunk->length))
         return -1;
 
+    if (bq->ring)
+        return ring_push(bq, uchunk);
+
     old = bq->write_index;
     chunk = *uchunk;
 
@@ -480,6 +562,9 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
     if (update_prebuf(bq))
         return -1;
 
+    if (bq->ring)
+        return ring_peek(bq, chunk);
+
     fix_current_read(bq);
 
     /* Do we need to spit out silence? */
@@ -567,7 +652,21 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
 
     while (rchunk.index < block_size) {
 
-        if (!item || item->index > ri) {
+        if (bq->ring) {
+            if (ri >= bq->ring_start && ri < bq->ring_end) {
+                /* We can append real data! This only happens if the
+                 * block starts in a hole in front of the ring data. */
+                tchunk.memblock = bq->ring_memblock;
+                tchunk.index = ring_offset(bq, ri);
+                tchunk.length = (size_t) (bq->ring_end - ri);
+            } else {
+                tchunk = bq->silence;
+
+                if (ri < bq->ring_start)
+                    tchunk.length = PA_MIN(tchunk.length, (size_t) (bq->ring_start - ri));
+            }
+
+        } else if (!item || item->index > ri) {
             /* Do we need to append silence? */
             tchunk = bq->silence;
 
@@ -615,6 +714,20 @@ void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
         if (update_prebuf(bq))
             break;
 
+        if (bq->ring) {
+            int64_t d;
+
+            if (bq->ring_end <= bq->read_index) {
+                bq->read_index += (int64_t) length;
+                break;
+            }
+
+            d = PA_MIN(bq->ring_end - bq->read_index, (int64_t) length);
+            bq->read_index += d;
+            length -= (size_t) d;
+            continue;
+        }
+
         fix_current_read(bq);
 
         if (bq->current_read) {
@@ -697,7 +810,10 @@ void pa_memblockq_seek(pa_memblockq *bq, int64_t offset, pa_seek_mode_t seek, bo
             bq->write_index = bq->read_index + offset;
             break;
         case PA_SEEK_RELATIVE_END:
-            bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
+            if (bq->ring)
+                bq->write_index = (bq->ring_end > bq->ring_start ? bq->ring_end : bq->read_index) + offset;
+            else
+                bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
             break;
         default:
             pa_assert_not_reached();
@@ -972,6 +1088,12 @@ void pa_memblockq_willneed(pa_memblockq *bq) {
 
     pa_assert(bq);
 
+    if (bq->ring) {
+        if (bq->ring_memblock)
+            pa_memblock_will_need(bq->ring_memblock);
+        return;
+    }
+
     fix_current_read(bq);
 
     for (q = bq->current_read; q; q = q->next)
@@ -994,12 +1116,17 @@ void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
 bool pa_memblockq_is_empty(pa_memblockq *bq) {
     pa_assert(bq);
 
+    if (bq->ring)
+        return bq->ring_end <= bq->ring_start;
+
     return !bq->blocks;
 }
 
 void pa_memblockq_silence(pa_memblockq *bq) {
     pa_assert(bq);
 
+    bq->ring_start = bq->ring_end;
+
     while (bq->blocks)
         drop_block(bq, bq->blocks);
 
@@ -1009,6 +1136,9 @@ void pa_memblockq_silence(pa_memblockq *bq) {
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq) {
     pa_assert(bq);
 
+    if (bq->ring)
+        return bq->ring_end > bq->ring_start ? 1 : 0;
+
     return bq->n_blocks;
 }
 
@@ -1017,3 +1147,300 @@ size_t pa_memblockq_get_base(pa_memblockq *bq) {
 
     return bq->base;
 }
+
+bool pa_memblockq_is_ring(pa_memblockq *bq) {
+    pa_assert(bq);
+
+    return bq->ring;
+}
+
+/* Ring mode implementation */
+
+static void ring_memory_free(void *userdata) {
+    struct ring_memory *m = userdata;
+
+    pa_assert(m);
+
+#if defined(HAVE_MEMFD) && defined(HAVE_SYS_MMAN_H)
+    if (m->mirrored)
+        pa_assert_se(munmap(m->data, m->size * 2) == 0);
+    else
+#endif
+        pa_xfree(m->data);
+
+    pa_xfree(m);
+}
+
+static struct ring_memory *ring_memory_new(size_t size) {
+    struct ring_memory *m;
+
+    m = pa_xnew0(struct ring_memory, 1);
+    m->size = size;
+
+#if defined(HAVE_MEMFD) && defined(HAVE_SYS_MMAN_H)
+    {
+        int fd;
+        uint8_t *p = MAP_FAILED;
+
+        if ((fd = memfd_create("pulseaudio-memblockq", MFD_CLOEXEC)) < 0)
+            goto fallback;
+
+        if (ftruncate(fd, (off_t) size) < 0)
+            goto fail;
+
+        /* Reserve twice the size, then map the same memory into both halves */
+        if ((p = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+            goto fail;
+
+        if (mmap(p, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(p + size, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED)
+            goto fail;
+
+        pa_assert_se(pa_close(fd) == 0);
+
+        m->data = p;
+        m->mirrored = true;
+        return m;
+
+    fail:
+        pa_log_debug("Failed to set up mirrored ring buffer: %s", pa_cstrerror(errno));
+
+        if (p != MAP_FAILED)
+            munmap(p, size * 2);
+
+        pa_close(fd);
+    }
+
+fallback:
+#endif
+
+    m->data = pa_xmalloc(size * 2);
+    m->mirrored = false;
+    return m;
+}
+
+static size_t ring_offset(pa_memblockq *bq, int64_t idx) {
+    int64_t size = (int64_t) bq->ring_memory->size;
+
+    return (size_t) (((idx % size) + size) % size);
+}
+
+/* Copy data into the ring at the given stream index. The target range
+ * must fit into the ring. */
+static void ring_write(pa_memblockq *bq, int64_t idx, const void *p, size_t length) {
+    struct ring_memory *m = bq->ring_memory;
+    size_t o;
+
+    pa_assert(length <= m->size);
+
+    o = ring_offset(bq, idx);
+    memcpy(m->data + o, p, length);
+
+    if (!m->mirrored) {
+        /* Keep both halves in sync by hand */
+        if (o < m->size)
+            memcpy(m->data + o + m->size, m->data + o, PA_MIN(length, m->size - o));
+
+        if (o + length > m->size)
+            memcpy(m->data, m->data + m->size, o + length - m->size);
+    }
+}
+
+static void ring_write_silence(pa_memblockq *bq, int64_t idx, size_t length) {
+
+    while (length > 0) {
+        size_t l;
+
+        if (bq->silence.memblock) {
+            void *p;
+
+            l = PA_MIN(length, bq->silence.length);
+            p = pa_memblock_acquire(bq->silence.memblock);
+            ring_write(bq, idx, (uint8_t*) p + bq->silence.index, l);
+            pa_memblock_release(bq->silence.memblock);
+        } else {
+            size_t o = ring_offset(bq, idx);
+
+            l = length;
+            pa_silence_memory(bq->ring_memory->data + o, l, &bq->sample_spec);
+
+            if (!bq->ring_memory->mirrored) {
+                if (o < bq->ring_memory->size)
+                    memcpy(bq->ring_memory->data + o + bq->ring_memory->size,
+                           bq->ring_memory->data + o, PA_MIN(l, bq->ring_memory->size - o));
+
+                if (o + l > bq->ring_memory->size)
+                    memcpy(bq->ring_memory->data, bq->ring_memory->data + bq->ring_memory->size, o + l - bq->ring_memory->size);
+            }
+        }
+
+        idx += (int64_t) l;
+        length -= l;
+    }
+}
+
+/* Replace the ring memory by a new area of the given size, and move
+ * the buffered data over. */
+static void ring_realloc(pa_memblockq *bq, size_t size) {
+    pa_memblock *old_memblock = bq->ring_memblock;
+    struct ring_memory *old = bq->ring_memory;
+
+    bq->ring_memory = ring_memory_new(size);
+    bq->ring_memblock = pa_memblock_new_user(bq->ring_pool, bq->ring_memory->data, size * 2,
+                                             ring_memory_free, bq->ring_memory, false);
+
+    if (old_memblock) {
+        if (bq->ring_end > bq->ring_start) {
+            size_t o = (size_t) (((bq->ring_start % (int64_t) old->size) + (int64_t) old->size) % (int64_t) old->size);
+
+            pa_assert((size_t) (bq->ring_end - bq->ring_start) <= size);
+            ring_write(bq, bq->ring_start, old->data + o, (size_t) (bq->ring_end - bq->ring_start));
+        }
+
+        pa_memblock_unref(old_memblock);
+    }
+}
+
+/* Make sure we may write to the ring and that it can hold the given
+ * number of bytes. Chunks handed out by ring_peek() reference the ring
+ * memblock, and we must not change data somebody else still looks
+ * at. If that's the case we move to fresh memory, the old block stays
+ * valid until the last reference is gone. */
+static void ring_prepare(pa_memblockq *bq, size_t length, size_t limit) {
+    size_t size;
+
+    size = bq->ring_memory ? bq->ring_memory->size : PA_MIN(PA_PAGE_ALIGN(RING_SIZE_MIN), limit);
+
+    while (size < length)
+        size *= 2;
+
+    if (!bq->ring_memblock ||
+        size != bq->ring_memory->size ||
+        !pa_memblock_ref_is_one(bq->ring_memblock))
+        ring_realloc(bq, size);
+}
+
+static void ring_drop_backlog(pa_memblockq *bq) {
+    int64_t boundary;
+
+    boundary = bq->read_index - (int64_t) bq->maxrewind;
+
+    if (bq->ring_start < boundary)
+        bq->ring_start = PA_MIN(boundary, bq->ring_end);
+}
+
+static int ring_push(pa_memblockq *bq, const pa_memchunk *chunk) {
+    int64_t old, start, end, w;
+    size_t skip = 0, limit;
+    void *p;
+
+    old = bq->write_index;
+    w = bq->write_index;
+
+    /* Anything left of the rewind history is of no use */
+    if (w < bq->read_index - (int64_t) bq->maxrewind)
+        skip = (size_t) PA_MIN(bq->read_index - (int64_t) bq->maxrewind - w, (int64_t) chunk->length);
+
+    w += (int64_t) skip;
+
+    if (skip >= chunk->length)
+        goto finish;
+
+    if (bq->ring_end <= bq->ring_start)
+        bq->ring_start = bq->ring_end = w;
+
+    start = PA_MIN(bq->ring_start, w);
+    end = PA_MAX(bq->ring_end, bq->write_index + (int64_t) chunk->length);
+
+    /* Never let the ring grow beyond what the queue could possibly
+     * need, drop the oldest data instead */
+    limit = PA_PAGE_ALIGN(bq->maxlength + bq->maxrewind);
+    if (end - start > (int64_t) limit) {
+        start = end - (int64_t) limit;
+
+        if (w < start) {
+            skip += (size_t) (start - w);
+            w = start;
+        }
+
+        /* E.g. after a seek back behind a rewind, all of the chunk may be
+         * older than what is kept */
+        if (skip >= chunk->length) {
+            if (bq->ring_start < start)
+                bq->ring_start = start;
+            goto finish;
+        }
+    }
+
+    if (start >= bq->ring_end)
+        /* Nothing of the old data survives */
+        bq->ring_start = bq->ring_end = start;
+    else if (bq->ring_start < start)
+        bq->ring_start = start;
+
+    ring_prepare(bq, (size_t) (end - start), limit);
+
+    /* Fill the holes between the old and the new data with silence */
+    if (w > bq->ring_end)
+        ring_write_silence(bq, bq->ring_end, (size_t) (w - bq->ring_end));
+    else if (bq->write_index + (int64_t) chunk->length < bq->ring_start)
+        ring_write_silence(bq, bq->write_index + (int64_t) chunk->length,
+                           (size_t) (bq->ring_start - bq->write_index - (int64_t) chunk->length));
+
+    p = pa_memblock_acquire(chunk->memblock);
+    ring_write(bq, w, (uint8_t*) p + chunk->index + skip, chunk->length - skip);
+    pa_memblock_release(chunk->memblock);
+
+    bq->ring_start = start;
+    bq->ring_end = end;
+
+finish:
+    bq->write_index += (int64_t) chunk->length;
+
+    write_index_changed(bq, old, true);
+    return 0;
+}
+
+static int ring_peek(pa_memblockq *bq, pa_memchunk *chunk) {
+    size_t length;
+
+    if (bq->read_index >= bq->ring_start && bq->read_index < bq->ring_end) {
+
+        /* Thanks to the mirroring any window of the ring is contiguous */
+        chunk->memblock = pa_memblock_ref(bq->ring_memblock);
+        chunk->index = ring_offset(bq, bq->read_index);
+        chunk->length = (size_t) (bq->ring_end - bq->read_index);
+
+        return 0;
+    }
+
+    /* How much silence shall we return? */
+    if (bq->ring_end > bq->ring_start && bq->read_index < bq->ring_start)
+        length = (size_t) (bq->ring_start - bq->read_index);
+    else if (bq->write_index > bq->read_index)
+        length = (size_t) (bq->write_index - bq->read_index);
+    else
+        length = 0;
+
+    /* We need to return silence, since no data is yet available */
+    if (bq->silence.memblock) {
+        *chunk = bq->silence;
+        pa_memblock_ref(chunk->memblock);
+
+        if (length > 0 && length < chunk->length)
+            chunk->length = length;
+
+    } else {
+
+        /* If the memblockq is empty, return -1, otherwise return
+         * the time to sleep */
+        if (length <= 0)
+            return -1;
+
+        chunk->memblock = NULL;
+        chunk->length = length;
+    }
+
+    chunk->index = 0;
+    return 0;
+}
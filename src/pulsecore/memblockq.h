@@ -74,6 +74,25 @@ pa_memblockq* pa_memblockq_new(
         size_t maxrewind,
         pa_memchunk *silence);
 
+/* Like pa_memblockq_new(), but the queue copies all pushed data into a
+ * contiguous, mirrored ring buffer allocated on behalf of the given
+ * pool instead of keeping references to the pushed memory blocks. This
+ * costs one copy per push, but pa_memblockq_peek() and
+ * pa_memblockq_peek_fixed_size() can then hand out any buffered
+ * range without merging blocks. Holes inside the buffered range read
+ * back as silence. */
+pa_memblockq* pa_memblockq_new_ring(
+        const char *name,
+        int64_t idx,
+        size_t maxlength,
+        size_t tlength,
+        const pa_sample_spec *sample_spec,
+        size_t prebuf,
+        size_t minreq,
+        size_t maxrewind,
+        pa_memchunk *silence,
+        pa_mempool *pool);
+
 void pa_memblockq_free(pa_memblockq*bq);
 
 /* Push a new memory chunk into the queue.  */
@@ -184,4 +203,7 @@ bool pa_memblockq_prebuf_active(pa_memblockq *bq);
 /* Return how many items are currently stored in the queue */
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq);
 
+/* Check whether this queue was created with pa_memblockq_new_ring() */
+bool pa_memblockq_is_ring(pa_memblockq *bq);
+
 #endif
@@ -30,13 +30,17 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/proplist.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/core-error.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/modinfo.h>
+#include <pulsecore/startup-trace.h>
+#include <pulsecore/thread.h>
 
 #include "module.h"
 
@@ -46,6 +50,25 @@
 #define PA_SYMBOL_GET_N_USED "pa__get_n_used"
 #define PA_SYMBOL_GET_DEPRECATE "pa__get_deprecated"
 #define PA_SYMBOL_GET_VERSION "pa__get_version"
+#define PA_SYMBOL_PREPARE "pa__prepare"
+
+struct pa_module_load_request {
+    pa_core *core;
+    char *name, *argument;
+
+    /* Keeps the module mapped while the prepare hook runs */
+    lt_dlhandle dl;
+    int (*prepare)(const char *argument);
+    int prepare_result;
+    pa_usec_t prepare_begin, prepare_end;
+
+    pa_thread *thread;
+    int fds[2];
+    pa_io_event *io_event;
+
+    pa_module_load_cb_t cb;
+    void *userdata;
+};
 
 bool pa_module_exists(const char *name) {
     const char *paths, *state = NULL;
@@ -112,32 +135,35 @@ void pa_module_hook_connect(pa_module *m, pa_hook *hook, pa_hook_priority_t prio
     pa_dynarray_append(m->hooks, pa_hook_connect(hook, prio, cb, data));
 }
 
-int pa_module_load(pa_module** module, pa_core *c, const char *name, const char *argument) {
+static int module_load(pa_module** module, pa_core *c, const char *name, const char *argument, bool prepared) {
     pa_module *m = NULL;
     const char *(*get_version)(void);
     bool (*load_once)(void);
     const char* (*get_deprecated)(void);
     pa_modinfo *mi;
+    pa_startup_trace_span load_span, span;
     int errcode, rval;
 
     pa_assert(module);
     pa_assert(c);
     pa_assert(name);
 
-    if (c->disallow_module_loading) {
-        errcode = -PA_ERR_ACCESS;
-        goto fail;
-    }
+    load_span = pa_startup_trace_begin("module", name, argument);
 
     m = pa_xnew(pa_module, 1);
     m->name = pa_xstrdup(name);
     m->argument = pa_xstrdup(argument);
     m->load_once = false;
+    m->prepared = prepared;
     m->proplist = pa_proplist_new();
     m->hooks = pa_dynarray_new((pa_free_cb_t) pa_hook_slot_free);
     m->index = PA_IDXSET_INVALID;
 
-    if (!(m->dl = lt_dlopenext(name))) {
+    span = pa_startup_trace_begin("module", "dlopen", name);
+    m->dl = lt_dlopenext(name);
+    pa_startup_trace_end(span);
+
+    if (!m->dl) {
         /* We used to print the error that is returned by lt_dlerror(), but
          * lt_dlerror() is useless. It returns pretty much always "file not
          * found". That's because if there are any problems with loading the
@@ -205,7 +231,11 @@ int pa_module_load(pa_module** module, pa_core *c, const char *name, const char
     pa_assert_se(pa_idxset_put(c->modules, m, &m->index) >= 0);
     pa_assert(m->index != PA_IDXSET_INVALID);
 
-    if ((rval = m->init(m)) < 0) {
+    span = pa_startup_trace_begin("module", "init", name);
+    rval = m->init(m);
+    pa_startup_trace_end(span);
+
+    if (rval < 0) {
         if (rval == -PA_MODULE_ERR_SKIP) {
             errcode = -PA_ERR_NOENTITY;
             goto fail;
@@ -237,6 +267,8 @@ int pa_module_load(pa_module** module, pa_core *c, const char *name, const char
 
     *module = m;
 
+    pa_startup_trace_end(load_span);
+
     return 0;
 
 fail:
@@ -262,9 +294,206 @@ fail:
 
     *module = NULL;
 
+    pa_startup_trace_end(load_span);
+
+    return errcode;
+}
+
+int pa_module_load(pa_module** module, pa_core *c, const char *name, const char *argument) {
+    pa_assert(module);
+    pa_assert(c);
+
+    if (c->disallow_module_loading) {
+        *module = NULL;
+        return -PA_ERR_ACCESS;
+    }
+
+    return module_load(module, c, name, argument, false);
+}
+
+static void load_request_free(pa_module_load_request *r) {
+    pa_assert(r);
+
+    if (r->io_event)
+        r->core->mainloop->io_free(r->io_event);
+
+    if (r->thread)
+        pa_thread_free(r->thread);
+
+    pa_close_pipe(r->fds);
+
+    if (r->dl)
+        lt_dlclose(r->dl);
+
+    pa_xfree(r->name);
+    pa_xfree(r->argument);
+    pa_xfree(r);
+}
+
+static void load_request_signal(pa_module_load_request *r) {
+    char x = 'x';
+
+    if (pa_write(r->fds[1], &x, sizeof(x), NULL) != sizeof(x))
+        pa_log_error("Failed to signal completion of module preparation: %s", pa_cstrerror(errno));
+}
+
+static void prepare_thread_func(void *userdata) {
+    pa_module_load_request *r = userdata;
+
+    pa_assert(r);
+
+    r->prepare_begin = pa_rtclock_now();
+    r->prepare_result = r->prepare(r->argument);
+    r->prepare_end = pa_rtclock_now();
+
+    load_request_signal(r);
+}
+
+static void load_request_io_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_module_load_request *r = userdata;
+    pa_module *m = NULL;
+    char *thread_name;
+    int errcode;
+    char x;
+
+    pa_assert(r);
+    pa_assert(r->io_event == e);
+
+    (void) pa_read(fd, &x, sizeof(x), NULL);
+
+    a->io_free(r->io_event);
+    r->io_event = NULL;
+
+    if (r->thread) {
+        pa_thread_free(r->thread);
+        r->thread = NULL;
+
+        thread_name = pa_sprintf_malloc("prepare-%s", r->name);
+        pa_startup_trace_add("module", "prepare", r->name, r->prepare_begin, r->prepare_end, thread_name);
+        pa_xfree(thread_name);
+    }
+
+    if (r->prepare_result < 0) {
+        pa_log_error("Failed to load module \"%s\" (argument: \"%s\"): preparation failed.", r->name, r->argument ? r->argument : "");
+        errcode = r->prepare_result == -PA_MODULE_ERR_SKIP ? -PA_ERR_NOENTITY : -PA_ERR_IO;
+    } else
+        /* Not checking disallow_module_loading again: the request was
+         * accepted while loading was allowed. The daemon disallows loading
+         * right after the startup script, before any deferred module from
+         * that script got here. */
+        errcode = module_load(&m, r->core, r->name, r->argument, !!r->prepare);
+
+    pa_hashmap_remove(r->core->modules_pending_load, r);
+
+    r->cb(m, errcode, r->userdata);
+    load_request_free(r);
+}
+
+int pa_module_load_async(pa_module_load_request **request, pa_core *c, const char *name, const char *argument, pa_module_load_cb_t cb, void *userdata) {
+    pa_module_load_request *r;
+    const char *(*get_version)(void);
+    char *thread_name;
+    int errcode;
+
+    pa_assert(request);
+    pa_assert(c);
+    pa_assert(name);
+    pa_assert(cb);
+
+    *request = NULL;
+
+    if (c->disallow_module_loading)
+        return -PA_ERR_ACCESS;
+
+    r = pa_xnew0(pa_module_load_request, 1);
+    r->core = c;
+    r->name = pa_xstrdup(name);
+    r->argument = pa_xstrdup(argument);
+    r->cb = cb;
+    r->userdata = userdata;
+    r->fds[0] = r->fds[1] = -1;
+
+    if (!(r->dl = lt_dlopenext(name))) {
+        pa_log("Failed to open module \"%s\".", name);
+        errcode = -PA_ERR_IO;
+        goto fail;
+    }
+
+    /* Don't run any code from a module built for another version */
+    if (!(get_version = (const char *(*)(void)) pa_load_sym(r->dl, name, PA_SYMBOL_GET_VERSION)) ||
+        !pa_safe_streq(get_version(), PACKAGE_VERSION)) {
+        pa_log("Module \"%s\" version doesn't match the expected version (%s).", name, PACKAGE_VERSION);
+        errcode = -PA_ERR_IO;
+        goto fail;
+    }
+
+    r->prepare = (int (*)(const char *_argument)) pa_load_sym(r->dl, name, PA_SYMBOL_PREPARE);
+
+    if (pa_pipe_cloexec(r->fds) < 0) {
+        pa_log("pipe() failed: %s", pa_cstrerror(errno));
+        errcode = -PA_ERR_INTERNAL;
+        goto fail;
+    }
+
+    pa_make_fd_nonblock(r->fds[0]);
+    pa_assert_se(r->io_event = c->mainloop->io_new(c->mainloop, r->fds[0], PA_IO_EVENT_INPUT, load_request_io_cb, r));
+
+    if (r->prepare) {
+        thread_name = pa_sprintf_malloc("prepare-%s", name);
+        r->thread = pa_thread_new(thread_name, prepare_thread_func, r);
+        pa_xfree(thread_name);
+
+        if (!r->thread) {
+            pa_log("Failed to create module preparation thread.");
+            errcode = -PA_ERR_INTERNAL;
+            goto fail;
+        }
+    } else
+        /* Nothing to do off the main loop, complete on the next iteration */
+        load_request_signal(r);
+
+    pa_log_debug("Loading \"%s\" asynchronously (argument: \"%s\").", name, argument ? argument : "");
+
+    *request = r;
+    return 0;
+
+fail:
+    load_request_free(r);
     return errcode;
 }
 
+void pa_module_load_request_cancel(pa_module_load_request *r) {
+    pa_assert(r);
+
+    pa_log_debug("Cancelling asynchronous load of \"%s\".", r->name);
+
+    pa_hashmap_remove(r->core->modules_pending_load, r);
+
+    /* pa_thread_free() joins, so the prepare hook is done afterwards */
+    load_request_free(r);
+}
+
+static void deferred_load_cb(pa_module *m, int error, void *userdata) {
+    /* Failures have been logged already */
+    if (m)
+        pa_log_info("Deferred load of \"%s\" completed as module #%u.", m->name, m->index);
+}
+
+int pa_module_load_deferred(pa_core *c, const char *name, const char *argument) {
+    pa_module_load_request *r;
+    int errcode;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    if ((errcode = pa_module_load_async(&r, c, name, argument, deferred_load_cb, NULL)) < 0)
+        return errcode;
+
+    pa_hashmap_put(c->modules_pending_load, r, r);
+
+    return 0;
+}
+
 static void postponed_dlclose(pa_mainloop_api *api, void *userdata) {
     lt_dlhandle dl = userdata;
 
@@ -338,6 +567,7 @@ void pa_module_unload_by_index(pa_core *c, uint32_t idx, bool force) {
 
 void pa_module_unload_all(pa_core *c) {
     pa_module *m;
+    pa_module_load_request *r;
     uint32_t *indices;
     uint32_t state;
     int i;
@@ -345,6 +575,10 @@ void pa_module_unload_all(pa_core *c) {
     pa_assert(c);
     pa_assert(c->modules);
 
+    /* Deferred loads that didn't complete yet are not going to */
+    while ((r = pa_hashmap_first(c->modules_pending_load)))
+        pa_module_load_request_cancel(r);
+
     if (pa_idxset_isempty(c->modules))
         return;
 
@@ -51,6 +51,10 @@ struct pa_module {
     bool load_once:1;
     bool unload_requested:1;
 
+    /* True if the module's pa__prepare() hook ran successfully before
+     * pa__init() was called, see pa_module_load_async() */
+    bool prepared:1;
+
     pa_proplist *proplist;
     pa_dynarray *hooks;
 };
@@ -59,6 +63,35 @@ bool pa_module_exists(const char *name);
 
 int pa_module_load(pa_module** m, pa_core *c, const char *name, const char *argument);
 
+/* Asynchronous module loading. If the module exports a pa__prepare()
+ * hook it is called with the module argument from a worker thread, so
+ * that slow work that doesn't need the core (opening or probing a
+ * device, loading firmware, ...) doesn't stall the main loop. The hook
+ * must not touch any core object. Once it returns, pa__init() is run
+ * from the main loop as with pa_module_load() and cb is called with
+ * the result. cb receives the loaded module, or NULL and a negative
+ * error code. If the request can't be started at all, an error code is
+ * returned right away and cb is never called. That includes module
+ * loading being disallowed; a request that was started before loading
+ * got disallowed still completes. */
+typedef struct pa_module_load_request pa_module_load_request;
+typedef void (*pa_module_load_cb_t)(pa_module *m, int error, void *userdata);
+
+int pa_module_load_async(pa_module_load_request **r, pa_core *c, const char *name, const char *argument, pa_module_load_cb_t cb, void *userdata);
+
+/* Cancel a pending request, cb is not called anymore. If the prepare
+ * hook is still running, this waits for it to finish. */
+void pa_module_load_request_cancel(pa_module_load_request *r);
+
+/* Like pa_module_load_async(), but the request is owned by the core and
+ * there is nobody to report the result to. pa__init() runs from the
+ * main loop at the earliest after the caller returns, so a startup
+ * script that defers a module has all its other commands executed,
+ * including the one loading the native protocol, before the module is
+ * initialized. Pending requests are cancelled by
+ * pa_module_unload_all(). */
+int pa_module_load_deferred(pa_core *c, const char *name, const char *argument);
+
 void pa_module_unload(pa_module *m, bool force);
 void pa_module_unload_by_index(pa_core *c, uint32_t idx, bool force);
 
@@ -113,10 +146,12 @@ void pa_module_hook_connect(pa_module *m, pa_hook *hook, pa_hook_priority_t prio
 #define pa__get_deprecated _MACRO_CONCAT(PA_MODULE_NAME, _LTX_pa__get_deprecated)
 #define pa__load_once _MACRO_CONCAT(PA_MODULE_NAME, _LTX_pa__load_once)
 #define pa__get_n_used _MACRO_CONCAT(PA_MODULE_NAME, _LTX_pa__get_n_used)
+#define pa__prepare _MACRO_CONCAT(PA_MODULE_NAME, _LTX_pa__prepare)
 
 int pa__init(pa_module*m);
 void pa__done(pa_module*m);
 int pa__get_n_used(pa_module*m);
+int pa__prepare(const char *argument);
 
 const char* pa__get_author(void);
 const char* pa__get_description(void);
@@ -190,6 +190,9 @@ enum {
     /* Supported since protocol v34 (14.0) */
     PA_COMMAND_SEND_OBJECT_MESSAGE,
 
+    /* Supported since protocol v37 (15.0) */
+    PA_COMMAND_GET_SINK_INPUT_INFO_DELTA,
+
     PA_COMMAND_MAX
 };
 
@@ -34,6 +34,7 @@
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
 #include <pulse/internal.h>
+#include <pulse/introspect.h>
 
 #include <pulsecore/native-common.h>
 #include <pulsecore/packet.h>
@@ -2463,7 +2464,7 @@ static void command_exit(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_pstream_send_simple_ack(c->pstream, tag); /* nonsense */
 }
 
-static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
+static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type, size_t size) {
     pa_srbchannel_template srbt;
     pa_srbchannel *srb;
     pa_memchunk mc;
@@ -2511,12 +2512,17 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
     }
     pa_mempool_set_is_remote_writable(c->rw_mempool, true);
 
-    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool);
+    /* The client may ask for a ring size, otherwise we use the one
+     * configured for the module, if any */
+    if (size == 0)
+        size = c->options->srbchannel_size;
+
+    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool, size);
     if (!srb) {
         pa_log_debug("Failed to create srbchannel");
         goto fail;
     }
-    pa_log_debug("Enabling srbchannel...");
+    pa_log_debug("Enabling srbchannel with a ring size of %zu bytes...", pa_srbchannel_get_size(srb));
     pa_srbchannel_export(srb, &srbt);
 
     /* Send enable command to client */
@@ -2563,6 +2569,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_tagstruct *reply;
     pa_mem_type_t shm_type;
     bool shm_on_remote = false, do_shm;
+    size_t srbchannel_size = 0;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -2591,6 +2598,15 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
         if ((c->version & PA_PROTOCOL_VERSION_MASK) >= 31)
             memfd_on_remote = !!(c->version & PA_PROTOCOL_FLAG_MEMFD);
 
+        /* Starting with protocol version 36, the version tag may carry
+         * the srbchannel ring size the client would like to use. */
+        if ((c->version & PA_PROTOCOL_VERSION_MASK) >= 36) {
+            unsigned size_log2 = (c->version & PA_PROTOCOL_SRBCHANNEL_SIZE_MASK) >> PA_PROTOCOL_SRBCHANNEL_SIZE_SHIFT;
+
+            if (size_log2 > 0)
+                srbchannel_size = (size_t) 1 << size_log2;
+        }
+
         /* Reserve the two most-significant _bytes_ of the version tag
          * for flags. */
         c->version &= PA_PROTOCOL_VERSION_MASK;
@@ -2732,7 +2748,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
             pa_log("Failed to register memfd mempool. Reason: %s", reason);
     }
 
-    setup_srbchannel(c, shm_type);
+    setup_srbchannel(c, shm_type, srbchannel_size);
 }
 
 static void command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -3157,6 +3173,17 @@ static void fixup_sample_spec(pa_native_connection *c, pa_sample_spec *fixed, co
     }
 }
 
+/* The render.* entries are added to a copy, they aren't kept in the object's
+ * own proplist */
+static void put_proplist_with_render_stats(pa_tagstruct *t, pa_proplist *p, pa_render_stats_snapshot *snapshot) {
+    pa_render_stats stats;
+
+    pa_render_stats_read(snapshot, &stats);
+    p = pa_render_stats_proplist_copy(&stats, p);
+    pa_tagstruct_put_proplist(t, p);
+    pa_proplist_free(p);
+}
+
 static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
     pa_sample_spec fixed_ss;
 
@@ -3183,7 +3210,7 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
-        pa_tagstruct_put_proplist(t, sink->proplist);
+        put_proplist_with_render_stats(t, sink->proplist, &sink->render_stats);
         pa_tagstruct_put_usec(t, pa_sink_get_requested_latency(sink));
     }
 
@@ -3427,7 +3454,7 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     if (c->version >= 11)
         pa_tagstruct_put_boolean(t, s->muted);
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, s->proplist);
+        put_proplist_with_render_stats(t, s->proplist, &s->render_stats);
     if (c->version >= 19)
         pa_tagstruct_put_boolean(t, s->state == PA_SINK_INPUT_CORKED);
     if (c->version >= 20) {
@@ -3438,6 +3465,64 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
         pa_tagstruct_put_format_info(t, s->format);
 }
 
+/* Only the field groups in fields, for PA_COMMAND_GET_SINK_INPUT_INFO_DELTA */
+static void sink_input_fill_delta_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s, uint32_t fields) {
+    pa_sample_spec fixed_ss;
+
+    pa_assert(t);
+    pa_sink_input_assert_ref(s);
+
+    fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
+
+    pa_tagstruct_putu32(t, s->index);
+    pa_tagstruct_put_boolean(t, false);
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_VOLUME) {
+        pa_cvolume v;
+        bool has_volume;
+
+        has_volume = pa_sink_input_is_volume_readable(s);
+        if (has_volume)
+            pa_sink_input_get_volume(s, &v, true);
+        else
+            pa_cvolume_reset(&v, fixed_ss.channels);
+
+        pa_tagstruct_put_cvolume(t, &v);
+        pa_tagstruct_put_boolean(t, s->muted);
+        pa_tagstruct_put_boolean(t, has_volume);
+        pa_tagstruct_put_boolean(t, s->volume_writable);
+    }
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_STATE) {
+        pa_tagstruct_putu32(t, s->sink ? s->sink->index : PA_INVALID_INDEX);
+        pa_tagstruct_put_boolean(t, s->state == PA_SINK_INPUT_CORKED);
+    }
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_NAME) {
+        pa_tagstruct_puts(t, pa_strnull(pa_proplist_gets(s->proplist, PA_PROP_MEDIA_NAME)));
+        pa_tagstruct_putu32(t, s->module ? s->module->index : PA_INVALID_INDEX);
+        pa_tagstruct_putu32(t, s->client ? s->client->index : PA_INVALID_INDEX);
+        pa_tagstruct_puts(t, s->driver);
+    }
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_FORMAT) {
+        pa_tagstruct_put_sample_spec(t, &fixed_ss);
+        pa_tagstruct_put_channel_map(t, &s->channel_map);
+        pa_tagstruct_put_format_info(t, s->format);
+        pa_tagstruct_puts(t, pa_resample_method_to_string(pa_sink_input_get_resample_method(s)));
+    }
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_LATENCY) {
+        pa_usec_t sink_latency;
+
+        pa_tagstruct_put_usec(t, pa_sink_input_get_latency(s, &sink_latency));
+        pa_tagstruct_put_usec(t, sink_latency);
+    }
+
+    if (fields & PA_SINK_INPUT_INFO_FIELD_PROPLIST)
+        put_proplist_with_render_stats(t, s->proplist, &s->render_stats);
+}
+
 static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s) {
     pa_sample_spec fixed_ss;
     pa_usec_t source_latency;
@@ -3671,6 +3756,54 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static void command_get_sink_input_info_delta(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_core *core;
+    pa_sink_input *i;
+    pa_tagstruct *reply;
+    uint64_t generation;
+    uint32_t fields, idx;
+    bool full;
+    unsigned j;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu64(t, &generation) < 0 ||
+        pa_tagstruct_getu32(t, &fields) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+
+    core = c->protocol->core;
+    fields &= PA_SINK_INPUT_INFO_FIELD_ALL;
+
+    /* Removals the client might have missed are gone, so let it start
+     * over. A generation from the future means the server restarted. */
+    full = generation == 0 || generation < core->tombstone_horizon || generation > core->generation;
+
+    reply = reply_new(tag);
+    pa_tagstruct_putu64(reply, core->generation);
+    pa_tagstruct_put_boolean(reply, full);
+    pa_tagstruct_putu32(reply, fields);
+
+    PA_IDXSET_FOREACH(i, core->sink_inputs, idx)
+        if (full || i->generation > generation)
+            sink_input_fill_delta_tagstruct(c, reply, i, fields);
+
+    if (!full)
+        for (j = 0; j < core->n_tombstones; j++)
+            if (core->tombstones[j].generation > generation) {
+                pa_tagstruct_putu32(reply, core->tombstones[j].index);
+                pa_tagstruct_put_boolean(reply, true);
+            }
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
 static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_tagstruct *reply;
@@ -5023,6 +5156,7 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = command_register_memfd_shmid,
 
     [PA_COMMAND_SEND_OBJECT_MESSAGE] = command_send_object_message,
+    [PA_COMMAND_GET_SINK_INPUT_INFO_DELTA] = command_get_sink_input_info_delta,
 
     [PA_COMMAND_EXTENSION] = command_extension
 };
@@ -5476,6 +5610,12 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    o->srbchannel_size = 0;
+    if (pa_modargs_get_value_u32(ma, "srbchannel-size", &o->srbchannel_size) < 0) {
+        pa_log("srbchannel-size= expects a numerical argument.");
+        return -1;
+    }
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
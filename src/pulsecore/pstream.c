@@ -82,6 +82,13 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
+/* Up to this many queued items are coalesced into a single writev() */
+#define WRITE_BATCH_MAX (16)
+
+/* Small frames are received through a buffer of this size, so that a
+ * burst of them costs one read() instead of two per frame */
+#define READ_BUFFER_SIZE (16*1024)
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -109,6 +116,17 @@ struct item_info {
     uint32_t block_id;
 };
 
+struct pstream_write {
+    union {
+        uint8_t minibuf[MINIBUF_SIZE];
+        pa_pstream_descriptor descriptor;
+    };
+    struct item_info* current;
+    void *data;
+    int minibuf_validsize;
+    pa_memchunk memchunk;
+};
+
 struct pstream_read {
     pa_pstream_descriptor descriptor;
     pa_memblock *memblock;
@@ -131,20 +149,25 @@ struct pa_pstream {
 
     bool dead;
 
+    /* Items taken off the send queue, in order. index counts the bytes
+     * of items[0] that have been written already. */
     struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
+        struct pstream_write items[WRITE_BATCH_MAX];
+        unsigned n;
         size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
     } write;
 
     struct pstream_read readio, readsrb;
 
+    /* Receive buffer of readio, see read_io() */
+    struct {
+        uint8_t *data;
+        size_t index, length;
+#ifdef HAVE_CREDS
+        pa_cmsg_ancil_data ancil_data;
+#endif
+    } readbuf;
+
     /* @use_shm: beside copying the full audio data to the other
      * PA end, this pipe supports just sending references of the
      * same audio data blocks if they reside in a SHM pool.
@@ -181,8 +204,7 @@ struct pa_pstream {
     pa_mempool *mempool;
 
 #ifdef HAVE_CREDS
-    pa_cmsg_ancil_data read_ancil_data, *write_ancil_data;
-    bool send_ancil_data_now;
+    pa_cmsg_ancil_data read_ancil_data;
 #endif
 };
 
@@ -258,8 +280,12 @@ static void do_pstream_read_write(pa_pstream *p) {
     }
 
     if (!p->dead && pa_iochannel_is_readable(p->io)) {
-        if (do_read(p, &p->readio) < 0)
-            goto fail;
+        /* Dispatch all frames already sitting in the receive buffer
+         * before going back to the main loop */
+        do {
+            if (do_read(p, &p->readio) < 0)
+                goto fail;
+        } while (!p->dead && p->readbuf.length > 0);
     } else if (!p->dead && pa_iochannel_is_hungup(p->io))
         goto fail;
 
@@ -410,17 +436,25 @@ static void item_free(void *item) {
 }
 
 static void pstream_free(pa_pstream *p) {
+    unsigned k;
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
 
     pa_queue_free(p->send_queue, item_free);
 
-    if (p->write.current)
-        item_free(p->write.current);
+    for (k = 0; k < p->write.n; k++) {
+        item_free(p->write.items[k].current);
+
+        if (p->write.items[k].memchunk.memblock)
+            pa_memblock_unref(p->write.items[k].memchunk.memblock);
+    }
 
-    if (p->write.memchunk.memblock)
-        pa_memblock_unref(p->write.memchunk.memblock);
+#ifdef HAVE_CREDS
+    pa_cmsg_ancil_data_close_fds(&p->readbuf.ancil_data);
+#endif
+    pa_xfree(p->readbuf.data);
 
     if (p->readsrb.memblock)
         pa_memblock_unref(p->readsrb.memblock);
@@ -593,68 +627,66 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static void prepare_write_item(pa_pstream *p, struct pstream_write *w, struct item_info *item) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(w);
+    pa_assert(item);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    w->current = item;
+    w->data = NULL;
+    w->minibuf_validsize = 0;
+    pa_memchunk_reset(&w->memchunk);
 
-    if (!p->write.current)
-        return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
-
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
-
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET) {
         size_t plen;
 
-        pa_assert(p->write.current->packet);
+        pa_assert(w->current->packet);
 
-        p->write.data = (void *) pa_packet_data(p->write.current->packet, &plen);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
+        w->data = (void *) pa_packet_data(w->current->packet, &plen);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
 
         if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, plen);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+            memcpy(&w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], w->data, plen);
+            w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
         }
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
     } else {
         uint32_t flags;
         bool send_payload = true;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+            uint32_t *shm_info = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
             size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
-            pa_mempool *current_pool = pa_memblock_get_pool(p->write.current->chunk.memblock);
+            pa_mempool *current_pool = pa_memblock_get_pool(w->current->chunk.memblock);
             pa_memexport *current_export;
 
             if (p->mempool == current_pool)
@@ -663,7 +695,7 @@ static void prepare_next_write_item(pa_pstream *p) {
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
             if (pa_memexport_put(current_export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &type,
                                  &block_id,
                                  &shm_id,
@@ -696,11 +728,11 @@ static void prepare_next_write_item(pa_pstream *p) {
 
                     shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
                     shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                    p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
+                    w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
                 }
             }
 /*             else */
@@ -713,18 +745,23 @@ static void prepare_next_write_item(pa_pstream *p) {
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
+}
 
-#ifdef HAVE_CREDS
-    if ((p->send_ancil_data_now = p->write.current->with_ancil_data))
-        p->write_ancil_data = &p->write.current->ancil_data;
-#endif
+/* Fill up the write batch from the send queue */
+static void prepare_write_items(pa_pstream *p) {
+    struct item_info *item;
+
+    pa_assert(p);
+
+    while (p->write.n < WRITE_BATCH_MAX && (item = pa_queue_pop(p->send_queue)))
+        prepare_write_item(p, &p->write.items[p->write.n++], item);
 }
 
 static void check_srbpending(pa_pstream *p) {
@@ -741,99 +778,235 @@ static void check_srbpending(pa_pstream *p) {
         pa_srbchannel_set_callback(p->srb, srb_callback, p);
 }
 
+static size_t write_item_length(struct pstream_write *w) {
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+/* Appends d to the iovec, minus whatever part of it was written already */
+static void write_append(struct iovec *iov, unsigned *n, size_t *skip, void *d, size_t l) {
+    if (*skip >= l) {
+        *skip -= l;
+        return;
+    }
+
+    iov[*n].iov_base = (uint8_t*) d + *skip;
+    iov[*n].iov_len = l - *skip;
+    (*n)++;
+    *skip = 0;
+}
+
+static size_t srbchannel_writev(pa_srbchannel *srb, const struct iovec *iov, unsigned n) {
+    size_t r = 0;
+    unsigned k;
+
+    for (k = 0; k < n; k++) {
+        size_t w = pa_srbchannel_write(srb, iov[k].iov_base, iov[k].iov_len);
+
+        r += w;
+        if (w < iov[k].iov_len)
+            break;
+    }
+
+    return r;
+}
+
 static int do_write(pa_pstream *p) {
-    void *d;
-    size_t l;
+    struct iovec iov[WRITE_BATCH_MAX * 2];
+    pa_memblock *release_memblocks[WRITE_BATCH_MAX];
+    unsigned n_iov = 0, n_release = 0, n_done = 0, k;
+    size_t l = 0, skip;
     ssize_t r;
-    pa_memblock *release_memblock = NULL;
+#ifdef HAVE_CREDS
+    pa_cmsg_ancil_data *ancil_data = NULL;
+#endif
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
+    prepare_write_items(p);
 
-    if (!p->write.current) {
+    if (p->write.n == 0) {
         /* The out queue is empty, so switching channels is safe */
         check_srbpending(p);
         return 0;
     }
 
-    if (p->write.minibuf_validsize > 0) {
-        d = p->write.minibuf + p->write.index;
-        l = p->write.minibuf_validsize - p->write.index;
-    } else if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->write.descriptor + p->write.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
-    } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
+#ifdef HAVE_CREDS
+    /* Ancillary data goes out together with the first byte of its item */
+    if (p->write.items[0].current->with_ancil_data && p->write.index == 0)
+        ancil_data = &p->write.items[0].current->ancil_data;
+#endif
+
+    skip = p->write.index;
+
+    for (k = 0; k < p->write.n; k++) {
+        struct pstream_write *w = &p->write.items[k];
+        size_t length = ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
 
-        if (p->write.data)
-            d = p->write.data;
+#ifdef HAVE_CREDS
+        /* Ancillary data is sent in a message of its own. The receiving
+         * end hands received fds to the frame its read ended in. */
+        if (k > 0 && (ancil_data || w->current->with_ancil_data))
+            break;
+#endif
+
+        if (w->minibuf_validsize > 0)
+            write_append(iov, &n_iov, &skip, w->minibuf, w->minibuf_validsize);
         else {
-            d = pa_memblock_acquire_chunk(&p->write.memchunk);
-            release_memblock = p->write.memchunk.memblock;
+            write_append(iov, &n_iov, &skip, w->descriptor, PA_PSTREAM_DESCRIPTOR_SIZE);
+
+            if (length > 0) {
+                void *d;
+
+                pa_assert(w->data || w->memchunk.memblock);
+
+                if (w->data)
+                    d = w->data;
+                else {
+                    d = pa_memblock_acquire_chunk(&w->memchunk);
+                    release_memblocks[n_release++] = w->memchunk.memblock;
+                }
+
+                write_append(iov, &n_iov, &skip, d, length);
+            }
         }
 
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        l += PA_PSTREAM_DESCRIPTOR_SIZE + length;
     }
 
+    l -= p->write.index;
     pa_assert(l > 0);
+    pa_assert(n_iov > 0);
 
 #ifdef HAVE_CREDS
-    if (p->send_ancil_data_now) {
-        if (p->write_ancil_data->creds_valid) {
-            pa_assert(p->write_ancil_data->nfd == 0);
-            if ((r = pa_iochannel_write_with_creds(p->io, d, l, &p->write_ancil_data->creds)) < 0)
+    if (ancil_data) {
+        if (ancil_data->creds_valid) {
+            pa_assert(ancil_data->nfd == 0);
+            if ((r = pa_iochannel_writev_with_creds(p->io, iov, n_iov, &ancil_data->creds)) < 0)
                 goto fail;
         }
         else
-            if ((r = pa_iochannel_write_with_fds(p->io, d, l, p->write_ancil_data->nfd, p->write_ancil_data->fds)) < 0)
+            if ((r = pa_iochannel_writev_with_fds(p->io, iov, n_iov, ancil_data->nfd, ancil_data->fds)) < 0)
                 goto fail;
 
-        pa_cmsg_ancil_data_close_fds(p->write_ancil_data);
-        p->send_ancil_data_now = false;
+        pa_cmsg_ancil_data_close_fds(ancil_data);
     } else
 #endif
     if (p->srb)
-        r = pa_srbchannel_write(p->srb, d, l);
-    else if ((r = pa_iochannel_write(p->io, d, l)) < 0)
+        r = srbchannel_writev(p->srb, iov, n_iov);
+    else if ((r = pa_iochannel_writev(p->io, iov, n_iov)) < 0)
         goto fail;
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    for (k = 0; k < n_release; k++)
+        pa_memblock_release(release_memblocks[k]);
 
     p->write.index += (size_t) r;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
+    while (p->write.n > 0 && p->write.index >= write_item_length(&p->write.items[0])) {
+        struct pstream_write *w = &p->write.items[0];
+
+        p->write.index -= write_item_length(w);
 
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
+        item_free(w->current);
 
-        pa_memchunk_reset(&p->write.memchunk);
+        if (w->memchunk.memblock)
+            pa_memblock_unref(w->memchunk.memblock);
 
-        if (p->drain_callback && !pa_pstream_is_pending(p))
-            p->drain_callback(p, p->drain_callback_userdata);
+        p->write.n--;
+        memmove(p->write.items, p->write.items + 1, sizeof(struct pstream_write) * p->write.n);
+        n_done++;
     }
 
+    if (n_done > 0 && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
     return (size_t) r == l ? 1 : 0;
 
 fail:
 #ifdef HAVE_CREDS
-    if (p->send_ancil_data_now)
-        pa_cmsg_ancil_data_close_fds(p->write_ancil_data);
+    if (ancil_data)
+        pa_cmsg_ancil_data_close_fds(ancil_data);
 #endif
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    for (k = 0; k < n_release; k++)
+        pa_memblock_release(release_memblocks[k]);
 
     return -1;
 }
 
+#ifdef HAVE_CREDS
+static void read_ancil_data_update(pa_pstream *p, pa_cmsg_ancil_data *b, bool take_fds) {
+    if (b->creds_valid) {
+        p->read_ancil_data.creds_valid = true;
+        p->read_ancil_data.creds = b->creds;
+    }
+    if (take_fds && b->nfd > 0) {
+        pa_assert(b->nfd <= MAX_ANCIL_DATA_FDS);
+        p->read_ancil_data.nfd = b->nfd;
+        memcpy(p->read_ancil_data.fds, b->fds, sizeof(int) * b->nfd);
+        p->read_ancil_data.close_fds_on_cleanup = b->close_fds_on_cleanup;
+        b->nfd = 0;
+    }
+}
+#endif
+
+/* Reads up to l bytes of the frame currently received on the io
+ * channel. Short reads are served from the receive buffer, which is
+ * refilled with one large read, reads that would not fit in there go
+ * to their destination directly. */
+static ssize_t read_io(pa_pstream *p, void *d, size_t l) {
+    ssize_t r;
+
+    pa_assert(p);
+    pa_assert(d);
+    pa_assert(l > 0);
+
+    if (p->readbuf.length == 0) {
+
+        if (l >= READ_BUFFER_SIZE) {
+#ifdef HAVE_CREDS
+            pa_cmsg_ancil_data b;
+
+            if ((r = pa_iochannel_read_with_ancil_data(p->io, d, l, &b)) > 0)
+                read_ancil_data_update(p, &b, true);
+
+            return r;
+#else
+            return pa_iochannel_read(p->io, d, l);
+#endif
+        }
+
+        if (!p->readbuf.data)
+            p->readbuf.data = pa_xmalloc(READ_BUFFER_SIZE);
+
+#ifdef HAVE_CREDS
+        r = pa_iochannel_read_with_ancil_data(p->io, p->readbuf.data, READ_BUFFER_SIZE, &p->readbuf.ancil_data);
+#else
+        r = pa_iochannel_read(p->io, p->readbuf.data, READ_BUFFER_SIZE);
+#endif
+        if (r <= 0)
+            return r;
+
+        p->readbuf.index = 0;
+        p->readbuf.length = (size_t) r;
+    }
+
+    r = (ssize_t) PA_MIN(l, p->readbuf.length);
+    memcpy(d, p->readbuf.data + p->readbuf.index, (size_t) r);
+    p->readbuf.index += (size_t) r;
+    p->readbuf.length -= (size_t) r;
+
+#ifdef HAVE_CREDS
+    /* Credentials hold for everything in the buffer. Items with fds are
+     * always sent on their own, and the kernel ends a read within the
+     * message carrying them, so the fds belong to whatever frame the
+     * buffered data ends in. */
+    read_ancil_data_update(p, &p->readbuf.ancil_data, p->readbuf.length == 0);
+#endif
+
+    return r;
+}
+
 static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
     pa_memchunk chunk;
     int64_t offset;
@@ -891,29 +1064,8 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
             return 1;
         }
     }
-    else
-#ifdef HAVE_CREDS
-    {
-        pa_cmsg_ancil_data b;
-
-        if ((r = pa_iochannel_read_with_ancil_data(p->io, d, l, &b)) <= 0)
-            goto fail;
-
-        if (b.creds_valid) {
-            p->read_ancil_data.creds_valid = true;
-            p->read_ancil_data.creds = b.creds;
-        }
-        if (b.nfd > 0) {
-            pa_assert(b.nfd <= MAX_ANCIL_DATA_FDS);
-            p->read_ancil_data.nfd = b.nfd;
-            memcpy(p->read_ancil_data.fds, b.fds, sizeof(int) * b.nfd);
-            p->read_ancil_data.close_fds_on_cleanup = b.close_fds_on_cleanup;
-        }
-    }
-#else
-    if ((r = pa_iochannel_read(p->io, d, l)) <= 0)
+    else if ((r = read_io(p, d, l)) <= 0)
         goto fail;
-#endif
 
     if (release_memblock)
         pa_memblock_release(release_memblock);
@@ -1168,7 +1320,7 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     if (p->dead)
         b = false;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.n > 0 || !pa_queue_isempty(p->send_queue);
 
     return b;
 }
@@ -0,0 +1,76 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+
+#include "render-stats.h"
+
+void pa_render_stats_publish(pa_render_stats_snapshot *p, const pa_render_stats *s) {
+    pa_assert(p);
+    pa_assert(s);
+
+    /* Both increments are full barriers */
+    pa_atomic_inc(&p->seq);
+    p->stats = *s;
+    pa_atomic_inc(&p->seq);
+}
+
+void pa_render_stats_read(pa_render_stats_snapshot *p, pa_render_stats *s) {
+    int seq;
+
+    pa_assert(p);
+    pa_assert(s);
+
+    for (;;) {
+        if ((seq = pa_atomic_load(&p->seq)) & 1)
+            continue;
+
+        *s = p->stats;
+
+        /* Adding nothing, but as a full barrier it keeps the copy from
+         * being reordered past the check, which a plain load doesn't */
+        if (pa_atomic_add(&p->seq, 0) == seq)
+            return;
+    }
+}
+
+void pa_render_stats_to_proplist(const pa_render_stats *s, pa_proplist *p) {
+    pa_assert(s);
+    pa_assert(p);
+
+    pa_proplist_setf(p, PA_RENDER_STATS_PROP_CYCLES, "%" PRIu64, s->cycles);
+    pa_proplist_setf(p, PA_RENDER_STATS_PROP_TOTAL_NSEC, "%" PRIu64, s->total_nsec);
+    pa_proplist_setf(p, PA_RENDER_STATS_PROP_MAX_NSEC, "%" PRIu64, s->max_nsec);
+    pa_proplist_setf(p, PA_RENDER_STATS_PROP_RESAMPLE_NSEC, "%" PRIu64, s->resample_nsec);
+    pa_proplist_setf(p, PA_RENDER_STATS_PROP_UNDERRUNS, "%" PRIu64, s->underruns);
+}
+
+pa_proplist *pa_render_stats_proplist_copy(const pa_render_stats *s, pa_proplist *p) {
+    pa_proplist *copy;
+
+    pa_assert(s);
+    pa_assert(p);
+
+    copy = pa_proplist_copy(p);
+    pa_render_stats_to_proplist(s, copy);
+
+    return copy;
+}
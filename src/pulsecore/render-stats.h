@@ -0,0 +1,73 @@
+#ifndef foorenderstatshfoo
+#define foorenderstatshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/proplist.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/atomic.h>
+
+/* Time spent in the render path of a sink or a sink input. The counters
+ * are only touched from the IO thread, which publishes a copy of them
+ * after each cycle, see pa_render_stats_snapshot. */
+typedef struct pa_render_stats {
+    uint64_t cycles;        /* Number of render/peek calls */
+    uint64_t total_nsec;    /* Cumulative time spent in them */
+    uint64_t max_nsec;      /* Longest single call */
+    uint64_t resample_nsec; /* Part of total_nsec spent resampling */
+    uint64_t underruns;     /* Cycles that found no data to play */
+} pa_render_stats;
+
+/* The copy of the counters the main thread reads, without a round trip to
+ * the IO thread. This is a sequence lock: seq is odd while the IO thread is
+ * writing, and a reader retries if seq moved while it was copying. There
+ * is only ever one writer. */
+typedef struct pa_render_stats_snapshot {
+    pa_atomic_t seq;
+    pa_render_stats stats;
+} pa_render_stats_snapshot;
+
+/* Not stored in the proplist of the object, they are added to the copy of
+ * it that goes out in info replies and listings */
+#define PA_RENDER_STATS_PROP_CYCLES "render.cycles"
+#define PA_RENDER_STATS_PROP_TOTAL_NSEC "render.total_nsec"
+#define PA_RENDER_STATS_PROP_MAX_NSEC "render.max_nsec"
+#define PA_RENDER_STATS_PROP_RESAMPLE_NSEC "render.resample_nsec"
+#define PA_RENDER_STATS_PROP_UNDERRUNS "render.underruns"
+
+static inline void pa_render_stats_account(pa_render_stats *s, uint64_t nsec) {
+    s->cycles++;
+    s->total_nsec += nsec;
+
+    if (nsec > s->max_nsec)
+        s->max_nsec = nsec;
+}
+
+/* Called from the IO thread that owns s */
+void pa_render_stats_publish(pa_render_stats_snapshot *p, const pa_render_stats *s);
+/* Called from any other thread */
+void pa_render_stats_read(pa_render_stats_snapshot *p, pa_render_stats *s);
+
+void pa_render_stats_to_proplist(const pa_render_stats *s, pa_proplist *p);
+/* Returns a copy of p with the counters added, to be freed by the caller */
+pa_proplist *pa_render_stats_proplist_copy(const pa_render_stats *s, pa_proplist *p);
+
+#endif
@@ -24,9 +24,16 @@
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define USE_EPOLL
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
@@ -36,6 +43,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ratelimit.h>
 #include <pulse/rtclock.h>
@@ -45,7 +53,8 @@
 /* #define DEBUG_TIMING */
 
 struct pa_rtpoll {
-    struct pollfd *pollfd, *pollfd2;
+    /* The pollfds of all items gathered for poll() */
+    struct pollfd *pollfd;
     unsigned n_pollfd_alloc, n_pollfd_used;
 
     struct timeval next_elapse;
@@ -53,10 +62,33 @@ struct pa_rtpoll {
 
     bool scan_for_dead:1;
     bool running:1;
-    bool rebuild_needed:1;
     bool quit:1;
     bool timer_elapsed:1;
 
+#ifdef USE_EPOLL
+    /* If epoll_fd is valid, the item pollfds are registered with it
+     * instead of being passed to poll(), and the timer is programmed
+     * into timer_fd */
+    int epoll_fd, timer_fd;
+    struct timeval timer_fd_elapse;
+    bool timer_fd_armed:1;
+    struct epoll_event *epoll_events;
+    unsigned n_epoll_events_alloc;
+
+    /* The pollfds whose revents were set by the last epoll_wait() */
+    struct pollfd **dirty;
+    unsigned n_dirty, n_dirty_alloc;
+
+    /* The live items by id, to look up what epoll wakes us up for */
+    pa_hashmap *epoll_items;
+    uint32_t next_item_id;
+
+    /* epoll reported a registration that outlived its pollfd */
+    bool epoll_stale:1;
+#endif
+
+    pa_rtpoll_stats stats;
+
 #ifdef DEBUG_TIMING
     pa_usec_t timestamp;
     pa_usec_t slept, awake;
@@ -65,15 +97,38 @@ struct pa_rtpoll {
     PA_LLIST_HEAD(pa_rtpoll_item, items);
 };
 
+#ifdef USE_EPOLL
+/* What is registered with epoll for a pollfd, fd -1 for nothing. The
+ * serial tells apart the registrations a pollfd had over time. */
+struct registration {
+    int fd;
+    short events;
+    uint16_t serial;
+};
+
+/* The epoll data of a pollfd: its item, its index in the item and its
+ * registration. Wakeups are checked against the live items with it, so
+ * a registration that outlived its pollfd, because the fd was closed
+ * while the file stayed open elsewhere, cannot touch freed memory. Zero
+ * is the timer, item ids start at one. */
+#define EPOLL_KEY(id, serial, k) (((uint64_t) (id) << 32) | ((uint64_t) (serial) << 16) | (uint64_t) (k))
+#endif
+
 struct pa_rtpoll_item {
     pa_rtpoll *rtpoll;
     bool dead;
 
     pa_rtpoll_priority_t priority;
 
+    /* Owned by the item, so adding and removing items is cheap */
     struct pollfd *pollfd;
     unsigned n_pollfd;
 
+#ifdef USE_EPOLL
+    uint32_t id;
+    struct registration *registered;
+#endif
+
     int (*work_cb)(pa_rtpoll_item *i);
     int (*before_cb)(pa_rtpoll_item *i);
     void (*after_cb)(pa_rtpoll_item *i);
@@ -86,65 +141,239 @@ struct pa_rtpoll_item {
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
-pa_rtpoll *pa_rtpoll_new(void) {
-    pa_rtpoll *p;
-
-    p = pa_xnew0(pa_rtpoll, 1);
+#ifdef USE_EPOLL
+static void epoll_done(pa_rtpoll *p) {
+    unsigned k;
 
-    p->n_pollfd_alloc = 32;
-    p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
-    p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
+    for (k = 0; k < p->n_dirty; k++)
+        p->dirty[k]->revents = 0;
+    p->n_dirty = 0;
 
-#ifdef DEBUG_TIMING
-    p->timestamp = pa_rtclock_now();
-#endif
+    if (p->timer_fd >= 0) {
+        pa_close(p->timer_fd);
+        p->timer_fd = -1;
+    }
 
-    return p;
+    if (p->epoll_fd >= 0) {
+        pa_close(p->epoll_fd);
+        p->epoll_fd = -1;
+    }
 }
 
-static void rtpoll_rebuild(pa_rtpoll *p) {
+static void epoll_init(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    /* The pollfd flags are passed through to epoll as they are */
+    pa_assert_cc(EPOLLIN == POLLIN);
+    pa_assert_cc(EPOLLPRI == POLLPRI);
+    pa_assert_cc(EPOLLOUT == POLLOUT);
+    pa_assert_cc(EPOLLERR == POLLERR);
+    pa_assert_cc(EPOLLHUP == POLLHUP);
+
+    p->epoll_fd = p->timer_fd = -1;
+
+    if (getenv("PULSE_RTPOLL_NO_EPOLL"))
+        return;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        goto fail;
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0)
+        goto fail;
 
-    struct pollfd *e, *t;
+    return;
+
+fail:
+    pa_log_debug("Not using epoll: %s", pa_cstrerror(errno));
+    epoll_done(p);
+}
+
+/* Brings the epoll registrations in line with what the item owners
+ * put into their pollfds since the last run. That is a comparison per
+ * pollfd, system calls are only made for the ones that changed. */
+static int epoll_sync(pa_rtpoll *p) {
     pa_rtpoll_item *i;
-    int ra = 0;
+    struct epoll_event ev;
+    unsigned k;
 
-    pa_assert(p);
+    for (i = p->items; i; i = i->next) {
 
-    p->rebuild_needed = false;
+        if (i->dead)
+            continue;
 
-    if (p->n_pollfd_used > p->n_pollfd_alloc) {
-        /* Hmm, we have to allocate some more space */
-        p->n_pollfd_alloc = p->n_pollfd_used * 2;
-        p->pollfd2 = pa_xrealloc(p->pollfd2, p->n_pollfd_alloc * sizeof(struct pollfd));
-        ra = 1;
+        for (k = 0; k < i->n_pollfd; k++) {
+            struct pollfd *f = &i->pollfd[k];
+            struct registration *r = &i->registered[k];
+            int op;
+
+            if (f->fd == r->fd && f->events == r->events)
+                continue;
+
+            if (r->fd >= 0 && r->fd != f->fd) {
+                /* Fails if the fd was closed already, nothing to do then */
+                (void) epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, r->fd, NULL);
+                r->fd = -1;
+            }
+
+            if (f->fd >= 0) {
+                op = r->fd == f->fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+                if (op == EPOLL_CTL_ADD)
+                    r->serial++;
+
+                pa_zero(ev);
+                ev.events = (uint32_t) f->events;
+                ev.data.u64 = EPOLL_KEY(i->id, r->serial, k);
+
+                if (epoll_ctl(p->epoll_fd, op, f->fd, &ev) < 0) {
+                    /* The fd was closed and reopened since, the old
+                     * registration may live on with the old file */
+                    bool reopened = op == EPOLL_CTL_MOD && errno == ENOENT;
+
+                    if (reopened) {
+                        r->serial++;
+                        ev.data.u64 = EPOLL_KEY(i->id, r->serial, k);
+                    }
+
+                    if (!reopened || epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev) < 0) {
+                        /* E.g. the same fd in two pollfds, or a regular file */
+                        pa_log_debug("Falling back to poll(), epoll_ctl() failed for fd %d: %s", f->fd, pa_cstrerror(errno));
+                        return -1;
+                    }
+                }
+            }
+
+            r->fd = f->fd;
+            r->events = f->events;
+        }
     }
 
-    e = p->pollfd2;
+    return 0;
+}
 
-    for (i = p->items; i; i = i->next) {
+static void epoll_unregister(pa_rtpoll_item *i) {
+    pa_rtpoll *p = i->rtpoll;
+    unsigned k;
+
+    for (k = 0; k < i->n_pollfd; k++)
+        if (i->registered[k].fd >= 0) {
+            (void) epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, i->registered[k].fd, NULL);
+            i->registered[k].fd = -1;
+        }
 
-        if (i->n_pollfd > 0) {
-            size_t l = i->n_pollfd * sizeof(struct pollfd);
+    /* Forget about the revents we set on this item */
+    for (k = 0; k < p->n_dirty; k++)
+        if (p->dirty[k] >= i->pollfd && p->dirty[k] < i->pollfd + i->n_pollfd)
+            p->dirty[k--] = p->dirty[--p->n_dirty];
+}
 
-            if (i->pollfd)
-                memcpy(e, i->pollfd, l);
-            else
-                memset(e, 0, l);
+static int epoll_wait_events(pa_rtpoll *p) {
+    int timeout = -1, n, r = 0, k;
 
-            i->pollfd = e;
-        } else
-            i->pollfd = NULL;
+    for (k = 0; k < (int) p->n_dirty; k++)
+        p->dirty[k]->revents = 0;
+    p->n_dirty = 0;
 
-        e += i->n_pollfd;
+    if (p->quit)
+        timeout = 0;
+    else if (p->timer_enabled) {
+        if (!p->timer_fd_armed || pa_timeval_cmp(&p->timer_fd_elapse, &p->next_elapse) != 0) {
+            struct itimerspec its;
+
+            pa_zero(its);
+            its.it_value.tv_sec = p->next_elapse.tv_sec;
+            its.it_value.tv_nsec = p->next_elapse.tv_usec * 1000;
+
+            /* A zero it_value would disarm the timer */
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1;
+
+            pa_assert_se(timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+            p->timer_fd_elapse = p->next_elapse;
+            p->timer_fd_armed = true;
+        }
+    } else if (p->timer_fd_armed) {
+        struct itimerspec its;
+
+        pa_zero(its);
+        pa_assert_se(timerfd_settime(p->timer_fd, 0, &its, NULL) == 0);
+        p->timer_fd_armed = false;
     }
 
-    pa_assert((unsigned) (e - p->pollfd2) == p->n_pollfd_used);
-    t = p->pollfd;
-    p->pollfd = p->pollfd2;
-    p->pollfd2 = t;
+    if (p->n_epoll_events_alloc < p->n_pollfd_used + 1) {
+        p->n_epoll_events_alloc = (p->n_pollfd_used + 1) * 2;
+        p->epoll_events = pa_xrealloc(p->epoll_events, p->n_epoll_events_alloc * sizeof(struct epoll_event));
+        p->dirty = pa_xrealloc(p->dirty, p->n_epoll_events_alloc * sizeof(struct pollfd*));
+    }
 
-    if (ra)
-        p->pollfd2 = pa_xrealloc(p->pollfd2, p->n_pollfd_alloc * sizeof(struct pollfd));
+    if ((n = epoll_wait(p->epoll_fd, p->epoll_events, (int) p->n_epoll_events_alloc, timeout)) < 0)
+        return n;
+
+    for (k = 0; k < n; k++) {
+        uint64_t key = p->epoll_events[k].data.u64;
+        pa_rtpoll_item *i;
+        unsigned slot = (unsigned) (key & 0xffff);
+        struct pollfd *f;
+
+        if (key == 0) {
+            uint64_t expirations;
+
+            /* The timer doesn't count as a ready fd, just like a poll()
+             * timeout */
+            if (read(p->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                p->timer_fd_armed = false;
+            continue;
+        }
+
+        if (!(i = pa_hashmap_get(p->epoll_items, PA_UINT32_TO_PTR((uint32_t) (key >> 32)))) ||
+            slot >= i->n_pollfd ||
+            i->registered[slot].fd < 0 ||
+            i->registered[slot].serial != (uint16_t) (key >> 16)) {
+
+            /* Only closing the epoll fd gets rid of such a registration */
+            if (!p->epoll_stale)
+                pa_log_debug("Falling back to poll(), epoll reported an fd that was closed without removing it first");
+            p->epoll_stale = true;
+            continue;
+        }
+
+        f = &i->pollfd[slot];
+        f->revents = (short) p->epoll_events[k].events;
+        p->dirty[p->n_dirty++] = f;
+        r++;
+    }
+
+    /* Don't take a wakeup for nothing as the timer */
+    if (r == 0 && p->epoll_stale) {
+        errno = EINTR;
+        return -1;
+    }
+
+    return r;
+}
+#endif
+
+pa_rtpoll *pa_rtpoll_new(void) {
+    pa_rtpoll *p;
+
+    p = pa_xnew0(pa_rtpoll, 1);
+
+    p->n_pollfd_alloc = 32;
+    p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
+
+#ifdef USE_EPOLL
+    p->epoll_items = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    epoll_init(p);
+#endif
+
+#ifdef DEBUG_TIMING
+    p->timestamp = pa_rtclock_now();
+#endif
+
+    return p;
 }
 
 static void rtpoll_item_destroy(pa_rtpoll_item *i) {
@@ -154,14 +383,21 @@ static void rtpoll_item_destroy(pa_rtpoll_item *i) {
 
     p = i->rtpoll;
 
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0)
+        epoll_unregister(i);
+
+    pa_hashmap_remove(p->epoll_items, PA_UINT32_TO_PTR(i->id));
+    pa_xfree(i->registered);
+#endif
+
     PA_LLIST_REMOVE(pa_rtpoll_item, p->items, i);
 
     p->n_pollfd_used -= i->n_pollfd;
+    pa_xfree(i->pollfd);
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(items), i) < 0)
         pa_xfree(i);
-
-    p->rebuild_needed = true;
 }
 
 void pa_rtpoll_free(pa_rtpoll *p) {
@@ -171,11 +407,61 @@ void pa_rtpoll_free(pa_rtpoll *p) {
         rtpoll_item_destroy(p->items);
 
     pa_xfree(p->pollfd);
-    pa_xfree(p->pollfd2);
+
+#ifdef USE_EPOLL
+    epoll_done(p);
+    pa_hashmap_free(p->epoll_items);
+    pa_xfree(p->epoll_events);
+    pa_xfree(p->dirty);
+#endif
 
     pa_xfree(p);
 }
 
+/* Runs poll() on the pollfds of all items */
+static int poll_events(pa_rtpoll *p, const struct timeval *timeout) {
+    struct pollfd *e;
+    pa_rtpoll_item *i;
+    int r;
+
+    if (p->n_pollfd_used > p->n_pollfd_alloc) {
+        p->n_pollfd_alloc = p->n_pollfd_used * 2;
+        p->pollfd = pa_xrealloc(p->pollfd, p->n_pollfd_alloc * sizeof(struct pollfd));
+    }
+
+    e = p->pollfd;
+    for (i = p->items; i; i = i->next) {
+        if (i->n_pollfd > 0)
+            memcpy(e, i->pollfd, i->n_pollfd * sizeof(struct pollfd));
+        e += i->n_pollfd;
+    }
+
+#ifdef HAVE_PPOLL
+    {
+        struct timespec ts;
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_usec * 1000;
+        r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
+    }
+#else
+    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout->tv_sec*1000) + (timeout->tv_usec / 1000)) : -1);
+#endif
+
+    if (r < 0)
+        return r;
+
+    e = p->pollfd;
+    for (i = p->items; i; i = i->next) {
+        unsigned k;
+
+        for (k = 0; k < i->n_pollfd; k++)
+            i->pollfd[k].revents = e[k].revents;
+        e += i->n_pollfd;
+    }
+
+    return r;
+}
+
 static void reset_revents(pa_rtpoll_item *i) {
     struct pollfd *f;
     unsigned n;
@@ -217,6 +503,7 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 
     p->running = true;
     p->timer_elapsed = false;
+    p->stats.runs++;
 
     /* First, let's do some work */
     for (i = p->items; i && i->priority < PA_RTPOLL_NEVER; i = i->next) {
@@ -238,6 +525,7 @@ int pa_rtpoll_run(pa_rtpoll *p) {
         if ((k = i->work_cb(i)) != 0) {
             if (k < 0)
                 r = k;
+            p->stats.work++;
 #ifdef DEBUG_TIMING
             pa_log("rtpoll finish");
 #endif
@@ -272,6 +560,8 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 
             if (k < 0)
                 r = k;
+            if (!p->quit)
+                p->stats.before++;
 #ifdef DEBUG_TIMING
             pa_log("rtpoll finish");
 #endif
@@ -279,9 +569,6 @@ int pa_rtpoll_run(pa_rtpoll *p) {
         }
     }
 
-    if (p->rebuild_needed)
-        rtpoll_rebuild(p);
-
     pa_zero(timeout);
 
     /* Calculate timeout */
@@ -308,19 +595,23 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
-#ifdef HAVE_PPOLL
-    {
-        struct timespec ts;
-        ts.tv_sec = timeout.tv_sec;
-        ts.tv_nsec = timeout.tv_usec * 1000;
-        r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
-    }
-#else
-    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0 && (p->epoll_stale || epoll_sync(p) < 0))
+        epoll_done(p);
+
+    if (p->epoll_fd >= 0)
+        r = epoll_wait_events(p);
+    else
 #endif
+        r = poll_events(p, &timeout);
 
     p->timer_elapsed = r == 0;
 
+    if (r > 0)
+        p->stats.fds++;
+    else if (r == 0 && !p->quit)
+        p->stats.timer++;
+
 #ifdef DEBUG_TIMING
     {
         pa_usec_t now = pa_rtclock_now();
@@ -334,9 +625,10 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     if (r < 0) {
-        if (errno == EAGAIN || errno == EINTR)
+        if (errno == EAGAIN || errno == EINTR) {
             r = 0;
-        else
+            p->stats.interrupted++;
+        } else
             pa_log_error("poll(): %s", pa_cstrerror(errno));
 
         reset_all_revents(p);
@@ -413,6 +705,32 @@ pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsi
     i->pollfd = NULL;
     i->priority = prio;
 
+#ifdef USE_EPOLL
+    pa_assert(n_fds <= 0xffff);
+
+    /* Ids are only reused when the counter wraps, so a stale key
+     * doesn't match a later item */
+    if (++p->next_item_id == 0)
+        p->next_item_id = 1;
+    i->id = p->next_item_id;
+    i->registered = NULL;
+    pa_assert_se(pa_hashmap_put(p->epoll_items, PA_UINT32_TO_PTR(i->id), i) == 0);
+#endif
+
+    if (n_fds > 0) {
+        i->pollfd = pa_xnew0(struct pollfd, n_fds);
+
+#ifdef USE_EPOLL
+        {
+            unsigned k;
+
+            i->registered = pa_xnew0(struct registration, n_fds);
+            for (k = 0; k < n_fds; k++)
+                i->registered[k].fd = -1;
+        }
+#endif
+    }
+
     i->work_userdata = NULL;
     i->before_userdata = NULL;
     i->work_userdata = NULL;
@@ -429,10 +747,7 @@ pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsi
 
     PA_LLIST_INSERT_AFTER(pa_rtpoll_item, p->items, j ? j->prev : l, i);
 
-    if (n_fds > 0) {
-        p->rebuild_needed = 1;
-        p->n_pollfd_used += n_fds;
-    }
+    p->n_pollfd_used += n_fds;
 
     return i;
 }
@@ -452,10 +767,6 @@ void pa_rtpoll_item_free(pa_rtpoll_item *i) {
 struct pollfd *pa_rtpoll_item_get_pollfd(pa_rtpoll_item *i, unsigned *n_fds) {
     pa_assert(i);
 
-    if (i->n_pollfd > 0)
-        if (i->rtpoll->rebuild_needed)
-            rtpoll_rebuild(i->rtpoll);
-
     if (n_fds)
         *n_fds = i->n_pollfd;
 
@@ -543,18 +854,27 @@ static void asyncmsgq_read_after(pa_rtpoll_item *i) {
     pa_asyncmsgq_read_after_poll(i->after_userdata);
 }
 
+/* Dispatch up to this many messages per loop iteration instead of
+ * restarting the loop after every single one */
+#define ASYNCMSGQ_WORK_BATCH 32
+
 static int asyncmsgq_read_work(pa_rtpoll_item *i) {
     pa_msgobject *object;
     int code;
     void *data;
     pa_memchunk chunk;
     int64_t offset;
+    unsigned n;
 
     pa_assert(i);
 
-    if (pa_asyncmsgq_get(i->work_userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
+    /* A message may remove this very item, stop dispatching once it is dead */
+    for (n = 0; n < ASYNCMSGQ_WORK_BATCH && !i->dead; n++) {
         int ret;
 
+        if (pa_asyncmsgq_get(i->work_userdata, &object, &code, &data, &offset, &chunk, 0) < 0)
+            break;
+
         if (!object && code == PA_MESSAGE_SHUTDOWN) {
             pa_asyncmsgq_done(i->work_userdata, 0);
             /* Requests the loop to exit. Will cause the next iteration of
@@ -565,10 +885,9 @@ static int asyncmsgq_read_work(pa_rtpoll_item *i) {
 
         ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
         pa_asyncmsgq_done(i->work_userdata, ret);
-        return 1;
     }
 
-    return 0;
+    return n > 0;
 }
 
 pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
@@ -629,3 +948,10 @@ bool pa_rtpoll_timer_elapsed(pa_rtpoll *p) {
 
     return p->timer_elapsed;
 }
+
+void pa_rtpoll_get_stats(pa_rtpoll *p, pa_rtpoll_stats *stats) {
+    pa_assert(p);
+    pa_assert(stats);
+
+    *stats = p->stats;
+}
@@ -39,7 +39,9 @@
  * 3) It allows arbitrary functions to be run before entering the
  * actual poll() and after it.
  *
- * Only a single interval timer is supported. */
+ * Only a single interval timer is supported. Where available the fds
+ * are watched with epoll and the timer is a timerfd, so that the cost
+ * of a wakeup doesn't grow with the number of fds. */
 
 typedef struct pa_rtpoll pa_rtpoll;
 typedef struct pa_rtpoll_item pa_rtpoll_item;
@@ -68,6 +70,19 @@ void pa_rtpoll_set_timer_disabled(pa_rtpoll *p);
  * the last pa_rtpoll_run() invocation to finish */
 bool pa_rtpoll_timer_elapsed(pa_rtpoll *p);
 
+/* Why pa_rtpoll_run() returned, counted since the rtpoll was created */
+typedef struct pa_rtpoll_stats {
+    uint64_t runs;
+    uint64_t work;        /* A work callback asked for another iteration */
+    uint64_t before;      /* A before callback didn't let the loop sleep */
+    uint64_t timer;       /* Woken up by the timer */
+    uint64_t fds;         /* Woken up by at least one fd */
+    uint64_t interrupted; /* The sleep was interrupted by a signal */
+} pa_rtpoll_stats;
+
+/* To be called from the thread running the rtpoll */
+void pa_rtpoll_get_stats(pa_rtpoll *p, pa_rtpoll_stats *stats);
+
 /* A new fd wakeup item for pa_rtpoll */
 pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsigned n_fds);
 void pa_rtpoll_item_free(pa_rtpoll_item *i);
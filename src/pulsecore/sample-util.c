@@ -121,16 +121,10 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) {
     return l % fs == 0;
 }
 
-void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
+static void interleave_generic(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
     unsigned c;
     size_t fs;
 
-    pa_assert(src);
-    pa_assert(channels > 0);
-    pa_assert(dst);
-    pa_assert(ss > 0);
-    pa_assert(n > 0);
-
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -149,16 +143,10 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
     }
 }
 
-void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n) {
+static void deinterleave_generic(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n) {
     size_t fs;
     unsigned c;
 
-    pa_assert(src);
-    pa_assert(dst);
-    pa_assert(channels > 0);
-    pa_assert(ss > 0);
-    pa_assert(n > 0);
-
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -177,6 +165,242 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
     }
 }
 
+/* The channel count is a compile time constant in each of the functions
+ * below, which lets the compiler unroll the inner loop and keep all plane
+ * pointers in registers. */
+
+#define DEFINE_INTERLEAVE(type, bits)                                   \
+static inline void interleave_##bits(const void *src[], unsigned channels, void *dst, unsigned n) { \
+    type *d = dst;                                                      \
+    unsigned i, c;                                                      \
+                                                                        \
+    for (i = 0; i < n; i++)                                             \
+        for (c = 0; c < channels; c++)                                  \
+            *(d++) = ((const type *) src[c])[i];                        \
+}                                                                       \
+                                                                        \
+static inline void deinterleave_##bits(const void *src, void *dst[], unsigned channels, unsigned n) { \
+    const type *s = src;                                                \
+    unsigned i, c;                                                      \
+                                                                        \
+    for (i = 0; i < n; i++)                                             \
+        for (c = 0; c < channels; c++)                                  \
+            ((type *) dst[c])[i] = *(s++);                              \
+}
+
+DEFINE_INTERLEAVE(uint16_t, 16)
+DEFINE_INTERLEAVE(uint32_t, 32)
+
+static inline void interleave_to_s16ne(const float *src[], unsigned channels, int16_t *dst, unsigned n) {
+    unsigned i, c;
+
+    for (i = 0; i < n; i++)
+        for (c = 0; c < channels; c++) {
+            float v = src[c][i] * (1 << 15);
+            *(dst++) = (int16_t) PA_CLAMP_UNLIKELY(lrintf(v), -0x8000, 0x7FFF);
+        }
+}
+
+static inline void deinterleave_to_float32ne(const int16_t *src, float *dst[], unsigned channels, unsigned n) {
+    unsigned i, c;
+
+    for (i = 0; i < n; i++)
+        for (c = 0; c < channels; c++)
+            dst[c][i] = *(src++) * (1.0f / (1 << 15));
+}
+
+#define DEFINE_INTERLEAVE_CHANNELS(c)                                   \
+static void interleave_16_##c(const void *src[], void *dst, unsigned n) { \
+    interleave_16(src, c, dst, n);                                      \
+}                                                                       \
+static void interleave_32_##c(const void *src[], void *dst, unsigned n) { \
+    interleave_32(src, c, dst, n);                                      \
+}                                                                       \
+static void deinterleave_16_##c(const void *src, void *dst[], unsigned n) { \
+    deinterleave_16(src, dst, c, n);                                    \
+}                                                                       \
+static void deinterleave_32_##c(const void *src, void *dst[], unsigned n) { \
+    deinterleave_32(src, dst, c, n);                                    \
+}                                                                       \
+static void interleave_to_s16ne_##c(const float *src[], int16_t *dst, unsigned n) { \
+    interleave_to_s16ne(src, c, dst, n);                                \
+}                                                                       \
+static void deinterleave_to_float32ne_##c(const int16_t *src, float *dst[], unsigned n) { \
+    deinterleave_to_float32ne(src, dst, c, n);                          \
+}
+
+DEFINE_INTERLEAVE_CHANNELS(1)
+DEFINE_INTERLEAVE_CHANNELS(2)
+DEFINE_INTERLEAVE_CHANNELS(3)
+DEFINE_INTERLEAVE_CHANNELS(4)
+DEFINE_INTERLEAVE_CHANNELS(5)
+DEFINE_INTERLEAVE_CHANNELS(6)
+DEFINE_INTERLEAVE_CHANNELS(7)
+DEFINE_INTERLEAVE_CHANNELS(8)
+
+#define CHANNEL_TABLE(prefix) {                                         \
+    prefix##1, prefix##2, prefix##3, prefix##4,                         \
+    prefix##5, prefix##6, prefix##7, prefix##8,                         \
+}
+
+/* Indexed by sample size (2 or 4 bytes) and channel count - 1 */
+static pa_interleave_func_t interleave_table[2][PA_INTERLEAVE_CHANNELS_MAX] = {
+    CHANNEL_TABLE(interleave_16_),
+    CHANNEL_TABLE(interleave_32_),
+};
+
+static pa_deinterleave_func_t deinterleave_table[2][PA_INTERLEAVE_CHANNELS_MAX] = {
+    CHANNEL_TABLE(deinterleave_16_),
+    CHANNEL_TABLE(deinterleave_32_),
+};
+
+static pa_interleave_to_s16ne_func_t interleave_to_s16ne_table[PA_INTERLEAVE_CHANNELS_MAX] =
+    CHANNEL_TABLE(interleave_to_s16ne_);
+
+static pa_deinterleave_to_float32ne_func_t deinterleave_to_float32ne_table[PA_INTERLEAVE_CHANNELS_MAX] =
+    CHANNEL_TABLE(deinterleave_to_float32ne_);
+
+static int interleave_table_index(size_t ss) {
+    switch (ss) {
+        case 2:
+            return 0;
+        case 4:
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss, unsigned channels) {
+    int k;
+
+    if (channels < 1 || channels > PA_INTERLEAVE_CHANNELS_MAX)
+        return NULL;
+
+    if ((k = interleave_table_index(ss)) < 0)
+        return NULL;
+
+    return interleave_table[k][channels - 1];
+}
+
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss, unsigned channels) {
+    int k;
+
+    if (channels < 1 || channels > PA_INTERLEAVE_CHANNELS_MAX)
+        return NULL;
+
+    if ((k = interleave_table_index(ss)) < 0)
+        return NULL;
+
+    return deinterleave_table[k][channels - 1];
+}
+
+pa_interleave_to_s16ne_func_t pa_get_interleave_to_s16ne_func(unsigned channels) {
+    if (channels < 1 || channels > PA_INTERLEAVE_CHANNELS_MAX)
+        return NULL;
+
+    return interleave_to_s16ne_table[channels - 1];
+}
+
+pa_deinterleave_to_float32ne_func_t pa_get_deinterleave_to_float32ne_func(unsigned channels) {
+    if (channels < 1 || channels > PA_INTERLEAVE_CHANNELS_MAX)
+        return NULL;
+
+    return deinterleave_to_float32ne_table[channels - 1];
+}
+
+void pa_set_interleave_func(size_t ss, unsigned channels, pa_interleave_func_t func) {
+    int k;
+
+    pa_assert(channels >= 1 && channels <= PA_INTERLEAVE_CHANNELS_MAX);
+    pa_assert_se((k = interleave_table_index(ss)) >= 0);
+    pa_assert(func);
+
+    interleave_table[k][channels - 1] = func;
+}
+
+void pa_set_deinterleave_func(size_t ss, unsigned channels, pa_deinterleave_func_t func) {
+    int k;
+
+    pa_assert(channels >= 1 && channels <= PA_INTERLEAVE_CHANNELS_MAX);
+    pa_assert_se((k = interleave_table_index(ss)) >= 0);
+    pa_assert(func);
+
+    deinterleave_table[k][channels - 1] = func;
+}
+
+void pa_set_interleave_to_s16ne_func(unsigned channels, pa_interleave_to_s16ne_func_t func) {
+    pa_assert(channels >= 1 && channels <= PA_INTERLEAVE_CHANNELS_MAX);
+    pa_assert(func);
+
+    interleave_to_s16ne_table[channels - 1] = func;
+}
+
+void pa_set_deinterleave_to_float32ne_func(unsigned channels, pa_deinterleave_to_float32ne_func_t func) {
+    pa_assert(channels >= 1 && channels <= PA_INTERLEAVE_CHANNELS_MAX);
+    pa_assert(func);
+
+    deinterleave_to_float32ne_table[channels - 1] = func;
+}
+
+void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
+    pa_interleave_func_t func;
+
+    pa_assert(src);
+    pa_assert(channels > 0);
+    pa_assert(dst);
+    pa_assert(ss > 0);
+    pa_assert(n > 0);
+
+    if ((func = pa_get_interleave_func(ss, channels)))
+        func(src, dst, n);
+    else
+        interleave_generic(src, channels, dst, ss, n);
+}
+
+void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n) {
+    pa_deinterleave_func_t func;
+
+    pa_assert(src);
+    pa_assert(dst);
+    pa_assert(channels > 0);
+    pa_assert(ss > 0);
+    pa_assert(n > 0);
+
+    if ((func = pa_get_deinterleave_func(ss, channels)))
+        func(src, dst, n);
+    else
+        deinterleave_generic(src, dst, channels, ss, n);
+}
+
+void pa_interleave_float32ne_to_s16ne(const float *src[], unsigned channels, int16_t *dst, unsigned n) {
+    pa_interleave_to_s16ne_func_t func;
+
+    pa_assert(src);
+    pa_assert(channels > 0);
+    pa_assert(dst);
+    pa_assert(n > 0);
+
+    if ((func = pa_get_interleave_to_s16ne_func(channels)))
+        func(src, dst, n);
+    else
+        interleave_to_s16ne(src, channels, dst, n);
+}
+
+void pa_deinterleave_s16ne_to_float32ne(const int16_t *src, float *dst[], unsigned channels, unsigned n) {
+    pa_deinterleave_to_float32ne_func_t func;
+
+    pa_assert(src);
+    pa_assert(dst);
+    pa_assert(channels > 0);
+    pa_assert(n > 0);
+
+    if ((func = pa_get_deinterleave_to_float32ne_func(channels)))
+        func(src, dst, n);
+    else
+        deinterleave_to_float32ne(src, dst, channels, n);
+}
+
 static pa_memblock *silence_memblock_new(pa_mempool *pool, uint8_t c) {
     pa_memblock *b;
     size_t length;
@@ -52,6 +52,30 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) PA_GCC_PURE;
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n);
 void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n);
 
+/* Interleave float32ne planes into s16ne frames and vice versa, converting
+ * the samples on the fly. */
+void pa_interleave_float32ne_to_s16ne(const float *src[], unsigned channels, int16_t *dst, unsigned n);
+void pa_deinterleave_s16ne_to_float32ne(const int16_t *src, float *dst[], unsigned channels, unsigned n);
+
+/* Specialized kernels exist for 2 and 4 byte samples with up to this many
+ * channels, everything else takes the generic path */
+#define PA_INTERLEAVE_CHANNELS_MAX 8
+
+typedef void (*pa_interleave_func_t)(const void *src[], void *dst, unsigned n);
+typedef void (*pa_deinterleave_func_t)(const void *src, void *dst[], unsigned n);
+typedef void (*pa_interleave_to_s16ne_func_t)(const float *src[], int16_t *dst, unsigned n);
+typedef void (*pa_deinterleave_to_float32ne_func_t)(const int16_t *src, float *dst[], unsigned n);
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss, unsigned channels) PA_GCC_PURE;
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss, unsigned channels) PA_GCC_PURE;
+pa_interleave_to_s16ne_func_t pa_get_interleave_to_s16ne_func(unsigned channels) PA_GCC_PURE;
+pa_deinterleave_to_float32ne_func_t pa_get_deinterleave_to_float32ne_func(unsigned channels) PA_GCC_PURE;
+
+void pa_set_interleave_func(size_t ss, unsigned channels, pa_interleave_func_t func);
+void pa_set_deinterleave_func(size_t ss, unsigned channels, pa_deinterleave_func_t func);
+void pa_set_interleave_to_s16ne_func(unsigned channels, pa_interleave_to_s16ne_func_t func);
+void pa_set_deinterleave_to_float32ne_func(unsigned channels, pa_deinterleave_to_float32ne_func_t func);
+
 void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n);
 
 static inline int32_t pa_mult_s16_volume(int16_t v, int32_t cv) {
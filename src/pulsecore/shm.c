@@ -344,6 +344,24 @@ void pa_shm_punch(pa_shm *m, size_t offset, size_t size) {
 #endif
 }
 
+void pa_shm_advise_hugepages(pa_shm *m) {
+    pa_assert(m);
+    pa_assert(m->ptr);
+    pa_assert(m->size > 0);
+
+    /* Transparent huge pages work both for anonymous private memory
+     * and, if enabled in the kernel's shmem_enabled setting, for POSIX
+     * SHM and memfd backed areas. This is purely a hint, and a NOOP
+     * where it is not supported. */
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(m->ptr, PA_PAGE_ALIGN(m->size), MADV_HUGEPAGE) < 0)
+        pa_log_debug("madvise(MADV_HUGEPAGE) failed: %s", pa_cstrerror(errno));
+    else
+        pa_log_debug("Using transparent huge pages for %s memory area.", pa_mem_type_to_string(m->type));
+#endif
+}
+
 static int shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable, bool for_cleanup) {
 #if defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD)
     char fn[32];
@@ -419,6 +437,38 @@ fail:
     return -1;
 }
 
+/* Maps a memfd region owned by someone else for reading and writing, with a
+ * new ID. A duplicate of @memfd_fd is kept, the caller keeps ownership of
+ * the passed fd. Like with pa_shm_create_rw(), m->fd is open until it is
+ * passed to the other PA endpoint. */
+int pa_shm_create_from_memfd(pa_shm *m, int memfd_fd) {
+#ifdef HAVE_MEMFD
+    int fd;
+    unsigned id;
+
+    pa_assert(m);
+    pa_assert(memfd_fd >= 0);
+
+    if ((fd = fcntl(memfd_fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        pa_log("fcntl(F_DUPFD_CLOEXEC) failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    pa_random(&id, sizeof(id));
+
+    if (shm_attach(m, PA_MEM_TYPE_SHARED_MEMFD, id, fd, true, false) < 0) {
+        pa_close(fd);
+        return -1;
+    }
+
+    m->fd = fd;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 /* Caller owns passed @memfd_fd and must close it down when appropriate. */
 int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable) {
     return shm_attach(m, type, id, memfd_fd, writable, false);
@@ -51,8 +51,10 @@ typedef struct pa_shm {
 
 int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode);
 int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable);
+int pa_shm_create_from_memfd(pa_shm *m, int memfd_fd);
 
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
+void pa_shm_advise_hugepages(pa_shm *m);
 
 void pa_shm_free(pa_shm *m);
 
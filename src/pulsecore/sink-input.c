@@ -31,6 +31,7 @@
 #include <pulse/internal.h>
 
 #include <pulsecore/core-format.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/mix.h>
 #include <pulsecore/stream-util.h>
 #include <pulsecore/core-subscribe.h>
@@ -866,6 +867,16 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
     return r[0];
 }
 
+/* Called from main context. Reads what the IO thread published after the
+ * last peek, without waking it up. */
+void pa_sink_input_get_render_stats(pa_sink_input *i, pa_render_stats *stats) {
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(stats);
+
+    pa_render_stats_read(&i->render_stats, stats);
+}
+
 /* Called from thread context */
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
     bool do_volume_adj_here, need_volume_factor_sink;
@@ -873,6 +884,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
     size_t ilength_full;
+    uint64_t render_start;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -885,6 +897,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     pa_log_debug("peek");
 #endif
 
+    render_start = pa_rtclock_now_nsec();
+
     block_size_max_sink_input = i->thread_info.resampler ?
         pa_resampler_max_block_size(i->thread_info.resampler) :
         pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sample_spec);
@@ -934,6 +948,13 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
              * data, so let's just hand out silence */
 
             pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) slength, PA_SEEK_RELATIVE, true);
+
+            /* Only count it as an underrun if we were actually playing
+             * something before, not for corked or not yet started
+             * streams */
+            if (i->thread_info.playing_for > 0 && i->thread_info.state != PA_SINK_INPUT_CORKED)
+                i->thread_info.render_stats.underruns++;
+
             i->thread_info.playing_for = 0;
             if (i->thread_info.underrun_for != (uint64_t) -1) {
                 i->thread_info.underrun_for += ilength_full;
@@ -991,7 +1012,11 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
                 pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
             } else {
                 pa_memchunk rchunk;
+                uint64_t resample_start;
+
+                resample_start = pa_rtclock_now_nsec();
                 pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
+                i->thread_info.render_stats.resample_nsec += pa_rtclock_now_nsec() - resample_start;
 
 #ifdef SINK_INPUT_DEBUG
                 pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
@@ -1041,6 +1066,9 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         pa_cvolume_mute(volume, i->sink->sample_spec.channels);
     else
         *volume = i->thread_info.soft_volume;
+
+    pa_render_stats_account(&i->thread_info.render_stats, pa_rtclock_now_nsec() - render_start);
+    pa_render_stats_publish(&i->render_stats, &i->thread_info.render_stats);
 }
 
 /* Called from thread context */
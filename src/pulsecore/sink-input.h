@@ -32,6 +32,7 @@
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core.h>
+#include <pulsecore/render-stats.h>
 
 typedef enum pa_sink_input_state {
     PA_SINK_INPUT_INIT,         /*< The stream is not active yet, because pa_sink_input_put() has not been called yet */
@@ -86,6 +87,9 @@ struct pa_sink_input {
 
     pa_sink *origin_sink;               /* only set by filter sinks */
 
+    /* core->generation as of the last new or change event */
+    uint64_t generation;
+
     /* A sink input may be connected to multiple source outputs
      * directly, so that they don't get mixed data of the entire
      * source. */
@@ -231,6 +235,9 @@ struct pa_sink_input {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_sink_input *i); /* may be NULL */
 
+    /* Published by the IO thread, see pa_sink_input_get_render_stats() */
+    pa_render_stats_snapshot render_stats;
+
     struct {
         pa_sink_input_state_t state;
 
@@ -258,6 +265,8 @@ struct pa_sink_input {
         pa_usec_t requested_sink_latency;
 
         pa_hashmap *direct_outputs;
+
+        pa_render_stats render_stats;
     } thread_info;
 
     void *userdata;
@@ -374,6 +383,8 @@ void pa_sink_input_kill(pa_sink_input*i);
 
 pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency);
 
+void pa_sink_input_get_render_stats(pa_sink_input *i, pa_render_stats *stats);
+
 bool pa_sink_input_is_passthrough(pa_sink_input *i);
 bool pa_sink_input_is_volume_readable(pa_sink_input *i);
 void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool save, bool absolute);
@@ -37,10 +37,12 @@
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/sink-input.h>
+#include <pulsecore/startup-trace.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/mix.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -734,6 +736,8 @@ void pa_sink_put(pa_sink* s) {
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_NEW, s->index);
     pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_PUT], s);
 
+    pa_startup_trace_mark_once("device", "first sink", s->name);
+
     /* It's good to fire the SINK_PUT hook before updating the default sink,
      * because module-switch-on-connect will set the new sink as the default
      * sink, and if we were to call pa_core_update_default_sink() before that,
@@ -1227,6 +1231,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t block_size_max;
+    uint64_t render_start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1245,6 +1250,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     }
 
     pa_sink_ref(s);
+    render_start = pa_rtclock_now_nsec();
 
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
@@ -1304,6 +1310,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     inputs_drop(s, info, n, result);
 
+    pa_render_stats_account(&s->thread_info.render_stats, pa_rtclock_now_nsec() - render_start);
+    pa_render_stats_publish(&s->render_stats, &s->thread_info.render_stats);
     pa_sink_unref(s);
 }
 
@@ -1312,6 +1320,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t length, block_size_max;
+    uint64_t render_start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1330,6 +1339,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     }
 
     pa_sink_ref(s);
+    render_start = pa_rtclock_now_nsec();
 
     length = target->length;
     block_size_max = pa_mempool_block_size_max(s->core->mempool);
@@ -1389,6 +1399,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    pa_render_stats_account(&s->thread_info.render_stats, pa_rtclock_now_nsec() - render_start);
+    pa_render_stats_publish(&s->render_stats, &s->thread_info.render_stats);
     pa_sink_unref(s);
 }
 
@@ -2976,6 +2988,13 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             s->thread_info.port_latency_offset = offset;
             return 0;
 
+        case PA_SINK_MESSAGE_GET_RTPOLL_STATS:
+            if (s->thread_info.rtpoll)
+                pa_rtpoll_get_stats(s->thread_info.rtpoll, userdata);
+            else
+                pa_zero(*(pa_rtpoll_stats*) userdata);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY:
         case PA_SINK_MESSAGE_MAX:
             ;
@@ -3332,6 +3351,28 @@ pa_usec_t pa_sink_get_fixed_latency(pa_sink *s) {
     return latency;
 }
 
+/* Called from main thread. Reads what the IO thread published after its
+ * last render cycle, without waking it up. */
+void pa_sink_get_render_stats(pa_sink *s, pa_render_stats *stats) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(stats);
+
+    pa_render_stats_read(&s->render_stats, stats);
+}
+
+/* Called from main thread */
+void pa_sink_get_rtpoll_stats(pa_sink *s, pa_rtpoll_stats *stats) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(stats);
+
+    if (PA_SINK_IS_LINKED(s->state))
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_RTPOLL_STATS, stats, 0, NULL) == 0);
+    else
+        pa_zero(*stats);
+}
+
 /* Called from IO thread */
 void pa_sink_set_fixed_latency_within_thread(pa_sink *s, pa_usec_t latency) {
     pa_sink_assert_ref(s);
@@ -41,6 +41,7 @@
 #include <pulsecore/device-port.h>
 #include <pulsecore/card.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/render-stats.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/sink-input.h>
 
@@ -276,6 +277,9 @@ struct pa_sink {
      * main thread. */
     void (*reconfigure)(pa_sink *s, pa_sample_spec *spec, bool passthrough);
 
+    /* Published by the IO thread, see pa_sink_get_render_stats() */
+    pa_render_stats_snapshot render_stats;
+
     /* Contains copies of the above data so that the real-time worker
      * thread can work without access locking */
     struct {
@@ -332,6 +336,8 @@ struct pa_sink {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        pa_render_stats render_stats;
     } thread_info;
 
     void *userdata;
@@ -365,6 +371,7 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_MAX_REQUEST,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_PORT_LATENCY_OFFSET,
+    PA_SINK_MESSAGE_GET_RTPOLL_STATS,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -461,6 +468,11 @@ pa_usec_t pa_sink_get_requested_latency(pa_sink *s);
 void pa_sink_get_latency_range(pa_sink *s, pa_usec_t *min_latency, pa_usec_t *max_latency);
 pa_usec_t pa_sink_get_fixed_latency(pa_sink *s);
 
+void pa_sink_get_render_stats(pa_sink *s, pa_render_stats *stats);
+
+/* Wakeup statistics of the rtpoll of the IO thread, all zero if there is none */
+void pa_sink_get_rtpoll_stats(pa_sink *s, pa_rtpoll_stats *stats);
+
 size_t pa_sink_get_max_rewind(pa_sink *s);
 size_t pa_sink_get_max_request(pa_sink *s);
 
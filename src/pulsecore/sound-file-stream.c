@@ -228,12 +228,16 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
 int pa_play_file(
         pa_sink *sink,
         const char *fname,
-        const pa_cvolume *volume) {
+        pa_volume_t volume,
+        pa_proplist *p,
+        pa_sink_input_flags_t flags,
+        uint32_t *sink_input_index) {
 
     file_stream *u = NULL;
     pa_sample_spec ss;
     pa_channel_map cm;
     pa_sink_input_new_data data;
+    pa_cvolume cv;
     int fd;
     SF_INFO sfi;
     pa_memchunk silence;
@@ -298,12 +302,16 @@ int pa_play_file(
     pa_sink_input_new_data_init(&data);
     pa_sink_input_new_data_set_sink(&data, sink, false, true);
     data.driver = __FILE__;
+    data.flags |= flags;
     pa_sink_input_new_data_set_sample_spec(&data, &ss);
     pa_sink_input_new_data_set_channel_map(&data, &cm);
-    pa_sink_input_new_data_set_volume(&data, volume);
+    if (PA_VOLUME_IS_VALID(volume))
+        pa_sink_input_new_data_set_volume(&data, pa_cvolume_set(&cv, ss.channels, volume));
     pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, pa_path_get_filename(fname));
     pa_proplist_sets(data.proplist, PA_PROP_MEDIA_FILENAME, fname);
     pa_sndfile_init_proplist(u->sndfile, data.proplist);
+    if (p)
+        pa_proplist_update(data.proplist, PA_UPDATE_REPLACE, p);
 
     pa_sink_input_new(&u->sink_input, sink->core, &data);
     pa_sink_input_new_data_done(&data);
@@ -324,6 +332,9 @@ int pa_play_file(
 
     pa_sink_input_put(u->sink_input);
 
+    if (sink_input_index)
+        *sink_input_index = u->sink_input->index;
+
     /* The reference to u is dangling here, because we want to keep
      * this stream around until it is fully played. */
 
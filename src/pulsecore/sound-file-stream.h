@@ -22,6 +22,15 @@
 
 #include <pulsecore/sink.h>
 
-int pa_play_file(pa_sink *sink, const char *fname, const pa_cvolume *volume);
+/* Plays the file while reading it from disk. volume is applied to all
+ * channels unless it is PA_VOLUME_INVALID, p is merged into the stream's
+ * proplist. */
+int pa_play_file(
+        pa_sink *sink,
+        const char *fname,
+        pa_volume_t volume,
+        pa_proplist *p,
+        pa_sink_input_flags_t flags,
+        uint32_t *sink_input_index);
 
 #endif
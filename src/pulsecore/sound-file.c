@@ -28,6 +28,7 @@
 #include <sndfile.h>
 
 #include <pulse/sample.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
@@ -37,97 +38,153 @@
 
 #include "sound-file.h"
 
-int pa_sound_file_load(
-        pa_mempool *pool,
+struct pa_sound_file {
+    SNDFILE *sf;
+    pa_sample_spec sample_spec;
+    pa_sndfile_readf_t readf_function;
+};
+
+pa_sound_file *pa_sound_file_open(
         const char *fname,
         pa_sample_spec *ss,
         pa_channel_map *map,
-        pa_memchunk *chunk,
-        pa_proplist *p) {
+        pa_proplist *p,
+        size_t *length) {
 
-    SNDFILE *sf = NULL;
+    pa_sound_file *f;
     SF_INFO sfi;
-    int ret = -1;
     size_t l;
-    sf_count_t (*readf_function)(SNDFILE *sndfile, void *ptr, sf_count_t frames) = NULL;
-    void *ptr = NULL;
     int fd;
 
     pa_assert(fname);
     pa_assert(ss);
-    pa_assert(chunk);
-
-    pa_memchunk_reset(chunk);
+    pa_assert(length);
 
     if ((fd = pa_open_cloexec(fname, O_RDONLY, 0)) < 0) {
         pa_log("Failed to open file %s: %s", fname, pa_cstrerror(errno));
-        goto finish;
+        return NULL;
     }
 
 #ifdef HAVE_POSIX_FADVISE
     if (posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL) < 0) {
         pa_log_warn("POSIX_FADV_SEQUENTIAL failed: %s", pa_cstrerror(errno));
-        goto finish;
+        pa_close(fd);
+        return NULL;
     } else
         pa_log_debug("POSIX_FADV_SEQUENTIAL succeeded.");
 #endif
 
+    f = pa_xnew0(pa_sound_file, 1);
+
     pa_zero(sfi);
-    if (!(sf = sf_open_fd(fd, SFM_READ, &sfi, 1))) {
+    if (!(f->sf = sf_open_fd(fd, SFM_READ, &sfi, 1))) {
         pa_log("Failed to open file %s", fname);
-        goto finish;
+        pa_close(fd);
+        goto fail;
     }
 
-    fd = -1;
-
-    if (pa_sndfile_read_sample_spec(sf, ss) < 0) {
+    if (pa_sndfile_read_sample_spec(f->sf, ss) < 0) {
         pa_log("Failed to determine file sample format.");
-        goto finish;
+        goto fail;
     }
 
-    if ((map && pa_sndfile_read_channel_map(sf, map) < 0)) {
+    if ((map && pa_sndfile_read_channel_map(f->sf, map) < 0)) {
         if (ss->channels > 2)
             pa_log("Failed to determine file channel map, synthesizing one.");
         pa_channel_map_init_extend(map, ss->channels, PA_CHANNEL_MAP_DEFAULT);
     }
 
     if (p)
-        pa_sndfile_init_proplist(sf, p);
+        pa_sndfile_init_proplist(f->sf, p);
 
     if ((l = pa_frame_size(ss) * (size_t) sfi.frames) > PA_SCACHE_ENTRY_SIZE_MAX) {
         pa_log("File too large");
-        goto finish;
+        goto fail;
+    }
+
+    f->sample_spec = *ss;
+    f->readf_function = pa_sndfile_readf_function(ss);
+
+    *length = l;
+    return f;
+
+fail:
+    pa_sound_file_close(f);
+    return NULL;
+}
+
+ssize_t pa_sound_file_read(pa_sound_file *f, void *data, size_t length) {
+    size_t fs;
+    sf_count_t n;
+
+    pa_assert(f);
+    pa_assert(data);
+
+    fs = pa_frame_size(&f->sample_spec);
+    pa_assert(length % fs == 0);
+
+    if (f->readf_function) {
+        if ((n = f->readf_function(f->sf, data, (sf_count_t) (length / fs))) < 0)
+            return -1;
+
+        return (ssize_t) ((size_t) n * fs);
     }
 
+    if ((n = sf_read_raw(f->sf, data, (sf_count_t) length)) < 0)
+        return -1;
+
+    return (ssize_t) pa_frame_align((size_t) n, &f->sample_spec);
+}
+
+void pa_sound_file_close(pa_sound_file *f) {
+    pa_assert(f);
+
+    if (f->sf)
+        sf_close(f->sf);
+
+    pa_xfree(f);
+}
+
+int pa_sound_file_load(
+        pa_mempool *pool,
+        const char *fname,
+        pa_sample_spec *ss,
+        pa_channel_map *map,
+        pa_memchunk *chunk,
+        pa_proplist *p) {
+
+    pa_sound_file *f;
+    size_t l;
+    void *ptr;
+    int ret = 0;
+
+    pa_assert(fname);
+    pa_assert(ss);
+    pa_assert(chunk);
+
+    pa_memchunk_reset(chunk);
+
+    if (!(f = pa_sound_file_open(fname, ss, map, p, &l)))
+        return -1;
+
     chunk->memblock = pa_memblock_new(pool, l);
     chunk->index = 0;
     chunk->length = l;
 
-    readf_function = pa_sndfile_readf_function(ss);
-
     ptr = pa_memblock_acquire(chunk->memblock);
 
-    if ((readf_function && readf_function(sf, ptr, sfi.frames) != sfi.frames) ||
-        (!readf_function && sf_read_raw(sf, ptr, (sf_count_t) l) != (sf_count_t) l)) {
+    if (pa_sound_file_read(f, ptr, l) != (ssize_t) l) {
         pa_log("Premature file end");
-        goto finish;
+        ret = -1;
     }
 
-    ret = 0;
+    pa_memblock_release(chunk->memblock);
+    pa_sound_file_close(f);
 
-finish:
-
-    if (sf)
-        sf_close(sf);
-
-    if (ptr)
-        pa_memblock_release(chunk->memblock);
-
-    if (ret != 0 && chunk->memblock)
+    if (ret < 0) {
         pa_memblock_unref(chunk->memblock);
-
-    if (fd >= 0)
-        pa_close(fd);
+        pa_memchunk_reset(chunk);
+    }
 
     return ret;
 }
@@ -20,10 +20,23 @@
   along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <sys/types.h>
+
 #include <pulse/sample.h>
 #include <pulse/channelmap.h>
+#include <pulse/proplist.h>
 #include <pulsecore/memchunk.h>
 
+typedef struct pa_sound_file pa_sound_file;
+
+/* Reads the header of fname, for decoding it in steps with
+ * pa_sound_file_read(). *length is the size of the decoded file. */
+pa_sound_file *pa_sound_file_open(const char *fname, pa_sample_spec *ss, pa_channel_map *map, pa_proplist *p, size_t *length);
+/* Decodes up to length bytes, a multiple of the frame size. Returns the
+ * number of bytes decoded, 0 at the end of the file, -1 on error. */
+ssize_t pa_sound_file_read(pa_sound_file *f, void *data, size_t length);
+void pa_sound_file_close(pa_sound_file *f);
+
 int pa_sound_file_load(pa_mempool *pool, const char *fname, pa_sample_spec *ss, pa_channel_map *map, pa_memchunk *chunk, pa_proplist *p);
 
 int pa_sound_file_too_big_to_cache(const char *fname);
@@ -35,6 +35,7 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/source-output.h>
+#include <pulsecore/startup-trace.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
@@ -676,6 +677,9 @@ void pa_source_put(pa_source *s) {
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_NEW, s->index);
     pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SOURCE_PUT], s);
 
+    if (!s->monitor_of)
+        pa_startup_trace_mark_once("device", "first source", s->name);
+
     /* It's good to fire the SOURCE_PUT hook before updating the default source,
      * because module-switch-on-connect will set the new source as the default
      * source, and if we were to call pa_core_update_default_source() before that,
@@ -2324,6 +2328,13 @@ int pa_source_process_msg(pa_msgobject *object, int code, void *userdata, int64_
             s->thread_info.port_latency_offset = offset;
             return 0;
 
+        case PA_SOURCE_MESSAGE_GET_RTPOLL_STATS:
+            if (s->thread_info.rtpoll)
+                pa_rtpoll_get_stats(s->thread_info.rtpoll, userdata);
+            else
+                pa_zero(*(pa_rtpoll_stats*) userdata);
+            return 0;
+
         case PA_SOURCE_MESSAGE_MAX:
             ;
     }
@@ -2613,6 +2624,18 @@ pa_usec_t pa_source_get_fixed_latency(pa_source *s) {
     return latency;
 }
 
+/* Called from main thread */
+void pa_source_get_rtpoll_stats(pa_source *s, pa_rtpoll_stats *stats) {
+    pa_source_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(stats);
+
+    if (PA_SOURCE_IS_LINKED(s->state))
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SOURCE_MESSAGE_GET_RTPOLL_STATS, stats, 0, NULL) == 0);
+    else
+        pa_zero(*stats);
+}
+
 /* Called from IO thread */
 void pa_source_set_fixed_latency_within_thread(pa_source *s, pa_usec_t latency) {
     pa_source_assert_ref(s);
@@ -24,6 +24,8 @@
 #include "srbchannel.h"
 
 #include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
 /* #define DEBUG_SRBCHANNEL */
@@ -86,6 +88,9 @@ struct pa_srbchannel {
     pa_io_event *read_event;
     pa_defer_event *defer_event;
     pa_mainloop_api *mainloop;
+
+    pa_usec_t busy_poll_max, busy_poll_usec;
+    pa_srbchannel_busy_poll_stats busy_poll_stats;
 };
 
 /* We always listen to sem_read, and always signal on sem_write.
@@ -178,6 +183,33 @@ struct srbheader {
     /* TODO: Maybe a marker here to make sure we talk to a server with equally sized struct */
 };
 
+/* Returns true if the other side signalled us while we were spinning */
+static bool srbchannel_busy_poll(pa_srbchannel *sr) {
+    pa_usec_t start, now;
+
+    if (sr->busy_poll_max == 0)
+        return false;
+
+    start = now = pa_rtclock_now();
+
+    do {
+        if (pa_fdsem_try(sr->sem_read)) {
+            sr->busy_poll_stats.wakeups_avoided++;
+            sr->busy_poll_stats.spin_time += pa_rtclock_now() - start;
+            sr->busy_poll_usec = PA_MIN(sr->busy_poll_usec * 2, sr->busy_poll_max);
+            return true;
+        }
+
+        now = pa_rtclock_now();
+    } while (now - start < sr->busy_poll_usec);
+
+    sr->busy_poll_stats.spins_timed_out++;
+    sr->busy_poll_stats.spin_time += now - start;
+    sr->busy_poll_usec = PA_MAX(sr->busy_poll_usec / 2, PA_MAX(sr->busy_poll_max / 16, (pa_usec_t) 1));
+
+    return false;
+}
+
 static void srbchannel_rwloop(pa_srbchannel* sr) {
     do {
 #ifdef DEBUG_SRBCHANNEL
@@ -200,7 +232,7 @@ static void srbchannel_rwloop(pa_srbchannel* sr) {
         pa_log("In rw loop from srbchannel, after callback, count = %d", q);
 #endif
 
-    } while (pa_fdsem_before_poll(sr->sem_read) < 0);
+    } while (srbchannel_busy_poll(sr) || pa_fdsem_before_poll(sr->sem_read) < 0);
 }
 
 static void semread_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
@@ -221,14 +253,24 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata) {
     srbchannel_rwloop(sr);
 }
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, size_t size) {
     int capacity;
     int readfd;
+    size_t length = (size_t) -1;
     struct srbheader *srh;
 
     pa_srbchannel* sr = pa_xmalloc0(sizeof(pa_srbchannel));
     sr->mainloop = m;
-    sr->memblock = pa_memblock_new_pool(p, -1);
+
+    if (size > 0) {
+        size = PA_ALIGN(PA_MAX(size, (size_t) PA_SRBCHANNEL_SIZE_MIN));
+        length = PA_ALIGN(sizeof(*srh)) + 2 * size;
+
+        if (length > pa_mempool_block_size_max(p))
+            length = (size_t) -1;
+    }
+
+    sr->memblock = pa_memblock_new_pool(p, length);
     if (!sr->memblock)
         goto fail;
 
@@ -337,6 +379,25 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t) {
     t->writefd = pa_fdsem_get(sr->sem_write);
 }
 
+size_t pa_srbchannel_get_size(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) sr->rb_read.capacity;
+}
+
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t max_usec) {
+    pa_assert(sr);
+
+    sr->busy_poll_max = sr->busy_poll_usec = PA_MIN(max_usec, (pa_usec_t) PA_SRBCHANNEL_BUSY_POLL_MAX_USEC);
+}
+
+void pa_srbchannel_get_busy_poll_stats(pa_srbchannel *sr, pa_srbchannel_busy_poll_stats *stats) {
+    pa_assert(sr);
+    pa_assert(stats);
+
+    *stats = sr->busy_poll_stats;
+}
+
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata) {
     if (sr->callback)
         pa_fdsem_after_poll(sr->sem_read);
@@ -360,6 +421,12 @@ void pa_srbchannel_free(pa_srbchannel *sr)
 #endif
     pa_assert(sr);
 
+    if (sr->busy_poll_max > 0)
+        pa_log_debug("srbchannel busy polling avoided %llu wakeups, timed out %llu times, spun for %llu us in total",
+                     (unsigned long long) sr->busy_poll_stats.wakeups_avoided,
+                     (unsigned long long) sr->busy_poll_stats.spins_timed_out,
+                     (unsigned long long) sr->busy_poll_stats.spin_time);
+
     if (sr->defer_event)
         sr->mainloop->defer_free(sr->defer_event);
     if (sr->read_event)
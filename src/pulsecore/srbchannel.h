@@ -21,6 +21,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulse/sample.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/memblock.h>
 
@@ -34,7 +35,16 @@ typedef struct pa_srbchannel_template {
     pa_memblock *memblock;
 } pa_srbchannel_template;
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p);
+/* Smallest ring we are willing to set up, in bytes per direction */
+#define PA_SRBCHANNEL_SIZE_MIN (4*1024)
+
+/* Upper bound for the time spent busy polling per wakeup */
+#define PA_SRBCHANNEL_BUSY_POLL_MAX_USEC (1000)
+
+/* size is the capacity of each of the two rings. Pass 0 for the largest
+ * ring that fits into a block of the pool, anything else is clamped to
+ * PA_SRBCHANNEL_SIZE_MIN and to what fits into a block. */
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, size_t size);
 /* Note: this creates a srbchannel with swapped read and write. */
 pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t);
 
@@ -45,6 +55,28 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
 size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
 size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 
+/* Returns the capacity of each of the two rings */
+size_t pa_srbchannel_get_size(pa_srbchannel *sr);
+
+/* After handling a wakeup, spin for a while waiting for the other side to
+ * signal again before going back to sleep. While we spin, signalling us
+ * costs the other side no system call and us no main loop wakeup. The
+ * spin time adapts between 1/16th of max_usec and max_usec depending on
+ * whether it paid off recently. 0 turns it off, which is the default.
+ * Spinning blocks everything else that runs in the thread of the main
+ * loop, so only use this where that thread does nothing else. libpulse
+ * enables it for contexts on a pa_threaded_mainloop only. The server
+ * handles all clients in its main loop and never spins. */
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t max_usec);
+
+typedef struct pa_srbchannel_busy_poll_stats {
+    uint64_t wakeups_avoided;
+    uint64_t spins_timed_out;
+    pa_usec_t spin_time;
+} pa_srbchannel_busy_poll_stats;
+
+void pa_srbchannel_get_busy_poll_stats(pa_srbchannel *sr, pa_srbchannel_busy_poll_stats *stats);
+
 /* Set the callback function that is called whenever data becomes available for reading.
  * It can also be called if the output buffer was full and can now be written to.
  *
@@ -0,0 +1,233 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/dynarray.h>
+#include <pulsecore/json.h>
+#include <pulsecore/macro.h>
+
+#include "startup-trace.h"
+
+/* Keep recording this long after the daemon reported ready */
+#define GRACE_USEC (30 * PA_USEC_PER_SEC)
+#define MAX_EVENTS 4096
+
+#define MAIN_TID 1
+
+struct event {
+    const char *category;
+    char *name;
+    char *detail;
+    pa_usec_t begin, end;
+    unsigned tid;
+    bool instant;
+};
+
+static struct {
+    pa_usec_t origin, ready;
+    pa_dynarray *events;
+    pa_dynarray *threads; /* Names of helper threads, tid is index + 2 */
+} trace;
+
+static void event_free(struct event *e) {
+    pa_xfree(e->name);
+    pa_xfree(e->detail);
+    pa_xfree(e);
+}
+
+void pa_startup_trace_start(void) {
+    pa_assert(!trace.events);
+
+    trace.origin = pa_rtclock_now();
+    trace.ready = 0;
+    trace.events = pa_dynarray_new((pa_free_cb_t) event_free);
+    trace.threads = pa_dynarray_new(pa_xfree);
+}
+
+void pa_startup_trace_ready(void) {
+    if (!trace.events)
+        return;
+
+    pa_startup_trace_mark_once("daemon", "ready", NULL);
+    trace.ready = pa_rtclock_now();
+}
+
+void pa_startup_trace_done(void) {
+    if (!trace.events)
+        return;
+
+    pa_dynarray_free(trace.events);
+    pa_dynarray_free(trace.threads);
+    pa_zero(trace);
+}
+
+static bool recording(pa_usec_t now) {
+    if (!trace.events || pa_dynarray_size(trace.events) >= MAX_EVENTS)
+        return false;
+
+    return !trace.ready || now < trace.ready + GRACE_USEC;
+}
+
+static struct event *add_event(const char *category, const char *name, const char *detail, pa_usec_t begin) {
+    struct event *e;
+
+    e = pa_xnew0(struct event, 1);
+    e->category = category;
+    e->name = pa_xstrdup(name);
+    e->detail = pa_xstrdup(detail);
+    e->begin = begin;
+    e->tid = MAIN_TID;
+    pa_dynarray_append(trace.events, e);
+
+    return e;
+}
+
+pa_startup_trace_span pa_startup_trace_begin(const char *category, const char *name, const char *detail) {
+    pa_usec_t now = pa_rtclock_now();
+
+    pa_assert(category);
+    pa_assert(name);
+
+    if (!recording(now))
+        return PA_STARTUP_TRACE_SPAN_INVALID;
+
+    add_event(category, name, detail, now);
+
+    return pa_dynarray_size(trace.events) - 1;
+}
+
+void pa_startup_trace_end(pa_startup_trace_span span) {
+    struct event *e;
+
+    if (span == PA_STARTUP_TRACE_SPAN_INVALID || !trace.events)
+        return;
+
+    pa_assert_se(e = pa_dynarray_get(trace.events, span));
+    e->end = pa_rtclock_now();
+}
+
+void pa_startup_trace_add(const char *category, const char *name, const char *detail,
+                          pa_usec_t begin, pa_usec_t end, const char *thread) {
+    struct event *e;
+
+    pa_assert(category);
+    pa_assert(name);
+    pa_assert(thread);
+
+    if (!recording(begin))
+        return;
+
+    e = add_event(category, name, detail, begin);
+    e->end = end;
+
+    pa_dynarray_append(trace.threads, pa_xstrdup(thread));
+    e->tid = pa_dynarray_size(trace.threads) + 1;
+}
+
+void pa_startup_trace_mark_once(const char *category, const char *name, const char *detail) {
+    pa_usec_t now = pa_rtclock_now();
+    struct event *e;
+    unsigned i;
+
+    pa_assert(category);
+    pa_assert(name);
+
+    if (!recording(now))
+        return;
+
+    PA_DYNARRAY_FOREACH(e, trace.events, i)
+        if (e->instant && pa_streq(e->name, name))
+            return;
+
+    e = add_event(category, name, detail, now);
+    e->end = now;
+    e->instant = true;
+}
+
+static void thread_name(pa_json_encoder *encoder, unsigned tid, const char *name) {
+    pa_json_encoder_begin_element_object(encoder);
+    pa_json_encoder_add_member_string(encoder, "name", "thread_name");
+    pa_json_encoder_add_member_string(encoder, "ph", "M");
+    pa_json_encoder_add_member_int(encoder, "pid", getpid());
+    pa_json_encoder_add_member_int(encoder, "tid", tid);
+    pa_json_encoder_begin_member_object(encoder, "args");
+    pa_json_encoder_add_member_string(encoder, "name", name);
+    pa_json_encoder_end_object(encoder);
+    pa_json_encoder_end_object(encoder);
+}
+
+char *pa_startup_trace_to_json(void) {
+    pa_json_encoder *encoder;
+    pa_usec_t now = pa_rtclock_now();
+    struct event *e;
+    const char *name;
+    unsigned i;
+
+    if (!trace.events)
+        return NULL;
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_object(encoder);
+    pa_json_encoder_begin_member_array(encoder, "traceEvents");
+
+    thread_name(encoder, MAIN_TID, "main");
+    PA_DYNARRAY_FOREACH(name, trace.threads, i)
+        thread_name(encoder, i + 2, name);
+
+    PA_DYNARRAY_FOREACH(e, trace.events, i) {
+        pa_json_encoder_begin_element_object(encoder);
+        pa_json_encoder_add_member_string(encoder, "name", e->name);
+        pa_json_encoder_add_member_string(encoder, "cat", e->category);
+        pa_json_encoder_add_member_int(encoder, "pid", getpid());
+        pa_json_encoder_add_member_int(encoder, "tid", e->tid);
+        pa_json_encoder_add_member_int(encoder, "ts", e->begin - trace.origin);
+
+        if (e->instant) {
+            pa_json_encoder_add_member_string(encoder, "ph", "i");
+            pa_json_encoder_add_member_string(encoder, "s", "p");
+        } else {
+            /* Spans still open, e.g. because something failed on the way,
+             * are shown as lasting until now */
+            pa_json_encoder_add_member_string(encoder, "ph", "X");
+            pa_json_encoder_add_member_int(encoder, "dur", (e->end ? e->end : now) - e->begin);
+        }
+
+        if (e->detail) {
+            pa_json_encoder_begin_member_object(encoder, "args");
+            pa_json_encoder_add_member_string(encoder, "detail", e->detail);
+            pa_json_encoder_end_object(encoder);
+        }
+
+        pa_json_encoder_end_object(encoder);
+    }
+
+    pa_json_encoder_end_array(encoder);
+    pa_json_encoder_add_member_string(encoder, "displayTimeUnit", "ms");
+    pa_json_encoder_end_object(encoder);
+
+    return pa_json_encoder_to_string_free(encoder);
+}
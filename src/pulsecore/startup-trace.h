@@ -0,0 +1,54 @@
+#ifndef foostartuptracehfoo
+#define foostartuptracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+/* A timeline of what the daemon spends its startup on: daemon phases,
+ * script commands, module loads and when the first devices show up.
+ * Recording starts with pa_startup_trace_start() and ends a while after
+ * pa_startup_trace_ready(), so that whatever finishes asynchronously is
+ * still caught. Timestamps come from pa_rtclock_now(). Main thread only;
+ * work done in helper threads is added afterwards with
+ * pa_startup_trace_add(). */
+
+/* Handle for a span; ending an invalid one is a no-op */
+typedef unsigned pa_startup_trace_span;
+#define PA_STARTUP_TRACE_SPAN_INVALID ((pa_startup_trace_span) -1)
+
+void pa_startup_trace_start(void);
+void pa_startup_trace_ready(void);
+void pa_startup_trace_done(void);
+
+/* detail may be NULL; it shows up in the event arguments */
+pa_startup_trace_span pa_startup_trace_begin(const char *category, const char *name, const char *detail);
+void pa_startup_trace_end(pa_startup_trace_span span);
+
+/* Records a span that already ended, run by the named thread */
+void pa_startup_trace_add(const char *category, const char *name, const char *detail,
+                          pa_usec_t begin, pa_usec_t end, const char *thread);
+
+/* Records a point in time, but only the first time name is seen */
+void pa_startup_trace_mark_once(const char *category, const char *name, const char *detail);
+
+/* Returns the trace in the Chrome trace event format, or NULL if nothing
+ * was recorded */
+char *pa_startup_trace_to_json(void);
+
+#endif
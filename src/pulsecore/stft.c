@@ -0,0 +1,319 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/sample.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/fft-plan.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "stft.h"
+
+/* pa_fft_alloc() hands out 32 byte aligned blocks in multiples of 8
+ * floats, keep every per channel buffer on such a boundary too */
+#define ALIGN_FLOATS 8
+
+typedef float v4sf __attribute__((vector_size(4 * sizeof(float))));
+
+struct pa_stft {
+    unsigned channels;
+    size_t fft_size, window_size, hop_size;
+    size_t window_stride, hop_stride;
+
+    pa_fft_plan *plan;
+    pa_stft_filter_cb_t filter;
+    void *userdata;
+
+    /* Zero padded to window_stride */
+    float *window;
+    float *time, *spectrum;
+
+    /* Per channel: the last window_size input samples, the overlap-add
+     * sums that are not complete yet (both window_stride apart) and the
+     * output of the last hop (hop_stride apart). fill is the number of
+     * frames of the current hop gathered so far. */
+    float *input, *accum, *output;
+    size_t fill;
+
+    /* The last ring_size input frames, indexed by absolute position.
+     * Frames before ring_begin are not available. */
+    float *ring;
+    size_t ring_size, history;
+    uint64_t pos, ring_begin;
+};
+
+/* n is a multiple of 8 and all arrays come from pa_fft_alloc(), so these
+ * compile to plain vector loads, multiplies and adds (SSE, NEON) */
+static void multiply(float *dst, const float *a, const float *b, size_t n) {
+    v4sf *d = (v4sf *) dst;
+    const v4sf *x = (const v4sf *) a, *y = (const v4sf *) b;
+    size_t i;
+
+    for (i = 0; i < n / 4; i++)
+        d[i] = x[i] * y[i];
+}
+
+static void accumulate(float *dst, const float *a, size_t n) {
+    v4sf *d = (v4sf *) dst;
+    const v4sf *x = (const v4sf *) a;
+    size_t i;
+
+    for (i = 0; i < n / 4; i++)
+        d[i] += x[i];
+}
+
+static void reset_state(pa_stft *s) {
+    memset(s->input, 0, s->channels * s->window_stride * sizeof(float));
+    memset(s->accum, 0, s->channels * s->window_stride * sizeof(float));
+    memset(s->output, 0, s->channels * s->hop_stride * sizeof(float));
+    s->fill = 0;
+}
+
+pa_stft *pa_stft_new(unsigned channels, size_t fft_size, const float *window, size_t window_size, size_t hop_size,
+                     size_t max_rewind, pa_stft_filter_cb_t filter, void *userdata) {
+    pa_stft *s;
+
+    pa_assert(channels > 0 && channels <= PA_CHANNELS_MAX);
+    pa_assert(window);
+    pa_assert(window_size > 0 && window_size <= fft_size);
+    pa_assert(hop_size > 0 && hop_size <= window_size);
+    pa_assert(filter);
+
+    s = pa_xnew0(pa_stft, 1);
+
+    if (!(s->plan = pa_fft_plan_get(fft_size))) {
+        pa_xfree(s);
+        return NULL;
+    }
+
+    s->channels = channels;
+    s->fft_size = fft_size;
+    s->window_size = window_size;
+    s->hop_size = hop_size;
+    s->window_stride = PA_ROUND_UP(window_size, ALIGN_FLOATS);
+    s->hop_stride = PA_ROUND_UP(hop_size, ALIGN_FLOATS);
+    s->filter = filter;
+    s->userdata = userdata;
+
+    s->window = pa_fft_alloc(s->window_stride);
+    memcpy(s->window, window, window_size * sizeof(float));
+
+    s->time = pa_fft_alloc(PA_MAX(fft_size, s->window_stride));
+    s->spectrum = pa_fft_alloc(fft_size + 2);
+
+    s->input = pa_fft_alloc(channels * s->window_stride);
+    s->accum = pa_fft_alloc(channels * s->window_stride);
+    s->output = pa_fft_alloc(channels * s->hop_stride);
+
+    /* An output sample depends on the hops of the last window_size frames,
+     * which depend on the window_size frames before each of them. Replay
+     * starts on a hop boundary. */
+    s->history = PA_ROUND_UP(2 * window_size + hop_size, hop_size);
+    pa_stft_set_max_rewind(s, max_rewind);
+
+    return s;
+}
+
+void pa_stft_free(pa_stft *s) {
+    pa_assert(s);
+
+    pa_fft_plan_unref(s->plan);
+
+    pa_fft_free(s->window);
+    pa_fft_free(s->time);
+    pa_fft_free(s->spectrum);
+    pa_fft_free(s->input);
+    pa_fft_free(s->accum);
+    pa_fft_free(s->output);
+    pa_xfree(s->ring);
+    pa_xfree(s);
+}
+
+static void run_hop(pa_stft *s) {
+    size_t overlap = s->window_size - s->hop_size;
+    unsigned c;
+
+    for (c = 0; c < s->channels; c++) {
+        float *input = s->input + c * s->window_stride;
+        float *accum = s->accum + c * s->window_stride;
+
+        multiply(s->time, input, s->window, s->window_stride);
+        if (s->fft_size > s->window_stride)
+            memset(s->time + s->window_stride, 0, (s->fft_size - s->window_stride) * sizeof(float));
+
+        pa_fft_plan_forward(s->plan, s->time, s->spectrum);
+        s->filter(s, c, s->spectrum, s->userdata);
+        pa_fft_plan_inverse(s->plan, s->spectrum, s->time);
+
+        /* Whatever lands beyond window_size is cleared again below */
+        accumulate(accum, s->time, s->window_stride);
+
+        memcpy(s->output + c * s->hop_stride, accum, s->hop_size * sizeof(float));
+        memmove(accum, accum + s->hop_size, overlap * sizeof(float));
+        memset(accum + overlap, 0, (s->window_stride - overlap) * sizeof(float));
+
+        memmove(input, input + s->hop_size, overlap * sizeof(float));
+    }
+}
+
+static void ring_store(pa_stft *s, const float *src, size_t n) {
+    uint64_t p = s->pos;
+
+    /* Only the last ring_size frames survive anyway */
+    if (n > s->ring_size) {
+        src += (n - s->ring_size) * s->channels;
+        p += n - s->ring_size;
+        n = s->ring_size;
+    }
+
+    while (n > 0) {
+        size_t i = (size_t) (p % s->ring_size);
+        size_t k = PA_MIN(n, s->ring_size - i);
+
+        memcpy(s->ring + i * s->channels, src, k * s->channels * sizeof(float));
+        src += k * s->channels;
+        p += k;
+        n -= k;
+    }
+}
+
+static void feed(pa_stft *s, const float *src, float *dst, size_t n, bool store) {
+    void *in[PA_CHANNELS_MAX];
+    const void *out[PA_CHANNELS_MAX];
+    unsigned c;
+
+    if (store) {
+        ring_store(s, src, n);
+
+        if (s->pos + n - s->ring_begin > s->ring_size)
+            s->ring_begin = s->pos + n - s->ring_size;
+    }
+
+    while (n > 0) {
+        size_t k = PA_MIN(n, s->hop_size - s->fill);
+
+        for (c = 0; c < s->channels; c++) {
+            in[c] = s->input + c * s->window_stride + s->window_size - s->hop_size + s->fill;
+            out[c] = s->output + c * s->hop_stride + s->fill;
+        }
+
+        /* The output slot of a frame is free once it was read, and the
+         * hop runs as soon as all of its input is in */
+        pa_deinterleave(src, in, s->channels, sizeof(float), k);
+        if (dst) {
+            pa_interleave(out, s->channels, dst, sizeof(float), k);
+            dst += k * s->channels;
+        }
+
+        src += k * s->channels;
+        n -= k;
+        s->pos += k;
+
+        if ((s->fill += k) == s->hop_size) {
+            run_hop(s);
+            s->fill = 0;
+        }
+    }
+}
+
+void pa_stft_process(pa_stft *s, const float *src, float *dst, size_t n) {
+    pa_assert(s);
+    pa_assert(src);
+    pa_assert(dst);
+
+    feed(s, src, dst, n, true);
+}
+
+void pa_stft_rewind(pa_stft *s, size_t n) {
+    uint64_t target, start;
+
+    pa_assert(s);
+
+    if (n == 0)
+        return;
+
+    target = s->pos - PA_MIN((uint64_t) n, s->pos);
+    start = target > s->history ? (target - s->history) / s->hop_size * s->hop_size : 0;
+
+    reset_state(s);
+
+    if (start < s->ring_begin) {
+        /* Not enough history kept, continue as if it had been silence */
+        pa_log_debug("Rewind of %zu frames exceeds the kept history.", n);
+        s->pos = s->ring_begin = target;
+        s->fill = (size_t) (target % s->hop_size);
+        return;
+    }
+
+    /* Replay from a hop boundary, without producing output */
+    s->pos = start;
+    while (s->pos < target) {
+        size_t i = (size_t) (s->pos % s->ring_size);
+        size_t k = (size_t) PA_MIN(target - s->pos, (uint64_t) (s->ring_size - i));
+
+        feed(s, s->ring + i * s->channels, NULL, k, false);
+    }
+}
+
+void pa_stft_set_max_rewind(pa_stft *s, size_t max_rewind) {
+    size_t size = max_rewind + s->history + s->hop_size;
+    uint64_t p;
+    float *ring;
+
+    pa_assert(s);
+
+    /* A bigger ring keeps more history than asked for, which doesn't hurt */
+    if (size <= s->ring_size)
+        return;
+
+    ring = pa_xnew(float, size * s->channels);
+
+    /* Move the kept frames to where the new size expects them, so that a
+     * rewind right after this is still exact */
+    for (p = s->ring_begin; p < s->pos; ) {
+        size_t i = (size_t) (p % s->ring_size), j = (size_t) (p % size);
+        size_t k = (size_t) PA_MIN(s->pos - p, (uint64_t) PA_MIN(s->ring_size - i, size - j));
+
+        memcpy(ring + j * s->channels, s->ring + i * s->channels, k * s->channels * sizeof(float));
+        p += k;
+    }
+
+    pa_xfree(s->ring);
+    s->ring = ring;
+    s->ring_size = size;
+}
+
+void pa_stft_reset(pa_stft *s) {
+    pa_assert(s);
+
+    reset_state(s);
+    s->pos = s->ring_begin = 0;
+}
+
+size_t pa_stft_get_latency(pa_stft *s) {
+    pa_assert(s);
+
+    return s->window_size;
+}
@@ -0,0 +1,63 @@
+#ifndef foostfthfoo
+#define foostfthfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+/* Short-time Fourier transform block processor with overlap-add (only
+ * available when built with FFTW). Every hop_size frames each channel's
+ * last window_size input samples are windowed, zero padded to fft_size and
+ * transformed, handed to a filter callback, transformed back and added to
+ * the output. The window must satisfy the constant overlap-add condition
+ * for hop_size to get a transparent result.
+ *
+ * Input and output are interleaved float frames, n frames in give n frames
+ * out, delayed by window_size frames. The last input frames are kept so
+ * that the state can be rebuilt after a rewind. */
+typedef struct pa_stft pa_stft;
+
+/* spectrum holds fft_size/2+1 interleaved complex values and may be
+ * modified in place. The transforms are unnormalized: a filter that
+ * should pass the signal unchanged scales it by 1/fft_size. */
+typedef void (*pa_stft_filter_cb_t)(pa_stft *s, unsigned channel, float *spectrum, void *userdata);
+
+/* max_rewind is in frames. Returns NULL if the FFT plans cannot be created. */
+pa_stft *pa_stft_new(unsigned channels, size_t fft_size, const float *window, size_t window_size, size_t hop_size,
+                     size_t max_rewind, pa_stft_filter_cb_t filter, void *userdata);
+void pa_stft_free(pa_stft *s);
+
+/* src and dst may be the same buffer */
+void pa_stft_process(pa_stft *s, const float *src, float *dst, size_t n);
+
+/* Takes back the last n frames passed to pa_stft_process(), so that the
+ * next call continues from there. Exact as long as n does not exceed
+ * max_rewind; older history is treated as silence. */
+void pa_stft_rewind(pa_stft *s, size_t n);
+
+/* Keeps the input history. Only allocates when max_rewind grows beyond
+ * what the ring already holds, so pass an upper bound to pa_stft_new() to
+ * keep this free of allocations. */
+void pa_stft_set_max_rewind(pa_stft *s, size_t max_rewind);
+
+/* Forgets all input, as if only silence had been processed */
+void pa_stft_reset(pa_stft *s);
+
+size_t pa_stft_get_latency(pa_stft *s);
+
+#endif
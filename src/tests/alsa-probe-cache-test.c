@@ -0,0 +1,395 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/log.h>
+#include <pulsecore/tagstruct.h>
+
+#include <modules/alsa/alsa-mixer.h>
+#include <modules/alsa/alsa-util.h>
+
+/* No card has this index, so the mixer paths probed on load find nothing */
+#define NO_CARD 31
+
+/* Version of the entries written by hand below */
+#define ENTRY_VERSION 2
+
+static const char profile_set_conf[] =
+    "[Mapping analog-stereo]\n"
+    "device-strings = hw:%f\n"
+    "channel-map = left,right\n"
+    "direction = output\n"
+    "\n"
+    "[Mapping analog-mono]\n"
+    "device-strings = hw:%f\n"
+    "channel-map = mono\n"
+    "direction = output\n"
+    "\n"
+    "[Profile output:analog-stereo]\n"
+    "output-mappings = analog-stereo\n"
+    "\n"
+    "[Profile output:analog-mono]\n"
+    "output-mappings = analog-mono\n";
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 48000,
+    .channels = 2
+};
+
+static char *dir, *conf_path, *db_path;
+static pa_hashmap *mixers;
+
+static void write_file(const char *fn, const char *contents) {
+    FILE *f;
+
+    fail_unless((f = fopen(fn, "w")) != NULL);
+    fail_unless(fputs(contents, f) >= 0);
+    fail_unless(fclose(f) == 0);
+}
+
+static char *card_key(pa_alsa_profile_set *ps, const char *driver) {
+    return pa_alsa_profile_set_probe_cache_key_for_card(ps, driver, "Board Audio", "HDA:10ec0269", "Realtek ALC269", &ss, 4, 25);
+}
+
+/* What a probe that only got the stereo mapping to open leaves behind */
+static pa_alsa_profile_set *probed_profile_set(void) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_mapping *m;
+
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+
+    fail_unless((m = pa_hashmap_get(ps->mappings, "analog-stereo")) != NULL);
+    m->supported = 1;
+    m->hw_device_index = 3;
+    ((pa_alsa_profile *) pa_hashmap_get(ps->profiles, "output:analog-stereo"))->supported = true;
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+    ps->probed = true;
+
+    return ps;
+}
+
+static void save(const char *key) {
+    pa_alsa_profile_set *ps;
+    pa_database *db;
+
+    ps = probed_profile_set();
+
+    fail_unless((db = pa_database_open_internal(db_path, true)) != NULL);
+    pa_alsa_profile_set_probe_cache_save(ps, db, key);
+    pa_database_close(db);
+
+    pa_alsa_profile_set_free(ps);
+}
+
+static bool load(pa_alsa_profile_set *ps, const char *key) {
+    pa_database *db;
+    bool r;
+
+    fail_unless((db = pa_database_open_internal(db_path, false)) != NULL);
+    r = pa_alsa_profile_set_probe_cache_load(ps, db, key, mixers, NO_CARD);
+    pa_database_close(db);
+
+    return r;
+}
+
+static void setup(void) {
+    char t[] = "/tmp/alsa-probe-cache-test-XXXXXX";
+
+    fail_unless(mkdtemp(t) != NULL);
+    dir = pa_xstrdup(t);
+    conf_path = pa_sprintf_malloc("%s/test.conf", dir);
+    db_path = pa_sprintf_malloc("%s/probe-cache", dir);
+
+    write_file(conf_path, profile_set_conf);
+
+    mixers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                 NULL, (pa_free_cb_t) pa_alsa_mixer_free);
+}
+
+static void teardown(void) {
+    char *fn;
+
+    pa_hashmap_free(mixers);
+
+    unlink(conf_path);
+    unlink(db_path);
+    fn = pa_sprintf_malloc("%s.wal", db_path);
+    unlink(fn);
+    pa_xfree(fn);
+    rmdir(dir);
+
+    pa_xfree(conf_path);
+    pa_xfree(db_path);
+    pa_xfree(dir);
+}
+
+START_TEST (probe_cache_key_test) {
+    pa_alsa_profile_set *ps;
+    pa_sample_spec other_ss = ss;
+    char *key, *k;
+
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+    fail_unless((key = card_key(ps, "snd_hda_intel")) != NULL);
+
+    /* Stable for the same card and configuration */
+    k = card_key(ps, "snd_hda_intel");
+    ck_assert_str_eq(k, key);
+    pa_xfree(k);
+
+    /* Another driver */
+    k = card_key(ps, "snd_usb_audio");
+    ck_assert_str_ne(k, key);
+    pa_xfree(k);
+
+    /* Another codec behind the same driver */
+    k = pa_alsa_profile_set_probe_cache_key_for_card(ps, "snd_hda_intel", "Board Audio", "HDA:10ec0282", "Realtek ALC269", &ss, 4, 25);
+    ck_assert_str_ne(k, key);
+    pa_xfree(k);
+
+    /* Other stream settings */
+    other_ss.rate = 44100;
+    k = pa_alsa_profile_set_probe_cache_key_for_card(ps, "snd_hda_intel", "Board Audio", "HDA:10ec0269", "Realtek ALC269", &other_ss, 4, 25);
+    ck_assert_str_ne(k, key);
+    pa_xfree(k);
+
+    k = pa_alsa_profile_set_probe_cache_key_for_card(ps, "snd_hda_intel", "Board Audio", "HDA:10ec0269", "Realtek ALC269", &ss, 2, 25);
+    ck_assert_str_ne(k, key);
+    pa_xfree(k);
+
+    pa_alsa_profile_set_free(ps);
+
+    /* An edited profile set */
+    write_file(conf_path, "[General]\nauto-profiles = no\n\n" "[Mapping analog-stereo]\ndevice-strings = hw:%f\nchannel-map = left,right\n");
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+    k = card_key(ps, "snd_hda_intel");
+    ck_assert_str_ne(k, key);
+    pa_xfree(k);
+    pa_alsa_profile_set_free(ps);
+
+    pa_xfree(key);
+}
+END_TEST
+
+START_TEST (probe_cache_hit_test) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_mapping *m;
+    pa_channel_map stereo;
+    char *key;
+
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+    key = card_key(ps, "snd_hda_intel");
+
+    save(key);
+
+    fail_unless(load(ps, key));
+    fail_unless(ps->probed);
+
+    /* Only what the probe found survives */
+    fail_unless(pa_hashmap_get(ps->profiles, "output:analog-stereo") != NULL);
+    fail_unless(pa_hashmap_get(ps->profiles, "output:analog-mono") == NULL);
+    fail_unless(pa_hashmap_get(ps->mappings, "analog-mono") == NULL);
+
+    fail_unless((m = pa_hashmap_get(ps->mappings, "analog-stereo")) != NULL);
+    fail_unless(pa_channel_map_equal(&m->channel_map, pa_channel_map_init_stereo(&stereo)));
+    ck_assert_int_eq(m->hw_device_index, 3);
+    ck_assert_int_eq(m->supported, 1);
+
+    pa_alsa_profile_set_free(ps);
+    pa_xfree(key);
+}
+END_TEST
+
+START_TEST (probe_cache_card_change_test) {
+    pa_alsa_profile_set *ps;
+    char *key;
+
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+
+    key = card_key(ps, "snd_hda_intel");
+    save(key);
+    pa_xfree(key);
+
+    /* The same profile set on a card with another driver has to probe */
+    key = card_key(ps, "snd_usb_audio");
+    fail_if(load(ps, key));
+    fail_if(ps->probed);
+    fail_unless(pa_hashmap_get(ps->profiles, "output:analog-mono") != NULL);
+
+    pa_alsa_profile_set_free(ps);
+    pa_xfree(key);
+}
+END_TEST
+
+static void store(const char *key, const void *data, size_t size) {
+    pa_database *db;
+    pa_datum k, d;
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+    d.data = (void *) data;
+    d.size = size;
+
+    fail_unless((db = pa_database_open_internal(db_path, true)) != NULL);
+    fail_unless(pa_database_set(db, &k, &d, true) == 0);
+    pa_database_close(db);
+}
+
+static void store_tagstruct(const char *key, pa_tagstruct *t) {
+    const uint8_t *data;
+    size_t size;
+
+    data = pa_tagstruct_data(t, &size);
+    store(key, data, size);
+    pa_tagstruct_free(t);
+}
+
+static void assert_unprobed(pa_alsa_profile_set *ps, const char *key) {
+    fail_if(load(ps, key));
+    fail_if(ps->probed);
+    fail_unless(pa_hashmap_get(ps->profiles, "output:analog-mono") != NULL);
+    fail_unless(pa_hashmap_get(ps->mappings, "analog-mono") != NULL);
+}
+
+START_TEST (probe_cache_corrupt_test) {
+    pa_alsa_profile_set *ps;
+    pa_channel_map stereo;
+    pa_tagstruct *t;
+    char *key;
+
+    fail_unless((ps = pa_alsa_profile_set_new(conf_path, NULL)) != NULL);
+    key = card_key(ps, "snd_hda_intel");
+
+    /* Not a tagstruct at all */
+    store(key, "garbage", 7);
+    assert_unprobed(ps, key);
+
+    /* Unknown version */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, 0xff);
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* Truncated after the profile count */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+    pa_tagstruct_putu32(t, 1);
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* A profile this profile set doesn't have */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "output:surround");
+    pa_tagstruct_putu32(t, 0);
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* An entry from before the mixer paths were stored */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, 1);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "output:analog-stereo");
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "analog-stereo");
+    pa_tagstruct_put_channel_map(t, pa_channel_map_init_stereo(&stereo));
+    pa_tagstruct_puts64(t, 3);
+    pa_tagstruct_putu32(t, 1);
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* A mixer path list that ends early */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "output:analog-stereo");
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "analog-stereo");
+    pa_tagstruct_put_channel_map(t, pa_channel_map_init_stereo(&stereo));
+    pa_tagstruct_puts64(t, 3);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_putu32(t, 2);
+    pa_tagstruct_puts(t, "analog-output-speaker");
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* A valid entry followed by trailing junk */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "output:analog-stereo");
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "analog-stereo");
+    pa_tagstruct_put_channel_map(t, pa_channel_map_init_stereo(&stereo));
+    pa_tagstruct_puts64(t, 3);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_puts(t, "analog-output-speaker");
+    pa_tagstruct_putu32(t, 0);
+    pa_tagstruct_putu32(t, 0);
+    store_tagstruct(key, t);
+    assert_unprobed(ps, key);
+
+    /* A fresh probe result replaces the corrupt entry */
+    save(key);
+    fail_unless(load(ps, key));
+    fail_unless(ps->probed);
+
+    pa_alsa_profile_set_free(ps);
+    pa_xfree(key);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-probe-cache");
+    tc = tcase_create("alsa-probe-cache");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, probe_cache_key_test);
+    tcase_add_test(tc, probe_cache_hit_test);
+    tcase_add_test(tc, probe_cache_card_change_test);
+    tcase_add_test(tc, probe_cache_corrupt_test);
+    tcase_set_timeout(tc, 30);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
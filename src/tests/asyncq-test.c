@@ -87,6 +87,113 @@ START_TEST (asyncq_test) {
 }
 END_TEST
 
+static void batch_producer(void *_q) {
+    pa_asyncq *q = _q;
+    void *p[7];
+    unsigned i, k;
+
+    for (i = 0; i < 1000; i += k) {
+        unsigned n = PA_MIN(PA_ELEMENTSOF(p), 1000 - i);
+
+        for (k = 0; k < n; k++)
+            p[k] = PA_UINT_TO_PTR(i+k+1);
+
+        fail_unless(pa_asyncq_push_many(q, p, n, true) == n);
+    }
+
+    pa_asyncq_push(q, PA_UINT_TO_PTR(-1), true);
+}
+
+static void batch_consumer(void *_q) {
+    pa_asyncq *q = _q;
+    void *p[5];
+    unsigned i = 0, k, n;
+
+    pa_msleep(100);
+
+    for (;;) {
+        n = pa_asyncq_pop_many(q, p, PA_ELEMENTSOF(p), true);
+        fail_unless(n > 0);
+
+        for (k = 0; k < n; k++, i++) {
+            if (p[k] == PA_UINT_TO_PTR(-1)) {
+                fail_unless(i == 1000);
+                fail_unless(k == n - 1);
+                return;
+            }
+
+            fail_unless(p[k] == PA_UINT_TO_PTR(i+1));
+        }
+    }
+}
+
+START_TEST (asyncq_batch_test) {
+    pa_asyncq *q[2];
+    pa_thread *t1, *t2;
+    unsigned i;
+
+    q[0] = pa_asyncq_new(16);
+    q[1] = pa_asyncq_new_growable(4, 64);
+
+    for (i = 0; i < PA_ELEMENTSOF(q); i++) {
+        fail_unless(q[i] != NULL);
+
+        t1 = pa_thread_new("producer", batch_producer, q[i]);
+        fail_unless(t1 != NULL);
+        t2 = pa_thread_new("consumer", batch_consumer, q[i]);
+        fail_unless(t2 != NULL);
+
+        pa_thread_free(t1);
+        pa_thread_free(t2);
+
+        pa_asyncq_free(q[i], NULL);
+    }
+}
+END_TEST
+
+START_TEST (asyncq_grow_test) {
+    pa_asyncq *q;
+    void *p[128];
+    unsigned i, n;
+
+    q = pa_asyncq_new_growable(4, 64);
+    fail_unless(q != NULL);
+
+    /* Without a reader, the ring grows from 4 to 64 entries. The old
+     * segments stay around until they are drained, so 4+8+16+32+64 items
+     * fit in. */
+    for (i = 0; i < 124; i++)
+        fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(i+1), false) == 0);
+
+    fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(125), false) < 0);
+
+    /* Partially drain, so the reader sits in the middle of an old segment */
+    n = pa_asyncq_pop_many(q, p, 3, false);
+    fail_unless(n == 3);
+
+    for (i = 0; i < n; i++)
+        fail_unless(p[i] == PA_UINT_TO_PTR(i+1));
+
+    n = pa_asyncq_pop_many(q, p, PA_ELEMENTSOF(p), false);
+    fail_unless(n == 121);
+
+    for (i = 0; i < n; i++)
+        fail_unless(p[i] == PA_UINT_TO_PTR(i+4));
+
+    fail_unless(pa_asyncq_pop(q, false) == NULL);
+    fail_unless(pa_asyncq_read_before_poll(q) == 0);
+    pa_asyncq_read_after_poll(q);
+
+    /* Only the largest segment is left, and it wraps around */
+    for (i = 0; i < 100; i++) {
+        fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(i+1), false) == 0);
+        fail_unless(pa_asyncq_pop(q, false) == PA_UINT_TO_PTR(i+1));
+    }
+
+    pa_asyncq_free(q, NULL);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -96,6 +203,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Queue");
     tc = tcase_create("asyncq");
     tcase_add_test(tc, asyncq_test);
+    tcase_add_test(tc, asyncq_batch_test);
+    tcase_add_test(tc, asyncq_grow_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,157 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/convolver.h>
+#include <pulsecore/macro.h>
+
+#define N_INPUTS 3
+#define N_OUTPUTS 2
+#define N_BLOCKS 24
+
+/* Impulse response lengths shorter than, equal to and spanning several
+ * partitions, with one input/output pair left without a filter */
+static const size_t ir_lengths[N_INPUTS][N_OUTPUTS] = {
+    { 1, 300 },
+    { 64, 0 },
+    { 129, 31 },
+};
+
+static float random_sample(void) {
+    return (float) rand() / (float) RAND_MAX - 0.5f;
+}
+
+/* out[n] = sum over inputs of (in * ir)[n], the slow way */
+static void convolve_direct(const float *in, size_t n_frames, float *ir[N_INPUTS][N_OUTPUTS], float *out) {
+    size_t n, j;
+    unsigned i, o;
+
+    for (n = 0; n < n_frames; n++)
+        for (o = 0; o < N_OUTPUTS; o++) {
+            double sum = 0;
+
+            for (i = 0; i < N_INPUTS; i++)
+                for (j = 0; j < ir_lengths[i][o] && j <= n; j++)
+                    sum += (double) ir[i][o][j] * in[(n - j) * N_INPUTS + i];
+
+            out[n * N_OUTPUTS + o] = (float) sum;
+        }
+}
+
+static void check_block(const float *got, const float *expected, size_t n) {
+    size_t s;
+
+    for (s = 0; s < n; s++)
+        ck_assert_msg(fabsf(got[s] - expected[s]) < 1e-4f, "sample %zu: %f != %f", s, got[s], expected[s]);
+}
+
+START_TEST (convolver_test) {
+    const size_t block_sizes[] = { 16, 64, 128 };
+    size_t block_size = block_sizes[_i];
+    float *ir[N_INPUTS][N_OUTPUTS];
+    float *in, *out, *expected;
+    pa_convolver *c;
+    size_t n_frames, history, b, s;
+    unsigned i, o;
+
+    srand(_i);
+    n_frames = N_BLOCKS * block_size;
+
+    fail_unless((c = pa_convolver_new(block_size, N_INPUTS, N_OUTPUTS, 300)) != NULL);
+    ck_assert_int_eq(pa_convolver_get_block_size(c), block_size);
+
+    history = pa_convolver_get_history(c);
+    ck_assert_int_eq(history % block_size, 0);
+    fail_unless(history >= 300);
+
+    for (i = 0; i < N_INPUTS; i++)
+        for (o = 0; o < N_OUTPUTS; o++) {
+            ir[i][o] = pa_xnew(float, ir_lengths[i][o] + 1);
+
+            for (s = 0; s < ir_lengths[i][o]; s++)
+                ir[i][o][s] = random_sample();
+
+            pa_convolver_set_ir(c, i, o, ir[i][o], ir_lengths[i][o]);
+        }
+
+    in = pa_xnew(float, n_frames * N_INPUTS);
+    out = pa_xnew(float, block_size * N_OUTPUTS);
+    expected = pa_xnew(float, n_frames * N_OUTPUTS);
+
+    for (s = 0; s < n_frames * N_INPUTS; s++)
+        in[s] = random_sample();
+
+    convolve_direct(in, n_frames, ir, expected);
+
+    for (b = 0; b < N_BLOCKS / 2; b++) {
+        pa_convolver_process(c, in + b * block_size * N_INPUTS, out);
+        check_block(out, expected + b * block_size * N_OUTPUTS, block_size * N_OUTPUTS);
+    }
+
+    /* Throw the state away and rebuild it from the input history, the way
+     * a filter sink does after a rewind */
+    pa_convolver_reset(c);
+
+    for (s = history > b * block_size ? 0 : b * block_size - history; s < b * block_size; s += block_size) {
+        /* Blocks before the start of the stream are silence anyway */
+        pa_convolver_process(c, in + s * N_INPUTS, NULL);
+    }
+
+    for (; b < N_BLOCKS; b++) {
+        pa_convolver_process(c, in + b * block_size * N_INPUTS, out);
+        check_block(out, expected + b * block_size * N_OUTPUTS, block_size * N_OUTPUTS);
+    }
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_xfree(expected);
+
+    for (i = 0; i < N_INPUTS; i++)
+        for (o = 0; o < N_OUTPUTS; o++)
+            pa_xfree(ir[i][o]);
+
+    pa_convolver_free(c);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Convolver");
+    tc = tcase_create("convolver");
+    tcase_add_loop_test(tc, convolver_test, 0, 3);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,320 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "runtime-test-util.h"
+
+/* Not a multiple of any vector width, so the leftover paths get exercised */
+#define SAMPLES 1021
+#define TIMES 300
+#define TIMES2 100
+
+#define CHANNELS PA_INTERLEAVE_CHANNELS_MAX
+
+typedef struct interleave_funcs {
+    pa_interleave_func_t interleave[2][CHANNELS];
+    pa_deinterleave_func_t deinterleave[2][CHANNELS];
+    pa_interleave_to_s16ne_func_t interleave_to_s16ne[CHANNELS];
+    pa_deinterleave_to_float32ne_func_t deinterleave_to_float32ne[CHANNELS];
+} interleave_funcs;
+
+static void get_funcs(interleave_funcs *f) {
+    unsigned c;
+
+    for (c = 1; c <= CHANNELS; c++) {
+        f->interleave[0][c - 1] = pa_get_interleave_func(2, c);
+        f->interleave[1][c - 1] = pa_get_interleave_func(4, c);
+        f->deinterleave[0][c - 1] = pa_get_deinterleave_func(2, c);
+        f->deinterleave[1][c - 1] = pa_get_deinterleave_func(4, c);
+        f->interleave_to_s16ne[c - 1] = pa_get_interleave_to_s16ne_func(c);
+        f->deinterleave_to_float32ne[c - 1] = pa_get_deinterleave_to_float32ne_func(c);
+    }
+}
+
+static void run_interleave_test(
+        const interleave_funcs *func,
+        const interleave_funcs *orig,
+        size_t ss,
+        unsigned channels,
+        bool perf) {
+
+    pa_interleave_func_t ifunc = func->interleave[ss == 4][channels - 1];
+    pa_interleave_func_t iorig = orig->interleave[ss == 4][channels - 1];
+    pa_deinterleave_func_t dfunc = func->deinterleave[ss == 4][channels - 1];
+    pa_deinterleave_func_t dorig = orig->deinterleave[ss == 4][channels - 1];
+
+    uint8_t *planes[CHANNELS], *planes_ref[CHANNELS];
+    uint8_t *frames, *frames_ref;
+    unsigned c;
+
+    frames = pa_xmalloc(SAMPLES * CHANNELS * ss);
+    frames_ref = pa_xmalloc(SAMPLES * CHANNELS * ss);
+
+    for (c = 0; c < channels; c++) {
+        planes[c] = pa_xmalloc(SAMPLES * ss);
+        planes_ref[c] = pa_xmalloc(SAMPLES * ss);
+        pa_random(planes_ref[c], SAMPLES * ss);
+    }
+
+    iorig((const void **) planes_ref, frames_ref, SAMPLES);
+    ifunc((const void **) planes_ref, frames, SAMPLES);
+    fail_unless(memcmp(frames, frames_ref, SAMPLES * channels * ss) == 0);
+
+    dfunc(frames_ref, (void **) planes, SAMPLES);
+    for (c = 0; c < channels; c++)
+        fail_unless(memcmp(planes[c], planes_ref[c], SAMPLES * ss) == 0);
+
+    if (perf) {
+        pa_log_debug("Testing %u channel %u byte interleave performance", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            ifunc((const void **) planes_ref, frames, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            iorig((const void **) planes_ref, frames_ref, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_log_debug("Testing %u channel %u byte deinterleave performance", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            dfunc(frames_ref, (void **) planes, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            dorig(frames_ref, (void **) planes, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (c = 0; c < channels; c++) {
+        pa_xfree(planes[c]);
+        pa_xfree(planes_ref[c]);
+    }
+
+    pa_xfree(frames);
+    pa_xfree(frames_ref);
+}
+
+static void run_conv_test(
+        const interleave_funcs *func,
+        const interleave_funcs *orig,
+        unsigned channels,
+        bool perf) {
+
+    pa_interleave_to_s16ne_func_t ifunc = func->interleave_to_s16ne[channels - 1];
+    pa_interleave_to_s16ne_func_t iorig = orig->interleave_to_s16ne[channels - 1];
+    pa_deinterleave_to_float32ne_func_t dfunc = func->deinterleave_to_float32ne[channels - 1];
+    pa_deinterleave_to_float32ne_func_t dorig = orig->deinterleave_to_float32ne[channels - 1];
+
+    float *floats[CHANNELS], *floats_ref[CHANNELS];
+    int16_t *samples, *samples_ref;
+    unsigned c, i;
+
+    samples = pa_xnew(int16_t, SAMPLES * CHANNELS);
+    samples_ref = pa_xnew(int16_t, SAMPLES * CHANNELS);
+
+    for (c = 0; c < channels; c++) {
+        floats[c] = pa_xnew(float, SAMPLES);
+        floats_ref[c] = pa_xnew(float, SAMPLES);
+
+        /* Slightly out of range to exercise clamping */
+        for (i = 0; i < SAMPLES; i++)
+            floats_ref[c][i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+    }
+
+    iorig((const float **) floats_ref, samples_ref, SAMPLES);
+    ifunc((const float **) floats_ref, samples, SAMPLES);
+
+    for (i = 0; i < SAMPLES * channels; i++) {
+        if (abs(samples[i] - samples_ref[i]) > 1) {
+            pa_log_debug("Correctness test failed: channels=%u", channels);
+            pa_log_debug("%u: %04hx != %04hx\n", i, samples[i], samples_ref[i]);
+            ck_abort();
+        }
+    }
+
+    dorig(samples_ref, floats_ref, SAMPLES);
+    dfunc(samples_ref, floats, SAMPLES);
+
+    for (c = 0; c < channels; c++) {
+        for (i = 0; i < SAMPLES; i++) {
+            if (fabsf(floats[c][i] - floats_ref[c][i]) > 0.0001f) {
+                pa_log_debug("Correctness test failed: channels=%u", channels);
+                pa_log_debug("%u/%u: %.24f != %.24f\n", c, i, floats[c][i], floats_ref[c][i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %u channel float -> s16 interleave performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            ifunc((const float **) floats_ref, samples, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            iorig((const float **) floats_ref, samples_ref, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_log_debug("Testing %u channel s16 -> float deinterleave performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            dfunc(samples_ref, floats, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            dorig(samples_ref, floats_ref, SAMPLES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (c = 0; c < channels; c++) {
+        pa_xfree(floats[c]);
+        pa_xfree(floats_ref[c]);
+    }
+
+    pa_xfree(samples);
+    pa_xfree(samples_ref);
+}
+
+static void run_all_tests(const interleave_funcs *func, const interleave_funcs *orig) {
+    unsigned c;
+
+    for (c = 1; c <= CHANNELS; c++) {
+        run_interleave_test(func, orig, 2, c, true);
+        run_interleave_test(func, orig, 4, c, true);
+        run_conv_test(func, orig, c, true);
+    }
+}
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
+START_TEST (interleave_sse_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    interleave_funcs orig, sse;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    get_funcs(&orig);
+    pa_interleave_func_init_sse(flags);
+    get_funcs(&sse);
+
+    pa_log_debug("Checking SSE interleave");
+    run_all_tests(&sse, &orig);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (interleave_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    interleave_funcs orig, neon;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    get_funcs(&orig);
+    pa_interleave_func_init_neon(flags);
+    get_funcs(&neon);
+
+    pa_log_debug("Checking NEON interleave");
+    run_all_tests(&neon, &orig);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
+/* The unrolled C kernels against a straightforward reference */
+START_TEST (interleave_c_test) {
+    static uint8_t planes[2][CHANNELS][SAMPLES * 4];
+    static uint8_t frames[SAMPLES * CHANNELS * 4];
+    void *p[CHANNELS];
+    unsigned c, k, i;
+    size_t ss;
+
+    for (ss = 2; ss <= 4; ss += 2) {
+        for (c = 1; c <= CHANNELS; c++) {
+            for (k = 0; k < c; k++) {
+                pa_random(planes[0][k], SAMPLES * ss);
+                p[k] = planes[0][k];
+            }
+
+            pa_interleave((const void **) p, c, frames, ss, SAMPLES);
+
+            for (i = 0; i < SAMPLES; i++)
+                for (k = 0; k < c; k++)
+                    fail_unless(memcmp(frames + (i * c + k) * ss, planes[0][k] + i * ss, ss) == 0);
+
+            for (k = 0; k < c; k++)
+                p[k] = planes[1][k];
+
+            pa_deinterleave(frames, p, c, ss, SAMPLES);
+
+            for (k = 0; k < c; k++)
+                fail_unless(memcmp(planes[0][k], planes[1][k], SAMPLES * ss) == 0);
+        }
+    }
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("interleave");
+    tcase_add_test(tc, interleave_c_test);
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
+    tcase_add_test(tc, interleave_sse_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, interleave_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,277 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/log.h>
+
+/* The journal file starts with a four byte magic */
+#define MAGIC_SIZE 4
+
+static char *dir, *journal_path, *test_path, *other_path;
+static pa_mainloop *m;
+static pa_core *core;
+
+static void set_string(pa_database_journal *j, pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+
+    key.data = (void *) k;
+    key.size = strlen(k);
+    data.data = (void *) v;
+    data.size = strlen(v);
+
+    fail_unless(pa_database_journal_set(j, db, &key, &data, true) == 0);
+}
+
+static void unset_string(pa_database_journal *j, pa_database *db, const char *k) {
+    pa_datum key;
+
+    key.data = (void *) k;
+    key.size = strlen(k);
+
+    fail_unless(pa_database_journal_unset(j, db, &key) == 0);
+}
+
+static bool has_string(pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+    bool r;
+
+    key.data = (void *) k;
+    key.size = strlen(k);
+
+    if (!pa_database_get(db, &key, &data))
+        return v == NULL;
+
+    r = v && data.size == strlen(v) && memcmp(data.data, v, data.size) == 0;
+    pa_datum_free(&data);
+
+    return r;
+}
+
+static size_t file_size(const char *fn) {
+    struct stat st;
+
+    fail_unless(stat(fn, &st) == 0);
+
+    return (size_t) st.st_size;
+}
+
+static uint8_t *read_file(const char *fn, size_t *length) {
+    uint8_t *buffer;
+    FILE *f;
+
+    *length = file_size(fn);
+    buffer = pa_xmalloc(*length);
+
+    fail_unless((f = fopen(fn, "r")) != NULL);
+    fail_unless(fread(buffer, *length, 1, f) == 1);
+    fclose(f);
+
+    return buffer;
+}
+
+static void write_file(const char *fn, const void *buffer, size_t length) {
+    FILE *f;
+
+    fail_unless((f = fopen(fn, "w")) != NULL);
+    fail_unless(fwrite(buffer, length, 1, f) == 1);
+    fclose(f);
+}
+
+static void setup(void) {
+    char t[] = "/tmp/database-journal-test-XXXXXX";
+
+    fail_unless(mkdtemp(t) != NULL);
+    dir = pa_xstrdup(t);
+    test_path = pa_sprintf_malloc("%s/test.db", dir);
+    other_path = pa_sprintf_malloc("%s/other.db", dir);
+
+    /* The journal lives in the state directory */
+    setenv("PULSE_STATE_PATH", dir, 1);
+    fail_unless((journal_path = pa_state_path("restore-journal", true)) != NULL);
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(m), false, false, 0)) != NULL);
+}
+
+static void teardown(void) {
+    char *fn;
+
+    pa_core_unref(core);
+    pa_mainloop_free(m);
+
+    unlink(journal_path);
+    fn = pa_sprintf_malloc("%s.tmp", journal_path);
+    unlink(fn);
+    pa_xfree(fn);
+    unlink(test_path);
+    unlink(other_path);
+    rmdir(dir);
+
+    pa_xfree(journal_path);
+    pa_xfree(test_path);
+    pa_xfree(other_path);
+    pa_xfree(dir);
+}
+
+START_TEST (database_journal_replay_test) {
+    pa_database_journal *j;
+    pa_database *test, *other;
+    uint8_t *journal;
+    size_t complete, length;
+
+    /* Journal some changes for two databases */
+    fail_unless((test = pa_database_open_internal(test_path, true)) != NULL);
+    fail_unless((other = pa_database_open_internal(other_path, true)) != NULL);
+    j = pa_database_journal_get(core);
+    pa_database_journal_attach(j, test, "test");
+    pa_database_journal_attach(j, other, "other");
+
+    set_string(j, test, "z", "0");
+    fail_unless(pa_database_journal_clear(j, test) == 0);
+    set_string(j, test, "a", "1");
+    set_string(j, test, "b", "2");
+    unset_string(j, test, "a");
+    set_string(j, other, "x", "9");
+    pa_database_journal_flush(j);
+    complete = file_size(journal_path);
+
+    set_string(j, test, "c", "3");
+    pa_database_journal_flush(j);
+
+    journal = read_file(journal_path, &length);
+    fail_unless(length > complete);
+
+    pa_database_journal_detach(j, test);
+    pa_database_journal_detach(j, other);
+    pa_database_close(test);
+    pa_database_close(other);
+    pa_database_journal_unref(j);
+
+    /* As if we crashed before any database got synced, in the middle of
+     * appending the last record */
+    unlink(test_path);
+    unlink(other_path);
+    write_file(journal_path, journal, complete + (length - complete) / 2);
+    pa_xfree(journal);
+
+    /* The torn record is dropped from the journal right away */
+    j = pa_database_journal_get(core);
+    ck_assert_int_eq(file_size(journal_path), complete);
+
+    fail_unless((test = pa_database_open_internal(test_path, true)) != NULL);
+    pa_database_journal_attach(j, test, "test");
+    fail_unless(has_string(test, "z", NULL));
+    fail_unless(has_string(test, "a", NULL));
+    fail_unless(has_string(test, "b", "2"));
+    fail_unless(has_string(test, "c", NULL));
+    ck_assert_int_eq(pa_database_size(test), 1);
+
+    /* Compaction syncs the attached database and keeps only what nobody
+     * attached yet */
+    pa_database_journal_detach(j, test);
+    pa_database_close(test);
+    pa_database_journal_unref(j);
+
+    fail_unless(file_size(journal_path) > MAGIC_SIZE);
+    fail_unless(file_size(journal_path) < complete);
+
+    fail_unless((test = pa_database_open_internal(test_path, false)) != NULL);
+    fail_unless(has_string(test, "b", "2"));
+    ck_assert_int_eq(pa_database_size(test), 1);
+    pa_database_close(test);
+
+    /* The rest is still there for the other database */
+    j = pa_database_journal_get(core);
+    fail_unless((other = pa_database_open_internal(other_path, true)) != NULL);
+    pa_database_journal_attach(j, other, "other");
+    fail_unless(has_string(other, "x", "9"));
+    pa_database_journal_detach(j, other);
+    pa_database_close(other);
+    pa_database_journal_unref(j);
+
+    ck_assert_int_eq(file_size(journal_path), MAGIC_SIZE);
+
+    fail_unless((other = pa_database_open_internal(other_path, false)) != NULL);
+    fail_unless(has_string(other, "x", "9"));
+    pa_database_close(other);
+}
+END_TEST
+
+START_TEST (database_journal_garbage_test) {
+    static const uint8_t garbage[] = { 'P', 'A', 'J', '1', 0xde, 0xad, 0xbe, 0xef, 1, 2, 3, 4, 5, 6, 7, 8,
+                                       0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0 };
+    pa_database_journal *j;
+    pa_database *test;
+
+    /* Nothing usable in there, but nothing breaks either */
+    write_file(journal_path, garbage, sizeof(garbage));
+
+    j = pa_database_journal_get(core);
+    ck_assert_int_eq(file_size(journal_path), MAGIC_SIZE);
+
+    fail_unless((test = pa_database_open_internal(test_path, true)) != NULL);
+    pa_database_journal_attach(j, test, "test");
+    ck_assert_int_eq(pa_database_size(test), 0);
+
+    set_string(j, test, "a", "1");
+    pa_database_journal_detach(j, test);
+    pa_database_close(test);
+    pa_database_journal_unref(j);
+
+    fail_unless((test = pa_database_open_internal(test_path, false)) != NULL);
+    fail_unless(has_string(test, "a", "1"));
+    pa_database_close(test);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Database-journal");
+    tc = tcase_create("database-journal");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, database_journal_replay_test);
+    tcase_add_test(tc, database_journal_garbage_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
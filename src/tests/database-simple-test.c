@@ -0,0 +1,574 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define ENTRIES 5000
+#define TIMES 10
+#define TIMES2 10
+
+static char *dir, *path;
+
+static void set_string(pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+
+    key.data = (void *) k;
+    key.size = strlen(k);
+    data.data = (void *) v;
+    data.size = strlen(v);
+
+    fail_unless(pa_database_set(db, &key, &data, true) == 0);
+}
+
+static bool has_string(pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+    bool r;
+
+    key.data = (void *) k;
+    key.size = strlen(k);
+
+    if (!pa_database_get(db, &key, &data))
+        return v == NULL;
+
+    r = v && data.size == strlen(v) && memcmp(data.data, v, data.size) == 0;
+    pa_datum_free(&data);
+
+    return r;
+}
+
+static unsigned count_entries(pa_database *db) {
+    pa_datum key, next;
+    unsigned n = 0;
+    bool done;
+
+    done = !pa_database_first(db, &key, NULL);
+    while (!done) {
+        n++;
+        done = !pa_database_next(db, &key, &next, NULL);
+        pa_datum_free(&key);
+        key = next;
+    }
+
+    return n;
+}
+
+static void fill(pa_database *db, unsigned n) {
+    char k[64], v[64];
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        pa_snprintf(k, sizeof(k), "sink-input-by-application-name:app%u", i);
+        pa_snprintf(v, sizeof(v), "volume-of-app%u", i);
+        set_string(db, k, v);
+    }
+}
+
+/* The on-disk layout, as in database-simple.c */
+
+typedef struct file_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_buckets;
+    uint32_t n_entries;
+    uint32_t n_deleted;
+    uint32_t data_end;
+    uint32_t garbage;
+    uint32_t reserved;
+} file_header;
+
+typedef struct wal_header {
+    char magic[4];
+    uint32_t n_records;
+    uint32_t length;
+    uint32_t checksum;
+} wal_header;
+
+typedef struct wal_record {
+    uint32_t removed;
+    uint32_t key_size;
+    uint32_t data_size;
+} wal_record;
+
+static uint8_t *read_file(const char *fn, size_t *length) {
+    uint8_t *buffer;
+    FILE *f;
+    long l;
+
+    fail_unless((f = fopen(fn, "r")) != NULL);
+    fail_unless(fseek(f, 0, SEEK_END) == 0);
+    fail_unless((l = ftell(f)) > 0);
+    rewind(f);
+
+    buffer = pa_xmalloc(l);
+    fail_unless(fread(buffer, l, 1, f) == 1);
+    fclose(f);
+
+    *length = l;
+    return buffer;
+}
+
+static void write_file(const char *fn, const void *buffer, size_t length) {
+    FILE *f;
+
+    fail_unless((f = fopen(fn, "w")) != NULL);
+    fail_unless(fwrite(buffer, length, 1, f) == 1);
+    fclose(f);
+}
+
+static uint32_t fnv1a(const uint8_t *p, size_t length) {
+    uint32_t h = 2166136261U;
+
+    while (length--) {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* Builds a log of changes; a NULL value removes the key */
+static uint8_t *make_wal(const char *const changes[][2], unsigned n, size_t *length) {
+    uint8_t *buffer;
+    wal_header *w;
+    size_t offset;
+    unsigned i;
+
+    *length = sizeof(wal_header);
+    for (i = 0; i < n; i++)
+        *length += sizeof(wal_record) + strlen(changes[i][0]) + (changes[i][1] ? strlen(changes[i][1]) : 0);
+
+    buffer = pa_xmalloc0(*length);
+    w = (wal_header *) buffer;
+    memcpy(w->magic, "PAWL", 4);
+    offset = sizeof(wal_header);
+
+    for (i = 0; i < n; i++) {
+        wal_record r;
+
+        r.removed = !changes[i][1];
+        r.key_size = strlen(changes[i][0]);
+        r.data_size = changes[i][1] ? strlen(changes[i][1]) : 0;
+        memcpy(buffer + offset, &r, sizeof(r));
+        offset += sizeof(r);
+        memcpy(buffer + offset, changes[i][0], r.key_size);
+        offset += r.key_size;
+        if (r.data_size > 0)
+            memcpy(buffer + offset, changes[i][1], r.data_size);
+        offset += r.data_size;
+        w->n_records++;
+    }
+
+    w->length = *length - sizeof(wal_header);
+    w->checksum = fnv1a(buffer + sizeof(wal_header), w->length);
+
+    return buffer;
+}
+
+static char *wal_path(void) {
+    return pa_sprintf_malloc("%s.wal", path);
+}
+
+static bool wal_exists(void) {
+    char *fn = wal_path();
+    bool r = access(fn, F_OK) == 0;
+
+    pa_xfree(fn);
+    return r;
+}
+
+static void put_wal(const void *buffer, size_t length) {
+    char *fn = wal_path();
+
+    write_file(fn, buffer, length);
+    pa_xfree(fn);
+}
+
+static size_t find(const uint8_t *buffer, size_t length, const char *s) {
+    size_t i, l = strlen(s);
+
+    for (i = 0; i + l <= length; i++)
+        if (memcmp(buffer + i, s, l) == 0)
+            return i;
+
+    ck_abort_msg("'%s' not found", s);
+    return 0;
+}
+
+static void setup(void) {
+    char t[] = "/tmp/database-simple-test-XXXXXX";
+
+    fail_unless(mkdtemp(t) != NULL);
+    dir = pa_xstrdup(t);
+    path = pa_sprintf_malloc("%s/test.simple", dir);
+}
+
+static void teardown(void) {
+    char *fn;
+
+    unlink(path);
+    fn = pa_sprintf_malloc("%s.wal", path);
+    unlink(fn);
+    pa_xfree(fn);
+    rmdir(dir);
+
+    pa_xfree(path);
+    pa_xfree(dir);
+}
+
+START_TEST (database_simple_roundtrip_test) {
+    pa_database *db;
+    pa_datum key;
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fill(db, 100);
+    fail_unless(pa_database_sync(db) == 0);
+
+    /* In place, growing, removed and new entries */
+    set_string(db, "sink-input-by-application-name:app1", "short");
+    set_string(db, "sink-input-by-application-name:app2", "a value that no longer fits in place");
+    key.data = (void *) "sink-input-by-application-name:app3";
+    key.size = strlen(key.data);
+    fail_unless(pa_database_unset(db, &key) == 0);
+    fail_unless(pa_database_unset(db, &key) < 0);
+    set_string(db, "new", "entry");
+
+    fail_unless(pa_database_size(db) == 100);
+    fail_unless(count_entries(db) == 100);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "sink-input-by-application-name:app1", "short"));
+    fail_unless(has_string(db, "sink-input-by-application-name:app2", "a value that no longer fits in place"));
+    fail_unless(has_string(db, "sink-input-by-application-name:app3", NULL));
+    fail_unless(has_string(db, "sink-input-by-application-name:app4", "volume-of-app4"));
+    fail_unless(has_string(db, "new", "entry"));
+    fail_unless(pa_database_size(db) == 100);
+    fail_unless(count_entries(db) == 100);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fail_unless(pa_database_clear(db) == 0);
+    fail_unless(pa_database_size(db) == 0);
+    fail_unless(count_entries(db) == 0);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(pa_database_size(db) == 0);
+    pa_database_close(db);
+}
+END_TEST
+
+START_TEST (database_simple_migrate_test) {
+    static const uint8_t old[] = {
+        3, 0, 0, 0, 'a', 'b', 'c',
+        2, 0, 0, 0, 'x', 'y',
+        1, 0, 0, 0, 'd',
+        1, 0, 0, 0, 'e'
+    };
+    pa_database *db;
+    FILE *f;
+
+    fail_unless((f = fopen(path, "w")) != NULL);
+    fail_unless(fwrite(old, sizeof(old), 1, f) == 1);
+    fclose(f);
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fail_unless(has_string(db, "abc", "xy"));
+    fail_unless(has_string(db, "d", "e"));
+    fail_unless(pa_database_size(db) == 2);
+    pa_database_close(db);
+
+    /* Converted on open, readable without the old parser now */
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "abc", "xy"));
+    fail_unless(count_entries(db) == 2);
+    pa_database_close(db);
+}
+END_TEST
+
+START_TEST (database_simple_wal_replay_test) {
+    static const char *const changes[][2] = {
+        { "a", "2" },
+        { "b", "new" },
+        { "c", NULL },
+    };
+    pa_database *db;
+    uint8_t *wal;
+    size_t length;
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    set_string(db, "a", "1");
+    set_string(db, "c", "3");
+    pa_database_close(db);
+
+    /* As if we crashed after writing the log, before updating the file */
+    wal = make_wal(changes, PA_ELEMENTSOF(changes), &length);
+    put_wal(wal, length);
+    pa_xfree(wal);
+
+    /* Read-only opens don't replay */
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "a", "1"));
+    fail_unless(has_string(db, "c", "3"));
+    pa_database_close(db);
+    fail_unless(wal_exists());
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fail_unless(!wal_exists());
+    fail_unless(has_string(db, "a", "2"));
+    fail_unless(has_string(db, "b", "new"));
+    fail_unless(has_string(db, "c", NULL));
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "a", "2"));
+    fail_unless(has_string(db, "b", "new"));
+    fail_unless(has_string(db, "c", NULL));
+    fail_unless(pa_database_size(db) == 2);
+    fail_unless(count_entries(db) == 2);
+    pa_database_close(db);
+}
+END_TEST
+
+START_TEST (database_simple_torn_wal_test) {
+    static const char *const changes[][2] = {
+        { "a", "2" },
+        { "b", "new" },
+    };
+    pa_database *db;
+    wal_header *w;
+    uint8_t *wal;
+    size_t length;
+    unsigned i;
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    set_string(db, "a", "1");
+    pa_database_close(db);
+
+    wal = make_wal(changes, PA_ELEMENTSOF(changes), &length);
+    w = (wal_header *) wal;
+
+    for (i = 0; i < 5; i++) {
+        size_t l = length;
+
+        switch (i) {
+            case 0:
+                /* Cut off in the middle of the last record */
+                l = length - 2;
+                break;
+            case 1:
+                /* Only the header made it */
+                l = sizeof(wal_header);
+                break;
+            case 2:
+                /* A length the file can't hold */
+                w->length = UINT32_MAX;
+                break;
+            case 3:
+                w->length = 0;
+                break;
+            case 4:
+                /* Complete, but the contents don't match the checksum */
+                w->length = length - sizeof(wal_header);
+                wal[length - 1] ^= 0xff;
+                break;
+        }
+
+        put_wal(wal, l);
+
+        /* The log was never acted upon, the file is what it was */
+        fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+        fail_unless(!wal_exists(), "log %u was kept", i);
+        fail_unless(has_string(db, "a", "1"), "log %u was replayed", i);
+        fail_unless(has_string(db, "b", NULL), "log %u was replayed", i);
+        pa_database_close(db);
+    }
+
+    pa_xfree(wal);
+}
+END_TEST
+
+/* Finds a used bucket from i on that doesn't hold app7 or app42 */
+static uint32_t other_bucket(uint8_t *file, uint32_t i) {
+    file_header *h = (file_header *) file;
+    uint32_t *buckets = (uint32_t *) (file + sizeof(file_header));
+
+    for (; i < h->n_buckets; i++) {
+        const char *k;
+        uint32_t l;
+
+        if (buckets[i] <= 1)
+            continue;
+
+        /* The key follows the four fields of the record header */
+        l = ((uint32_t *) (file + buckets[i]))[0];
+        k = (const char *) file + buckets[i] + 4 * sizeof(uint32_t);
+
+        if ((l == 35 && memcmp(k, "sink-input-by-application-name:app7", l) == 0) ||
+            (l == 36 && memcmp(k, "sink-input-by-application-name:app42", l) == 0))
+            continue;
+
+        return i;
+    }
+
+    ck_abort_msg("Out of buckets");
+    return 0;
+}
+
+START_TEST (database_simple_recovery_test) {
+    static const char *const changes[][2] = {
+        { "sink-input-by-application-name:app7", "restored" },
+    };
+    pa_database *db;
+    uint8_t *file, *wal;
+    uint32_t *buckets, i;
+    size_t length, wal_length, o;
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fill(db, 100);
+    pa_database_close(db);
+
+    file = read_file(path, &length);
+    buckets = (uint32_t *) (file + sizeof(file_header));
+
+    /* A record torn by a crash in the middle of an in place update */
+    o = find(file, length, "volume-of-app7");
+    file[o] = 'X';
+
+    /* Bucket offsets past the end of the file and into the header, and
+     * a record claiming to be larger than the file */
+    i = other_bucket(file, 0);
+    buckets[i] = 0xfffffff0;
+    i = other_bucket(file, i + 1);
+    buckets[i] = 8;
+    i = other_bucket(file, i + 1);
+    ((uint32_t *) (file + buckets[i]))[0] = UINT32_MAX - 1;
+
+    write_file(path, file, length);
+    pa_xfree(file);
+
+    /* Read-only, nothing gets fixed, but nothing bad is returned */
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "sink-input-by-application-name:app7", NULL));
+    fail_unless(has_string(db, "sink-input-by-application-name:app42", "volume-of-app42"));
+    fail_unless(count_entries(db) == 96);
+    pa_database_close(db);
+
+    /* Replaying the log brings the torn record back and drops the rest */
+    wal = make_wal(changes, PA_ELEMENTSOF(changes), &wal_length);
+    put_wal(wal, wal_length);
+    pa_xfree(wal);
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fail_unless(has_string(db, "sink-input-by-application-name:app7", "restored"));
+    fail_unless(pa_database_size(db) == 97);
+    fail_unless(count_entries(db) == 97);
+
+    /* And the file stays usable */
+    set_string(db, "new", "entry");
+    fail_unless(pa_database_sync(db) == 0);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+    fail_unless(has_string(db, "new", "entry"));
+    fail_unless(has_string(db, "sink-input-by-application-name:app7", "restored"));
+    fail_unless(count_entries(db) == 98);
+    pa_database_close(db);
+}
+END_TEST
+
+START_TEST (database_simple_benchmark_test) {
+    pa_database *db;
+    char v[32];
+    unsigned n = 0;
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+    fill(db, ENTRIES);
+    fail_unless(pa_database_sync(db) == 0);
+    pa_database_close(db);
+
+    PA_RUNTIME_TEST_RUN_START("open", TIMES, TIMES2) {
+        fail_unless((db = pa_database_open_internal(path, false)) != NULL);
+        pa_database_close(db);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless((db = pa_database_open_internal(path, true)) != NULL);
+
+    PA_RUNTIME_TEST_RUN_START("lookup", TIMES, TIMES2) {
+        fail_unless(has_string(db, "sink-input-by-application-name:app42", "volume-of-app42"));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("change one entry and sync", TIMES, TIMES2) {
+        pa_snprintf(v, sizeof(v), "volume-%u", n++ % 10);
+        set_string(db, "sink-input-by-application-name:app42", v);
+        fail_unless(pa_database_sync(db) == 0);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("rewrite all entries and sync", 1, TIMES2) {
+        fail_unless(pa_database_clear(db) == 0);
+        fill(db, ENTRIES);
+        fail_unless(pa_database_sync(db) == 0);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(pa_database_size(db) == ENTRIES);
+    pa_database_close(db);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Database-simple");
+    tc = tcase_create("database-simple");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, database_simple_roundtrip_test);
+    tcase_add_test(tc, database_simple_migrate_test);
+    tcase_add_test(tc, database_simple_wal_replay_test);
+    tcase_add_test(tc, database_simple_torn_wal_test);
+    tcase_add_test(tc, database_simple_recovery_test);
+    tcase_add_test(tc, database_simple_benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
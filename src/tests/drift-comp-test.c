@@ -0,0 +1,218 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pulsecore/drift-comp.h>
+#include <pulsecore/macro.h>
+
+#define RATE 48000
+#define THRESHOLD (5 * PA_USEC_PER_MSEC)
+#define CLOCK_DRIFT 50e-6
+#define STEP PA_DRIFT_COMP_SNAPSHOT_INTERVAL
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = RATE,
+    .channels = 2
+};
+
+/* Timing jitter of up to +-300 usec */
+static double jitter(void) {
+    return (double) (rand() % 601) - 300.0;
+}
+
+/* Only the sink latency is set, so the snapshot says exactly alignment */
+static void make_snapshot(pa_drift_snapshot *s, pa_usec_t now, double alignment) {
+    pa_zero(*s);
+    s->sink_now = s->source_now = now;
+    s->sink_latency = (pa_usec_t) lrint(alignment);
+}
+
+START_TEST (drift_comp_calc_diff_test) {
+    pa_drift_comp *d;
+    pa_drift_snapshot s;
+
+    d = pa_drift_comp_new(&ss, &ss, true, THRESHOLD);
+
+    make_snapshot(&s, 1000000, 2000);
+    ck_assert_int_eq(pa_drift_comp_calc_diff(d, &s), 2000);
+
+    /* A second of played samples waiting for capture puts playback ahead */
+    s.plen = pa_usec_to_bytes(PA_USEC_PER_SEC, &ss);
+    ck_assert_int_eq(pa_drift_comp_calc_diff(d, &s), 2000 - (int64_t) PA_USEC_PER_SEC);
+
+    pa_drift_comp_free(d);
+}
+END_TEST
+
+/* The playback thread gets one of two slots per interval and skips a
+ * snapshot while the capture thread holds both */
+START_TEST (drift_comp_snapshot_slots_test) {
+    pa_drift_comp *d;
+    pa_drift_snapshot *a, *b, *c;
+    pa_usec_t now = STEP;
+
+    d = pa_drift_comp_new(&ss, &ss, true, THRESHOLD);
+
+    fail_unless((a = pa_drift_comp_snapshot_get(d, now)) != NULL);
+    fail_unless(pa_drift_comp_snapshot_get(d, now + STEP / 2) == NULL);
+
+    now += STEP;
+    fail_unless((b = pa_drift_comp_snapshot_get(d, now)) != NULL);
+    fail_unless(a != b);
+
+    now += STEP;
+    fail_unless(pa_drift_comp_snapshot_get(d, now) == NULL);
+
+    /* Still rate limited after a skipped one */
+    pa_drift_comp_snapshot_release(d, a);
+    fail_unless(pa_drift_comp_snapshot_get(d, now + STEP / 2) == NULL);
+
+    now += STEP;
+    fail_unless((c = pa_drift_comp_snapshot_get(d, now)) == a);
+
+    pa_drift_comp_snapshot_release(d, b);
+    pa_drift_comp_snapshot_release(d, c);
+
+    now += STEP;
+    fail_unless(pa_drift_comp_snapshot_get(d, now) == b);
+
+    pa_drift_comp_free(d);
+}
+END_TEST
+
+/* Closed loop: the rate the module applies once a second feeds back into
+ * the alignment. The drift has to be found and cancelled without a single
+ * resync, and the alignment has to end up in the middle of the window. */
+START_TEST (drift_comp_correct_test) {
+    pa_drift_comp *d;
+    pa_drift_snapshot s;
+    double alignment = 1000, ratio = 0, sum = 0;
+    pa_usec_t now;
+    int64_t diff_time;
+    unsigned n = 0;
+
+    srand(1);
+    d = pa_drift_comp_new(&ss, &ss, true, THRESHOLD);
+
+    for (now = PA_USEC_PER_SEC; now < 300 * PA_USEC_PER_SEC; now += STEP) {
+        /* Faster playback clock and faster stream both eat into it */
+        alignment -= (CLOCK_DRIFT + ratio) * STEP;
+
+        make_snapshot(&s, now, alignment + jitter());
+        fail_if(pa_drift_comp_update(d, &s, &diff_time), "resync at %llu usec", (unsigned long long) now);
+
+        if (now % PA_USEC_PER_SEC == 0)
+            ratio = (double) pa_drift_comp_get_rate(d) / RATE - 1;
+
+        if (now > 200 * PA_USEC_PER_SEC) {
+            sum += alignment;
+            n++;
+        }
+    }
+
+    ck_assert_msg(fabs(pa_drift_comp_get_drift(d) - (CLOCK_DRIFT + ratio)) < 5e-6, "drift %g", pa_drift_comp_get_drift(d));
+    ck_assert_msg(fabs(sum / n - THRESHOLD / 2) < 300, "alignment %g", sum / n);
+
+    pa_drift_comp_free(d);
+}
+END_TEST
+
+/* Estimating only: the drift comes out, but the alignment is left alone */
+START_TEST (drift_comp_estimate_test) {
+    pa_drift_comp *d;
+    pa_drift_snapshot s;
+    pa_usec_t now;
+    int64_t diff_time;
+
+    srand(2);
+    d = pa_drift_comp_new(&ss, &ss, false, THRESHOLD);
+
+    ck_assert(pa_drift_comp_get_drift(d) == 0);
+
+    for (now = PA_USEC_PER_SEC; now < 60 * PA_USEC_PER_SEC; now += STEP) {
+        make_snapshot(&s, now, 100000 - CLOCK_DRIFT * now + jitter());
+        fail_if(pa_drift_comp_update(d, &s, &diff_time));
+    }
+
+    ck_assert_msg(fabs(pa_drift_comp_get_drift(d) - CLOCK_DRIFT) < 5e-6, "drift %g", pa_drift_comp_get_drift(d));
+    ck_assert_int_eq(pa_drift_comp_get_rate(d), RATE);
+
+    pa_drift_comp_free(d);
+}
+END_TEST
+
+/* A sudden jump is resynced right away and not mistaken for drift */
+START_TEST (drift_comp_jump_test) {
+    pa_drift_comp *d;
+    pa_drift_snapshot s;
+    pa_usec_t now;
+    int64_t diff_time = 0;
+    size_t sink_skip = 0, source_skip = 0;
+
+    srand(3);
+    d = pa_drift_comp_new(&ss, &ss, true, THRESHOLD);
+
+    for (now = PA_USEC_PER_SEC; now < 20 * PA_USEC_PER_SEC; now += STEP) {
+        make_snapshot(&s, now, 2500 + jitter());
+        fail_if(pa_drift_comp_update(d, &s, &diff_time));
+    }
+
+    make_snapshot(&s, now, 22500);
+    fail_unless(pa_drift_comp_update(d, &s, &diff_time));
+    ck_assert_int_eq(diff_time, 20000);
+
+    pa_drift_comp_get_skip(d, diff_time, &sink_skip, &source_skip);
+    ck_assert_int_eq(sink_skip, 0);
+    ck_assert_int_eq(source_skip, pa_usec_to_bytes(20000, &ss));
+
+    ck_assert_msg(fabs(pa_drift_comp_get_drift(d)) < 5e-6, "drift %g", pa_drift_comp_get_drift(d));
+
+    pa_drift_comp_free(d);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Drift compensation");
+    tc = tcase_create("drift-comp");
+    tcase_add_test(tc, drift_comp_calc_diff_test);
+    tcase_add_test(tc, drift_comp_snapshot_slots_test);
+    tcase_add_test(tc, drift_comp_correct_test);
+    tcase_add_test(tc, drift_comp_estimate_test);
+    tcase_add_test(tc, drift_comp_jump_test);
+    tcase_set_timeout(tc, 30);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,6 +20,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <assert.h>
@@ -30,6 +31,7 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/macro.h>
 
 #ifdef GLIB_MAIN_LOOP
 
@@ -120,6 +122,138 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+
+#define N_TIMERS 256
+
+struct timer {
+    pa_usec_t deadline;
+    bool freed;
+};
+
+static unsigned n_fired, n_expected;
+static pa_usec_t last_deadline;
+
+static pa_mainloop *new_mainloop(int i) {
+    /* Run each test with the default backend and with poll() */
+    if (i)
+        setenv("PULSE_MAINLOOP_NO_EPOLL", "1", 1);
+    else
+        unsetenv("PULSE_MAINLOOP_NO_EPOLL");
+
+    return pa_mainloop_new();
+}
+
+static void order_tcb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct timer *t = userdata;
+
+    fail_if(t->freed);
+    fail_unless(pa_rtclock_now() >= t->deadline);
+    fail_unless(t->deadline >= last_deadline);
+
+    last_deadline = t->deadline;
+
+    if (++n_fired == n_expected)
+        a->quit(a, 0);
+}
+
+START_TEST (timer_order_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_time_event *events[N_TIMERS];
+    struct timer timers[N_TIMERS];
+    struct timeval tv;
+    pa_usec_t base;
+    unsigned i;
+
+    fail_unless((m = new_mainloop(_i)) != NULL);
+    a = pa_mainloop_get_api(m);
+
+    n_fired = n_expected = 0;
+    last_deadline = 0;
+    base = pa_rtclock_now() + 20 * PA_USEC_PER_MSEC;
+
+    /* Distinct deadlines, 100us apart, added in scrambled order */
+    for (i = 0; i < N_TIMERS; i++) {
+        timers[i].deadline = base + ((i * 97) % N_TIMERS) * 100;
+        timers[i].freed = false;
+        events[i] = a->time_new(a, pa_timeval_rtstore(&tv, timers[i].deadline, true), order_tcb, &timers[i]);
+    }
+
+    for (i = 0; i < N_TIMERS; i++) {
+        if (i % 5 == 0) {
+            a->time_free(events[i]);
+            timers[i].freed = true;
+            continue;
+        }
+
+        /* Move some of them to the other end of the range */
+        if (i % 3 == 0) {
+            timers[i].deadline = base + (N_TIMERS * 100) - timers[i].deadline + base;
+            a->time_restart(events[i], pa_timeval_rtstore(&tv, timers[i].deadline, true));
+        }
+
+        n_expected++;
+    }
+
+    fail_unless(pa_mainloop_run(m, NULL) >= 0);
+    ck_assert_int_eq(n_fired, n_expected);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static unsigned n_io_fired;
+
+static void shared_fd_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    fail_unless(f & PA_IO_EVENT_INPUT);
+
+    a->io_enable(e, PA_IO_EVENT_NULL);
+
+    if (++n_io_fired == 2)
+        a->quit(a, 0);
+}
+
+static void writer_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    char c = 'x';
+
+    fail_unless(f & PA_IO_EVENT_OUTPUT);
+    fail_unless(write(fd, &c, 1) == 1);
+
+    a->io_enable(e, PA_IO_EVENT_NULL);
+}
+
+START_TEST (shared_fd_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_io_event *r1, *r2, *w;
+    int fds[2];
+
+    fail_unless((m = new_mainloop(_i)) != NULL);
+    a = pa_mainloop_get_api(m);
+
+    fail_unless(pipe(fds) == 0);
+    n_io_fired = 0;
+
+    /* Two io events watching the same fd must both be dispatched */
+    r1 = a->io_new(a, fds[0], PA_IO_EVENT_INPUT, shared_fd_iocb, NULL);
+    r2 = a->io_new(a, fds[0], PA_IO_EVENT_INPUT, shared_fd_iocb, NULL);
+    w = a->io_new(a, fds[1], PA_IO_EVENT_OUTPUT, writer_iocb, NULL);
+
+    fail_unless(pa_mainloop_run(m, NULL) >= 0);
+    ck_assert_int_eq(n_io_fired, 2);
+
+    a->io_free(r1);
+    a->io_free(r2);
+    a->io_free(w);
+    pa_mainloop_free(m);
+
+    pa_close_pipe(fds);
+}
+END_TEST
+
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -129,6 +263,10 @@ int main(int argc, char *argv[]) {
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_loop_test(tc, timer_order_test, 0, 2);
+    tcase_add_loop_test(tc, shared_fd_test, 0, 2);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
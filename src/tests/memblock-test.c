@@ -20,14 +20,18 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include <check.h>
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/memfd-wrappers.h>
 #include <pulsecore/macro.h>
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
@@ -176,6 +180,131 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+START_TEST (memblock_class_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *small, *large, *huge;
+    unsigned k;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    stat = pa_mempool_get_stat(pool);
+
+    for (k = 1; k < PA_MEMPOOL_N_CLASSES; k++)
+        fail_unless(pa_mempool_class_block_size(pool, k - 1) <= pa_mempool_class_block_size(pool, k));
+
+    /* A small block is served by the smallest class */
+    small = pa_memblock_new_pool(pool, 100);
+    fail_unless(small != NULL);
+    fail_unless(pa_atomic_load(&stat->n_class_allocated[0]) == 1);
+
+    /* The standard size still fits into a pool slot */
+    large = pa_memblock_new_pool(pool, (size_t) -1);
+    fail_unless(large != NULL);
+    fail_unless(pa_memblock_get_length(large) == pa_mempool_block_size_max(pool));
+
+    /* Blocks larger than the standard slot size no longer need to be
+     * allocated outside of the pool */
+    huge = pa_memblock_new_pool(pool, pa_mempool_block_size_max(pool) * 2);
+    fail_unless(huge != NULL);
+    fail_unless(pa_atomic_load(&stat->n_class_allocated[PA_MEMPOOL_N_CLASSES - 1]) == 1);
+
+    pa_memblock_unref(small);
+    pa_memblock_unref(large);
+    pa_memblock_unref(huge);
+
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++)
+        fail_unless(pa_atomic_load(&stat->n_class_allocated[k]) == 0);
+
+    fail_unless(pa_atomic_load(&stat->n_class_high_water[0]) == 1);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* The size classes must not take slots away from the standard class,
+ * which everything that allocates pa_mempool_block_size_max() uses */
+START_TEST (memblock_class_capacity_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[1024];
+    unsigned i, k;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    stat = pa_mempool_get_stat(pool);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        blocks[i] = pa_memblock_new_pool(pool, (size_t) -1);
+        fail_unless(blocks[i] != NULL);
+    }
+
+    /* Nothing spilled over into the larger class */
+    fail_unless(pa_atomic_load(&stat->n_class_allocated[PA_MEMPOOL_N_CLASSES - 1]) == 0);
+    fail_unless(pa_atomic_load(&stat->n_pool_full) == 0);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    for (k = 0; k < PA_MEMPOOL_N_CLASSES; k++)
+        fail_unless(pa_atomic_load(&stat->n_class_allocated[k]) == 0);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+#ifdef HAVE_MEMFD
+START_TEST (memblock_memfd_test) {
+    pa_mempool *pool;
+    pa_memblock *b;
+    const size_t size = 4 * 1024 * 1024, page_size = pa_page_size();
+    uint8_t *region, *d;
+    size_t i;
+    int fd;
+
+    fd = memfd_create("memblock-test", 0);
+    fail_unless(fd >= 0);
+
+    /* Too small for the standard slots */
+    fail_unless(ftruncate(fd, (off_t) page_size) == 0);
+    fail_unless(pa_mempool_new_from_memfd(fd, true) == NULL);
+
+    fail_unless(ftruncate(fd, (off_t) size) == 0);
+    pool = pa_mempool_new_from_memfd(fd, true);
+    fail_unless(pool != NULL);
+    fail_unless(pa_mempool_is_shared(pool));
+    fail_unless(pa_mempool_is_memfd_backed(pool));
+
+    region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    fail_unless(region != MAP_FAILED);
+
+    /* The pool keeps a duplicate */
+    pa_close(fd);
+
+    b = pa_memblock_new_pool(pool, 1000);
+    fail_unless(b != NULL);
+
+    d = pa_memblock_acquire(b);
+    memset(d, 0x5a, 1000);
+    pa_memblock_release(b);
+
+    /* Written through the pool, visible through the region's own mapping */
+    d = memchr(region, 0x5a, size);
+    fail_unless(d != NULL);
+    fail_unless(d + 1000 <= region + size);
+
+    for (i = 0; i < 1000; i++)
+        fail_unless(d[i] == 0x5a);
+
+    pa_memblock_unref(b);
+    munmap(region, size);
+    pa_mempool_unref(pool);
+}
+END_TEST
+#endif
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -188,6 +317,11 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, memblock_class_test);
+    tcase_add_test(tc, memblock_class_capacity_test);
+#ifdef HAVE_MEMFD
+    tcase_add_test(tc, memblock_memfd_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
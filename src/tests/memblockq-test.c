@@ -232,7 +232,7 @@ START_TEST (memblockq_test_initial_properties) {
 }
 END_TEST
 
-START_TEST (memblockq_test) {
+static void run_memblockq_test(bool ring) {
     int ret;
 
     pa_mempool *p;
@@ -250,7 +250,10 @@ START_TEST (memblockq_test) {
 
     silence = memchunk_from_str(p, "__");
 
-    bq = pa_memblockq_new("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence);
+    if (ring)
+        bq = pa_memblockq_new_ring("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence, p);
+    else
+        bq = pa_memblockq_new("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence);
     fail_unless(bq != NULL);
     check_queue_invariants(bq);
 
@@ -332,6 +335,125 @@ START_TEST (memblockq_test) {
 
     pa_mempool_unref(p);
 }
+
+START_TEST (memblockq_test) {
+    run_memblockq_test(false);
+}
+END_TEST
+
+START_TEST (memblockq_test_ring) {
+    run_memblockq_test(true);
+}
+END_TEST
+
+START_TEST (memblockq_test_ring_fixed_size) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence, data, out;
+    unsigned i;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S32BE,
+        .rate = 48000,
+        .channels = 1
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence = memchunk_from_str(p, "____");
+    data = memchunk_from_str(p, "1234567890ab");
+
+    bq = pa_memblockq_new_ring("test memblockq", 0, 4096, 0, &ss, 0, 4, 0, &silence, p);
+    fail_unless(bq != NULL);
+    fail_unless(pa_memblockq_is_ring(bq));
+
+    /* Push and consume in differently sized blocks, so that both the
+     * pushed chunks and the peeked blocks wrap around the ring many
+     * times */
+    for (i = 0; i < 2000; i++) {
+        char *q;
+
+        ck_assert_int_eq(pa_memblockq_push(bq, &data), 0);
+
+        while (pa_memblockq_get_length(bq) >= 8) {
+            ck_assert_int_eq(pa_memblockq_peek_fixed_size(bq, 8, &out), 0);
+            ck_assert_int_eq(out.length, 8);
+
+            /* Data must come out of the ring itself, not a merged copy. The
+             * ring is rounded up to whole pages and mapped twice. */
+            ck_assert_int_eq(pa_memblock_get_length(out.memblock), 2 * PA_PAGE_ALIGN(4096));
+
+            q = pa_memblock_acquire_chunk(&out);
+            fail_unless(memcmp(q, "1234567890ab1234567890ab" + (pa_memblockq_get_read_index(bq) % 12), 8) == 0);
+            pa_memblock_release(out.memblock);
+            pa_memblock_unref(out.memblock);
+
+            pa_memblockq_drop(bq, 8);
+        }
+    }
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(silence.memblock);
+    pa_memblock_unref(data.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+START_TEST (memblockq_test_ring_seek_back) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence, data, out;
+    unsigned i;
+    char *q;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S32BE,
+        .rate = 48000,
+        .channels = 1
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence = memchunk_from_str(p, "____");
+
+    data.memblock = pa_memblock_new(p, 1024);
+    data.index = 0;
+    data.length = 1024;
+    memset(pa_memblock_acquire(data.memblock), '1', 1024);
+    pa_memblock_release(data.memblock);
+
+    bq = pa_memblockq_new_ring("test memblockq", 0, 4096, 0, &ss, 0, 4, 4096, &silence, p);
+    fail_unless(bq != NULL);
+
+    /* Fill the ring to its limit: 4096 bytes of history, 4096 queued */
+    for (i = 0; i < 16; i++) {
+        ck_assert_int_eq(pa_memblockq_push(bq, &data), 0);
+        if (i < 12)
+            pa_memblockq_drop(bq, 1024);
+    }
+
+    /* After a rewind, a write a little further back is still in the
+     * history, but the ring can't keep it without dropping queued data */
+    pa_memblockq_rewind(bq, 4096);
+    pa_memblockq_seek(bq, 4096, PA_SEEK_ABSOLUTE, true);
+    ck_assert_int_eq(pa_memblockq_push(bq, &data), 0);
+    ck_assert_int_eq(pa_memblockq_get_write_index(bq), 5120);
+
+    /* What is queued is untouched */
+    ck_assert_int_eq(pa_memblockq_get_read_index(bq), 8192);
+    ck_assert_int_eq(pa_memblockq_peek(bq, &out), 0);
+    ck_assert_int_eq(out.length, 8192);
+    q = pa_memblock_acquire_chunk(&out);
+    for (i = 0; i < out.length; i++)
+        ck_assert_int_eq(q[i], '1');
+    pa_memblock_release(out.memblock);
+    pa_memblock_unref(out.memblock);
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(silence.memblock);
+    pa_memblock_unref(data.memblock);
+    pa_mempool_unref(p);
+}
 END_TEST
 
 START_TEST (memblockq_test_length_changes) {
@@ -647,6 +769,9 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, memchunk_from_str_test);
     tcase_add_test(tc, memblockq_test_initial_properties);
     tcase_add_test(tc, memblockq_test);
+    tcase_add_test(tc, memblockq_test_ring);
+    tcase_add_test(tc, memblockq_test_ring_fixed_size);
+    tcase_add_test(tc, memblockq_test_ring_seek_back);
     tcase_add_test(tc, memblockq_test_length_changes);
     tcase_add_test(tc, memblockq_test_pop_missing);
     tcase_add_test(tc, memblockq_test_tlength_change);
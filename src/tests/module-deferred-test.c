@@ -0,0 +1,121 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+
+#include <ltdl.h>
+
+#include <pulse/def.h>
+#include <pulse/mainloop.h>
+#include <pulsecore/core.h>
+#include <pulsecore/log.h>
+#include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
+
+/* Any module without side effects outside the core does */
+#define MODULE "module-null-sink"
+
+static pa_mainloop *m;
+static pa_core *core;
+
+static void run_pending_loads(void) {
+    unsigned n;
+
+    for (n = 0; !pa_hashmap_isempty(core->modules_pending_load) && n < 100; n++)
+        fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+
+    fail_unless(pa_hashmap_isempty(core->modules_pending_load));
+}
+
+static void setup(void) {
+    fail_unless(lt_dlinit() == 0);
+    fail_unless(lt_dlsetsearchpath(PA_BUILDDIR "/src/modules") == 0);
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(m), false, false, 0)) != NULL);
+}
+
+static void teardown(void) {
+    pa_module_unload_all(core);
+    pa_core_unref(core);
+    pa_mainloop_free(m);
+
+    lt_dlexit();
+}
+
+START_TEST (module_deferred_disallow_test) {
+    pa_module *module;
+
+    /* What the daemon does with disallow-module-loading: the startup
+     * script defers a module, and loading is disallowed as soon as the
+     * script is done */
+    fail_unless(pa_module_load_deferred(core, MODULE, "sink_name=deferred") == 0);
+    core->disallow_module_loading = true;
+
+    run_pending_loads();
+    ck_assert_int_eq(pa_idxset_size(core->modules), 1);
+    fail_unless(pa_namereg_get(core, "deferred", PA_NAMEREG_SINK) != NULL);
+
+    /* Nothing new gets in afterwards */
+    ck_assert_int_eq(pa_module_load_deferred(core, MODULE, "sink_name=late"), -PA_ERR_ACCESS);
+    ck_assert_int_eq(pa_module_load(&module, core, MODULE, "sink_name=late"), -PA_ERR_ACCESS);
+    fail_unless(module == NULL);
+
+    run_pending_loads();
+    ck_assert_int_eq(pa_idxset_size(core->modules), 1);
+}
+END_TEST
+
+START_TEST (module_deferred_unload_test) {
+    /* A deferred load that never got to run is dropped on shutdown */
+    fail_unless(pa_module_load_deferred(core, MODULE, "sink_name=deferred") == 0);
+    fail_unless(!pa_hashmap_isempty(core->modules_pending_load));
+
+    pa_module_unload_all(core);
+    fail_unless(pa_hashmap_isempty(core->modules_pending_load));
+    ck_assert_int_eq(pa_idxset_size(core->modules), 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Module-deferred");
+    tc = tcase_create("module-deferred");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, module_deferred_disallow_test);
+    tcase_add_test(tc, module_deferred_unload_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
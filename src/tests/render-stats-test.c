@@ -0,0 +1,114 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+
+#include <pulsecore/render-stats.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/macro.h>
+
+#define N_PUBLISH 200000
+
+static pa_render_stats_snapshot snapshot;
+static pa_atomic_t done;
+
+/* Plays the IO thread. Every copy it publishes has all counters equal. */
+static void writer(void *userdata) {
+    pa_render_stats stats;
+    uint64_t n;
+
+    for (n = 1; n <= N_PUBLISH; n++) {
+        stats.cycles = stats.total_nsec = stats.max_nsec = stats.resample_nsec = stats.underruns = n;
+        pa_render_stats_publish(&snapshot, &stats);
+    }
+
+    pa_atomic_store(&done, 1);
+}
+
+START_TEST (render_stats_snapshot_test) {
+    pa_render_stats stats;
+    pa_thread *t;
+    uint64_t last = 0;
+
+    pa_zero(snapshot);
+    pa_atomic_store(&done, 0);
+
+    fail_unless((t = pa_thread_new("writer", writer, NULL)) != NULL);
+
+    /* A reader never sees a half written copy, nor goes back in time */
+    while (!pa_atomic_load(&done)) {
+        pa_render_stats_read(&snapshot, &stats);
+
+        fail_unless(stats.total_nsec == stats.cycles);
+        fail_unless(stats.max_nsec == stats.cycles);
+        fail_unless(stats.resample_nsec == stats.cycles);
+        fail_unless(stats.underruns == stats.cycles);
+        fail_unless(stats.cycles >= last);
+        last = stats.cycles;
+    }
+
+    pa_thread_free(t);
+
+    pa_render_stats_read(&snapshot, &stats);
+    ck_assert_int_eq(stats.cycles, N_PUBLISH);
+}
+END_TEST
+
+START_TEST (render_stats_proplist_test) {
+    pa_render_stats stats = { 1, 2, 3, 4, 5 };
+    pa_proplist *p, *copy;
+
+    p = pa_proplist_new();
+    pa_proplist_sets(p, "media.name", "test");
+
+    /* The counters only end up in the copy */
+    copy = pa_render_stats_proplist_copy(&stats, p);
+    fail_unless(!pa_proplist_contains(p, PA_RENDER_STATS_PROP_CYCLES));
+    ck_assert_str_eq(pa_proplist_gets(copy, "media.name"), "test");
+    ck_assert_str_eq(pa_proplist_gets(copy, PA_RENDER_STATS_PROP_CYCLES), "1");
+    ck_assert_str_eq(pa_proplist_gets(copy, PA_RENDER_STATS_PROP_UNDERRUNS), "5");
+
+    pa_proplist_free(copy);
+    pa_proplist_free(p);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Render-stats");
+    tc = tcase_create("render-stats");
+    tcase_add_test(tc, render_stats_snapshot_test);
+    tcase_add_test(tc, render_stats_proplist_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,9 +21,14 @@
 
 #include <check.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pulse/timeval.h>
 
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/rtpoll.h>
 
 static int before(pa_rtpoll_item *i) {
@@ -82,6 +87,137 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+static pa_rtpoll *new_rtpoll(int i) {
+    /* Run each test with the default backend and with poll() */
+    if (i)
+        setenv("PULSE_RTPOLL_NO_EPOLL", "1", 1);
+    else
+        unsetenv("PULSE_RTPOLL_NO_EPOLL");
+
+    return pa_rtpoll_new();
+}
+
+START_TEST (rtpoll_wakeup_test) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    pa_rtpoll_stats stats;
+    struct pollfd *pollfd;
+    int a[2], b[2];
+    char c = 'x';
+
+    fail_unless(pipe(a) == 0);
+    fail_unless(pipe(b) == 0);
+
+    p = new_rtpoll(_i);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+
+    /* Woken up by the fd, the timer is far away */
+    fail_unless(write(a[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_SEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_if(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == POLLIN);
+
+    /* Woken up by the timer, the revents of the last run are gone */
+    fail_unless(read(a[0], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == 0);
+
+    /* Switching the fd of an existing item takes effect on the next run */
+    fail_unless(write(b[1], &c, 1) == 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = b[0];
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_SEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_if(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == POLLIN);
+
+    /* And so does disabling the timer */
+    pollfd->events = 0;
+    fail_unless(write(a[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_disabled(p);
+    pa_rtpoll_item_free(i);
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_if(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == POLLIN);
+
+    pa_rtpoll_get_stats(p, &stats);
+    ck_assert_int_eq(stats.runs, 4);
+    ck_assert_int_eq(stats.fds, 3);
+    ck_assert_int_eq(stats.timer, 1);
+    ck_assert_int_eq(stats.work, 0);
+    ck_assert_int_eq(stats.before, 0);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close_pipe(a);
+    pa_close_pipe(b);
+}
+END_TEST
+
+START_TEST (rtpoll_stale_fd_test) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    int a[2], b[2];
+    char c = 'x';
+
+    fail_unless(pipe(a) == 0);
+    fail_unless(pipe(b) == 0);
+
+    p = new_rtpoll(_i);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    fail_unless((pollfd->fd = dup(a[0])) >= 0);
+    pollfd->events = POLLIN;
+
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+
+    /* Closed before the item goes away, while the file stays open
+     * through a[0]: epoll can't drop the registration anymore and keeps
+     * reporting it once there is something to read */
+    pa_close(pollfd->fd);
+    pa_rtpoll_item_free(i);
+    fail_unless(write(a[1], &c, 1) == 1);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = b[0];
+    pollfd->events = POLLIN;
+
+    fail_unless(write(b[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_SEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == POLLIN);
+
+    /* And the stale registration doesn't wake us up later either */
+    fail_unless(read(b[0], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == 0);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close_pipe(a);
+    pa_close_pipe(b);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -91,6 +227,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_loop_test(tc, rtpoll_wakeup_test, 0, 2);
+    tcase_add_loop_test(tc, rtpoll_stale_fd_test, 0, 2);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
@@ -0,0 +1,267 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-scache.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/namereg.h>
+
+#define TITLE "Bell"
+
+static pa_mainloop *m;
+static pa_core *core;
+static char *dir;
+static char *path;
+
+static void put_le16(FILE *f, uint16_t v) {
+    uint8_t b[2] = { v & 0xff, v >> 8 };
+
+    fail_unless(fwrite(b, sizeof(b), 1, f) == 1);
+}
+
+static void put_le32(FILE *f, uint32_t v) {
+    uint8_t b[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24 };
+
+    fail_unless(fwrite(b, sizeof(b), 1, f) == 1);
+}
+
+static int16_t sample_value(size_t i) {
+    return (int16_t) (i * 37);
+}
+
+/* A 16 bit stereo WAV file with a title in its INFO list */
+static void write_wav(const char *fn, uint32_t rate, size_t frames) {
+    static const char title[] = TITLE;
+    uint32_t data_size = (uint32_t) (frames * 4);
+    uint32_t list_size = 4 + 8 + sizeof(title) + (sizeof(title) & 1);
+    FILE *f;
+    size_t i;
+
+    fail_unless((f = fopen(fn, "w")) != NULL);
+
+    fputs("RIFF", f);
+    put_le32(f, 4 + 8 + 16 + 8 + list_size + 8 + data_size);
+    fputs("WAVE", f);
+
+    fputs("fmt ", f);
+    put_le32(f, 16);
+    put_le16(f, 1);
+    put_le16(f, 2);
+    put_le32(f, rate);
+    put_le32(f, rate * 4);
+    put_le16(f, 4);
+    put_le16(f, 16);
+
+    fputs("LIST", f);
+    put_le32(f, list_size);
+    fputs("INFO", f);
+    fputs("INAM", f);
+    put_le32(f, sizeof(title));
+    fail_unless(fwrite(title, sizeof(title), 1, f) == 1);
+    if (sizeof(title) & 1)
+        fputc(0, f);
+
+    fputs("data", f);
+    put_le32(f, data_size);
+    for (i = 0; i < frames * 2; i++)
+        put_le16(f, (uint16_t) sample_value(i));
+
+    fclose(f);
+}
+
+static pa_scache_entry *add_lazy(const char *name) {
+    fail_unless(pa_scache_add_file_lazy(core, name, path, NULL) == 0);
+
+    return pa_namereg_get(core, name, PA_NAMEREG_SAMPLE);
+}
+
+/* Runs the main loop until the decoding thread hands over the sample */
+static void wait_for_load(pa_scache_entry *e) {
+    unsigned n;
+
+    for (n = 0; e->load && n < 1000; n++)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    fail_unless(e->load == NULL);
+}
+
+static void check_samples(pa_scache_entry *e, size_t frames) {
+    const int16_t *d;
+    size_t i;
+
+    fail_unless(e->memchunk.memblock != NULL);
+    fail_unless(e->memchunk.length == frames * 4);
+
+    d = (const int16_t *) ((const uint8_t *) pa_memblock_acquire(e->memchunk.memblock) + e->memchunk.index);
+    for (i = 0; i < frames * 2; i++)
+        fail_unless(d[i] == sample_value(i));
+    pa_memblock_release(e->memchunk.memblock);
+}
+
+static void setup(void) {
+    char t[] = "/tmp/scache-load-test-XXXXXX";
+
+    fail_unless(mkdtemp(t) != NULL);
+    dir = pa_xstrdup(t);
+    path = pa_sprintf_malloc("%s/bell.wav", dir);
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(m), false, false, 0)) != NULL);
+}
+
+static void teardown(void) {
+    pa_scache_free_all(core);
+
+    pa_core_unref(core);
+    pa_mainloop_free(m);
+
+    unlink(path);
+    rmdir(dir);
+
+    pa_xfree(path);
+    pa_xfree(dir);
+}
+
+START_TEST (scache_load_prefetch_test) {
+    pa_scache_entry *e;
+
+    write_wav(path, 44100, 44100);
+
+    /* Nothing is read when the sample is added */
+    e = add_lazy("bell");
+    fail_unless(e->memchunk.memblock == NULL);
+    fail_unless(e->load == NULL);
+    fail_unless(!pa_proplist_contains(e->proplist, PA_PROP_MEDIA_TITLE));
+
+    /* The header is read right away, the rest in the background */
+    fail_unless(pa_scache_prefetch_item(core, "bell") == 0);
+    fail_unless(e->load != NULL);
+    fail_unless(e->sample_spec.format == PA_SAMPLE_S16LE);
+    fail_unless(e->sample_spec.rate == 44100);
+    fail_unless(e->sample_spec.channels == 2);
+
+    /* Prefetching again doesn't start a second thread */
+    fail_unless(pa_scache_prefetch_item(core, "bell") == 0);
+
+    wait_for_load(e);
+    check_samples(e, 44100);
+
+    /* The file's properties are kept for the cached playbacks */
+    fail_unless(pa_streq(pa_proplist_gets(e->proplist, PA_PROP_MEDIA_TITLE), TITLE));
+    fail_unless(pa_streq(pa_proplist_gets(e->proplist, PA_PROP_MEDIA_FILENAME), path));
+
+    /* A prefetched sample isn't unloaded when idle */
+    core->scache_idle_time = 0;
+    pa_scache_unload_unused(core);
+    fail_unless(e->memchunk.memblock != NULL);
+
+    /* Nor decoded again */
+    fail_unless(pa_scache_prefetch_item(core, "bell") == 0);
+    fail_unless(e->load == NULL);
+}
+END_TEST
+
+START_TEST (scache_load_cancel_test) {
+    pa_scache_entry *e;
+
+    /* Large enough to take many steps to decode */
+    write_wav(path, 44100, 44100 * 20);
+
+    /* Replacing the sample cancels its decoding */
+    e = add_lazy("bell");
+    fail_unless(pa_scache_prefetch_item(core, "bell") == 0);
+    fail_unless(e->load != NULL);
+
+    fail_unless(add_lazy("bell") == e);
+    fail_unless(e->load == NULL);
+    fail_unless(e->memchunk.memblock == NULL);
+
+    /* Nothing of the cancelled decoding shows up later */
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+    fail_unless(e->memchunk.memblock == NULL);
+
+    /* The replacement decodes from scratch */
+    fail_unless(pa_scache_prefetch_item(core, "bell") == 0);
+    wait_for_load(e);
+    check_samples(e, 44100 * 20);
+
+    /* Removing it cancels too */
+    e = add_lazy("other");
+    fail_unless(pa_scache_prefetch_item(core, "other") == 0);
+    fail_unless(e->load != NULL);
+    fail_unless(pa_scache_remove_item(core, "other") == 0);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+}
+END_TEST
+
+START_TEST (scache_load_fail_test) {
+    pa_scache_entry *e;
+    FILE *f;
+
+    fail_unless((f = fopen(path, "w")) != NULL);
+    fputs("not a sound file", f);
+    fclose(f);
+
+    e = add_lazy("bell");
+    fail_unless(pa_scache_prefetch_item(core, "bell") < 0);
+    fail_unless(e->load == NULL);
+    fail_unless(e->memchunk.memblock == NULL);
+
+    /* A file that went away since it was added */
+    unlink(path);
+    fail_unless(pa_scache_prefetch_item(core, "bell") < 0);
+    fail_unless(e->load == NULL);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Scache-load");
+    tc = tcase_create("scache-load");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, scache_load_prefetch_test);
+    tcase_add_test(tc, scache_load_cancel_test);
+    tcase_add_test(tc, scache_load_fail_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,276 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-scache.h>
+#include <pulsecore/log.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+
+static const pa_sample_spec sample_ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+static pa_mainloop *m;
+static pa_core *core;
+
+static void fake_sink_free(pa_object *o) {
+    pa_sink *s = PA_SINK(o);
+
+    pa_idxset_free(s->inputs, NULL);
+    pa_xfree(s->name);
+    pa_xfree(s);
+}
+
+/* Just enough of a sink for the sample cache to look at */
+static pa_sink *fake_sink_new(const char *name, pa_sample_format_t format, uint32_t rate, uint8_t channels) {
+    pa_sink *s;
+
+    s = pa_msgobject_new(pa_sink);
+    s->parent.parent.free = fake_sink_free;
+    s->core = core;
+    s->name = pa_xstrdup(name);
+    s->state = PA_SINK_IDLE;
+    s->inputs = pa_idxset_new(NULL, NULL);
+    s->sample_spec.format = format;
+    s->sample_spec.rate = rate;
+    s->sample_spec.channels = channels;
+    pa_channel_map_init_extend(&s->channel_map, channels, PA_CHANNEL_MAP_DEFAULT);
+
+    pa_idxset_put(core->sinks, s, &s->index);
+
+    return s;
+}
+
+static void fake_sink_free_all(void) {
+    pa_sink *s;
+
+    while ((s = pa_idxset_steal_first(core->sinks, NULL)))
+        pa_sink_unref(s);
+}
+
+static void set_rate(pa_sink *s, uint32_t rate) {
+    s->sample_spec.rate = rate;
+}
+
+static pa_scache_entry *add_sample(const char *name, const pa_sample_spec *ss, size_t frames) {
+    pa_memchunk chunk;
+    int16_t *p;
+    size_t i;
+
+    chunk.memblock = pa_memblock_new(core->mempool, frames * pa_frame_size(ss));
+    chunk.index = 0;
+    chunk.length = pa_memblock_get_length(chunk.memblock);
+
+    p = pa_memblock_acquire(chunk.memblock);
+    for (i = 0; i < chunk.length / sizeof(int16_t); i++)
+        p[i] = (int16_t) (i * 37);
+    pa_memblock_release(chunk.memblock);
+
+    fail_unless(pa_scache_add_item(core, name, ss, NULL, &chunk, NULL, NULL) == 0);
+    pa_memblock_unref(chunk.memblock);
+
+    return pa_namereg_get(core, name, PA_NAMEREG_SAMPLE);
+}
+
+/* Lets the deferred conversions run to completion */
+static void run_conversions(pa_scache_entry *e) {
+    unsigned n;
+
+    for (n = 0; e->convert_event && n < 100; n++)
+        fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+
+    fail_unless(e->convert_event == NULL);
+}
+
+static bool plays_original(pa_scache_entry *e, pa_sink *s) {
+    const pa_sample_spec *ss;
+    const pa_channel_map *map;
+    const pa_memchunk *chunk;
+
+    fail_unless((chunk = pa_scache_entry_select(e, s, &ss, &map)) != NULL);
+
+    if (chunk != &e->memchunk)
+        return false;
+
+    fail_unless(ss == &e->sample_spec);
+    fail_unless(map == &e->channel_map);
+    return true;
+}
+
+static bool plays_copy(pa_scache_entry *e, pa_sink *s) {
+    const pa_sample_spec *ss;
+    const pa_channel_map *map;
+    const pa_memchunk *chunk;
+    size_t frames;
+
+    fail_unless((chunk = pa_scache_entry_select(e, s, &ss, &map)) != NULL);
+
+    if (chunk == &e->memchunk)
+        return false;
+
+    fail_unless(pa_sample_spec_equal(ss, &s->sample_spec));
+    fail_unless(pa_channel_map_equal(map, &s->channel_map));
+    fail_unless(chunk->length % pa_frame_size(ss) == 0);
+
+    /* As long as the original, give or take what the resampler holds back */
+    frames = e->memchunk.length / pa_frame_size(&e->sample_spec) * ss->rate / e->sample_spec.rate;
+    fail_unless(chunk->length / pa_frame_size(ss) <= frames);
+    fail_unless(chunk->length / pa_frame_size(ss) + 64 >= frames);
+
+    return true;
+}
+
+static void setup(void) {
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(m), false, false, 0)) != NULL);
+
+    core->scache_preconvert = true;
+    /* The conversion itself isn't under test here */
+    core->resample_method = PA_RESAMPLER_TRIVIAL;
+}
+
+static void teardown(void) {
+    pa_scache_free_all(core);
+    fake_sink_free_all();
+
+    pa_core_unref(core);
+    pa_mainloop_free(m);
+}
+
+START_TEST (scache_preconvert_select_test) {
+    pa_sink *same, *other;
+    pa_scache_entry *e;
+
+    same = fake_sink_new("same", PA_SAMPLE_S16LE, 44100, 2);
+    other = fake_sink_new("other", PA_SAMPLE_FLOAT32LE, 48000, 2);
+
+    e = add_sample("beep", &sample_ss, 4410);
+    run_conversions(e);
+
+    /* Nothing to convert for a sink in the sample's own format */
+    fail_unless(plays_original(e, same));
+    fail_unless(plays_copy(e, other));
+    fail_unless(e->convert_event == NULL);
+
+    /* Without the option the copies are neither used nor made */
+    core->scache_preconvert = false;
+    fail_unless(plays_original(e, other));
+    fail_unless(e->convert_event == NULL);
+}
+END_TEST
+
+START_TEST (scache_preconvert_fallback_test) {
+    static const pa_sample_spec long_ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 8000,
+        .channels = 1
+    };
+    pa_sink *other, *huge;
+    pa_scache_entry *e;
+
+    other = fake_sink_new("other", PA_SAMPLE_FLOAT32LE, 48000, 2);
+
+    /* Playing before the copy is there never waits for a conversion */
+    e = add_sample("beep", &sample_ss, 4410);
+    fail_unless(e->convert_event != NULL);
+    fail_unless(plays_original(e, other));
+    run_conversions(e);
+    fail_unless(plays_copy(e, other));
+
+    /* Ten seconds blow up beyond PA_SCACHE_ENTRY_SIZE_MAX on this one */
+    huge = fake_sink_new("huge", PA_SAMPLE_FLOAT32LE, 384000, 32);
+    e = add_sample("long", &long_ss, 80000);
+    run_conversions(e);
+
+    fail_unless(plays_copy(e, other));
+    fail_unless(plays_original(e, huge));
+
+    /* The failure is remembered rather than retried on every playback */
+    fail_unless(e->convert_event == NULL);
+}
+END_TEST
+
+START_TEST (scache_preconvert_invalidate_test) {
+    pa_sink *other;
+    pa_scache_entry *e;
+
+    other = fake_sink_new("other", PA_SAMPLE_FLOAT32LE, 48000, 2);
+
+    e = add_sample("beep", &sample_ss, 4410);
+    run_conversions(e);
+    fail_unless(plays_copy(e, other));
+
+    /* A reconfigured sink plays the original until its copy is made */
+    set_rate(other, 96000);
+    fail_unless(plays_original(e, other));
+    fail_unless(e->convert_event != NULL);
+    run_conversions(e);
+    fail_unless(plays_copy(e, other));
+
+    /* The copy for the old rate went away on the way */
+    set_rate(other, 48000);
+    fail_unless(plays_original(e, other));
+    run_conversions(e);
+    fail_unless(plays_copy(e, other));
+
+    /* Replacing and removing the sample cancel a pending conversion */
+    set_rate(other, 32000);
+    fail_unless(plays_original(e, other));
+    fail_unless(e->convert_event != NULL);
+    e = add_sample("beep", &sample_ss, 4410);
+    fail_unless(e->convert_event != NULL);
+    fail_unless(pa_scache_remove_item(core, "beep") == 0);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Scache-preconvert");
+    tc = tcase_create("scache-preconvert");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, scache_preconvert_select_test);
+    tcase_add_test(tc, scache_preconvert_fallback_test);
+    tcase_add_test(tc, scache_preconvert_invalidate_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,429 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ltdl.h>
+
+#include <pulse/context.h>
+#include <pulse/introspect.h>
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/play-memblockq.h>
+#include <pulsecore/protocol-native.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/socket-server.h>
+
+#define MAX_ITEMS (PA_CORE_TOMBSTONES_MAX + 16)
+
+/* What a pa_context_get_sink_input_info_delta() call reported */
+typedef struct delta {
+    bool done;
+    uint64_t generation;
+    bool full;
+    uint32_t fields;
+
+    unsigned n_items;
+    struct {
+        uint32_t index;
+        bool removed;
+        char *name;
+        uint32_t sink;
+        uint8_t channels;
+        unsigned n_props;
+    } items[MAX_ITEMS];
+} delta;
+
+static pa_mainloop *m;
+static pa_core *core;
+static pa_sink *sink;
+
+static char *dir;
+static char *socket_path;
+static pa_native_protocol *protocol;
+static pa_native_options *options;
+static pa_socket_server *server;
+static pa_context *context;
+
+static void on_connection(pa_socket_server *s, pa_iochannel *io, void *userdata) {
+    pa_native_protocol_connect(protocol, io, options);
+}
+
+static void delta_cb(pa_context *c, const pa_sink_input_info_delta *d, int eol, void *userdata) {
+    delta *r = userdata;
+
+    fail_unless(eol >= 0);
+    fail_unless(d != NULL);
+
+    r->generation = d->generation;
+    r->full = d->full;
+    r->fields = d->fields;
+
+    if (eol) {
+        fail_unless(d->index == PA_INVALID_INDEX);
+        r->done = true;
+        return;
+    }
+
+    fail_unless(r->n_items < MAX_ITEMS);
+    r->items[r->n_items].index = d->index;
+    r->items[r->n_items].removed = d->removed;
+
+    if (d->removed)
+        fail_unless(d->info == NULL);
+    else {
+        fail_unless(d->info != NULL);
+        fail_unless(d->info->index == d->index);
+        r->items[r->n_items].name = pa_xstrdup(d->info->name);
+        r->items[r->n_items].sink = d->info->sink;
+        r->items[r->n_items].channels = d->info->volume.channels;
+        r->items[r->n_items].n_props = pa_proplist_size(d->info->proplist);
+    }
+
+    r->n_items++;
+}
+
+/* Asks the server over the native protocol, as a client would */
+static delta *query(uint64_t generation, uint32_t fields) {
+    pa_operation *o;
+    delta *r;
+
+    r = pa_xnew0(delta, 1);
+
+    fail_unless((o = pa_context_get_sink_input_info_delta(context, generation, fields, delta_cb, r)) != NULL);
+
+    while (!r->done)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    pa_operation_unref(o);
+
+    return r;
+}
+
+static void delta_free(delta *r) {
+    unsigned j;
+
+    for (j = 0; j < r->n_items; j++)
+        pa_xfree(r->items[j].name);
+
+    pa_xfree(r);
+}
+
+/* Index of the entry for the sink input idx, -1 if there is none */
+static int find_item(delta *r, uint32_t idx) {
+    unsigned j;
+
+    for (j = 0; j < r->n_items; j++)
+        if (r->items[j].index == idx)
+            return (int) j;
+
+    return -1;
+}
+
+static bool lists_added(delta *r, pa_sink_input *i) {
+    int j;
+
+    return (j = find_item(r, i->index)) >= 0 && !r->items[j].removed;
+}
+
+static bool lists_removed(delta *r, uint32_t idx) {
+    int j;
+
+    return (j = find_item(r, idx)) >= 0 && r->items[j].removed;
+}
+
+static pa_sink_input *add_input(const char *name) {
+    pa_sink_input *i;
+    pa_proplist *p;
+
+    p = pa_proplist_new();
+    pa_proplist_sets(p, PA_PROP_MEDIA_NAME, name);
+    fail_unless((i = pa_memblockq_sink_input_new(sink, &sink->sample_spec, &sink->channel_map, NULL, NULL, p, 0)) != NULL);
+    pa_proplist_free(p);
+
+    pa_sink_input_put(i);
+
+    return i;
+}
+
+static uint32_t remove_input(pa_sink_input *i) {
+    uint32_t idx = i->index;
+
+    pa_sink_input_kill(i);
+    pa_sink_input_unref(i);
+
+    return idx;
+}
+
+static void context_state_cb(pa_context *c, void *userdata) {
+    fail_unless(pa_context_get_state(c) != PA_CONTEXT_FAILED);
+}
+
+static void setup(void) {
+    char t[] = "/tmp/sink-input-delta-test-XXXXXX";
+    pa_module *module;
+
+    fail_unless(mkdtemp(t) != NULL);
+    dir = pa_xstrdup(t);
+    socket_path = pa_sprintf_malloc("%s/native", dir);
+
+    fail_unless(lt_dlinit() == 0);
+    fail_unless(lt_dlsetsearchpath(PA_BUILDDIR "/src/modules") == 0);
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(m), false, false, 0)) != NULL);
+
+    fail_unless(pa_module_load(&module, core, "module-null-sink", "sink_name=null") == 0);
+    fail_unless((sink = pa_namereg_get(core, "null", PA_NAMEREG_SINK)) != NULL);
+
+    /* What module-native-protocol-unix does */
+    protocol = pa_native_protocol_get(core);
+    options = pa_native_options_new();
+    options->auth_anonymous = true;
+    fail_unless((server = pa_socket_server_new_unix(core->mainloop, socket_path)) != NULL);
+    pa_socket_server_set_callback(server, on_connection, NULL);
+
+    fail_unless((context = pa_context_new(pa_mainloop_get_api(m), "sink-input-delta-test")) != NULL);
+    pa_context_set_state_callback(context, context_state_cb, NULL);
+    fail_unless(pa_context_connect(context, socket_path, PA_CONTEXT_NOAUTOSPAWN, NULL) >= 0);
+
+    while (pa_context_get_state(context) != PA_CONTEXT_READY)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+}
+
+static void teardown(void) {
+    pa_context_set_state_callback(context, NULL, NULL);
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+
+    pa_socket_server_unref(server);
+    pa_native_options_unref(options);
+    pa_native_protocol_unref(protocol);
+
+    pa_module_unload_all(core);
+    pa_core_unref(core);
+    pa_mainloop_free(m);
+
+    lt_dlexit();
+
+    unlink(socket_path);
+    rmdir(dir);
+
+    pa_xfree(socket_path);
+    pa_xfree(dir);
+}
+
+START_TEST (sink_input_delta_changes_test) {
+    pa_sink_input *a, *b;
+    uint32_t b_index;
+    delta *r;
+    uint64_t g;
+
+    /* The first query always gets everything */
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(r->full);
+    ck_assert_int_eq(r->n_items, 0);
+    g = r->generation;
+    delta_free(r);
+
+    a = add_input("a");
+    b = add_input("b");
+
+    /* New sink inputs */
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, 2);
+    fail_unless(lists_added(r, a));
+    fail_unless(lists_added(r, b));
+    fail_unless(r->generation > g);
+    g = r->generation;
+    delta_free(r);
+
+    /* Nothing happened since */
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, 0);
+    fail_unless(r->generation == g);
+    delta_free(r);
+
+    /* A change */
+    pa_sink_input_set_mute(a, true, false);
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_added(r, a));
+    g = r->generation;
+    delta_free(r);
+
+    /* A removal */
+    b_index = remove_input(b);
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_removed(r, b_index));
+    delta_free(r);
+
+    /* A full snapshot lists what is there, not what went away */
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(r->full);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_added(r, a));
+    delta_free(r);
+
+    remove_input(a);
+}
+END_TEST
+
+START_TEST (sink_input_delta_tombstones_test) {
+    pa_sink_input *a;
+    uint32_t idx;
+    delta *r;
+    uint64_t g;
+    unsigned j;
+
+    a = add_input("a");
+
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_ALL);
+    g = r->generation;
+    delta_free(r);
+
+    /* As many removals as are remembered still make a delta */
+    for (j = 0; j < PA_CORE_TOMBSTONES_MAX; j++)
+        remove_input(add_input("short"));
+
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, PA_CORE_TOMBSTONES_MAX);
+    delta_free(r);
+
+    /* One more, and the client might miss one */
+    idx = remove_input(add_input("short"));
+
+    r = query(g, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(r->full);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_added(r, a));
+    g = r->generation;
+    delta_free(r);
+
+    /* Clients that kept up still get deltas */
+    r = query(g - 1, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(!r->full);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_removed(r, idx));
+    delta_free(r);
+
+    /* A generation the server hasn't reached, as after a restart */
+    r = query(g + 1000, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless(r->full);
+    fail_unless(r->generation == g);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(lists_added(r, a));
+    delta_free(r);
+
+    remove_input(a);
+}
+END_TEST
+
+START_TEST (sink_input_delta_fields_test) {
+    pa_module *module;
+    pa_sink_input *a;
+    delta *r;
+    int j;
+
+    /* So that a zeroed sink index doesn't look like the real one */
+    fail_unless(pa_module_load(&module, core, "module-null-sink", "sink_name=second") == 0);
+    fail_unless((sink = pa_namereg_get(core, "second", PA_NAMEREG_SINK)) != NULL);
+    fail_unless(sink->index != 0);
+
+    a = add_input("a");
+
+    /* Only the requested groups are sent, the rest stays zero */
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_NAME);
+    ck_assert_int_eq(r->fields, PA_SINK_INPUT_INFO_FIELD_NAME);
+    fail_unless((j = find_item(r, a->index)) >= 0);
+    fail_unless(pa_safe_streq(r->items[j].name, "a"));
+    ck_assert_int_eq(r->items[j].sink, 0);
+    ck_assert_int_eq(r->items[j].channels, 0);
+    ck_assert_int_eq(r->items[j].n_props, 0);
+    delta_free(r);
+
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_STATE|PA_SINK_INPUT_INFO_FIELD_VOLUME|PA_SINK_INPUT_INFO_FIELD_PROPLIST);
+    ck_assert_int_eq(r->fields, PA_SINK_INPUT_INFO_FIELD_STATE|PA_SINK_INPUT_INFO_FIELD_VOLUME|PA_SINK_INPUT_INFO_FIELD_PROPLIST);
+    fail_unless((j = find_item(r, a->index)) >= 0);
+    fail_unless(r->items[j].name == NULL);
+    ck_assert_int_eq(r->items[j].sink, sink->index);
+    ck_assert_int_eq(r->items[j].channels, sink->sample_spec.channels);
+    fail_unless(r->items[j].n_props > 0);
+    delta_free(r);
+
+    /* No groups at all still tells what changed */
+    r = query(0, 0);
+    ck_assert_int_eq(r->fields, 0);
+    ck_assert_int_eq(r->n_items, 1);
+    fail_unless(find_item(r, a->index) == 0);
+    fail_unless(r->items[0].name == NULL);
+    ck_assert_int_eq(r->items[0].n_props, 0);
+    delta_free(r);
+
+    /* Everything, latency included, parses */
+    r = query(0, PA_SINK_INPUT_INFO_FIELD_ALL);
+    ck_assert_int_eq(r->fields, PA_SINK_INPUT_INFO_FIELD_ALL);
+    fail_unless((j = find_item(r, a->index)) >= 0);
+    fail_unless(pa_safe_streq(r->items[j].name, "a"));
+    ck_assert_int_eq(r->items[j].sink, sink->index);
+    delta_free(r);
+
+    remove_input(a);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Sink-input-delta");
+    tc = tcase_create("sink-input-delta");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, sink_input_delta_changes_test);
+    tcase_add_test(tc, sink_input_delta_tombstones_test);
+    tcase_add_test(tc, sink_input_delta_fields_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
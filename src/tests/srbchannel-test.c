@@ -24,6 +24,9 @@
 #include <unistd.h>
 #include <check.h>
 
+#include <pulsecore/core-util.h>
+#include <pulsecore/socket.h>
+
 #include <pulse/mainloop.h>
 #include <pulsecore/packet.h>
 #include <pulsecore/pstream.h>
@@ -80,6 +83,93 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     pa_packet_unref(packet);
 }
 
+#ifdef HAVE_CREDS
+static unsigned batch_received;
+
+static bool batch_has_fd(unsigned i) {
+    return i == 0 || i == 57 || i == 58 || i == 199;
+}
+
+static size_t batch_packet_length(unsigned i) {
+    return i == 100 ? 100000 : 4 + (i * 37) % 300;
+}
+
+static void batch_packet_received(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    const uint8_t *pdata;
+    size_t plen;
+    uint32_t i;
+
+    pdata = pa_packet_data(packet, &plen);
+    memcpy(&i, pdata, sizeof(i));
+
+    /* Frames arrive in order and received fds stick to the right one */
+    fail_unless(i == batch_received);
+    fail_unless(plen == batch_packet_length(i));
+
+    if (batch_has_fd(i)) {
+        fail_unless(ancil_data && ancil_data->nfd == 1);
+        pa_cmsg_ancil_data_close_fds(ancil_data);
+    } else
+        fail_unless(!ancil_data || ancil_data->nfd == 0);
+
+    batch_received++;
+}
+
+START_TEST (pstream_batch_test) {
+    int sv[2], pipefd[2];
+    unsigned i;
+
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_pstream *p1, *p2;
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fail_unless(pipe(pipefd) == 0);
+
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), sv[0], sv[0]), mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), sv[1], sv[1]), mp);
+    pa_pstream_set_receive_packet_callback(p2, batch_packet_received, NULL);
+
+    /* Queue everything up front so that the writer coalesces it */
+    for (i = 0; i < 200; i++) {
+        pa_packet *packet = pa_packet_new(batch_packet_length(i));
+        uint32_t j = i;
+        uint8_t *pdata;
+        size_t plen;
+
+        pdata = (uint8_t *) pa_packet_data(packet, &plen);
+        memset(pdata, 0xaa, plen);
+        memcpy(pdata, &j, sizeof(j));
+
+        if (batch_has_fd(i)) {
+            pa_cmsg_ancil_data ancil;
+
+            pa_zero(ancil);
+            ancil.nfd = 1;
+            ancil.fds[0] = pipefd[0];
+            ancil.close_fds_on_cleanup = false;
+            pa_pstream_send_packet(p1, packet, &ancil);
+        } else
+            pa_pstream_send_packet(p1, packet, NULL);
+
+        pa_packet_unref(packet);
+    }
+
+    while (batch_received < 200)
+        fail_unless(pa_mainloop_iterate(ml, 1, NULL) >= 0);
+
+    fail_unless(!pa_pstream_is_pending(p1));
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_close(pipefd[0]);
+    pa_close(pipefd[1]);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
+#endif
+
 START_TEST (srbchannel_test) {
 
     int pipefd[4];
@@ -105,7 +195,7 @@ START_TEST (srbchannel_test) {
 
     pa_log_debug("And now the same thing with srbchannel...");
 
-    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp, 0);
     pa_srbchannel_export(sr1, &srt);
     pa_pstream_set_srbchannel(p1, sr1);
     sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
@@ -114,6 +204,21 @@ START_TEST (srbchannel_test) {
     packet_test(250, 5, ml, p1, p2);
     packet_test(10, 1234567, ml, p1, p2);
 
+    pa_log_debug("And with a small, busy polling srbchannel...");
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp, PA_SRBCHANNEL_SIZE_MIN);
+    fail_unless(pa_srbchannel_get_size(sr1) == PA_SRBCHANNEL_SIZE_MIN);
+    pa_srbchannel_set_busy_poll(sr1, 50);
+    pa_srbchannel_export(sr1, &srt);
+    pa_pstream_set_srbchannel(p1, sr1);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+    fail_unless(pa_srbchannel_get_size(sr2) == PA_SRBCHANNEL_SIZE_MIN);
+    pa_srbchannel_set_busy_poll(sr2, 50);
+    pa_pstream_set_srbchannel(p2, sr2);
+
+    packet_test(250, 5, ml, p1, p2);
+    packet_test(10, 1234567, ml, p1, p2);
+
     pa_pstream_unref(p1);
     pa_pstream_unref(p2);
     pa_mempool_unref(mp);
@@ -134,6 +239,9 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+#ifdef HAVE_CREDS
+    tcase_add_test(tc, pstream_batch_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,235 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/stft.h>
+
+#define CHANNELS 2
+#define FFT_SIZE 512
+#define WINDOW_SIZE 256
+#define HOP_SIZE 128
+#define MAX_REWIND 1000
+#define N_FRAMES 6000
+
+static float window[WINDOW_SIZE];
+
+static void hann(void) {
+    size_t i;
+
+    /* Periodic, so that hops of half its length add up to one */
+    for (i = 0; i < WINDOW_SIZE; i++)
+        window[i] = 0.5f * (1.0f - cosf(2.0f * (float) M_PI * i / WINDOW_SIZE));
+}
+
+static float random_sample(void) {
+    return (float) rand() / (float) RAND_MAX - 0.5f;
+}
+
+static void gain_cb(pa_stft *s, unsigned channel, float *spectrum, void *userdata) {
+    float gain = *(float *) userdata * (channel + 1) / FFT_SIZE;
+    size_t i;
+
+    for (i = 0; i < FFT_SIZE + 2; i++)
+        spectrum[i] *= gain;
+}
+
+/* Something with memory across hops */
+static void lowpass_cb(pa_stft *s, unsigned channel, float *spectrum, void *userdata) {
+    size_t i;
+
+    for (i = 0; i < FFT_SIZE + 2; i++)
+        spectrum[i] *= (i < FFT_SIZE / 4 ? 1.0f : 0.1f) / FFT_SIZE;
+}
+
+/* Feeds the input in chunks of odd sizes */
+static void process_chunked(pa_stft *s, const float *in, float *out, size_t from, size_t to) {
+    while (from < to) {
+        size_t n = PA_MIN(to - from, (size_t) (rand() % 300 + 1));
+
+        pa_stft_process(s, in + from * CHANNELS, out + from * CHANNELS, n);
+        from += n;
+    }
+}
+
+START_TEST (stft_passthrough_test) {
+    float gain = 0.5f;
+    float *in, *out;
+    pa_stft *s;
+    size_t i;
+    unsigned c;
+
+    hann();
+    srand(1);
+
+    fail_unless((s = pa_stft_new(CHANNELS, FFT_SIZE, window, WINDOW_SIZE, HOP_SIZE, MAX_REWIND, gain_cb, &gain)) != NULL);
+    ck_assert_int_eq(pa_stft_get_latency(s), WINDOW_SIZE);
+
+    in = pa_xnew(float, N_FRAMES * CHANNELS);
+    out = pa_xnew(float, N_FRAMES * CHANNELS);
+
+    for (i = 0; i < N_FRAMES * CHANNELS; i++)
+        in[i] = random_sample();
+
+    process_chunked(s, in, out, 0, N_FRAMES);
+
+    /* A flat gain comes out as the same gain, one window late */
+    for (i = 0; i < N_FRAMES; i++)
+        for (c = 0; c < CHANNELS; c++) {
+            float expected = i < WINDOW_SIZE ? 0.0f : in[(i - WINDOW_SIZE) * CHANNELS + c] * gain * (c + 1);
+
+            ck_assert_msg(fabsf(out[i * CHANNELS + c] - expected) < 1e-5f, "frame %zu channel %u", i, c);
+        }
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_stft_free(s);
+}
+END_TEST
+
+START_TEST (stft_rewind_test) {
+    float *in, *out, *expected;
+    pa_stft *s, *ref;
+    size_t i, pos;
+
+    hann();
+    srand(2);
+
+    fail_unless((s = pa_stft_new(CHANNELS, FFT_SIZE, window, WINDOW_SIZE, HOP_SIZE, MAX_REWIND, lowpass_cb, NULL)) != NULL);
+    fail_unless((ref = pa_stft_new(CHANNELS, FFT_SIZE, window, WINDOW_SIZE, HOP_SIZE, MAX_REWIND, lowpass_cb, NULL)) != NULL);
+
+    in = pa_xnew(float, N_FRAMES * CHANNELS);
+    out = pa_xnew(float, N_FRAMES * CHANNELS);
+    expected = pa_xnew(float, N_FRAMES * CHANNELS);
+
+    for (i = 0; i < N_FRAMES * CHANNELS; i++)
+        in[i] = random_sample();
+
+    process_chunked(ref, in, expected, 0, N_FRAMES);
+
+    /* Run ahead on other input, take it back and continue with the real
+     * one: the output has to match a run that never went ahead. Covers
+     * rewinds to the start of the stream and across several hops. */
+    for (pos = 0; pos < N_FRAMES; ) {
+        size_t ahead = PA_MIN((size_t) (rand() % MAX_REWIND + 1), N_FRAMES - pos);
+        size_t keep = PA_MIN((size_t) (rand() % 700 + 1), N_FRAMES - pos);
+        float *junk = pa_xnew(float, ahead * CHANNELS);
+
+        for (i = 0; i < ahead * CHANNELS; i++)
+            junk[i] = random_sample();
+
+        process_chunked(s, in, out, pos, pos + keep);
+        pos += keep;
+
+        pa_stft_process(s, junk, junk, ahead);
+        pa_stft_rewind(s, ahead);
+        pa_xfree(junk);
+    }
+
+    for (i = 0; i < N_FRAMES * CHANNELS; i++)
+        ck_assert_msg(fabsf(out[i] - expected[i]) < 1e-5f, "sample %zu", i);
+
+    /* Going back further than the kept history must not break anything */
+    pa_stft_rewind(s, N_FRAMES);
+    pa_stft_process(s, in, out, N_FRAMES);
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_xfree(expected);
+    pa_stft_free(s);
+    pa_stft_free(ref);
+}
+END_TEST
+
+START_TEST (stft_set_max_rewind_test) {
+    float *in, *out, *expected, *junk;
+    pa_stft *s, *ref;
+    size_t i;
+
+    hann();
+    srand(3);
+
+    fail_unless((s = pa_stft_new(CHANNELS, FFT_SIZE, window, WINDOW_SIZE, HOP_SIZE, 16, lowpass_cb, NULL)) != NULL);
+    fail_unless((ref = pa_stft_new(CHANNELS, FFT_SIZE, window, WINDOW_SIZE, HOP_SIZE, 16, lowpass_cb, NULL)) != NULL);
+
+    in = pa_xnew(float, N_FRAMES * CHANNELS);
+    out = pa_xnew(float, N_FRAMES * CHANNELS);
+    expected = pa_xnew(float, N_FRAMES * CHANNELS);
+    junk = pa_xnew(float, MAX_REWIND * CHANNELS);
+
+    for (i = 0; i < N_FRAMES * CHANNELS; i++)
+        in[i] = random_sample();
+    for (i = 0; i < MAX_REWIND * CHANNELS; i++)
+        junk[i] = random_sample();
+
+    process_chunked(ref, in, expected, 0, N_FRAMES);
+
+    /* Growing keeps what was fed before */
+    process_chunked(s, in, out, 0, N_FRAMES / 3);
+    pa_stft_set_max_rewind(s, MAX_REWIND);
+    pa_stft_process(s, junk, junk, MAX_REWIND);
+    pa_stft_rewind(s, MAX_REWIND);
+
+    /* So does shrinking */
+    process_chunked(s, in, out, N_FRAMES / 3, 2 * N_FRAMES / 3);
+    pa_stft_set_max_rewind(s, 16);
+    pa_stft_process(s, junk, junk, 16);
+    pa_stft_rewind(s, 16);
+
+    process_chunked(s, in, out, 2 * N_FRAMES / 3, N_FRAMES);
+
+    for (i = 0; i < N_FRAMES * CHANNELS; i++)
+        ck_assert_msg(fabsf(out[i] - expected[i]) < 1e-5f, "sample %zu", i);
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_xfree(expected);
+    pa_xfree(junk);
+    pa_stft_free(s);
+    pa_stft_free(ref);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("STFT");
+    tc = tcase_create("stft");
+    tcase_add_test(tc, stft_passthrough_test);
+    tcase_add_test(tc, stft_rewind_test);
+    tcase_add_test(tc, stft_set_max_rewind_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}